@@ -0,0 +1,335 @@
+#include <stdlib.h> // calloc, free
+#include <stdio.h> // snprintf
+#include <string.h> // memset, memcpy, strlen, strcmp
+#include <errno.h> // errno, EINTR
+#include <unistd.h> // write
+
+#include "archive.h"
+
+#define TAR_BLOCK 512
+#define TAR_NAME_MAX 100
+#define TAR_PREFIX_MAX 155
+#define TAR_SIZE_MAX 077777777777ULL // eleven octal digits
+#define TAR_END_BLOCKS 2
+#define TAR_REGULAR_FILE '0'
+#define TAR_HARD_LINK '1'
+#define CPIO_ALIGN 4
+#define CPIO_HEADER_BYTES 110
+#define CPIO_TRAILER "TRAILER!!!"
+#define ARCHIVE_FILE_MODE 0644
+#define ARCHIVE_REGULAR_FILE 0100000
+#define ARCHIVE_NAMES_MIN 64
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+// Padding of the previous file, a header and its name padding
+#define ARCHIVE_BUFFER_BYTES (TAR_BLOCK * (TAR_END_BLOCKS + 1) + CPIO_HEADER_BYTES + 4096)
+
+struct Archive {
+    int fd;
+    int format;
+    uint64_t n_Files;
+    size_t n_Padding;       // owed after the current body, written with the next header
+    uint64_t * names;       // hashes of the member names so far, open addressed, 0 for a free slot
+    size_t n_Names;
+    size_t capacity_Names;  // a power of two, at least twice n_Names
+    unsigned char buffer[ARCHIVE_BUFFER_BYTES];
+};
+
+static int writeAll(int a_Fd, const unsigned char * a_pData, size_t a_Length)
+{
+    while (a_Length > 0)
+    {
+        ssize_t n = write(a_Fd, a_pData, a_Length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        a_pData += n;
+        a_Length -= (size_t)n;
+    }
+    return 0;
+}
+
+static size_t paddingFor(uint64_t a_Length, size_t a_Align)
+{
+    return (size_t)((a_Align - a_Length % a_Align) % a_Align);
+}
+
+/**
+ * @brief   Finds where a name too long for the ustar name field goes into the prefix field
+ * @details The prefix holds the directories up to a slash, which is left out, and the name field
+ *          the rest. The first slash that leaves the rest short enough keeps the prefix shortest.
+ * @return  The length of the prefix, 0 if the name fits without one, or -1 if it cannot be split
+ */
+static int splitTarName(const char * a_Name, size_t a_Length)
+{
+    if (a_Length <= TAR_NAME_MAX) return 0;
+    for (size_t i = a_Length - TAR_NAME_MAX - 1; i <= TAR_PREFIX_MAX && i + 1 < a_Length; i++)
+    {
+        if (a_Name[i] == '/' && i > 0) return (int)i;
+    }
+    return -1;
+}
+
+/**
+ * @brief   Fills one ustar header block
+ */
+static int formatTarHeader(unsigned char * a_pBlock, const char * a_Name, uint64_t a_Size, int64_t a_Mtime,
+    char a_Type, const char * a_LinkName)
+{
+    size_t const name_length = strlen(a_Name);
+    size_t const link_length = a_LinkName != NULL ? strlen(a_LinkName) : 0;
+    int const prefix = splitTarName(a_Name, name_length);
+    if (prefix < 0 || link_length > TAR_NAME_MAX || a_Size > TAR_SIZE_MAX) return -1;
+
+    memset(a_pBlock, 0, TAR_BLOCK);
+    size_t const skipped = prefix > 0 ? (size_t)prefix + 1 : 0;
+    memcpy(a_pBlock, a_Name + skipped, name_length - skipped);
+    memcpy(a_pBlock + 345, a_Name, (size_t)prefix);
+    snprintf((char *)a_pBlock + 100, 8, "%07o", ARCHIVE_FILE_MODE);
+    snprintf((char *)a_pBlock + 108, 8, "%07o", 0);
+    snprintf((char *)a_pBlock + 116, 8, "%07o", 0);
+    snprintf((char *)a_pBlock + 124, 12, "%011llo", (unsigned long long)a_Size);
+    unsigned long long const mtime = a_Mtime <= 0 ? 0 : (unsigned long long)a_Mtime & TAR_SIZE_MAX;
+    snprintf((char *)a_pBlock + 136, 12, "%011llo", mtime);
+    a_pBlock[156] = (unsigned char)a_Type;
+    if (link_length > 0) memcpy(a_pBlock + 157, a_LinkName, link_length);
+    memcpy(a_pBlock + 257, "ustar", 6);
+    memcpy(a_pBlock + 263, "00", 2);
+
+    // The checksum is taken with its own field read as spaces
+    memset(a_pBlock + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; i++) checksum += a_pBlock[i];
+    snprintf((char *)a_pBlock + 148, 8, "%06o", checksum);
+    a_pBlock[155] = ' ';
+    return TAR_BLOCK;
+}
+
+/**
+ * @brief   Fills a newc header and the name after it, padded for the body
+ */
+static int formatCpioHeader(unsigned char * a_pHeader, size_t a_Capacity, const char * a_Name, uint64_t a_Ino,
+    unsigned a_Mode, uint64_t a_Size, int64_t a_Mtime)
+{
+    size_t const name_bytes = strlen(a_Name) + 1;
+    size_t const length = CPIO_HEADER_BYTES + name_bytes;
+    size_t const total = length + paddingFor(length, CPIO_ALIGN);
+    if (total > a_Capacity || a_Size > UINT32_MAX) return -1;
+
+    uint32_t const mtime = a_Mtime > 0 && a_Mtime <= UINT32_MAX ? (uint32_t)a_Mtime : 0;
+    snprintf((char *)a_pHeader, a_Capacity, "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+        (unsigned)a_Ino, a_Mode, 0u, 0u, 1u, mtime, (unsigned)a_Size, 0u, 0u, 0u, 0u, (unsigned)name_bytes, 0u);
+    memcpy(a_pHeader + CPIO_HEADER_BYTES, a_Name, name_bytes);
+    memset(a_pHeader + length, 0, total - length);
+    return (int)total;
+}
+
+static uint64_t hashName(const char * a_Name)
+{
+    uint64_t hash = FNV_OFFSET;
+    for (const unsigned char * p = (const unsigned char *)a_Name; *p != '\0'; p++)
+    {
+        hash = (hash ^ *p) * FNV_PRIME;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+/**
+ * @brief   Finds the slot of a name hash, or the free slot it would take
+ */
+static size_t findName(const Archive * a_pArchive, uint64_t a_Hash)
+{
+    size_t const mask = a_pArchive->capacity_Names - 1;
+    size_t slot = (size_t)a_Hash & mask;
+    while (a_pArchive->names[slot] != 0 && a_pArchive->names[slot] != a_Hash) slot = (slot + 1) & mask;
+    return slot;
+}
+
+/**
+ * @brief   Remembers a member name, so archiveNameUsable() turns it down from now on
+ * @return  0, or -1 if out of memory
+ */
+static int recordName(Archive * a_pArchive, const char * a_Name)
+{
+    if ((a_pArchive->n_Names + 1) * 2 > a_pArchive->capacity_Names)
+    {
+        size_t const capacity = a_pArchive->capacity_Names > 0 ? a_pArchive->capacity_Names * 2 : ARCHIVE_NAMES_MIN;
+        uint64_t * const old = a_pArchive->names;
+        size_t const old_capacity = a_pArchive->capacity_Names;
+        a_pArchive->names = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+        if (a_pArchive->names == NULL)
+        {
+            a_pArchive->names = old;
+            return -1;
+        }
+        a_pArchive->capacity_Names = capacity;
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (old[i] != 0) a_pArchive->names[findName(a_pArchive, old[i])] = old[i];
+        }
+        free(old);
+    }
+
+    uint64_t const hash = hashName(a_Name);
+    size_t const slot = findName(a_pArchive, hash);
+    if (a_pArchive->names[slot] == 0) a_pArchive->n_Names++;
+    a_pArchive->names[slot] = hash;
+    return 0;
+}
+
+/**
+ * @brief   Looks up a format by the name --format takes
+ * @param a_Name    "tar" or "cpio"
+ * @return  ARCHIVE_TAR, ARCHIVE_CPIO, or ARCHIVE_NONE if the name is unknown
+ */
+int archiveFormatByName(const char * a_Name)
+{
+    if (strcmp(a_Name, "tar") == 0) return ARCHIVE_TAR;
+    if (strcmp(a_Name, "cpio") == 0) return ARCHIVE_CPIO;
+    return ARCHIVE_NONE;
+}
+
+/**
+ * @brief   Names the usual file extension of a format
+ * @param a_Format  ARCHIVE_TAR or ARCHIVE_CPIO
+ * @return  The extension, without a dot
+ */
+const char * archiveExtension(int a_Format)
+{
+    return a_Format == ARCHIVE_CPIO ? "cpio" : "tar";
+}
+
+/**
+ * @brief   Starts an archive
+ * @param a_Fd      Where the archive goes, written sequentially and left open
+ * @param a_Format  ARCHIVE_TAR or ARCHIVE_CPIO
+ * @return  The archive, or NULL if out of memory
+ */
+Archive * createArchive(int a_Fd, int a_Format)
+{
+    Archive * archive = (Archive *)calloc(1, sizeof(Archive));
+    if (archive == NULL) return NULL;
+    archive->fd = a_Fd;
+    archive->format = a_Format;
+    return archive;
+}
+
+/**
+ * @brief   Gives the descriptor file bodies are written to
+ * @param a_pArchive    The archive
+ * @return  The descriptor passed to createArchive()
+ */
+int archiveFd(const Archive * a_pArchive)
+{
+    return a_pArchive->fd;
+}
+
+/**
+ * @brief   Tells whether a file can go into the archive under a name
+ * @details A tar name longer than the name field is split at a slash into the prefix field,
+ *          and one that cannot be is turned down. So is a name an earlier member has, which
+ *          extracting would overwrite, or one that merely hashes the same.
+ * @param a_pArchive    The archive
+ * @param a_Name        The member name
+ * @return  1 if archiveBeginFile() can take the name, 0 if the caller should pick another
+ */
+int archiveNameUsable(const Archive * a_pArchive, const char * a_Name)
+{
+    size_t const length = strlen(a_Name);
+    if (a_pArchive->format == ARCHIVE_CPIO)
+    {
+        if (CPIO_HEADER_BYTES + length + 1 + CPIO_ALIGN * 2 > ARCHIVE_BUFFER_BYTES) return 0;
+    }
+    else if (splitTarName(a_Name, length) < 0) return 0;
+
+    if (a_pArchive->n_Names == 0) return 1;
+    uint64_t const hash = hashName(a_Name);
+    return a_pArchive->names[findName(a_pArchive, hash)] != hash;
+}
+
+/**
+ * @brief   Writes the header of the next file, after the padding of the one before
+ * @param a_pArchive    The archive
+ * @param a_Name        The member name
+ * @param a_Size        The exact number of body bytes that will follow
+ * @param a_Mtime       The modification time in seconds since the epoch
+ * @return  0, or -1 if the header cannot hold the file or the write failed
+ */
+int archiveBeginFile(Archive * a_pArchive, const char * a_Name, uint64_t a_Size, int64_t a_Mtime)
+{
+    unsigned char * buffer = a_pArchive->buffer;
+    size_t const padding = a_pArchive->n_Padding;
+    memset(buffer, 0, padding);
+
+    int header;
+    if (a_pArchive->format == ARCHIVE_CPIO)
+    {
+        header = formatCpioHeader(buffer + padding, ARCHIVE_BUFFER_BYTES - padding, a_Name,
+            ++a_pArchive->n_Files, ARCHIVE_REGULAR_FILE | ARCHIVE_FILE_MODE, a_Size, a_Mtime);
+        a_pArchive->n_Padding = paddingFor(a_Size, CPIO_ALIGN);
+    }
+    else
+    {
+        header = formatTarHeader(buffer + padding, a_Name, a_Size, a_Mtime, TAR_REGULAR_FILE, NULL);
+        a_pArchive->n_Padding = paddingFor(a_Size, TAR_BLOCK);
+    }
+    if (header < 0 || recordName(a_pArchive, a_Name) < 0) return -1;
+    return writeAll(a_pArchive->fd, buffer, padding + (size_t)header);
+}
+
+/**
+ * @brief   Adds a file as a hard link to one already in the archive, with no body of its own
+ * @param a_pArchive    The archive
+ * @param a_Name        The member name
+ * @param a_Target      The member it has the same contents as
+ * @param a_Mtime       The modification time in seconds since the epoch
+ * @return  0, or -1 if the format has no such links or the write failed, and the caller
+ *          writes the file in full
+ */
+int archiveLinkFile(Archive * a_pArchive, const char * a_Name, const char * a_Target, int64_t a_Mtime)
+{
+    // newc links share an inode and carry the data on the last of them, which a stream cannot know
+    if (a_pArchive->format != ARCHIVE_TAR) return -1;
+
+    unsigned char * buffer = a_pArchive->buffer;
+    size_t const padding = a_pArchive->n_Padding;
+    memset(buffer, 0, padding);
+
+    int const header = formatTarHeader(buffer + padding, a_Name, 0, a_Mtime, TAR_HARD_LINK, a_Target);
+    if (header < 0 || recordName(a_pArchive, a_Name) < 0) return -1;
+    a_pArchive->n_Padding = 0;
+    return writeAll(a_pArchive->fd, buffer, padding + (size_t)header);
+}
+
+/**
+ * @brief   Writes the end of the archive
+ * @param a_pArchive    The archive
+ * @return  0, or -1 if the write failed
+ */
+int finishArchive(Archive * a_pArchive)
+{
+    unsigned char * buffer = a_pArchive->buffer;
+    size_t const padding = a_pArchive->n_Padding;
+    memset(buffer, 0, padding);
+    a_pArchive->n_Padding = 0;
+
+    if (a_pArchive->format == ARCHIVE_CPIO)
+    {
+        int const trailer = formatCpioHeader(buffer + padding, ARCHIVE_BUFFER_BYTES - padding, CPIO_TRAILER, 0, 0, 0, 0);
+        return writeAll(a_pArchive->fd, buffer, padding + (size_t)trailer);
+    }
+
+    memset(buffer + padding, 0, TAR_BLOCK * TAR_END_BLOCKS);
+    return writeAll(a_pArchive->fd, buffer, padding + TAR_BLOCK * TAR_END_BLOCKS);
+}
+
+/**
+ * @brief   Frees an archive without writing anything
+ * @param a_pArchive    The archive, may be NULL
+ */
+void destroyArchive(Archive * a_pArchive)
+{
+    if (a_pArchive == NULL) return;
+    free(a_pArchive->names);
+    free(a_pArchive);
+}
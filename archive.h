@@ -0,0 +1,32 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t, int64_t
+
+#define ARCHIVE_NONE 0
+#define ARCHIVE_TAR 1  // POSIX ustar
+#define ARCHIVE_CPIO 2 // SVR4 "newc" cpio
+
+/**
+ * @brief   Writes regular files as one tar or cpio stream to a descriptor
+ * @details Only headers and padding are written here. The caller writes each file's body to
+ *          archiveFd() right after archiveBeginFile(), however it likes, as long as it writes
+ *          exactly the size it announced. The padding after a body is held back and goes out
+ *          with the next header, so the descriptor sees one write per file besides its body
+ *          and can be a pipe. Every member name is remembered, so archiveNameUsable() can
+ *          tell a caller which names would clash before it commits to one.
+ */
+typedef struct Archive Archive;
+
+int archiveFormatByName(const char * a_Name);
+const char * archiveExtension(int a_Format);
+Archive * createArchive(int a_Fd, int a_Format);
+int archiveFd(const Archive * a_pArchive);
+int archiveNameUsable(const Archive * a_pArchive, const char * a_Name);
+int archiveBeginFile(Archive * a_pArchive, const char * a_Name, uint64_t a_Size, int64_t a_Mtime);
+int archiveLinkFile(Archive * a_pArchive, const char * a_Name, const char * a_Target, int64_t a_Mtime);
+int finishArchive(Archive * a_pArchive);
+void destroyArchive(Archive * a_pArchive);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,129 @@
+#include <stdlib.h> // malloc, free
+#include <string.h> // memset
+#include <pthread.h> // pthread_mutex_t
+
+#include "arena.h"
+#include "report.h"
+
+#define ARENA_ALIGNMENT 16
+
+typedef struct ArenaChunk {
+    struct ArenaChunk * previous;
+    size_t capacity;
+    size_t used;
+    unsigned char * data;
+} ArenaChunk;
+
+struct Arena {
+    ArenaChunk * current;
+    size_t chunk_bytes;
+    pthread_mutex_t lock;
+};
+
+static size_t alignUp(size_t a_Bytes)
+{
+    return (a_Bytes + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+/**
+ * @brief   Allocates a chunk with its data right behind the header
+ * @return  The chunk, or NULL if out of memory
+ */
+static ArenaChunk * createChunk(size_t a_Capacity, ArenaChunk * a_pPrevious)
+{
+    size_t header = alignUp(sizeof(ArenaChunk));
+    ArenaChunk * chunk = (ArenaChunk *)malloc(header + a_Capacity);
+    if (chunk == NULL) return NULL;
+
+    chunk->previous = a_pPrevious;
+    chunk->capacity = a_Capacity;
+    chunk->used = 0;
+    chunk->data = (unsigned char *)chunk + header;
+    return chunk;
+}
+
+/**
+ * @brief   Creates an arena
+ * @param a_ChunkBytes  The size of each chunk, larger allocations get a chunk of their own
+ * @return  The empty arena
+ */
+Arena * createArena(size_t a_ChunkBytes)
+{
+    Arena * arena = (Arena *)malloc(sizeof(Arena));
+    observeAndReport(arena != NULL, "Error allocating memory for arena");
+
+    arena->chunk_bytes = alignUp(a_ChunkBytes);
+    arena->current = createChunk(arena->chunk_bytes, NULL);
+    observeAndReport(arena->current != NULL, "Error allocating memory for arena chunk");
+    pthread_mutex_init(&arena->lock, NULL);
+    return arena;
+}
+
+/**
+ * @brief   Allocates uninitialized memory that lives until the arena is reset
+ * @param a_pArena  The arena
+ * @param a_Bytes   The number of bytes, rounded up to the arena's alignment
+ * @return  The memory, aligned to ARENA_ALIGNMENT
+ */
+void * arenaAlloc(Arena * a_pArena, size_t a_Bytes)
+{
+    size_t const bytes = alignUp(a_Bytes == 0 ? 1 : a_Bytes);
+
+    for (;;)
+    {
+        ArenaChunk * chunk = __atomic_load_n(&a_pArena->current, __ATOMIC_ACQUIRE);
+        size_t offset = __atomic_fetch_add(&chunk->used, bytes, __ATOMIC_RELAXED);
+        if (offset + bytes <= chunk->capacity) return chunk->data + offset;
+
+        // Only the thread that still sees the full chunk as current adds the next one
+        ArenaChunk * added = chunk;
+        pthread_mutex_lock(&a_pArena->lock);
+        if (a_pArena->current == chunk)
+        {
+            size_t capacity = bytes > a_pArena->chunk_bytes ? bytes : a_pArena->chunk_bytes;
+            added = createChunk(capacity, chunk);
+            if (added != NULL) __atomic_store_n(&a_pArena->current, added, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&a_pArena->lock);
+        observeAndReport(added != NULL, "Error allocating memory for arena chunk");
+    }
+}
+
+/**
+ * @brief   Allocates zeroed memory that lives until the arena is reset
+ */
+void * arenaCalloc(Arena * a_pArena, size_t a_Bytes)
+{
+    void * memory = arenaAlloc(a_pArena, a_Bytes);
+    memset(memory, 0, a_Bytes);
+    return memory;
+}
+
+/**
+ * @brief   Releases every allocation at once, keeping the oldest chunk for reuse
+ * @param a_pArena  The arena, no other thread may be allocating from it
+ */
+void resetArena(Arena * a_pArena)
+{
+    ArenaChunk * chunk = a_pArena->current;
+    while (chunk->previous != NULL)
+    {
+        ArenaChunk * previous = chunk->previous;
+        free(chunk);
+        chunk = previous;
+    }
+    chunk->used = 0;
+    a_pArena->current = chunk;
+}
+
+/**
+ * @brief   Frees the arena and every allocation in it
+ */
+void destroyArena(Arena * a_pArena)
+{
+    if (a_pArena == NULL) return;
+    resetArena(a_pArena);
+    free(a_pArena->current);
+    pthread_mutex_destroy(&a_pArena->lock);
+    free(a_pArena);
+}
@@ -0,0 +1,20 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h> // size_t
+
+/**
+ * @brief   A bump allocator whose allocations are all released together
+ * @details Allocation is a single atomic add on the current chunk, so the tasks of a thread pool
+ *          can share one arena. A full chunk is followed by a new one under a lock. Resetting
+ *          keeps the first chunk for the next round of allocations.
+ */
+typedef struct Arena Arena;
+
+Arena * createArena(size_t a_ChunkBytes);
+void * arenaAlloc(Arena * a_pArena, size_t a_Bytes);
+void * arenaCalloc(Arena * a_pArena, size_t a_Bytes);
+void resetArena(Arena * a_pArena);
+void destroyArena(Arena * a_pArena);
+
+#endif // ARENA_H
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE // memmem
+#include <string.h> // memcmp, memmem
+#if defined(__SSE2__)
+#include <emmintrin.h> // _mm_cmpeq_epi8, _mm_movemask_epi8
+#endif
+
+#include "carve.h"
+
+typedef struct Signature {
+    const char * extension;
+    unsigned char header[CARVE_HEADER_MAX];
+    size_t header_length;
+    unsigned char footer[8];
+    size_t footer_length;
+    size_t trailing_bytes;        // fixed bytes that follow the footer
+    size_t comment_length_offset; // where a little-endian 16-bit trailing length sits after the footer, 0 if none
+} Signature;
+
+static const Signature s_Signatures[] = {
+    { "JPG", { 0xFF, 0xD8, 0xFF }, 3, { 0xFF, 0xD9 }, 2, 0, 0 },
+    { "PNG", { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A }, 8, { 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82 }, 8, 0, 0 },
+    { "GIF", { 'G', 'I', 'F', '8', '7', 'a' }, 6, { 0x00, 0x3B }, 2, 0, 0 },
+    { "GIF", { 'G', 'I', 'F', '8', '9', 'a' }, 6, { 0x00, 0x3B }, 2, 0, 0 },
+    { "PDF", { '%', 'P', 'D', 'F', '-' }, 5, { '%', '%', 'E', 'O', 'F' }, 5, 0, 0 },
+    { "ZIP", { 'P', 'K', 0x03, 0x04 }, 4, { 'P', 'K', 0x05, 0x06 }, 4, 18, 20 },
+};
+
+#define N_SIGNATURES ((int)(sizeof(s_Signatures) / sizeof(s_Signatures[0])))
+
+static int matchSignatureScalar(const unsigned char * a_pB_Data, size_t a_Length)
+{
+    for (int i = 0; i < N_SIGNATURES; i++)
+    {
+        const Signature * signature = &s_Signatures[i];
+        if (a_Length < signature->header_length) continue;
+        if (memcmp(a_pB_Data, signature->header, signature->header_length) == 0) return i;
+    }
+    return CARVE_NO_MATCH;
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief   Matches the first byte against every signature in one compare, then verifies the
+ *          few candidates with one more compare each
+ */
+static int matchSignatureSse2(const unsigned char * a_pB_Data)
+{
+    unsigned char firsts[16] = { 0 };
+    for (int i = 0; i < N_SIGNATURES; i++) firsts[i] = s_Signatures[i].header[0];
+
+    __m128i const block = _mm_loadu_si128((const __m128i *)a_pB_Data);
+    __m128i const first = _mm_set1_epi8((char)a_pB_Data[0]);
+    unsigned candidates = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)firsts)));
+    candidates &= (1u << N_SIGNATURES) - 1;
+
+    while (candidates != 0)
+    {
+        int i = __builtin_ctz(candidates);
+        candidates &= candidates - 1;
+
+        const Signature * signature = &s_Signatures[i];
+        __m128i const header = _mm_loadu_si128((const __m128i *)signature->header);
+        unsigned const equal = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, header));
+        unsigned const needed = (1u << signature->header_length) - 1;
+        if ((equal & needed) == needed) return i;
+    }
+    return CARVE_NO_MATCH;
+}
+#endif
+
+/**
+ * @brief   Checks whether a file of a known format starts at a given byte
+ * @param a_pB_Data The first byte of a cluster
+ * @param a_Length  How many bytes may be read from a_pB_Data
+ * @return  The matching signature, or CARVE_NO_MATCH
+ */
+int matchSignature(const unsigned char * a_pB_Data, size_t a_Length)
+{
+#if defined(__SSE2__)
+    if (a_Length >= CARVE_HEADER_MAX) return matchSignatureSse2(a_pB_Data);
+#endif
+    return matchSignatureScalar(a_pB_Data, a_Length);
+}
+
+/**
+ * @brief   Finds where a file that starts with a given signature ends
+ * @param a_Signature   The signature matchSignature() found at a_pB_Data
+ * @param a_pB_Data     The start of the file
+ * @param a_Length      How far the file may extend
+ * @return  The length of the file including its footer, or 0 if no footer was found
+ */
+size_t findSignatureEnd(int a_Signature, const unsigned char * a_pB_Data, size_t a_Length)
+{
+    size_t const end = findSignatureEndIn(a_Signature, a_pB_Data, a_Length, 0, a_Length);
+    return end < a_Length ? end : a_Length;
+}
+
+/**
+ * @brief   Looks for the end of a file in one window of it, for a file read a window at a time
+ * @details Only a footer that starts in the first a_Searched bytes counts, so a window that
+ *          overlaps the next by CARVE_TAIL_MAX never settles on a footer it cannot see whole.
+ * @param a_Signature   The signature matchSignature() found at the start of the file
+ * @param a_pB_Window   The window
+ * @param a_Length      The bytes in the window
+ * @param a_Start       Where the window starts in the file
+ * @param a_Searched    How far into the window a footer may start
+ * @return  The length of the file including its footer, which may reach past the window, or 0
+ *          if no footer starts in it
+ */
+size_t findSignatureEndIn(int a_Signature, const unsigned char * a_pB_Window, size_t a_Length, size_t a_Start, size_t a_Searched)
+{
+    if (a_Signature < 0 || a_Signature >= N_SIGNATURES) return 0;
+    const Signature * signature = &s_Signatures[a_Signature];
+
+    size_t const from = a_Start < signature->header_length ? signature->header_length - a_Start : 0;
+    size_t to = a_Searched + signature->footer_length - 1;
+    if (to > a_Length) to = a_Length;
+    if (to <= from) return 0;
+
+    const unsigned char * footer = (const unsigned char *)memmem(a_pB_Window + from, to - from,
+        signature->footer, signature->footer_length);
+    if (footer == NULL) return 0;
+
+    size_t end = (size_t)(footer - a_pB_Window) + signature->footer_length + signature->trailing_bytes;
+    if (signature->comment_length_offset != 0)
+    {
+        size_t const at = (size_t)(footer - a_pB_Window) + signature->comment_length_offset;
+        if (at + 2 <= a_Length) end += (size_t)a_pB_Window[at] | ((size_t)a_pB_Window[at + 1] << 8);
+    }
+    return a_Start + end;
+}
+
+/**
+ * @brief   Names the file extension of a signature
+ * @param a_Signature   A signature matchSignature() returned
+ * @return  The extension, without a dot
+ */
+const char * signatureExtension(int a_Signature)
+{
+    if (a_Signature < 0 || a_Signature >= N_SIGNATURES) return "";
+    return s_Signatures[a_Signature].extension;
+}
@@ -0,0 +1,22 @@
+#ifndef CARVE_H
+#define CARVE_H
+
+#include <stddef.h> // size_t
+
+#define CARVE_NO_MATCH (-1)
+#define CARVE_HEADER_MAX 16 // bytes a header check may look at
+#define CARVE_TAIL_MAX 32 // bytes from the start of a footer to the last one read after it
+
+/**
+ * @brief   File signatures used to recover files that no directory entry points to anymore
+ * @details Every format here starts at the first byte of a file, and files start on cluster
+ *          boundaries, so headers are only ever checked at the start of a cluster. The check
+ *          compares the first byte against every format at once and only verifies the formats
+ *          that pass.
+ */
+int matchSignature(const unsigned char * a_pB_Data, size_t a_Length);
+size_t findSignatureEnd(int a_Signature, const unsigned char * a_pB_Data, size_t a_Length);
+size_t findSignatureEndIn(int a_Signature, const unsigned char * a_pB_Window, size_t a_Length, size_t a_Start, size_t a_Searched);
+const char * signatureExtension(int a_Signature);
+
+#endif // CARVE_H
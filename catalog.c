@@ -0,0 +1,448 @@
+#include <stdlib.h> // calloc, free
+#include <stdio.h> // snprintf, fopen, fwrite, rename
+#include <string.h> // memcpy, memcmp
+#include <fcntl.h> // open, O_RDONLY
+#include <unistd.h> // close
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+
+#include "catalog.h"
+#include "report.h"
+
+#define CATALOG_MAGIC "NJCAT001"
+#define CATALOG_MAGIC_BYTES 8
+#define CATALOG_ALIGNMENT 8
+#define CATALOG_INITIAL_CAPACITY 64
+#define CATALOG_TEMP_SUFFIX ".tmp"
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+enum {
+    SECTION_PATH_OFFSET,
+    SECTION_PATH_LENGTH,
+    SECTION_ATTRIBUTES,
+    SECTION_STATUS,
+    SECTION_SIZE,
+    SECTION_EXTENT_FIRST,
+    SECTION_EXTENT_COUNT,
+    SECTION_HASH,
+    SECTION_EXTENT_OFFSET,
+    SECTION_EXTENT_LENGTH,
+    SECTION_BUCKETS,
+    SECTION_STRINGS,
+    N_SECTIONS
+};
+
+typedef struct CatalogHeader {
+    char magic[CATALOG_MAGIC_BYTES];
+    uint64_t image_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t n_Entries;
+    uint64_t n_Extents;
+    uint64_t n_Buckets;
+    uint64_t string_bytes;
+    uint64_t sections[N_SECTIONS]; // file offset of every array
+} CatalogHeader;
+
+struct CatalogBuilder {
+    size_t n_Entries;
+    size_t capacity_Entries;
+    uint32_t * path_offset;
+    uint32_t * path_length;
+    uint8_t * attributes;
+    uint8_t * status;
+    uint32_t * size;
+    uint32_t * extent_first;
+    uint32_t * extent_count;
+    uint64_t * hash;
+
+    size_t n_Extents;
+    size_t capacity_Extents;
+    uint64_t * extent_offset;
+    uint64_t * extent_length;
+
+    size_t string_bytes;
+    size_t capacity_Strings;
+    char * strings;
+};
+
+struct Catalog {
+    void * mapping;
+    size_t bytes;
+    const CatalogHeader * header;
+    const uint32_t * path_offset;
+    const uint32_t * path_length;
+    const uint8_t * attributes;
+    const uint8_t * status;
+    const uint32_t * size;
+    const uint32_t * extent_first;
+    const uint32_t * extent_count;
+    const uint64_t * hash;
+    const uint64_t * extent_offset;
+    const uint64_t * extent_length;
+    const uint32_t * buckets; // entry index plus one, zero when empty
+    const char * strings;
+};
+
+static uint64_t hashPath(const char * a_Path, size_t a_Length)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < a_Length; i++)
+    {
+        hash ^= (unsigned char)a_Path[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static size_t alignUp(size_t a_Bytes)
+{
+    return (a_Bytes + CATALOG_ALIGNMENT - 1) & ~(size_t)(CATALOG_ALIGNMENT - 1);
+}
+
+/**
+ * @brief   Starts an empty catalog in memory
+ * @return  The builder
+ */
+CatalogBuilder * createCatalogBuilder(void)
+{
+    CatalogBuilder * builder = (CatalogBuilder *)calloc(1, sizeof(CatalogBuilder));
+    observeAndReport(builder != NULL, "Error allocating memory for catalog");
+    return builder;
+}
+
+/**
+ * @brief   Appends an entry, its extents follow with catalogAddExtent()
+ * @param a_pBuilder    The catalog being built
+ * @param a_Path        The full path of the entry, copied
+ * @param a_PathLength  The length of a_Path
+ * @param a_Attributes  The FAT attribute byte
+ * @param a_Status      CATALOG_NORMAL, CATALOG_DELETED or CATALOG_CARVED
+ * @param a_Size        The size recorded for the entry
+ */
+void catalogAddEntry(CatalogBuilder * a_pBuilder, const char * a_Path, size_t a_PathLength,
+    unsigned a_Attributes, unsigned a_Status, uint32_t a_Size)
+{
+    CatalogBuilder * b = a_pBuilder;
+    if (b->n_Entries == b->capacity_Entries)
+    {
+        b->capacity_Entries = b->capacity_Entries == 0 ? CATALOG_INITIAL_CAPACITY : b->capacity_Entries * 2;
+        b->path_offset = (uint32_t *)growArray(b->path_offset, b->capacity_Entries, sizeof(uint32_t), "Error allocating memory for catalog");
+        b->path_length = (uint32_t *)growArray(b->path_length, b->capacity_Entries, sizeof(uint32_t), "Error allocating memory for catalog");
+        b->attributes = (uint8_t *)growArray(b->attributes, b->capacity_Entries, sizeof(uint8_t), "Error allocating memory for catalog");
+        b->status = (uint8_t *)growArray(b->status, b->capacity_Entries, sizeof(uint8_t), "Error allocating memory for catalog");
+        b->size = (uint32_t *)growArray(b->size, b->capacity_Entries, sizeof(uint32_t), "Error allocating memory for catalog");
+        b->extent_first = (uint32_t *)growArray(b->extent_first, b->capacity_Entries, sizeof(uint32_t), "Error allocating memory for catalog");
+        b->extent_count = (uint32_t *)growArray(b->extent_count, b->capacity_Entries, sizeof(uint32_t), "Error allocating memory for catalog");
+        b->hash = (uint64_t *)growArray(b->hash, b->capacity_Entries, sizeof(uint64_t), "Error allocating memory for catalog");
+    }
+    while (b->string_bytes + a_PathLength > b->capacity_Strings)
+    {
+        b->capacity_Strings = b->capacity_Strings == 0 ? CATALOG_INITIAL_CAPACITY * 16 : b->capacity_Strings * 2;
+        b->strings = (char *)growArray(b->strings, b->capacity_Strings, sizeof(char), "Error allocating memory for catalog");
+    }
+
+    size_t const i = b->n_Entries++;
+    b->path_offset[i] = (uint32_t)b->string_bytes;
+    b->path_length[i] = (uint32_t)a_PathLength;
+    b->attributes[i] = (uint8_t)a_Attributes;
+    b->status[i] = (uint8_t)a_Status;
+    b->size[i] = a_Size;
+    b->extent_first[i] = (uint32_t)b->n_Extents;
+    b->extent_count[i] = 0;
+    b->hash[i] = hashPath(a_Path, a_PathLength);
+
+    memcpy(b->strings + b->string_bytes, a_Path, a_PathLength);
+    b->string_bytes += a_PathLength;
+}
+
+/**
+ * @brief   Appends a byte range of the image to the last entry added
+ * @param a_pBuilder    The catalog being built
+ * @param a_Offset      Where the range starts in the image
+ * @param a_Length      The length of the range
+ */
+void catalogAddExtent(CatalogBuilder * a_pBuilder, uint64_t a_Offset, uint64_t a_Length)
+{
+    CatalogBuilder * b = a_pBuilder;
+    observeAndReport(b->n_Entries > 0, "Error: catalog extent without an entry");
+    if (b->n_Extents == b->capacity_Extents)
+    {
+        b->capacity_Extents = b->capacity_Extents == 0 ? CATALOG_INITIAL_CAPACITY : b->capacity_Extents * 2;
+        b->extent_offset = (uint64_t *)growArray(b->extent_offset, b->capacity_Extents, sizeof(uint64_t), "Error allocating memory for catalog");
+        b->extent_length = (uint64_t *)growArray(b->extent_length, b->capacity_Extents, sizeof(uint64_t), "Error allocating memory for catalog");
+    }
+    b->extent_offset[b->n_Extents] = a_Offset;
+    b->extent_length[b->n_Extents] = a_Length;
+    b->n_Extents++;
+    b->extent_count[b->n_Entries - 1]++;
+}
+
+static int writeSection(FILE * a_pFile, const void * a_pData, size_t a_Bytes)
+{
+    static const unsigned char padding[CATALOG_ALIGNMENT] = { 0 };
+    if (a_Bytes > 0 && fwrite(a_pData, 1, a_Bytes, a_pFile) != a_Bytes) return 0;
+    size_t const pad = alignUp(a_Bytes) - a_Bytes;
+    return pad == 0 || fwrite(padding, 1, pad, a_pFile) == pad;
+}
+
+/**
+ * @brief   Writes the catalog out, replacing any previous one in a single rename
+ * @param a_pBuilder    The finished catalog
+ * @param a_Path        Where to write it
+ * @param a_pStamp      The image the catalog describes
+ * @return  Whether the catalog was written
+ */
+int writeCatalog(const CatalogBuilder * a_pBuilder, const char * a_Path, const CatalogStamp * a_pStamp)
+{
+    const CatalogBuilder * b = a_pBuilder;
+
+    size_t n_Buckets = 1;
+    while (n_Buckets < b->n_Entries * 2) n_Buckets *= 2;
+    uint32_t * buckets = (uint32_t *)calloc(n_Buckets, sizeof(uint32_t));
+    observeAndReport(buckets != NULL, "Error allocating memory for catalog");
+    for (size_t i = 0; i < b->n_Entries; i++)
+    {
+        size_t slot = b->hash[i] & (n_Buckets - 1);
+        while (buckets[slot] != 0) slot = (slot + 1) & (n_Buckets - 1);
+        buckets[slot] = (uint32_t)(i + 1);
+    }
+
+    const void * data[N_SECTIONS] = {
+        b->path_offset, b->path_length, b->attributes, b->status, b->size, b->extent_first,
+        b->extent_count, b->hash, b->extent_offset, b->extent_length, buckets, b->strings
+    };
+    size_t const bytes[N_SECTIONS] = {
+        b->n_Entries * sizeof(uint32_t), b->n_Entries * sizeof(uint32_t), b->n_Entries * sizeof(uint8_t),
+        b->n_Entries * sizeof(uint8_t), b->n_Entries * sizeof(uint32_t), b->n_Entries * sizeof(uint32_t),
+        b->n_Entries * sizeof(uint32_t), b->n_Entries * sizeof(uint64_t), b->n_Extents * sizeof(uint64_t),
+        b->n_Extents * sizeof(uint64_t), n_Buckets * sizeof(uint32_t), b->string_bytes
+    };
+
+    CatalogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CATALOG_MAGIC, CATALOG_MAGIC_BYTES);
+    header.image_size = a_pStamp->image_size;
+    header.mtime_sec = a_pStamp->mtime_sec;
+    header.mtime_nsec = a_pStamp->mtime_nsec;
+    header.n_Entries = b->n_Entries;
+    header.n_Extents = b->n_Extents;
+    header.n_Buckets = n_Buckets;
+    header.string_bytes = b->string_bytes;
+
+    size_t offset = alignUp(sizeof(CatalogHeader));
+    for (int i = 0; i < N_SECTIONS; i++)
+    {
+        header.sections[i] = offset;
+        offset += alignUp(bytes[i]);
+    }
+
+    char temporary[4096];
+    int length = snprintf(temporary, sizeof(temporary), "%s%s", a_Path, CATALOG_TEMP_SUFFIX);
+    int written = length > 0 && (size_t)length < sizeof(temporary);
+
+    FILE * file = written ? fopen(temporary, "wb") : NULL;
+    written = file != NULL && writeSection(file, &header, sizeof(header));
+    for (int i = 0; i < N_SECTIONS && written; i++) written = writeSection(file, data[i], bytes[i]);
+    if (file != NULL && fclose(file) != 0) written = 0;
+
+    if (written) written = rename(temporary, a_Path) == 0;
+    else if (file != NULL) remove(temporary);
+
+    free(buckets);
+    return written;
+}
+
+/**
+ * @brief   Frees a catalog that is no longer being built
+ * @param a_pBuilder    The builder to free
+ */
+void destroyCatalogBuilder(CatalogBuilder * a_pBuilder)
+{
+    if (a_pBuilder == NULL) return;
+    free(a_pBuilder->path_offset);
+    free(a_pBuilder->path_length);
+    free(a_pBuilder->attributes);
+    free(a_pBuilder->status);
+    free(a_pBuilder->size);
+    free(a_pBuilder->extent_first);
+    free(a_pBuilder->extent_count);
+    free(a_pBuilder->hash);
+    free(a_pBuilder->extent_offset);
+    free(a_pBuilder->extent_length);
+    free(a_pBuilder->strings);
+    free(a_pBuilder);
+}
+
+/**
+ * @brief   Maps a catalog written by writeCatalog()
+ * @param a_Path    The catalog file
+ * @param a_pStamp  The image the catalog must describe
+ * @return  The catalog, or NULL when it is missing, damaged or describes another image
+ */
+Catalog * openCatalog(const char * a_Path, const CatalogStamp * a_pStamp)
+{
+    int fd = open(a_Path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CatalogHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t const bytes = (size_t)info.st_size;
+    void * mapping = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    const CatalogHeader * header = (const CatalogHeader *)mapping;
+    int valid = memcmp(header->magic, CATALOG_MAGIC, CATALOG_MAGIC_BYTES) == 0
+        && header->image_size == a_pStamp->image_size
+        && header->mtime_sec == a_pStamp->mtime_sec
+        && header->mtime_nsec == a_pStamp->mtime_nsec
+        && header->n_Buckets > 0 && (header->n_Buckets & (header->n_Buckets - 1)) == 0
+        && header->n_Entries < header->n_Buckets;
+
+    uint64_t const counts[N_SECTIONS] = {
+        header->n_Entries, header->n_Entries, header->n_Entries, header->n_Entries, header->n_Entries,
+        header->n_Entries, header->n_Entries, header->n_Entries, header->n_Extents, header->n_Extents,
+        header->n_Buckets, header->string_bytes
+    };
+    size_t const widths[N_SECTIONS] = {
+        sizeof(uint32_t), sizeof(uint32_t), sizeof(uint8_t), sizeof(uint8_t), sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(uint32_t), sizeof(uint64_t), sizeof(uint64_t), sizeof(uint64_t), sizeof(uint32_t), sizeof(char)
+    };
+    for (int i = 0; i < N_SECTIONS && valid; i++)
+    {
+        uint64_t const start = header->sections[i];
+        valid = start % CATALOG_ALIGNMENT == 0 && start <= bytes
+            && counts[i] <= (bytes - start) / widths[i];
+    }
+    if (!valid)
+    {
+        munmap(mapping, bytes);
+        return NULL;
+    }
+
+    Catalog * catalog = (Catalog *)calloc(1, sizeof(Catalog));
+    observeAndReport(catalog != NULL, "Error allocating memory for catalog");
+
+    const char * base = (const char *)mapping;
+    catalog->mapping = mapping;
+    catalog->bytes = bytes;
+    catalog->header = header;
+    catalog->path_offset = (const uint32_t *)(base + header->sections[SECTION_PATH_OFFSET]);
+    catalog->path_length = (const uint32_t *)(base + header->sections[SECTION_PATH_LENGTH]);
+    catalog->attributes = (const uint8_t *)(base + header->sections[SECTION_ATTRIBUTES]);
+    catalog->status = (const uint8_t *)(base + header->sections[SECTION_STATUS]);
+    catalog->size = (const uint32_t *)(base + header->sections[SECTION_SIZE]);
+    catalog->extent_first = (const uint32_t *)(base + header->sections[SECTION_EXTENT_FIRST]);
+    catalog->extent_count = (const uint32_t *)(base + header->sections[SECTION_EXTENT_COUNT]);
+    catalog->hash = (const uint64_t *)(base + header->sections[SECTION_HASH]);
+    catalog->extent_offset = (const uint64_t *)(base + header->sections[SECTION_EXTENT_OFFSET]);
+    catalog->extent_length = (const uint64_t *)(base + header->sections[SECTION_EXTENT_LENGTH]);
+    catalog->buckets = (const uint32_t *)(base + header->sections[SECTION_BUCKETS]);
+    catalog->strings = base + header->sections[SECTION_STRINGS];
+    return catalog;
+}
+
+/**
+ * @return  The number of entries in the catalog
+ */
+size_t catalogCount(const Catalog * a_pCatalog)
+{
+    return (size_t)a_pCatalog->header->n_Entries;
+}
+
+/**
+ * @brief   Finds an entry by its full path
+ * @param a_pCatalog    The catalog to search
+ * @param a_Path        The path, as listed
+ * @param a_PathLength  The length of a_Path
+ * @return  The entry's index, or CATALOG_NOT_FOUND
+ */
+size_t catalogLookup(const Catalog * a_pCatalog, const char * a_Path, size_t a_PathLength)
+{
+    uint64_t const hash = hashPath(a_Path, a_PathLength);
+    uint64_t const mask = a_pCatalog->header->n_Buckets - 1;
+
+    for (uint64_t slot = hash & mask; a_pCatalog->buckets[slot] != 0; slot = (slot + 1) & mask)
+    {
+        size_t const i = a_pCatalog->buckets[slot] - 1;
+        if (i >= catalogCount(a_pCatalog) || a_pCatalog->hash[i] != hash) continue;
+
+        size_t length = 0;
+        const char * path = catalogPath(a_pCatalog, i, &length);
+        if (length == a_PathLength && memcmp(path, a_Path, a_PathLength) == 0) return i;
+    }
+    return CATALOG_NOT_FOUND;
+}
+
+/**
+ * @brief   Gets the full path of an entry, it is not null terminated
+ * @param a_pCatalog    The catalog
+ * @param a_Index       The entry
+ * @param a_pLength     Receives the length of the path
+ * @return  The first character of the path
+ */
+const char * catalogPath(const Catalog * a_pCatalog, size_t a_Index, size_t * a_pLength)
+{
+    uint64_t const offset = a_pCatalog->path_offset[a_Index];
+    uint64_t const length = a_pCatalog->path_length[a_Index];
+    if (offset > a_pCatalog->header->string_bytes || length > a_pCatalog->header->string_bytes - offset)
+    {
+        *a_pLength = 0;
+        return a_pCatalog->strings;
+    }
+    *a_pLength = (size_t)length;
+    return a_pCatalog->strings + offset;
+}
+
+unsigned catalogAttributes(const Catalog * a_pCatalog, size_t a_Index)
+{
+    return a_pCatalog->attributes[a_Index];
+}
+
+unsigned catalogStatus(const Catalog * a_pCatalog, size_t a_Index)
+{
+    return a_pCatalog->status[a_Index];
+}
+
+uint32_t catalogSize(const Catalog * a_pCatalog, size_t a_Index)
+{
+    return a_pCatalog->size[a_Index];
+}
+
+/**
+ * @brief   Gets the image byte ranges holding an entry's data, in file order
+ * @param a_pCatalog    The catalog
+ * @param a_Index       The entry
+ * @param a_pOffsets    Receives the image offset of every range
+ * @param a_pLengths    Receives the length of every range
+ * @return  The number of ranges
+ */
+size_t catalogExtents(const Catalog * a_pCatalog, size_t a_Index, const uint64_t ** a_pOffsets, const uint64_t ** a_pLengths)
+{
+    uint64_t const first = a_pCatalog->extent_first[a_Index];
+    uint64_t const count = a_pCatalog->extent_count[a_Index];
+    if (first > a_pCatalog->header->n_Extents || count > a_pCatalog->header->n_Extents - first) return 0;
+
+    *a_pOffsets = a_pCatalog->extent_offset + first;
+    *a_pLengths = a_pCatalog->extent_length + first;
+    return (size_t)count;
+}
+
+/**
+ * @brief   Unmaps a catalog
+ * @param a_pCatalog    The catalog to close
+ */
+void closeCatalog(Catalog * a_pCatalog)
+{
+    if (a_pCatalog == NULL) return;
+    munmap(a_pCatalog->mapping, a_pCatalog->bytes);
+    free(a_pCatalog);
+}
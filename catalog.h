@@ -0,0 +1,47 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t, int64_t
+
+#define CATALOG_NORMAL 0
+#define CATALOG_DELETED 1
+#define CATALOG_CARVED 2
+
+#define CATALOG_NOT_FOUND ((size_t)-1)
+
+/**
+ * @brief   A parsed volume saved to disk so that later runs can skip parsing it
+ * @details The file is laid out to be used straight from a read-only mapping: a header, one
+ *          array per entry field, the extents of every entry as image byte ranges, an open
+ *          addressing table hashing full paths to entries, and the pool the paths point into.
+ *          A catalog remembers the size and modification time of the image it describes and
+ *          is not opened for any other.
+ */
+typedef struct Catalog Catalog;
+typedef struct CatalogBuilder CatalogBuilder;
+
+typedef struct CatalogStamp {
+    uint64_t image_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} CatalogStamp;
+
+CatalogBuilder * createCatalogBuilder(void);
+void catalogAddEntry(CatalogBuilder * a_pBuilder, const char * a_Path, size_t a_PathLength,
+    unsigned a_Attributes, unsigned a_Status, uint32_t a_Size);
+void catalogAddExtent(CatalogBuilder * a_pBuilder, uint64_t a_Offset, uint64_t a_Length);
+int writeCatalog(const CatalogBuilder * a_pBuilder, const char * a_Path, const CatalogStamp * a_pStamp);
+void destroyCatalogBuilder(CatalogBuilder * a_pBuilder);
+
+Catalog * openCatalog(const char * a_Path, const CatalogStamp * a_pStamp);
+size_t catalogCount(const Catalog * a_pCatalog);
+size_t catalogLookup(const Catalog * a_pCatalog, const char * a_Path, size_t a_PathLength);
+const char * catalogPath(const Catalog * a_pCatalog, size_t a_Index, size_t * a_pLength);
+unsigned catalogAttributes(const Catalog * a_pCatalog, size_t a_Index);
+unsigned catalogStatus(const Catalog * a_pCatalog, size_t a_Index);
+uint32_t catalogSize(const Catalog * a_pCatalog, size_t a_Index);
+size_t catalogExtents(const Catalog * a_pCatalog, size_t a_Index, const uint64_t ** a_pOffsets, const uint64_t ** a_pLengths);
+void closeCatalog(Catalog * a_pCatalog);
+
+#endif // CATALOG_H
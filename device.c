@@ -0,0 +1,530 @@
+#define _GNU_SOURCE // O_DIRECT
+#include <stdlib.h> // calloc, realloc, free, posix_memalign, strtoull, getenv
+#include <string.h> // memcpy, memmove, memset
+#include <errno.h> // errno, EINTR, EINVAL, EIO
+#include <fcntl.h> // open, O_RDONLY, O_DIRECT
+#include <unistd.h> // pread, close
+#include <pthread.h> // pthread_create, pthread_join, pthread_mutex_t, pthread_cond_t
+#include <sys/ioctl.h> // ioctl
+#include <sys/stat.h> // fstat, S_ISBLK
+#include <linux/fs.h> // BLKGETSIZE64, BLKSSZGET
+
+#include "device.h"
+
+#define DEVICE_CHUNK_BYTES (1024 * 1024) // what each read asks for at once
+#define DEVICE_POOL_CHUNKS 16 // chunk buffers in the pool, all the memory a reader holds
+#define DEVICE_QUEUE_DEPTH 4 // readers with a chunk of the head in flight
+#define DEVICE_RETRIES 3 // further attempts at a sector that failed
+#define DEVICE_DEFAULT_SECTOR 512
+#define DEVICE_INITIAL_CAPACITY 16
+#define DEVICE_NO_CHUNK UINT64_MAX
+
+typedef struct DeviceChunk {
+    uint64_t offset;            // DEVICE_NO_CHUNK while it holds nothing
+    unsigned char * data;
+    uint64_t last_use;
+    int users;                  // copies out of it in progress, and its own read
+    int loading;
+} DeviceChunk;
+
+struct DeviceReader {
+    int fd;
+    uint64_t bytes;
+    uint64_t span;              // bytes rounded up to a whole sector
+    size_t sector_bytes;
+    DeviceReport * report;
+    pthread_mutex_t lock;       // the chunks and the report
+    pthread_cond_t changed;     // a chunk finished loading or lost its last user
+    int failed;                 // out of memory for the report
+    uint64_t clock;
+    unsigned char * pool;
+    DeviceChunk chunks[DEVICE_POOL_CHUNKS];
+};
+
+typedef struct HeadRead {
+    DeviceReader * reader;
+    unsigned char * buffer;
+    uint64_t span;
+    uint64_t next_chunk;
+} HeadRead;
+
+#ifdef DEVICE_FAULT_INJECTION
+#define FAULT_MAX_RANGES 64
+
+static BadRange s_Faults[FAULT_MAX_RANGES]; // in sectors, whatever size the reader's are
+static size_t s_n_Faults;
+static pthread_once_t s_FaultsOnce = PTHREAD_ONCE_INIT;
+
+static void parseFaults(void)
+{
+    const char * spec = getenv("NOTJUSTCATS_BAD_SECTORS");
+    while (spec != NULL && *spec != '\0' && s_n_Faults < FAULT_MAX_RANGES)
+    {
+        char * end;
+        uint64_t first = strtoull(spec, &end, 10);
+        if (end == spec) break;
+        uint64_t last = first;
+        if (*end == '-') last = strtoull(end + 1, &end, 10);
+        if (last >= first)
+        {
+            s_Faults[s_n_Faults].offset = first;
+            s_Faults[s_n_Faults].length = last - first + 1;
+            s_n_Faults++;
+        }
+        spec = *end == ',' ? end + 1 : end;
+        if (*end != ',') break;
+    }
+}
+
+static ssize_t devicePread(int a_Fd, unsigned char * a_pBuffer, size_t a_Length, uint64_t a_Offset, size_t a_SectorBytes)
+{
+    pthread_once(&s_FaultsOnce, parseFaults);
+    for (size_t i = 0; i < s_n_Faults; i++)
+    {
+        uint64_t const offset = s_Faults[i].offset * a_SectorBytes;
+        uint64_t const length = s_Faults[i].length * a_SectorBytes;
+        if (offset < a_Offset + a_Length && a_Offset < offset + length)
+        {
+            errno = EIO;
+            return -1;
+        }
+    }
+    return pread(a_Fd, a_pBuffer, a_Length, (off_t)a_Offset);
+}
+#else
+static ssize_t devicePread(int a_Fd, unsigned char * a_pBuffer, size_t a_Length, uint64_t a_Offset, size_t a_SectorBytes)
+{
+    (void)a_SectorBytes;
+    return pread(a_Fd, a_pBuffer, a_Length, (off_t)a_Offset);
+}
+#endif
+
+/**
+ * @brief   Finds the first bad range that ends past an offset
+ * @param a_pReport     The report, its lock held
+ * @param a_Offset      The offset
+ * @return  Its index, or n_Bad if there is none
+ */
+static size_t findBadRange(const DeviceReport * a_pReport, uint64_t a_Offset)
+{
+    size_t low = 0;
+    size_t high = a_pReport->n_Bad;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        const BadRange * range = &a_pReport->bad[middle];
+        if (range->offset + range->length <= a_Offset) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+/**
+ * @brief   Records a range that could not be read, keeping the report sorted and merged
+ * @details The report is read while chunks are still being loaded, so a range goes in its
+ *          place straight away rather than being sorted in at the end.
+ * @param a_pReader     The reader
+ * @param a_Offset      Where the range starts
+ * @param a_Length      Its length
+ */
+static void addBadRange(DeviceReader * a_pReader, uint64_t a_Offset, uint64_t a_Length)
+{
+    if (a_Offset >= a_pReader->bytes) return;
+    if (a_Length > a_pReader->bytes - a_Offset) a_Length = a_pReader->bytes - a_Offset;
+
+    DeviceReport * report = a_pReader->report;
+    pthread_mutex_lock(&a_pReader->lock);
+    size_t at = findBadRange(report, a_Offset);
+    BadRange * range = at < report->n_Bad ? &report->bad[at] : NULL;
+    if (at > 0 && report->bad[at - 1].offset + report->bad[at - 1].length == a_Offset) range = &report->bad[--at];
+    else if (range == NULL || range->offset > a_Offset + a_Length)
+    {
+        if (report->n_Bad == report->capacity)
+        {
+            size_t capacity = report->capacity > 0 ? report->capacity * 2 : DEVICE_INITIAL_CAPACITY;
+            BadRange * grown = (BadRange *)realloc(report->bad, sizeof(BadRange) * capacity);
+            if (grown == NULL)
+            {
+                a_pReader->failed = 1;
+                pthread_mutex_unlock(&a_pReader->lock);
+                return;
+            }
+            report->bad = grown;
+            report->capacity = capacity;
+        }
+        memmove(&report->bad[at + 1], &report->bad[at], sizeof(BadRange) * (report->n_Bad - at));
+        report->n_Bad++;
+        range = &report->bad[at];
+        range->offset = a_Offset;
+        range->length = 0;
+    }
+
+    // The range now touches at, which grows over it and over any later range it reaches
+    uint64_t end = a_Offset + a_Length;
+    if (range->offset < a_Offset) a_Offset = range->offset;
+    uint64_t covered = 0;
+    size_t last = at;
+    for (;;)
+    {
+        BadRange const * merged = &report->bad[last];
+        if (merged->offset + merged->length > end) end = merged->offset + merged->length;
+        covered += merged->length;
+        if (last + 1 == report->n_Bad || report->bad[last + 1].offset > end) break;
+        last++;
+    }
+    report->bad[at].offset = a_Offset;
+    report->bad[at].length = end - a_Offset;
+    report->bad_bytes += report->bad[at].length - covered;
+    memmove(&report->bad[at + 1], &report->bad[last + 1], sizeof(BadRange) * (report->n_Bad - last - 1));
+    report->n_Bad -= last - at;
+    pthread_mutex_unlock(&a_pReader->lock);
+}
+
+/**
+ * @brief   Reads one range, or as much of it as is readable, straight into a buffer
+ * @details Short reads carry on from where they stopped, and the end of the device zero-fills
+ *          the rest. After an error the remaining window is halved, each half read on its own,
+ *          until a single sector is left, which is retried and then given up on.
+ * @param a_pReader The reader
+ * @param a_pBuffer Where the range goes, aligned for O_DIRECT
+ * @param a_Offset  Where the range starts, a whole number of sectors in
+ * @param a_Length  Its length, a whole number of sectors
+ */
+static void readRange(DeviceReader * a_pReader, unsigned char * a_pBuffer, uint64_t a_Offset, uint64_t a_Length)
+{
+    while (a_Length > 0)
+    {
+        ssize_t n = devicePread(a_pReader->fd, a_pBuffer, (size_t)a_Length, a_Offset, a_pReader->sector_bytes);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        if (n == 0)
+        {
+            memset(a_pBuffer, 0, (size_t)a_Length);
+            return;
+        }
+        a_pBuffer += n;
+        a_Offset += (uint64_t)n;
+        a_Length -= (uint64_t)n;
+    }
+    if (a_Length == 0) return;
+
+    size_t const sector = a_pReader->sector_bytes;
+    if (a_Length > sector)
+    {
+        uint64_t half = (a_Length / 2 + sector - 1) / sector * sector;
+        readRange(a_pReader, a_pBuffer, a_Offset, half);
+        readRange(a_pReader, a_pBuffer + half, a_Offset + half, a_Length - half);
+        return;
+    }
+
+    for (int attempt = 0; attempt < DEVICE_RETRIES; attempt++)
+    {
+        __atomic_add_fetch(&a_pReader->report->n_Retries, 1, __ATOMIC_RELAXED);
+        ssize_t n = devicePread(a_pReader->fd, a_pBuffer, (size_t)a_Length, a_Offset, a_pReader->sector_bytes);
+        if (n == (ssize_t)a_Length) return;
+        if (n >= 0)
+        {
+            // A partial sector only happens at the end of a file, which zero-fills
+            readRange(a_pReader, a_pBuffer, a_Offset, a_Length);
+            return;
+        }
+    }
+
+    memset(a_pBuffer, 0, (size_t)a_Length);
+    addBadRange(a_pReader, a_Offset, a_Length);
+}
+
+/**
+ * @brief   Fills a buffer from the device, zero-filling the ranges already known to be bad
+ * @details Only the stretches between known bad ranges go to the device, so a chunk read a
+ *          second time does not wait out the retries on the same sectors again.
+ * @param a_pReader The reader
+ * @param a_pBuffer Where the bytes go, aligned for O_DIRECT
+ * @param a_Offset  Where to start, a whole number of sectors in
+ * @param a_Length  How many bytes, a whole number of sectors
+ */
+static void fillRange(DeviceReader * a_pReader, unsigned char * a_pBuffer, uint64_t a_Offset, uint64_t a_Length)
+{
+    uint64_t const end = a_Offset + a_Length;
+    while (a_Offset < end)
+    {
+        BadRange bad = { end, 0 };
+        pthread_mutex_lock(&a_pReader->lock);
+        size_t const at = findBadRange(a_pReader->report, a_Offset);
+        if (at < a_pReader->report->n_Bad) bad = a_pReader->report->bad[at];
+        pthread_mutex_unlock(&a_pReader->lock);
+
+        uint64_t stop = bad.offset > a_Offset ? bad.offset : bad.offset + bad.length;
+        if (stop > end) stop = end;
+        if (bad.offset > a_Offset) readRange(a_pReader, a_pBuffer, a_Offset, stop - a_Offset);
+        else memset(a_pBuffer, 0, (size_t)(stop - a_Offset));
+        a_pBuffer += stop - a_Offset;
+        a_Offset = stop;
+    }
+}
+
+static void * readerMain(void * a_pArgument)
+{
+    HeadRead * head = (HeadRead *)a_pArgument;
+    for (;;)
+    {
+        uint64_t offset = __atomic_fetch_add(&head->next_chunk, DEVICE_CHUNK_BYTES, __ATOMIC_RELAXED);
+        if (offset >= head->span) break;
+        uint64_t length = head->span - offset < DEVICE_CHUNK_BYTES ? head->span - offset : DEVICE_CHUNK_BYTES;
+        fillRange(head->reader, head->buffer + offset, offset, length);
+    }
+    return NULL;
+}
+
+/**
+ * @brief   Finds the chunk that starts at an offset in the pool, reading it in if it is not there
+ * @details The chunk used longest ago that nobody is copying out of makes room. When every
+ *          chunk is busy, or another thread is already reading this one, it waits.
+ * @param a_pReader The reader
+ * @param a_Offset  Where the chunk starts, a whole number of chunks in
+ * @return  The chunk, with a use held until releaseChunk()
+ */
+static DeviceChunk * acquireChunk(DeviceReader * a_pReader, uint64_t a_Offset)
+{
+    pthread_mutex_lock(&a_pReader->lock);
+    for (;;)
+    {
+        DeviceChunk * found = NULL;
+        DeviceChunk * victim = NULL;
+        for (int i = 0; i < DEVICE_POOL_CHUNKS && found == NULL; i++)
+        {
+            DeviceChunk * chunk = &a_pReader->chunks[i];
+            if (chunk->offset == a_Offset) found = chunk;
+            else if (chunk->users == 0 && (victim == NULL || chunk->last_use < victim->last_use)) victim = chunk;
+        }
+
+        if (found != NULL && !found->loading)
+        {
+            found->users++;
+            found->last_use = ++a_pReader->clock;
+            pthread_mutex_unlock(&a_pReader->lock);
+            return found;
+        }
+        if (found == NULL && victim != NULL)
+        {
+            victim->offset = a_Offset;
+            victim->users = 1;
+            victim->loading = 1;
+            victim->last_use = ++a_pReader->clock;
+            pthread_mutex_unlock(&a_pReader->lock);
+
+            uint64_t const remaining = a_pReader->span - a_Offset;
+            fillRange(a_pReader, victim->data, a_Offset, remaining < DEVICE_CHUNK_BYTES ? remaining : DEVICE_CHUNK_BYTES);
+
+            pthread_mutex_lock(&a_pReader->lock);
+            victim->loading = 0;
+            pthread_cond_broadcast(&a_pReader->changed);
+            pthread_mutex_unlock(&a_pReader->lock);
+            return victim;
+        }
+        pthread_cond_wait(&a_pReader->changed, &a_pReader->lock);
+    }
+}
+
+static void releaseChunk(DeviceReader * a_pReader, DeviceChunk * a_pChunk)
+{
+    pthread_mutex_lock(&a_pReader->lock);
+    if (--a_pChunk->users == 0) pthread_cond_broadcast(&a_pReader->changed);
+    pthread_mutex_unlock(&a_pReader->lock);
+}
+
+/**
+ * @brief   Opens a device or image for reading, with O_DIRECT if it can be had
+ * @param a_Path        The device or image
+ * @param a_pDirect     Set to whether O_DIRECT was accepted
+ * @return  The descriptor, or -1 with errno set
+ */
+int openDevice(const char * a_Path, int * a_pDirect)
+{
+    int fd = open(a_Path, O_RDONLY | O_DIRECT);
+    *a_pDirect = fd >= 0;
+    if (fd < 0 && errno == EINVAL) fd = open(a_Path, O_RDONLY);
+    return fd;
+}
+
+/**
+ * @brief   Finds the size of a device or image and the unit reads have to be aligned to
+ * @details A block device reports its logical sector size, a file its file system's block,
+ *          neither larger than DEVICE_ALIGNMENT, so a buffer of that alignment suits both.
+ * @param a_Fd              The open device or image
+ * @param a_pBytes          Set to its size
+ * @param a_pSectorBytes    Set to its sector size
+ * @return  0, or -1 if the size cannot be found
+ */
+int deviceGeometry(int a_Fd, uint64_t * a_pBytes, size_t * a_pSectorBytes)
+{
+    struct stat st;
+    if (fstat(a_Fd, &st) != 0) return -1;
+
+    size_t sector = DEVICE_DEFAULT_SECTOR;
+    if (S_ISBLK(st.st_mode))
+    {
+        uint64_t bytes;
+        int logical;
+        if (ioctl(a_Fd, BLKGETSIZE64, &bytes) != 0) return -1;
+        if (ioctl(a_Fd, BLKSSZGET, &logical) == 0 && logical > 0) sector = (size_t)logical;
+        *a_pBytes = bytes;
+    }
+    else
+    {
+        if (st.st_blksize > 0) sector = (size_t)st.st_blksize;
+        *a_pBytes = (uint64_t)st.st_size;
+    }
+
+    if (sector > DEVICE_ALIGNMENT || (sector & (sector - 1)) != 0) sector = DEVICE_ALIGNMENT;
+    *a_pSectorBytes = sector;
+    return 0;
+}
+
+/**
+ * @brief   Starts reading a device through a pool of chunk buffers
+ * @param a_Fd              The open device or image, left open for the reader's lifetime
+ * @param a_Bytes           The size of the device
+ * @param a_SectorBytes     From deviceGeometry()
+ * @param a_pReport         Cleared, then filled with the bad ranges and retries as they are met
+ * @return  The reader, or NULL if out of memory
+ */
+DeviceReader * createDeviceReader(int a_Fd, uint64_t a_Bytes, size_t a_SectorBytes, DeviceReport * a_pReport)
+{
+    DeviceReader * reader = (DeviceReader *)calloc(1, sizeof(DeviceReader));
+    if (reader == NULL) return NULL;
+    void * pool = NULL;
+    if (posix_memalign(&pool, DEVICE_ALIGNMENT, (size_t)DEVICE_POOL_CHUNKS * DEVICE_CHUNK_BYTES) != 0)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    clearDeviceReport(a_pReport);
+    reader->fd = a_Fd;
+    reader->bytes = a_Bytes;
+    reader->span = (a_Bytes + a_SectorBytes - 1) / a_SectorBytes * a_SectorBytes;
+    reader->sector_bytes = a_SectorBytes;
+    reader->report = a_pReport;
+    reader->pool = (unsigned char *)pool;
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    for (int i = 0; i < DEVICE_POOL_CHUNKS; i++)
+    {
+        reader->chunks[i].offset = DEVICE_NO_CHUNK;
+        reader->chunks[i].data = reader->pool + (size_t)i * DEVICE_CHUNK_BYTES;
+    }
+    return reader;
+}
+
+/**
+ * @brief   Reads the start of a device straight into a buffer, a few chunks at a time
+ * @param a_pReader     The reader
+ * @param a_pBuffer     DEVICE_ALIGNMENT aligned, with room for a_Length rounded up to DEVICE_ALIGNMENT
+ * @param a_Length      How much of the device to read, no more than its size
+ * @return  0, or -1 if the report could not grow
+ */
+int readDeviceHead(DeviceReader * a_pReader, unsigned char * a_pBuffer, uint64_t a_Length)
+{
+    HeadRead head;
+    head.reader = a_pReader;
+    head.buffer = a_pBuffer;
+    head.span = (a_Length + a_pReader->sector_bytes - 1) / a_pReader->sector_bytes * a_pReader->sector_bytes;
+    head.next_chunk = 0;
+
+    pthread_t readers[DEVICE_QUEUE_DEPTH];
+    int n_Readers = 0;
+    while (n_Readers < DEVICE_QUEUE_DEPTH && (uint64_t)n_Readers * DEVICE_CHUNK_BYTES < head.span)
+    {
+        if (pthread_create(&readers[n_Readers], NULL, readerMain, &head) != 0) break;
+        n_Readers++;
+    }
+    if (n_Readers == 0) readerMain(&head);
+    for (int i = 0; i < n_Readers; i++) pthread_join(readers[i], NULL);
+    return __atomic_load_n(&a_pReader->failed, __ATOMIC_RELAXED) ? -1 : 0;
+}
+
+/**
+ * @brief   Copies a range of the device out of the pool, reading in the chunks it is missing
+ * @details Safe to call from any number of threads at once. Bytes past the end of the device
+ *          read as zeroes.
+ * @param a_pReader     The reader
+ * @param a_pBuffer     Receives the bytes, needs no alignment
+ * @param a_Offset      Where the range starts
+ * @param a_Length      Its length
+ * @return  0, or -1 if the report could not grow
+ */
+int readDevice(DeviceReader * a_pReader, unsigned char * a_pBuffer, uint64_t a_Offset, size_t a_Length)
+{
+    while (a_Length > 0)
+    {
+        uint64_t const start = a_Offset / DEVICE_CHUNK_BYTES * DEVICE_CHUNK_BYTES;
+        size_t const within = (size_t)(a_Offset - start);
+        size_t const length = a_Length < DEVICE_CHUNK_BYTES - within ? a_Length : DEVICE_CHUNK_BYTES - within;
+
+        size_t copied = 0;
+        uint64_t const filled = start < a_pReader->span ? a_pReader->span - start : 0;
+        if (within < filled) copied = filled - within < length ? (size_t)(filled - within) : length;
+        if (copied > 0)
+        {
+            DeviceChunk * chunk = acquireChunk(a_pReader, start);
+            memcpy(a_pBuffer, chunk->data + within, copied);
+            releaseChunk(a_pReader, chunk);
+        }
+        memset(a_pBuffer + copied, 0, length - copied);
+
+        a_pBuffer += length;
+        a_Offset += length;
+        a_Length -= length;
+    }
+    return __atomic_load_n(&a_pReader->failed, __ATOMIC_RELAXED) ? -1 : 0;
+}
+
+/**
+ * @brief   Counts the bytes of a range that were zero-filled
+ * @details Only what has been read so far is known, so a range is counted once it has been read.
+ * @param a_pReader     The reader
+ * @param a_Offset      Where the range starts on the device
+ * @param a_Length      Its length
+ * @return  How many of its bytes lie in a bad range
+ */
+uint64_t deviceBadBytes(DeviceReader * a_pReader, uint64_t a_Offset, uint64_t a_Length)
+{
+    DeviceReport const * report = a_pReader->report;
+    uint64_t const end = a_Offset + a_Length;
+    uint64_t total = 0;
+
+    pthread_mutex_lock(&a_pReader->lock);
+    for (size_t i = findBadRange(report, a_Offset); i < report->n_Bad && report->bad[i].offset < end; i++)
+    {
+        uint64_t first = report->bad[i].offset > a_Offset ? report->bad[i].offset : a_Offset;
+        uint64_t last = report->bad[i].offset + report->bad[i].length;
+        if (last > end) last = end;
+        total += last - first;
+    }
+    pthread_mutex_unlock(&a_pReader->lock);
+    return total;
+}
+
+/**
+ * @brief   Frees a reader and its pool, its descriptor and report stay with the caller
+ * @param a_pReader     The reader, may be NULL
+ */
+void destroyDeviceReader(DeviceReader * a_pReader)
+{
+    if (a_pReader == NULL) return;
+    pthread_cond_destroy(&a_pReader->changed);
+    pthread_mutex_destroy(&a_pReader->lock);
+    free(a_pReader->pool);
+    free(a_pReader);
+}
+
+/**
+ * @brief   Frees a report's ranges and empties it, for reuse
+ * @param a_pReport     The report
+ */
+void clearDeviceReport(DeviceReport * a_pReport)
+{
+    free(a_pReport->bad);
+    memset(a_pReport, 0, sizeof(DeviceReport));
+}
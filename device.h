@@ -0,0 +1,55 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+#define DEVICE_ALIGNMENT 4096   // what O_DIRECT buffers, offsets and lengths are aligned to
+
+/**
+ * @brief   A run of bytes the device would not give back, zero-filled wherever it is read
+ */
+typedef struct BadRange {
+    uint64_t offset;
+    uint64_t length;
+} BadRange;
+
+/**
+ * @brief   What reading a device has found so far, the bad ranges sorted by offset and merged
+ */
+typedef struct DeviceReport {
+    BadRange * bad;
+    size_t n_Bad;
+    size_t capacity;
+    uint64_t bad_bytes;
+    uint64_t n_Retries;     // single-sector reads repeated after an error
+    int direct;             // whether the device was read with O_DIRECT
+} DeviceReport;
+
+typedef struct DeviceReader DeviceReader;
+
+/**
+ * @brief   Reads a block device, or an image file, while tolerating sectors that fail
+ * @details The device is opened with O_DIRECT where the file system allows it. Its head, the
+ *          metadata a parser needs first, is read into the caller's DEVICE_ALIGNMENT aligned
+ *          buffer by a few threads at once, each with a large read in flight. Everything else
+ *          is read on demand a chunk at a time into a fixed pool of aligned chunk buffers and
+ *          copied out of there, so the memory held does not grow with the device. A read that
+ *          fails is split in half, and the halves retried, until the failing sectors are found
+ *          one at a time. Those are retried a few times more, then zero-filled and recorded in
+ *          the report, and a chunk read again after it left the pool skips them.
+ *          Built with DEVICE_FAULT_INJECTION, the sectors listed in NOTJUSTCATS_BAD_SECTORS
+ *          ("first[-last],...") fail as an unreadable medium would. They are counted in the
+ *          reader's sectors, which deviceGeometry() gives, so one listed sector is exactly one
+ *          zero-filled sector in the report.
+ */
+int openDevice(const char * a_Path, int * a_pDirect);
+int deviceGeometry(int a_Fd, uint64_t * a_pBytes, size_t * a_pSectorBytes);
+DeviceReader * createDeviceReader(int a_Fd, uint64_t a_Bytes, size_t a_SectorBytes, DeviceReport * a_pReport);
+int readDeviceHead(DeviceReader * a_pReader, unsigned char * a_pBuffer, uint64_t a_Length);
+int readDevice(DeviceReader * a_pReader, unsigned char * a_pBuffer, uint64_t a_Offset, size_t a_Length);
+uint64_t deviceBadBytes(DeviceReader * a_pReader, uint64_t a_Offset, uint64_t a_Length);
+void destroyDeviceReader(DeviceReader * a_pReader);
+void clearDeviceReport(DeviceReport * a_pReport);
+
+#endif // DEVICE_H
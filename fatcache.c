@@ -0,0 +1,154 @@
+#include <stdlib.h> // malloc, calloc, realloc, free
+#include <string.h> // memcpy, memcmp
+#include <pthread.h> // pthread_mutex_t
+
+#include "fatcache.h"
+
+#define FAT_CACHE_INITIAL_CAPACITY 16
+
+typedef struct FatCacheEntry {
+    FatCacheKey key;
+    uint32_t * table;       // followed by the run lengths, in one allocation
+    size_t n_Entries;
+    FatReport report;
+    uint64_t last_used;
+} FatCacheEntry;
+
+struct FatCache {
+    FatCacheEntry * entries;
+    size_t n_Entries;
+    size_t capacity;
+    size_t bytes;
+    size_t max_bytes;
+    uint64_t clock;
+    pthread_mutex_t lock;
+};
+
+static FatCacheEntry * findEntry(FatCache * a_pCache, const FatCacheKey * a_pKey)
+{
+    for (size_t i = 0; i < a_pCache->n_Entries; i++)
+    {
+        if (memcmp(&a_pCache->entries[i].key, a_pKey, sizeof(FatCacheKey)) == 0) return &a_pCache->entries[i];
+    }
+    return NULL;
+}
+
+static void evictEntry(FatCache * a_pCache, size_t a_Index)
+{
+    a_pCache->bytes -= a_pCache->entries[a_Index].n_Entries * 2 * sizeof(uint32_t);
+    free(a_pCache->entries[a_Index].table);
+    a_pCache->entries[a_Index] = a_pCache->entries[--a_pCache->n_Entries];
+}
+
+/**
+ * @brief   Creates an empty cache
+ * @param a_MaxBytes    The most table bytes to hold at once
+ * @return  The cache, or NULL if out of memory
+ */
+FatCache * createFatCache(size_t a_MaxBytes)
+{
+    FatCache * cache = (FatCache *)calloc(1, sizeof(FatCache));
+    if (cache == NULL) return NULL;
+    cache->max_bytes = a_MaxBytes;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+/**
+ * @brief   Copies out the FAT of an image and its run lengths if the cache holds them
+ * @param a_pCache      The cache
+ * @param a_pKey        The image
+ * @param a_pTable      Receives the table
+ * @param a_pRuns       Receives the run lengths
+ * @param a_n_Entries   The length of a_pTable and a_pRuns, a table of another length does not match
+ * @param a_pReport     Receives what mending the FAT found
+ * @return  1 on a hit, else 0
+ */
+int fatCacheGet(FatCache * a_pCache, const FatCacheKey * a_pKey, uint32_t * a_pTable, uint32_t * a_pRuns, size_t a_n_Entries, FatReport * a_pReport)
+{
+    pthread_mutex_lock(&a_pCache->lock);
+    FatCacheEntry * entry = findEntry(a_pCache, a_pKey);
+    int const hit = entry != NULL && entry->n_Entries == a_n_Entries;
+    if (hit)
+    {
+        memcpy(a_pTable, entry->table, a_n_Entries * sizeof(uint32_t));
+        memcpy(a_pRuns, entry->table + a_n_Entries, a_n_Entries * sizeof(uint32_t));
+        *a_pReport = entry->report;
+        entry->last_used = ++a_pCache->clock;
+    }
+    pthread_mutex_unlock(&a_pCache->lock);
+    return hit;
+}
+
+/**
+ * @brief   Keeps a copy of an image's FAT and run lengths, replacing any older one for the same image
+ * @details Tables larger than the whole cache are not kept, and nothing is kept when out of
+ *          memory, so a put can always be ignored.
+ * @param a_pCache      The cache
+ * @param a_pKey        The image
+ * @param a_pTable      Its decoded and mended FAT
+ * @param a_pRuns       The run lengths worked out from a_pTable
+ * @param a_n_Entries   The length of a_pTable and a_pRuns
+ * @param a_pReport     What mending it found
+ */
+void fatCachePut(FatCache * a_pCache, const FatCacheKey * a_pKey, const uint32_t * a_pTable, const uint32_t * a_pRuns, size_t a_n_Entries, const FatReport * a_pReport)
+{
+    size_t const half = a_n_Entries * sizeof(uint32_t);
+    size_t const bytes = half * 2;
+    if (bytes > a_pCache->max_bytes) return;
+
+    uint32_t * table = (uint32_t *)malloc(bytes);
+    if (table == NULL) return;
+    memcpy(table, a_pTable, half);
+    memcpy(table + a_n_Entries, a_pRuns, half);
+
+    pthread_mutex_lock(&a_pCache->lock);
+    FatCacheEntry * existing = findEntry(a_pCache, a_pKey);
+    if (existing != NULL) evictEntry(a_pCache, (size_t)(existing - a_pCache->entries));
+
+    while (a_pCache->bytes + bytes > a_pCache->max_bytes && a_pCache->n_Entries > 0)
+    {
+        size_t oldest = 0;
+        for (size_t i = 1; i < a_pCache->n_Entries; i++)
+        {
+            if (a_pCache->entries[i].last_used < a_pCache->entries[oldest].last_used) oldest = i;
+        }
+        evictEntry(a_pCache, oldest);
+    }
+
+    if (a_pCache->n_Entries == a_pCache->capacity)
+    {
+        size_t capacity = a_pCache->capacity > 0 ? a_pCache->capacity * 2 : FAT_CACHE_INITIAL_CAPACITY;
+        FatCacheEntry * grown = (FatCacheEntry *)realloc(a_pCache->entries, sizeof(FatCacheEntry) * capacity);
+        if (grown == NULL)
+        {
+            pthread_mutex_unlock(&a_pCache->lock);
+            free(table);
+            return;
+        }
+        a_pCache->entries = grown;
+        a_pCache->capacity = capacity;
+    }
+
+    FatCacheEntry * entry = &a_pCache->entries[a_pCache->n_Entries++];
+    entry->key = *a_pKey;
+    entry->table = table;
+    entry->n_Entries = a_n_Entries;
+    entry->report = *a_pReport;
+    entry->last_used = ++a_pCache->clock;
+    a_pCache->bytes += bytes;
+    pthread_mutex_unlock(&a_pCache->lock);
+}
+
+/**
+ * @brief   Frees a cache and every table in it
+ * @param a_pCache  The cache, may be NULL
+ */
+void destroyFatCache(FatCache * a_pCache)
+{
+    if (a_pCache == NULL) return;
+    for (size_t i = 0; i < a_pCache->n_Entries; i++) free(a_pCache->entries[i].table);
+    free(a_pCache->entries);
+    pthread_mutex_destroy(&a_pCache->lock);
+    free(a_pCache);
+}
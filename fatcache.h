@@ -0,0 +1,38 @@
+#ifndef FATCACHE_H
+#define FATCACHE_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t, int64_t
+
+#include "fatcheck.h"
+
+/**
+ * @brief   Which image a decoded FAT came from, equal only for the same unchanged file
+ */
+typedef struct FatCacheKey {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+} FatCacheKey;
+
+/**
+ * @brief   Decoded and mended FATs and their extents kept between images, shared by threads
+ * @details A FAT is stored as the next-cluster table decodeFat() and mendFat() leave behind,
+ *          with the report of what mending it found, and copied back out on a hit. Next to it
+ *          goes the length of the run of consecutive clusters its chain takes from each
+ *          cluster on, which is what turns a chain into extents a run at a time. The cache
+ *          holds at most a fixed number of bytes of tables and drops the least recently used
+ *          one to make room.
+ */
+typedef struct FatCache FatCache;
+
+FatCache * createFatCache(size_t a_MaxBytes);
+int fatCacheGet(FatCache * a_pCache, const FatCacheKey * a_pKey, uint32_t * a_pTable, uint32_t * a_pRuns, size_t a_n_Entries, FatReport * a_pReport);
+void fatCachePut(FatCache * a_pCache, const FatCacheKey * a_pKey, const uint32_t * a_pTable, const uint32_t * a_pRuns, size_t a_n_Entries, const FatReport * a_pReport);
+void destroyFatCache(FatCache * a_pCache);
+
+#endif // FATCACHE_H
@@ -0,0 +1,296 @@
+#include <stdlib.h> // calloc, free
+#include <string.h> // memset
+#if defined(__SSE2__)
+#include <emmintrin.h> // _mm_cmpeq_epi8, _mm_movemask_epi8
+#endif
+
+#include "fatcheck.h"
+
+#define FIRST_CLUSTER 2
+#define WORD_BITS 64
+#define RESERVED_BELOW_MASK 15 // 0xFF0, 0xFFF0 and 0x0FFFFFF0 start the reserved values
+#define BAD_BELOW_MASK 8       // 0xFF7, 0xFFF7 and 0x0FFFFFF7 mark a bad cluster
+#define END_BELOW_MASK 7       // 0xFF8 and up end a chain
+
+static uint32_t entryMask(unsigned a_Bits)
+{
+    return a_Bits >= 32 ? 0x0FFFFFFF : (1u << a_Bits) - 1;
+}
+
+static int isLink(uint32_t a_Value, size_t a_n_Entries)
+{
+    return a_Value >= FIRST_CLUSTER && a_Value < a_n_Entries;
+}
+
+static int testAndSet(uint64_t * a_pWords, size_t a_Bit)
+{
+    uint64_t const mask = (uint64_t)1 << (a_Bit % WORD_BITS);
+    int const was = (a_pWords[a_Bit / WORD_BITS] & mask) != 0;
+    a_pWords[a_Bit / WORD_BITS] |= mask;
+    return was;
+}
+
+static int testBit(const uint64_t * a_pWords, size_t a_Bit)
+{
+    return (a_pWords[a_Bit / WORD_BITS] >> (a_Bit % WORD_BITS)) & 1;
+}
+
+static void clearBit(uint64_t * a_pWords, size_t a_Bit)
+{
+    a_pWords[a_Bit / WORD_BITS] &= ~((uint64_t)1 << (a_Bit % WORD_BITS));
+}
+
+static void report(FatIssueFunction a_Function, void * a_pContext, int a_Kind, uint32_t a_First, uint32_t a_Last, uint32_t a_Value)
+{
+    if (a_Function != NULL) a_Function(a_pContext, a_Kind, a_First, a_Last, a_Value);
+}
+
+/**
+ * @brief   Finds the first byte where two copies of the FAT differ
+ * @details Compares 64 bytes per step while the copies agree, which they almost always do, and
+ *          only narrows down to the byte in the block where they stop agreeing.
+ * @param a_pFirst      The first copy
+ * @param a_pSecond     The second copy
+ * @param a_n_Bytes     The length of both
+ * @param a_Start       Where to start looking
+ * @return  The offset of the first differing byte at or after a_Start, a_n_Bytes if none
+ */
+size_t findFatDifference(const unsigned char * a_pFirst, const unsigned char * a_pSecond, size_t a_n_Bytes, size_t a_Start)
+{
+    size_t i = a_Start;
+#if defined(__SSE2__)
+    for (; i + 64 <= a_n_Bytes; i += 64)
+    {
+        __m128i const equal0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a_pFirst + i)), _mm_loadu_si128((const __m128i *)(a_pSecond + i)));
+        __m128i const equal1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a_pFirst + i + 16)), _mm_loadu_si128((const __m128i *)(a_pSecond + i + 16)));
+        __m128i const equal2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a_pFirst + i + 32)), _mm_loadu_si128((const __m128i *)(a_pSecond + i + 32)));
+        __m128i const equal3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a_pFirst + i + 48)), _mm_loadu_si128((const __m128i *)(a_pSecond + i + 48)));
+        __m128i const all = _mm_and_si128(_mm_and_si128(equal0, equal1), _mm_and_si128(equal2, equal3));
+        if (_mm_movemask_epi8(all) != 0xFFFF) break;
+    }
+    for (; i + 16 <= a_n_Bytes; i += 16)
+    {
+        __m128i const equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a_pFirst + i)), _mm_loadu_si128((const __m128i *)(a_pSecond + i)));
+        unsigned const differing = ~(unsigned)_mm_movemask_epi8(equal) & 0xFFFF;
+        if (differing != 0) return i + (size_t)__builtin_ctz(differing);
+    }
+#endif
+    for (; i < a_n_Bytes; i++)
+    {
+        if (a_pFirst[i] != a_pSecond[i]) return i;
+    }
+    return a_n_Bytes;
+}
+
+/**
+ * @brief   Tells whether an entry could be right: free, a link inside the volume, bad or an end
+ */
+static int isPlausible(uint32_t a_Value, size_t a_n_Entries, unsigned a_Bits)
+{
+    uint32_t const mask = entryMask(a_Bits);
+    if (a_Value == 0 || isLink(a_Value, a_n_Entries)) return 1;
+    return a_Value == mask - BAD_BELOW_MASK || a_Value >= mask - END_BELOW_MASK;
+}
+
+/**
+ * @brief   Reconciles the first FAT with the second where their bytes differ
+ * @details The first copy wins unless its entry cannot be right and the second copy's can, so a
+ *          table that was written to only one copy before a crash still reads the way the first
+ *          copy says. Only the entries under differing bytes are looked at.
+ * @param a_pTable      The decoded first copy, merged in place
+ * @param a_pMirror     The decoded second copy
+ * @param a_n_Entries   The number of entries in both
+ * @param a_Bits        12, 16 or 32
+ * @param a_pFirst      The first copy as stored
+ * @param a_pSecond     The second copy as stored
+ * @param a_pReport     Counts mismatched and merged entries
+ * @param a_Function    Gets every mismatched entry, may be NULL
+ * @param a_pContext    Passed to a_Function
+ */
+void mergeFatCopies(uint32_t * a_pTable, const uint32_t * a_pMirror, size_t a_n_Entries, unsigned a_Bits,
+    const unsigned char * a_pFirst, const unsigned char * a_pSecond, FatReport * a_pReport, FatIssueFunction a_Function, void * a_pContext)
+{
+    size_t const n_Bytes = (a_n_Entries * a_Bits + 7) / 8;
+    size_t offset = findFatDifference(a_pFirst, a_pSecond, n_Bytes, 0);
+    while (offset < n_Bytes)
+    {
+        // A FAT12 byte can hold parts of two entries
+        size_t const first = offset * 8 / a_Bits;
+        size_t const last = (offset * 8 + 7) / a_Bits;
+        for (size_t entry = first; entry <= last && entry < a_n_Entries; entry++)
+        {
+            if (a_pTable[entry] == a_pMirror[entry]) continue;
+            a_pReport->n_Mismatched++;
+            report(a_Function, a_pContext, FAT_ISSUE_MISMATCH, (uint32_t)entry, a_pTable[entry], a_pMirror[entry]);
+
+            if (!isPlausible(a_pTable[entry], a_n_Entries, a_Bits) && isPlausible(a_pMirror[entry], a_n_Entries, a_Bits))
+            {
+                a_pTable[entry] = a_pMirror[entry];
+                a_pReport->n_Merged++;
+            }
+        }
+        offset = findFatDifference(a_pFirst, a_pSecond, n_Bytes, ((last + 1) * a_Bits + 7) / 8);
+    }
+}
+
+/**
+ * @brief   Finds bad clusters, invalid links, cross-links and cycles, optionally cutting them
+ * @details The first pass reads every entry once. It flags the values no chain may hold, and
+ *          it marks every cluster something links to. The second pass walks each chain from
+ *          its head, a cluster nothing links to, marking clusters visited and on the current
+ *          walk. A walk ends at a cluster visited before, and a link back onto the current walk
+ *          closes a cycle, so a loop entered from a chain is a cycle cut where it closes,
+ *          whatever the cluster order. Clusters left over are in rings without a head, walked
+ *          from their lowest cluster. The third pass marks every link again, and a cluster
+ *          marked twice is cross-linked. No cluster is visited twice, so every pass is linear
+ *          in the size of the FAT.
+ *
+ *          Repairing turns every offending link into an end of chain. That is the reserved
+ *          and out of range values, the link that closes a cycle, and a cross-link's second
+ *          link in cluster order. The clusters stay allocated.
+ * @param a_pTable      The decoded FAT, repaired in place
+ * @param a_n_Entries   The number of entries, the clusters of the volume plus the first two
+ * @param a_Bits        12, 16 or 32
+ * @param a_Repair      Whether to cut the offending links
+ * @param a_pReport     Counts what was found
+ * @param a_Function    Gets every issue, may be NULL
+ * @param a_pContext    Passed to a_Function
+ */
+void checkFatChains(uint32_t * a_pTable, size_t a_n_Entries, unsigned a_Bits, int a_Repair,
+    FatReport * a_pReport, FatIssueFunction a_Function, void * a_pContext)
+{
+    if (a_n_Entries <= FIRST_CLUSTER) return;
+
+    uint32_t const mask = entryMask(a_Bits);
+    uint32_t const bad = mask - BAD_BELOW_MASK;
+    uint32_t const reserved = mask - RESERVED_BELOW_MASK;
+    uint32_t const end = mask - END_BELOW_MASK;
+
+    size_t const n_Words = (a_n_Entries + WORD_BITS - 1) / WORD_BITS;
+    uint64_t * linked_to = (uint64_t *)calloc(n_Words * 4, sizeof(uint64_t));
+    if (linked_to == NULL) return;
+    uint64_t * visited = linked_to + n_Words;
+    uint64_t * on_walk = visited + n_Words;
+    uint64_t * closes_cycle = on_walk + n_Words;
+
+    size_t bad_start = 0;
+    for (size_t cluster = FIRST_CLUSTER; cluster <= a_n_Entries; cluster++)
+    {
+        uint32_t const value = cluster < a_n_Entries ? a_pTable[cluster] : 0;
+
+        // Bad clusters are reported a run at a time
+        if (value == bad && cluster < a_n_Entries)
+        {
+            if (bad_start == 0) bad_start = cluster;
+            a_pReport->n_Bad++;
+            continue;
+        }
+        if (bad_start != 0)
+        {
+            report(a_Function, a_pContext, FAT_ISSUE_BAD, (uint32_t)bad_start, (uint32_t)(cluster - 1), bad);
+            bad_start = 0;
+        }
+        if (cluster == a_n_Entries || value == 0 || value >= end) continue;
+
+        if (!isLink(value, a_n_Entries))
+        {
+            int const kind = value >= reserved ? FAT_ISSUE_RESERVED : FAT_ISSUE_OUT_OF_RANGE;
+            if (kind == FAT_ISSUE_RESERVED) a_pReport->n_Reserved++;
+            else a_pReport->n_OutOfRange++;
+            report(a_Function, a_pContext, kind, (uint32_t)cluster, (uint32_t)cluster, value);
+            if (a_Repair)
+            {
+                a_pTable[cluster] = mask;
+                a_pReport->n_Repaired++;
+            }
+            continue;
+        }
+
+        if (a_pTable[value] == 0)
+        {
+            a_pReport->n_FreeLinks++;
+            report(a_Function, a_pContext, FAT_ISSUE_FREE_LINK, (uint32_t)cluster, (uint32_t)cluster, value);
+        }
+        testAndSet(linked_to, value);
+    }
+
+    // Heads first, then whatever is left, which only rings without a head reach
+    for (int round = 0; round < 2; round++)
+    {
+        for (size_t start = FIRST_CLUSTER; start < a_n_Entries; start++)
+        {
+            if (testBit(visited, start) || !isLink(a_pTable[start], a_n_Entries)) continue;
+            if (round == 0 && testBit(linked_to, start)) continue;
+
+            size_t cluster = start;
+            for (;;)
+            {
+                testAndSet(visited, cluster);
+                testAndSet(on_walk, cluster);
+                uint32_t const next = a_pTable[cluster];
+                if (!isLink(next, a_n_Entries)) break;
+                if (testBit(on_walk, next))
+                {
+                    a_pReport->n_Cycles++;
+                    report(a_Function, a_pContext, FAT_ISSUE_CYCLE, (uint32_t)cluster, (uint32_t)cluster, next);
+                    testAndSet(closes_cycle, cluster);
+                    if (a_Repair)
+                    {
+                        a_pTable[cluster] = mask;
+                        a_pReport->n_Repaired++;
+                    }
+                    break;
+                }
+                if (testBit(visited, next)) break;
+                cluster = next;
+            }
+
+            // The walk is a simple path, so retracing it clears exactly what it marked
+            for (cluster = start; testBit(on_walk, cluster); cluster = a_pTable[cluster])
+            {
+                clearBit(on_walk, cluster);
+                if (!isLink(a_pTable[cluster], a_n_Entries)) break;
+            }
+        }
+    }
+
+    // A link that closes a cycle was reported as one, and does not also cross
+    memset(linked_to, 0, n_Words * sizeof(uint64_t));
+    for (size_t cluster = FIRST_CLUSTER; cluster < a_n_Entries; cluster++)
+    {
+        uint32_t const value = a_pTable[cluster];
+        if (!isLink(value, a_n_Entries) || testBit(closes_cycle, cluster) || !testAndSet(linked_to, value)) continue;
+        a_pReport->n_CrossLinked++;
+        report(a_Function, a_pContext, FAT_ISSUE_CROSS_LINK, value, value, (uint32_t)cluster);
+        if (a_Repair)
+        {
+            a_pTable[cluster] = mask;
+            a_pReport->n_Repaired++;
+        }
+    }
+
+    free(linked_to);
+}
+
+/**
+ * @brief   Counts the issues in a report, mismatches that were resolved included
+ * @param a_pReport The report
+ * @return  Zero for a clean FAT
+ */
+size_t fatIssueCount(const FatReport * a_pReport)
+{
+    return a_pReport->n_Mismatched + a_pReport->n_Bad + a_pReport->n_Reserved + a_pReport->n_OutOfRange
+        + a_pReport->n_CrossLinked + a_pReport->n_Cycles + a_pReport->n_FreeLinks;
+}
+
+/**
+ * @brief   Names a kind of issue the way check prints it
+ * @param a_Kind    A FAT_ISSUE_ value
+ * @return  The name
+ */
+const char * fatIssueName(int a_Kind)
+{
+    static const char * const s_Names[] = { "MISMATCH", "BAD", "RESERVED", "OUT_OF_RANGE", "CROSS_LINK", "CYCLE", "FREE_LINK" };
+    if (a_Kind < 0 || a_Kind >= (int)(sizeof(s_Names) / sizeof(s_Names[0]))) return "UNKNOWN";
+    return s_Names[a_Kind];
+}
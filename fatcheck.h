@@ -0,0 +1,48 @@
+#ifndef FATCHECK_H
+#define FATCHECK_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+#define FAT_ISSUE_MISMATCH 0        // the copies disagree, a_Last is the first copy's entry, a_Value the second's
+#define FAT_ISSUE_BAD 1             // a run of clusters marked bad
+#define FAT_ISSUE_RESERVED 2        // a reserved value where a link should be
+#define FAT_ISSUE_OUT_OF_RANGE 3    // a link past the last cluster
+#define FAT_ISSUE_CROSS_LINK 4      // a_Value is a second cluster linking to a_First
+#define FAT_ISSUE_CYCLE 5           // a_First links back to a_Value, earlier in its own chain
+#define FAT_ISSUE_FREE_LINK 6       // a link to a cluster the FAT marks free
+
+/**
+ * @brief   What checking a FAT found and mended
+ */
+typedef struct FatReport {
+    size_t n_Mismatched;
+    size_t n_Merged;        // mismatched entries taken from the second copy
+    size_t n_Bad;
+    size_t n_Reserved;
+    size_t n_OutOfRange;
+    size_t n_CrossLinked;
+    size_t n_Cycles;
+    size_t n_FreeLinks;
+    size_t n_Repaired;      // links cut to end the chain instead
+} FatReport;
+
+/**
+ * @brief   Consistency checks on a decoded FAT
+ * @details Entries are the decoded values of one FAT, indexed by cluster, with every cluster
+ *          from 2 up to a_n_Entries - 1 in the volume. Each check is one linear pass over the
+ *          table with bitmaps on the side. No chain is followed from its start, so a damaged
+ *          chain costs no more than a good one. Every issue is passed to the callback once, and
+ *          runs of bad clusters are passed as one issue.
+ */
+typedef void (* FatIssueFunction)(void * a_pContext, int a_Kind, uint32_t a_First, uint32_t a_Last, uint32_t a_Value);
+
+size_t findFatDifference(const unsigned char * a_pFirst, const unsigned char * a_pSecond, size_t a_n_Bytes, size_t a_Start);
+void mergeFatCopies(uint32_t * a_pTable, const uint32_t * a_pMirror, size_t a_n_Entries, unsigned a_Bits,
+    const unsigned char * a_pFirst, const unsigned char * a_pSecond, FatReport * a_pReport, FatIssueFunction a_Function, void * a_pContext);
+void checkFatChains(uint32_t * a_pTable, size_t a_n_Entries, unsigned a_Bits, int a_Repair,
+    FatReport * a_pReport, FatIssueFunction a_Function, void * a_pContext);
+size_t fatIssueCount(const FatReport * a_pReport);
+const char * fatIssueName(int a_Kind);
+
+#endif // FATCHECK_H
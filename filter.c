@@ -0,0 +1,325 @@
+#include <stdlib.h> // calloc, free
+#include <string.h> // strlen, strchr, strrchr, memcpy
+#include <limits.h> // PATH_MAX
+
+#include "filter.h"
+#include "report.h"
+
+#define GLOB_END 0x100          // the end of the pattern
+#define GLOB_ANY 0x101          // ?, one character other than /
+#define GLOB_STAR 0x102         // *, any characters other than /
+#define GLOB_GLOBSTAR 0x103     // **, any characters
+#define GLOB_GLOBSTAR_DIR 0x104 // **/, nothing or any characters ending in /
+
+#define RULE_GLOB 0     // matched op by op
+#define RULE_LITERAL 1  // no wildcards, compared whole
+#define RULE_SUFFIX 2   // * and then no wildcards, as in *.JPG, compared at the end
+
+typedef struct Rule {
+    uint16_t * ops;     // folded characters and GLOB_ ops, ending in GLOB_END
+    size_t n_Ops;       // without GLOB_END
+    int anchored;       // matched against the whole path rather than the name
+    int kind;
+    int open_ended;     // ends in **, so a match of a directory with / after it matches all below
+} Rule;
+
+typedef struct RuleList {
+    Rule * rules;
+    size_t n_Rules;
+    size_t capacity;
+} RuleList;
+
+struct Filter {
+    RuleList include;
+    RuleList exclude;
+    uint64_t min_size;
+    uint64_t max_size;
+    int deleted;
+};
+
+static uint16_t fold(unsigned char a_Character)
+{
+    return a_Character >= 'a' && a_Character <= 'z' ? (uint16_t)(a_Character - 'a' + 'A') : a_Character;
+}
+
+/**
+ * @brief   Matches text against compiled ops
+ * @param a_pOps    The ops left to match
+ * @param a_Text    The text left to match
+ * @param a_Prefix  Whether the text may go on past its end, then any ops left over can still match
+ * @return  Nonzero on a match
+ */
+static int matchOps(const uint16_t * a_pOps, const unsigned char * a_Text, int a_Prefix)
+{
+    for (;; a_pOps++)
+    {
+        switch (*a_pOps)
+        {
+        case GLOB_END:
+            return *a_Text == '\0';
+        case GLOB_ANY:
+            if (*a_Text == '\0') return a_Prefix;
+            if (*a_Text == '/') return 0;
+            a_Text++;
+            break;
+        case GLOB_STAR:
+        case GLOB_GLOBSTAR:
+            for (const unsigned char * t = a_Text;; t++)
+            {
+                if (matchOps(a_pOps + 1, t, a_Prefix)) return 1;
+                if (*t == '\0' || (*t == '/' && *a_pOps == GLOB_STAR)) return 0;
+            }
+        case GLOB_GLOBSTAR_DIR:
+            if (matchOps(a_pOps + 1, a_Text, a_Prefix)) return 1;
+            for (const unsigned char * t = a_Text; *t != '\0'; t++)
+            {
+                if (*t == '/' && matchOps(a_pOps + 1, t + 1, a_Prefix)) return 1;
+            }
+            return 0;
+        default:
+            if (*a_Text == '\0') return a_Prefix;
+            if (fold(*a_Text) != *a_pOps) return 0;
+            a_Text++;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief   Matches a path against a rule
+ * @param a_pRule   The rule
+ * @param a_Path    The whole path, starting with /
+ * @return  Nonzero on a match
+ */
+static int matchRule(const Rule * a_pRule, const char * a_Path)
+{
+    const char * text = a_Path;
+    if (!a_pRule->anchored)
+    {
+        const char * slash = strrchr(a_Path, '/');
+        if (slash != NULL) text = slash + 1;
+    }
+
+    size_t const length = strlen(text);
+    if (a_pRule->kind == RULE_LITERAL && length != a_pRule->n_Ops) return 0;
+    if (a_pRule->kind == RULE_LITERAL || a_pRule->kind == RULE_SUFFIX)
+    {
+        // A suffix rule skips its leading * and compares the rest with the end of the text
+        size_t const skip = a_pRule->kind == RULE_SUFFIX ? 1 : 0;
+        size_t const n = a_pRule->n_Ops - skip;
+        if (length < n) return 0;
+        const unsigned char * tail = (const unsigned char *)text + length - n;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (fold(tail[i]) != a_pRule->ops[skip + i]) return 0;
+        }
+        return 1;
+    }
+    return matchOps(a_pRule->ops, (const unsigned char *)text, 0);
+}
+
+/**
+ * @brief   Compiles a glob into a rule
+ * @param a_pRule       Receives the rule
+ * @param a_Pattern     The glob
+ * @return  Nonzero on success, 0 for an empty pattern or one ending in a lone backslash
+ */
+static int compileRule(Rule * a_pRule, const char * a_Pattern)
+{
+    size_t const length = strlen(a_Pattern);
+    if (length == 0) return 0;
+
+    a_pRule->anchored = strchr(a_Pattern, '/') != NULL;
+    a_pRule->ops = (uint16_t *)growArray(NULL, length + 2, sizeof(uint16_t), "Error allocating memory for filter");
+    size_t n = 0;
+    if (a_pRule->anchored && a_Pattern[0] != '/') a_pRule->ops[n++] = '/';
+
+    int wildcards = 0;
+    int leading_star = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        char const c = a_Pattern[i];
+        if (c == '\\')
+        {
+            if (++i == length) {
+                free(a_pRule->ops);
+                return 0;
+            }
+            a_pRule->ops[n++] = fold((unsigned char)a_Pattern[i]);
+            continue;
+        }
+        if (c == '*' && a_Pattern[i + 1] == '*')
+        {
+            i++;
+            if (a_Pattern[i + 1] == '/') {
+                i++;
+                a_pRule->ops[n++] = GLOB_GLOBSTAR_DIR;
+            }
+            else a_pRule->ops[n++] = GLOB_GLOBSTAR;
+            wildcards++;
+            continue;
+        }
+        if (c == '*' || c == '?')
+        {
+            if (c == '*' && n == 0) leading_star = 1;
+            a_pRule->ops[n++] = c == '*' ? GLOB_STAR : GLOB_ANY;
+            wildcards++;
+            continue;
+        }
+        a_pRule->ops[n++] = fold((unsigned char)c);
+    }
+    a_pRule->ops[n] = GLOB_END;
+    a_pRule->n_Ops = n;
+
+    a_pRule->kind = RULE_GLOB;
+    if (wildcards == 0) a_pRule->kind = RULE_LITERAL;
+    else if (wildcards == 1 && leading_star && !a_pRule->anchored) a_pRule->kind = RULE_SUFFIX;
+    a_pRule->open_ended = n > 0 && a_pRule->ops[n - 1] == GLOB_GLOBSTAR;
+    return 1;
+}
+
+static int addRule(RuleList * a_pList, const char * a_Pattern)
+{
+    Rule rule;
+    if (!compileRule(&rule, a_Pattern)) return 0;
+    if (a_pList->n_Rules == a_pList->capacity)
+    {
+        a_pList->capacity = a_pList->capacity > 0 ? a_pList->capacity * 2 : 4;
+        a_pList->rules = (Rule *)growArray(a_pList->rules, a_pList->capacity, sizeof(Rule), "Error allocating memory for filter");
+    }
+    a_pList->rules[a_pList->n_Rules++] = rule;
+    return 1;
+}
+
+static int matchAny(const RuleList * a_pList, const char * a_Path)
+{
+    for (size_t i = 0; i < a_pList->n_Rules; i++)
+    {
+        if (matchRule(&a_pList->rules[i], a_Path)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief   Creates a filter that selects every file
+ * @return  The filter, or NULL if out of memory
+ */
+Filter * createFilter(void)
+{
+    Filter * filter = (Filter *)calloc(1, sizeof(Filter));
+    if (filter == NULL) return NULL;
+    filter->max_size = UINT64_MAX;
+    filter->deleted = FILTER_DELETED_ALL;
+    return filter;
+}
+
+/**
+ * @brief   Adds a glob that selects files, the first one leaves out every file it does not match
+ * @param a_pFilter     The filter
+ * @param a_Pattern     The glob
+ * @return  Nonzero on success, 0 if the glob is empty or malformed
+ */
+int filterInclude(Filter * a_pFilter, const char * a_Pattern)
+{
+    return addRule(&a_pFilter->include, a_Pattern);
+}
+
+/**
+ * @brief   Adds a glob that leaves out the files, and everything below the directories, it matches
+ * @param a_pFilter     The filter
+ * @param a_Pattern     The glob
+ * @return  Nonzero on success, 0 if the glob is empty or malformed
+ */
+int filterExclude(Filter * a_pFilter, const char * a_Pattern)
+{
+    return addRule(&a_pFilter->exclude, a_Pattern);
+}
+
+/**
+ * @brief   Limits the sizes of selected files
+ * @param a_pFilter     The filter
+ * @param a_Min         The smallest size, in bytes
+ * @param a_Max         The largest size, in bytes
+ */
+void filterSizeRange(Filter * a_pFilter, uint64_t a_Min, uint64_t a_Max)
+{
+    a_pFilter->min_size = a_Min;
+    a_pFilter->max_size = a_Max;
+}
+
+/**
+ * @brief   Selects files by whether they are deleted
+ * @param a_pFilter     The filter
+ * @param a_Mode        FILTER_DELETED_ALL, FILTER_DELETED_ONLY or FILTER_DELETED_NONE
+ */
+void filterDeleted(Filter * a_pFilter, int a_Mode)
+{
+    a_pFilter->deleted = a_Mode;
+}
+
+/**
+ * @brief   Tells whether a file is selected
+ * @param a_pFilter     The filter
+ * @param a_Path        The file's path, starting with /
+ * @param a_Size        The file's size
+ * @param a_Deleted     Whether the file is deleted
+ * @return  Nonzero if the file is selected
+ */
+int filterSelectsFile(const Filter * a_pFilter, const char * a_Path, uint64_t a_Size, int a_Deleted)
+{
+    if (a_Deleted && a_pFilter->deleted == FILTER_DELETED_NONE) return 0;
+    if (!a_Deleted && a_pFilter->deleted == FILTER_DELETED_ONLY) return 0;
+    if (a_Size < a_pFilter->min_size || a_Size > a_pFilter->max_size) return 0;
+    if (matchAny(&a_pFilter->exclude, a_Path)) return 0;
+    return a_pFilter->include.n_Rules == 0 || matchAny(&a_pFilter->include, a_Path);
+}
+
+/**
+ * @brief   Tells whether a directory could hold a selected file, anywhere below it
+ * @details Errs on the side of entering: a path too long to test is always entered.
+ * @param a_pFilter     The filter
+ * @param a_Path        The directory's path, starting with /
+ * @param a_Deleted     Whether the directory is deleted
+ * @return  Nonzero if the directory has to be read
+ */
+int filterEntersDirectory(const Filter * a_pFilter, const char * a_Path, int a_Deleted)
+{
+    // Everything below a deleted directory is deleted too
+    if (a_Deleted && a_pFilter->deleted == FILTER_DELETED_NONE) return 0;
+    if (matchAny(&a_pFilter->exclude, a_Path)) return 0;
+
+    char below[PATH_MAX];
+    size_t const length = strlen(a_Path);
+    if (length + 2 > sizeof(below)) return 1;
+    memcpy(below, a_Path, length);
+    below[length] = '/';
+    below[length + 1] = '\0';
+
+    for (size_t i = 0; i < a_pFilter->exclude.n_Rules; i++)
+    {
+        Rule const * rule = &a_pFilter->exclude.rules[i];
+        if (rule->anchored && rule->open_ended && matchOps(rule->ops, (const unsigned char *)below, 0)) return 0;
+    }
+
+    if (a_pFilter->include.n_Rules == 0) return 1;
+    for (size_t i = 0; i < a_pFilter->include.n_Rules; i++)
+    {
+        Rule const * rule = &a_pFilter->include.rules[i];
+        if (!rule->anchored || matchOps(rule->ops, (const unsigned char *)below, 1)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief   Frees a filter and its compiled globs
+ * @param a_pFilter     The filter, may be NULL
+ */
+void destroyFilter(Filter * a_pFilter)
+{
+    if (a_pFilter == NULL) return;
+    for (size_t i = 0; i < a_pFilter->include.n_Rules; i++) free(a_pFilter->include.rules[i].ops);
+    for (size_t i = 0; i < a_pFilter->exclude.n_Rules; i++) free(a_pFilter->exclude.rules[i].ops);
+    free(a_pFilter->include.rules);
+    free(a_pFilter->exclude.rules);
+    free(a_pFilter);
+}
@@ -0,0 +1,31 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h> // uint64_t
+
+#define FILTER_DELETED_ALL 0    // live and deleted entries alike
+#define FILTER_DELETED_ONLY 1   // only deleted files, and the directories that may hold them
+#define FILTER_DELETED_NONE 2   // no deleted files and no deleted directories
+
+/**
+ * @brief   Which files to extract, compiled once from the command line and shared by threads
+ * @details Patterns are globs matched without regard to case. * and ? stop at a /, ** does not,
+ *          and a ** followed by a / may also match nothing at all. A pattern with a / is
+ *          matched against the whole path, from the root whether or not it starts with one, and
+ *          any other against the name alone. A file is selected when it matches an include, or there are none, and
+ *          no exclude, and its size and deleted status are allowed. An exclude that matches a
+ *          directory leaves out everything below it, and so does an include that nothing below
+ *          the directory could match, so that neither is ever read.
+ */
+typedef struct Filter Filter;
+
+Filter * createFilter(void);
+int filterInclude(Filter * a_pFilter, const char * a_Pattern);
+int filterExclude(Filter * a_pFilter, const char * a_Pattern);
+void filterSizeRange(Filter * a_pFilter, uint64_t a_Min, uint64_t a_Max);
+void filterDeleted(Filter * a_pFilter, int a_Mode);
+int filterSelectsFile(const Filter * a_pFilter, const char * a_Path, uint64_t a_Size, int a_Deleted);
+int filterEntersDirectory(const Filter * a_pFilter, const char * a_Path, int a_Deleted);
+void destroyFilter(Filter * a_pFilter);
+
+#endif // FILTER_H
@@ -0,0 +1,196 @@
+#include <string.h> // memcpy, memset
+
+#include "hash.h"
+
+#define QUICK_HASH_MULTIPLIER 0xC6A4A7935BD1E995ULL
+#define QUICK_HASH_SHIFT 47
+
+static const uint32_t s_RoundConstants[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static inline uint32_t rotateRight(uint32_t a_Value, unsigned a_Bits)
+{
+    return (a_Value >> a_Bits) | (a_Value << (32 - a_Bits));
+}
+
+static inline uint32_t loadBigEndian32(const unsigned char * a_pB_Data)
+{
+    return ((uint32_t)a_pB_Data[0] << 24) | ((uint32_t)a_pB_Data[1] << 16) | ((uint32_t)a_pB_Data[2] << 8) | a_pB_Data[3];
+}
+
+/**
+ * @brief   Runs the compression function over whole 64-byte blocks
+ */
+static void compressBlocks(uint32_t a_State[8], const unsigned char * a_pB_Data, size_t a_n_Blocks)
+{
+    uint32_t schedule[64];
+    for (; a_n_Blocks > 0; a_n_Blocks--, a_pB_Data += SHA256_BLOCK_BYTES)
+    {
+        for (int i = 0; i < 16; i++) schedule[i] = loadBigEndian32(a_pB_Data + i * 4);
+        for (int i = 16; i < 64; i++)
+        {
+            uint32_t const s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+            uint32_t const s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+        }
+
+        uint32_t a = a_State[0], b = a_State[1], c = a_State[2], d = a_State[3];
+        uint32_t e = a_State[4], f = a_State[5], g = a_State[6], h = a_State[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t const t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) + s_RoundConstants[i] + schedule[i];
+            uint32_t const t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        a_State[0] += a;
+        a_State[1] += b;
+        a_State[2] += c;
+        a_State[3] += d;
+        a_State[4] += e;
+        a_State[5] += f;
+        a_State[6] += g;
+        a_State[7] += h;
+    }
+}
+
+/**
+ * @brief   Starts a SHA-256 computation
+ * @param a_pHash   The computation to start
+ */
+void sha256Init(Sha256 * a_pHash)
+{
+    static const uint32_t s_Initial[8] = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+    };
+    memcpy(a_pHash->state, s_Initial, sizeof(s_Initial));
+    a_pHash->n_Bytes = 0;
+}
+
+/**
+ * @brief   Feeds bytes into a SHA-256 computation
+ * @param a_pHash   The computation
+ * @param a_pData   The bytes
+ * @param a_Length  The number of bytes
+ */
+void sha256Update(Sha256 * a_pHash, const void * a_pData, size_t a_Length)
+{
+    const unsigned char * data = (const unsigned char *)a_pData;
+    size_t const buffered = (size_t)(a_pHash->n_Bytes % SHA256_BLOCK_BYTES);
+    a_pHash->n_Bytes += a_Length;
+
+    // Top up a partial block first, then compress straight from the caller's bytes
+    if (buffered > 0)
+    {
+        size_t const take = SHA256_BLOCK_BYTES - buffered < a_Length ? SHA256_BLOCK_BYTES - buffered : a_Length;
+        memcpy(a_pHash->block + buffered, data, take);
+        data += take;
+        a_Length -= take;
+        if (buffered + take < SHA256_BLOCK_BYTES) return;
+        compressBlocks(a_pHash->state, a_pHash->block, 1);
+    }
+
+    size_t const n_Blocks = a_Length / SHA256_BLOCK_BYTES;
+    compressBlocks(a_pHash->state, data, n_Blocks);
+    data += n_Blocks * SHA256_BLOCK_BYTES;
+    a_Length -= n_Blocks * SHA256_BLOCK_BYTES;
+    memcpy(a_pHash->block, data, a_Length);
+}
+
+/**
+ * @brief   Pads the message and gives the digest
+ * @param a_pHash   The computation, which cannot be fed afterwards
+ * @param a_Digest  Receives the digest
+ */
+void sha256Final(Sha256 * a_pHash, unsigned char a_Digest[SHA256_DIGEST_BYTES])
+{
+    uint64_t const n_Bits = a_pHash->n_Bytes * 8;
+    size_t used = (size_t)(a_pHash->n_Bytes % SHA256_BLOCK_BYTES);
+
+    a_pHash->block[used++] = 0x80;
+    if (used > SHA256_BLOCK_BYTES - 8)
+    {
+        memset(a_pHash->block + used, 0, SHA256_BLOCK_BYTES - used);
+        compressBlocks(a_pHash->state, a_pHash->block, 1);
+        used = 0;
+    }
+    memset(a_pHash->block + used, 0, SHA256_BLOCK_BYTES - 8 - used);
+    for (int i = 0; i < 8; i++) a_pHash->block[SHA256_BLOCK_BYTES - 1 - i] = (unsigned char)(n_Bits >> (i * 8));
+    compressBlocks(a_pHash->state, a_pHash->block, 1);
+
+    for (int i = 0; i < 8; i++)
+    {
+        a_Digest[i * 4] = (unsigned char)(a_pHash->state[i] >> 24);
+        a_Digest[i * 4 + 1] = (unsigned char)(a_pHash->state[i] >> 16);
+        a_Digest[i * 4 + 2] = (unsigned char)(a_pHash->state[i] >> 8);
+        a_Digest[i * 4 + 3] = (unsigned char)a_pHash->state[i];
+    }
+}
+
+/**
+ * @brief   Writes a digest as lowercase hex
+ * @param a_Digest  The digest
+ * @param a_Hex     Receives the hex digits and a terminating NUL
+ */
+void formatDigest(const unsigned char a_Digest[SHA256_DIGEST_BYTES], char a_Hex[SHA256_HEX_BYTES])
+{
+    static const char s_Digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_BYTES; i++)
+    {
+        a_Hex[i * 2] = s_Digits[a_Digest[i] >> 4];
+        a_Hex[i * 2 + 1] = s_Digits[a_Digest[i] & 0x0F];
+    }
+    a_Hex[SHA256_DIGEST_BYTES * 2] = '\0';
+}
+
+/**
+ * @brief   Hashes bytes quickly into 64 bits, for telling apart data that is certainly different
+ * @details MurmurHash64A, eight bytes per multiply. Equal hashes say nothing for certain.
+ * @param a_pData   The bytes
+ * @param a_Length  The number of bytes
+ * @param a_Seed    Mixed in first
+ * @return  The hash
+ */
+uint64_t quickHash(const void * a_pData, size_t a_Length, uint64_t a_Seed)
+{
+    const unsigned char * data = (const unsigned char *)a_pData;
+    uint64_t hash = a_Seed ^ (a_Length * QUICK_HASH_MULTIPLIER);
+
+    for (; a_Length >= 8; a_Length -= 8, data += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        word *= QUICK_HASH_MULTIPLIER;
+        word ^= word >> QUICK_HASH_SHIFT;
+        word *= QUICK_HASH_MULTIPLIER;
+        hash ^= word;
+        hash *= QUICK_HASH_MULTIPLIER;
+    }
+
+    if (a_Length > 0)
+    {
+        uint64_t tail = 0;
+        for (size_t i = 0; i < a_Length; i++) tail |= (uint64_t)data[i] << (i * 8);
+        hash ^= tail;
+        hash *= QUICK_HASH_MULTIPLIER;
+    }
+
+    hash ^= hash >> QUICK_HASH_SHIFT;
+    hash *= QUICK_HASH_MULTIPLIER;
+    hash ^= hash >> QUICK_HASH_SHIFT;
+    return hash;
+}
@@ -0,0 +1,27 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t
+
+#define SHA256_DIGEST_BYTES 32
+#define SHA256_BLOCK_BYTES 64
+#define SHA256_HEX_BYTES (SHA256_DIGEST_BYTES * 2 + 1)
+
+/**
+ * @brief   A SHA-256 computation fed one piece at a time
+ */
+typedef struct Sha256 {
+    uint32_t state[8];
+    uint64_t n_Bytes;
+    unsigned char block[SHA256_BLOCK_BYTES];
+} Sha256;
+
+void sha256Init(Sha256 * a_pHash);
+void sha256Update(Sha256 * a_pHash, const void * a_pData, size_t a_Length);
+void sha256Final(Sha256 * a_pHash, unsigned char a_Digest[SHA256_DIGEST_BYTES]);
+void formatDigest(const unsigned char a_Digest[SHA256_DIGEST_BYTES], char a_Hex[SHA256_HEX_BYTES]);
+
+uint64_t quickHash(const void * a_pData, size_t a_Length, uint64_t a_Seed);
+
+#endif // HASH_H
@@ -0,0 +1,39 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h> // fprintf, stderr
+
+/**
+ * @brief   Compile-time levels for what goes to stderr
+ * @details A message above LOG_LEVEL is compiled out along with its arguments. The default
+ *          keeps errors and one line per stage. make debug builds with LOG_LEVEL_DEBUG for the
+ *          per-entry dumps.
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define logError(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define logError(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define logInfo(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define logInfo(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define logDebug(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define logDebug(...) ((void)0)
+#endif
+
+#endif // LOG_H
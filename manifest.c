@@ -0,0 +1,323 @@
+#include <stdlib.h> // calloc, free
+#include <stdio.h> // snprintf, fopen, fread, fwrite, rename
+#include <string.h> // memcpy, memcmp, memset, strlen
+#include <pthread.h> // pthread_mutex_t
+#include <sys/stat.h> // fstat
+
+#include "manifest.h"
+#include "report.h"
+
+#define MANIFEST_MAGIC "NJMAN001"
+#define MANIFEST_MAGIC_BYTES 8
+#define MANIFEST_INITIAL_CAPACITY 64
+#define MANIFEST_TEMP_SUFFIX ".tmp"
+
+typedef struct ManifestHeader {
+    char magic[MANIFEST_MAGIC_BYTES];
+    uint64_t cluster_bytes;
+    uint64_t n_Clusters;
+    uint64_t n_Files;
+    uint64_t string_bytes;
+} ManifestHeader;
+
+struct Manifest {
+    uint64_t cluster_bytes;
+    size_t n_Clusters;
+    uint64_t * cluster_hash;
+
+    size_t n_Files;
+    size_t capacity_Files;
+    uint64_t * signature;
+    uint64_t * size;
+    uint32_t * name_offset;
+    uint32_t * path_offset;
+    uint8_t * status;
+
+    size_t string_bytes;
+    size_t capacity_Strings;
+    char * strings;
+
+    pthread_mutex_t lock;
+};
+
+/**
+ * @brief   Copies a name into the string pool
+ * @return  NULL, or what went wrong
+ */
+static const char * addString(Manifest * a_pManifest, const char * a_Text, uint32_t * a_pOffset)
+{
+    size_t const bytes = strlen(a_Text) + 1;
+    if (a_pManifest->string_bytes + bytes > UINT32_MAX) return "Error: manifest names are too long";
+    if (a_pManifest->string_bytes + bytes > a_pManifest->capacity_Strings)
+    {
+        size_t capacity = a_pManifest->capacity_Strings > 0 ? a_pManifest->capacity_Strings : MANIFEST_INITIAL_CAPACITY;
+        while (capacity < a_pManifest->string_bytes + bytes) capacity *= 2;
+        if (!resizeArray((void **)&a_pManifest->strings, capacity, sizeof(char))) return "Error allocating memory for manifest";
+        a_pManifest->capacity_Strings = capacity;
+    }
+
+    *a_pOffset = (uint32_t)a_pManifest->string_bytes;
+    memcpy(a_pManifest->strings + *a_pOffset, a_Text, bytes);
+    a_pManifest->string_bytes += bytes;
+    return NULL;
+}
+
+/**
+ * @brief   Makes room for a file number, with the manifest locked
+ * @return  NULL, or what went wrong
+ */
+static const char * reserveFile(Manifest * a_pManifest, size_t a_Index)
+{
+    Manifest * m = a_pManifest;
+    if (a_Index < m->capacity_Files) return NULL;
+
+    size_t capacity = m->capacity_Files > 0 ? m->capacity_Files : MANIFEST_INITIAL_CAPACITY;
+    while (capacity <= a_Index) capacity *= 2;
+    int const grown = resizeArray((void **)&m->signature, capacity, sizeof(uint64_t))
+        && resizeArray((void **)&m->size, capacity, sizeof(uint64_t))
+        && resizeArray((void **)&m->name_offset, capacity, sizeof(uint32_t))
+        && resizeArray((void **)&m->path_offset, capacity, sizeof(uint32_t))
+        && resizeArray((void **)&m->status, capacity, sizeof(uint8_t));
+    if (!grown) return "Error allocating memory for manifest";
+    m->capacity_Files = capacity;
+    return NULL;
+}
+
+static int writeSection(FILE * a_File, const void * a_pData, size_t a_Bytes)
+{
+    return a_Bytes == 0 || fwrite(a_pData, 1, a_Bytes, a_File) == a_Bytes;
+}
+
+static int readSection(FILE * a_File, void * a_pData, size_t a_Bytes)
+{
+    return a_Bytes == 0 || fread(a_pData, 1, a_Bytes, a_File) == a_Bytes;
+}
+
+/**
+ * @brief   Starts an empty manifest for a volume
+ * @param a_ClusterBytes    The size of a cluster
+ * @param a_n_Clusters      The number of data clusters, each gets a hash
+ * @return  The manifest, its cluster hashes zeroed
+ */
+Manifest * createManifest(uint64_t a_ClusterBytes, size_t a_n_Clusters)
+{
+    Manifest * manifest = (Manifest *)calloc(1, sizeof(Manifest));
+    observeAndReport(manifest != NULL, "Error allocating memory for manifest");
+    manifest->cluster_bytes = a_ClusterBytes;
+    manifest->n_Clusters = a_n_Clusters;
+    manifest->cluster_hash = (uint64_t *)calloc(a_n_Clusters > 0 ? a_n_Clusters : 1, sizeof(uint64_t));
+    observeAndReport(manifest->cluster_hash != NULL, "Error allocating memory for manifest");
+    pthread_mutex_init(&manifest->lock, NULL);
+    return manifest;
+}
+
+/**
+ * @return  The hashes of the data clusters, the first for cluster 2, for the caller to fill
+ */
+uint64_t * manifestClusterHashes(Manifest * a_pManifest)
+{
+    return a_pManifest->cluster_hash;
+}
+
+/**
+ * @return  The number of data clusters the manifest has hashes for
+ */
+size_t manifestClusterCount(const Manifest * a_pManifest)
+{
+    return a_pManifest->n_Clusters;
+}
+
+/**
+ * @return  The size of the clusters that were hashed
+ */
+uint64_t manifestClusterBytes(const Manifest * a_pManifest)
+{
+    return a_pManifest->cluster_bytes;
+}
+
+/**
+ * @brief   Records an output file, replacing any record with the same number
+ * @param a_pManifest   The manifest being built
+ * @param a_Index       The file's number
+ * @param a_Signature   The hash of its directory entry and extents
+ * @param a_Size        The number of bytes written for it
+ * @param a_Name        Its output name, copied
+ * @param a_Path        Its path in the image, copied
+ * @param a_Status      MANIFEST_NEW, MANIFEST_CHANGED or MANIFEST_UNCHANGED
+ */
+void manifestSetFile(Manifest * a_pManifest, size_t a_Index, uint64_t a_Signature, uint64_t a_Size,
+    const char * a_Name, const char * a_Path, unsigned a_Status)
+{
+    Manifest * m = a_pManifest;
+    pthread_mutex_lock(&m->lock);
+    const char * failure = reserveFile(m, a_Index);
+    if (failure == NULL)
+    {
+        // Files are finished out of order, numbers not recorded yet stay empty
+        if (a_Index >= m->n_Files)
+        {
+            memset(m->status + m->n_Files, MANIFEST_NONE, a_Index + 1 - m->n_Files);
+            m->n_Files = a_Index + 1;
+        }
+
+        m->signature[a_Index] = a_Signature;
+        m->size[a_Index] = a_Size;
+        m->status[a_Index] = MANIFEST_NONE;
+        failure = addString(m, a_Name, &m->name_offset[a_Index]);
+        if (failure == NULL) failure = addString(m, a_Path, &m->path_offset[a_Index]);
+        if (failure == NULL) m->status[a_Index] = (uint8_t)a_Status;
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    // Failing jumps away, and must not leave the lock held
+    observeAndReport(failure == NULL, failure);
+}
+
+/**
+ * @return  One past the highest file number recorded
+ */
+size_t manifestFileCount(const Manifest * a_pManifest)
+{
+    return a_pManifest->n_Files;
+}
+
+/**
+ * @brief   Looks up the record of an output file
+ * @param a_pManifest   The manifest
+ * @param a_Index       The file's number
+ * @param a_pSignature  Receives the hash of its directory entry and extents
+ * @param a_pSize       Receives the number of bytes written for it
+ * @param a_pName       Receives its output name
+ * @param a_pPath       Receives its path in the image
+ * @return  Its status, MANIFEST_NONE with nothing received when no file had this number
+ */
+unsigned manifestFile(const Manifest * a_pManifest, size_t a_Index, uint64_t * a_pSignature, uint64_t * a_pSize,
+    const char ** a_pName, const char ** a_pPath)
+{
+    if (a_Index >= a_pManifest->n_Files || a_pManifest->status[a_Index] == MANIFEST_NONE) return MANIFEST_NONE;
+    if (a_pSignature != NULL) *a_pSignature = a_pManifest->signature[a_Index];
+    if (a_pSize != NULL) *a_pSize = a_pManifest->size[a_Index];
+    if (a_pName != NULL) *a_pName = a_pManifest->strings + a_pManifest->name_offset[a_Index];
+    if (a_pPath != NULL) *a_pPath = a_pManifest->strings + a_pManifest->path_offset[a_Index];
+    return a_pManifest->status[a_Index];
+}
+
+/**
+ * @brief   Saves a manifest, replacing the file only once the new one is complete
+ * @param a_pManifest   The manifest, with no file being recorded
+ * @param a_Path        Where to save it
+ * @return  Whether it was saved
+ */
+int writeManifest(const Manifest * a_pManifest, const char * a_Path)
+{
+    const Manifest * m = a_pManifest;
+    ManifestHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MANIFEST_MAGIC, MANIFEST_MAGIC_BYTES);
+    header.cluster_bytes = m->cluster_bytes;
+    header.n_Clusters = m->n_Clusters;
+    header.n_Files = m->n_Files;
+    header.string_bytes = m->string_bytes;
+
+    char temporary[4096];
+    int length = snprintf(temporary, sizeof(temporary), "%s%s", a_Path, MANIFEST_TEMP_SUFFIX);
+    int written = length > 0 && (size_t)length < sizeof(temporary);
+
+    FILE * file = written ? fopen(temporary, "wb") : NULL;
+    written = file != NULL && writeSection(file, &header, sizeof(header));
+    if (written) written = writeSection(file, m->cluster_hash, m->n_Clusters * sizeof(uint64_t));
+    if (written) written = writeSection(file, m->signature, m->n_Files * sizeof(uint64_t));
+    if (written) written = writeSection(file, m->size, m->n_Files * sizeof(uint64_t));
+    if (written) written = writeSection(file, m->name_offset, m->n_Files * sizeof(uint32_t));
+    if (written) written = writeSection(file, m->path_offset, m->n_Files * sizeof(uint32_t));
+    if (written) written = writeSection(file, m->status, m->n_Files * sizeof(uint8_t));
+    if (written) written = writeSection(file, m->strings, m->string_bytes);
+    if (file != NULL && fclose(file) != 0) written = 0;
+
+    if (written) written = rename(temporary, a_Path) == 0;
+    else if (file != NULL) remove(temporary);
+    return written;
+}
+
+/**
+ * @brief   Loads a manifest saved by writeManifest()
+ * @param a_Path    The manifest file
+ * @return  The manifest, or NULL when it is missing or damaged
+ */
+Manifest * readManifest(const char * a_Path)
+{
+    FILE * file = fopen(a_Path, "rb");
+    if (file == NULL) return NULL;
+
+    ManifestHeader header;
+    struct stat info;
+    int valid = fstat(fileno(file), &info) == 0 && readSection(file, &header, sizeof(header))
+        && memcmp(header.magic, MANIFEST_MAGIC, MANIFEST_MAGIC_BYTES) == 0;
+
+    // Every section has to fit in the file before anything is allocated for it
+    uint64_t const record_bytes = 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t) + sizeof(uint8_t);
+    uint64_t const bytes = valid ? (uint64_t)info.st_size - sizeof(header) : 0;
+    valid = valid && header.n_Clusters <= bytes / sizeof(uint64_t)
+        && header.n_Files <= (bytes - header.n_Clusters * sizeof(uint64_t)) / record_bytes
+        && header.string_bytes == bytes - header.n_Clusters * sizeof(uint64_t) - header.n_Files * record_bytes
+        && header.string_bytes <= UINT32_MAX;
+    if (!valid)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    Manifest * m = createManifest(header.cluster_bytes, (size_t)header.n_Clusters);
+    size_t const n_Files = (size_t)header.n_Files;
+    m->n_Files = n_Files;
+    m->capacity_Files = n_Files;
+    m->signature = (uint64_t *)growArray(NULL, n_Files, sizeof(uint64_t), "Error allocating memory for manifest");
+    m->size = (uint64_t *)growArray(NULL, n_Files, sizeof(uint64_t), "Error allocating memory for manifest");
+    m->name_offset = (uint32_t *)growArray(NULL, n_Files, sizeof(uint32_t), "Error allocating memory for manifest");
+    m->path_offset = (uint32_t *)growArray(NULL, n_Files, sizeof(uint32_t), "Error allocating memory for manifest");
+    m->status = (uint8_t *)growArray(NULL, n_Files, sizeof(uint8_t), "Error allocating memory for manifest");
+    m->string_bytes = (size_t)header.string_bytes;
+    m->capacity_Strings = m->string_bytes;
+    m->strings = (char *)growArray(NULL, m->string_bytes, sizeof(char), "Error allocating memory for manifest");
+
+    valid = readSection(file, m->cluster_hash, m->n_Clusters * sizeof(uint64_t))
+        && readSection(file, m->signature, n_Files * sizeof(uint64_t))
+        && readSection(file, m->size, n_Files * sizeof(uint64_t))
+        && readSection(file, m->name_offset, n_Files * sizeof(uint32_t))
+        && readSection(file, m->path_offset, n_Files * sizeof(uint32_t))
+        && readSection(file, m->status, n_Files * sizeof(uint8_t))
+        && readSection(file, m->strings, m->string_bytes);
+    fclose(file);
+
+    // Names are used straight from the pool, so each has to end inside it
+    valid = valid && (m->string_bytes == 0 || m->strings[m->string_bytes - 1] == '\0');
+    for (size_t i = 0; i < n_Files && valid; i++)
+    {
+        if (m->status[i] == MANIFEST_NONE) continue;
+        valid = m->status[i] <= MANIFEST_UNCHANGED && m->name_offset[i] < m->string_bytes && m->path_offset[i] < m->string_bytes;
+    }
+    if (!valid)
+    {
+        destroyManifest(m);
+        return NULL;
+    }
+    return m;
+}
+
+/**
+ * @brief   Frees a manifest
+ * @param a_pManifest   The manifest, may be NULL
+ */
+void destroyManifest(Manifest * a_pManifest)
+{
+    if (a_pManifest == NULL) return;
+    pthread_mutex_destroy(&a_pManifest->lock);
+    free(a_pManifest->cluster_hash);
+    free(a_pManifest->signature);
+    free(a_pManifest->size);
+    free(a_pManifest->name_offset);
+    free(a_pManifest->path_offset);
+    free(a_pManifest->status);
+    free(a_pManifest->strings);
+    free(a_pManifest);
+}
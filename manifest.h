@@ -0,0 +1,35 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+#define MANIFEST_NONE 0         // no file has this number
+#define MANIFEST_NEW 1          // the previous run had no file with this number
+#define MANIFEST_CHANGED 2      // its directory entry or one of its clusters changed
+#define MANIFEST_UNCHANGED 3    // left as the previous run wrote it
+
+/**
+ * @brief   What one run recovered from an image, kept so that the next run can tell what changed
+ * @details A header with the cluster size and count, a 64-bit hash of every data cluster in
+ *          cluster order, then one record per output file by number: a signature of its
+ *          directory entry and extents, its size, how it compared with the run before, and
+ *          offsets into a pool holding its output name and its path in the image. Files can be
+ *          recorded from several threads at once.
+ */
+typedef struct Manifest Manifest;
+
+Manifest * createManifest(uint64_t a_ClusterBytes, size_t a_n_Clusters);
+uint64_t * manifestClusterHashes(Manifest * a_pManifest);
+size_t manifestClusterCount(const Manifest * a_pManifest);
+uint64_t manifestClusterBytes(const Manifest * a_pManifest);
+void manifestSetFile(Manifest * a_pManifest, size_t a_Index, uint64_t a_Signature, uint64_t a_Size,
+    const char * a_Name, const char * a_Path, unsigned a_Status);
+size_t manifestFileCount(const Manifest * a_pManifest);
+unsigned manifestFile(const Manifest * a_pManifest, size_t a_Index, uint64_t * a_pSignature, uint64_t * a_pSize,
+    const char ** a_pName, const char ** a_pPath);
+int writeManifest(const Manifest * a_pManifest, const char * a_Path);
+Manifest * readManifest(const char * a_Path);
+void destroyManifest(Manifest * a_pManifest);
+
+#endif // MANIFEST_H
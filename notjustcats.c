@@ -1,10 +1,51 @@
+#define _GNU_SOURCE // copy_file_range, strdup
 #include <stdlib.h> // exit, EXIT_FAILURE, EXIT_SUCCESS
 #include <stdint.h> // byte, uint16_t, uint32_t
 #include <stdio.h> // printf, FILE, fopen, fclose
 #include <string.h> // strcat
+#include <strings.h> // strncasecmp
 #include <ctype.h> // toupper
 #include <limits.h> //
 #include <assert.h> // assert
+#include <errno.h> // errno, EEXIST, EXDEV, ENOSYS
+#include <fcntl.h> // open, O_RDONLY, O_WRONLY, O_CREAT, O_TRUNC
+#include <unistd.h> // close, read, write, copy_file_range
+#include <sys/mman.h> // mmap, madvise, munmap
+#include <sys/stat.h> // fstat, mkdir
+#include <sys/sendfile.h> // sendfile
+#include <getopt.h> // getopt_long, optarg, optind
+#include <time.h> // clock_gettime, CLOCK_MONOTONIC
+#include <sys/resource.h> // getrusage
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // _mm_shuffle_epi8, _mm256_shuffle_epi8, _mm_unpacklo_epi32
+#endif
+
+#include <setjmp.h> // jmp_buf, setjmp, longjmp
+#include <pthread.h> // pthread_create, pthread_mutex_t, pthread_cond_t
+#include <glob.h> // glob, globfree
+#include <libgen.h> // basename
+#include <signal.h> // sigaction, pthread_sigmask, SIGINT, SIGTERM
+#include <sys/socket.h> // socket, bind, listen, accept4, send
+#include <sys/un.h> // sockaddr_un
+#include <poll.h> // ppoll, struct pollfd, POLLIN
+
+#include "threadpool.h"
+#include "arena.h"
+#include "carve.h"
+#include "catalog.h"
+#include "readplan.h"
+#include "output.h"
+#include "archive.h"
+#include "hash.h"
+#include "fatcheck.h"
+#include "manifest.h"
+#include "device.h"
+#include "fatcache.h"
+#include "timeline.h"
+#include "filter.h"
+#include "report.h"
+#include "volume.h"
+#include "log.h"
 
 #define NULL_CHAR '\0'
 #define SPACE_CHAR ' '
@@ -13,6 +54,7 @@
 #define DOUBLE_DOT_CHAR 0x2E
 #define FORWARD_SLASH_CHAR 0x2F
 #define FORWARD_SLASH_STRING "/"
+#define UNDERSCORE_CHAR '_'
 
 
 
@@ -20,6 +62,7 @@
 #define ZERO 0
 #define DIRECTORY_FILE_SIZE ZERO
 #define BITS_PER_BYTE 8
+#define BITS_PER_WORD 64 // bits per word of the cluster bitmap
 #define BYTES_PER_SECTOR 512
 
 #define BOOT_SECTOR_START 0
@@ -47,9 +90,19 @@
 #define CLUSTER_LAST_MIN 0xFF8
 #define CLUSTER_LAST_MAX 0xFFF
 
+#define FAT12_PAIR_BYTES 3 // two 12-bit entries share three bytes
+#define FAT12_BITS 12
+#define FAT16_BITS 16
+#define FAT32_BITS 32
+#define FAT12_MAX_CLUSTERS 4084 // more clusters than this make a volume FAT16
+#define FAT16_MAX_CLUSTERS 65524 // and more than this FAT32
+#define FAT32_ENTRY_MASK 0x0FFFFFFF // the top four bits of a FAT32 entry are reserved
+
 #define BOOT_BYTES_PER_SECTOR_OFFSET1 11
 #define BOOT_BYTES_PER_SECTOR_OFFSET2 12
 #define BOOT_SECTORS_PER_CLUSTER_OFFSET 13
+#define BOOT_RESERVED_SECTORS_OFFSET1 14
+#define BOOT_RESERVED_SECTORS_OFFSET2 15
 
 #define BOOT_FAT_COUNT_OFFSET 16
 
@@ -62,6 +115,10 @@
 #define BOOT_SECTORS_PER_FAT_OFFSET1 22
 #define BOOT_SECTORS_PER_FAT_OFFSET2 23
 
+#define BOOT_SECTORS_IN_DISK32_OFFSET 32
+#define BOOT_SECTORS_PER_FAT32_OFFSET 36
+#define BOOT_ROOT_CLUSTER_OFFSET 44
+
 #define BOOT_SIGNATURE_OFFSET1 510
 #define BOOT_SIGNATURE_CONSTANT1 0x55
 #define BOOT_SIGNATURE_OFFSET2 511
@@ -70,7 +127,10 @@
 // #define ROOT_OFFSET 0x2600
 #define DATA_AREA_OFFSET 0x4000
 
-#define SECTOR_SIZE 512
+#define SECTOR_SIZE 512 // the smallest sector, and the only one a 1.44MB floppy has
+#define SECTOR_SIZE_MAX 4096
+#define SECTORS_PER_CLUSTER_MAX 128
+#define FLOPPY_ROOT_ENTRIES 224
 #define ENTRY_SIZE 32
 
 #define ENTRY_FILENAME_OFFSET 0
@@ -92,6 +152,8 @@
 #define ENTRY_FIRST_CLUSTER_OFFSET1 26
 #define ENTRY_FIRST_CLUSTER_OFFSET2 27
 #define ENTRY_FIRST_CLUSTER_BYTES 2
+#define ENTRY_FIRST_CLUSTER_HIGH_OFFSET1 20 // FAT32 only
+#define ENTRY_FIRST_CLUSTER_HIGH_OFFSET2 21
 #define ENTRY_SIZE_OFFSET 28
 #define ENTRY_SIZE_BYTES 4
 
@@ -109,7 +171,51 @@
 
 
 #define DIR_HANDLE_OFFSET 64 //TODO: figure out what this is
-#define FIRST_DATA_SECTOR_NUM 33 //TODO: figure out what this is
+
+#define MAX_DIRECTORY_DEPTH 128
+#define ENTRY_NAME_MAX (ENTRY_FILENAME_BYTES + 1 + ENTRY_EXTENSION_BYTES) // "NAME.EXT"
+#define CARVED_DIRECTORY_NAME "CARVED" // where carved files show up in the listing
+#define ENTRY_PATH_MAX (MAX_DIRECTORY_DEPTH * (ENTRY_NAME_MAX + 1) + 1)
+#define ENTRY_ARENA_CHUNK_BYTES (64 * 1024)
+#define ENTRY_BLOCK 64 // directory entries classified at a time, one bit each
+
+#define BATCH_PREFETCH_PER_LANE 1 // images opened ahead of the lanes that will parse them
+#define BATCH_IMAGE_GLOB "*.img"
+#define BATCH_LISTING_SUFFIX ".txt"
+
+#define NO_FD -1
+#define CATALOG_SUFFIX ".cat" // written next to the image it describes
+#define COMMAND_INDEX "index"
+#define COMMAND_LIST "ls"
+#define COMMAND_EXTRACT "extract"
+#define COMMAND_CHECK "check"
+#define COMMAND_SERVE "serve"
+#define OUTPUT_FILE_MODE 0644
+#define OUTPUT_DIRECTORY_MODE 0755
+#define OUTPUT_FILENAME_MAX PATH_MAX
+
+#define STREAM_PATH "-" // reads the image from standard input
+#define STREAM_DEFAULT_BUDGET ((byte_count)64 * 1024 * 1024)
+#define STREAM_CHUNK_BYTES (1024 * 1024) // read from the stream at a time
+#define STREAM_OPEN_FILES 64 // output files kept open while streaming
+#define STREAM_PART_NAME ".stream%zu.part" // where a streamed file collects until it is numbered
+
+#define IMAGE_PIECE_BYTES (1024 * 1024) // of a device image copied out of its reader at a time
+
+#define ARCHIVE_STDOUT_PATH "-" // writes the archive to standard output
+#define DOS_EPOCH_YEAR 1980
+#define SECONDS_PER_DAY 86400
+#define DOS_DATE_MONTHS 2048 // every year and month a FAT date can hold, bits 15-5
+
+#define DEDUP_BUCKETS 4096 // power of two
+#define DEDUP_PREHASH_BYTES 4096 // of the start of a file, hashed with its size to find candidates
+#define MANIFEST_CHUNK_BYTES (4 * 1024 * 1024) // of clusters hashed by one task
+#define STATS_RECORD_MAX (2 * PATH_MAX + 1024)
+
+#define SERVE_QUEUE_DEPTH 256 // jobs accepted ahead of the lanes, the rest wait in their clients' sockets
+#define SERVE_BACKLOG 64
+#define SERVE_FAT_CACHE_BYTES ((size_t)256 * 1024 * 1024)
+#define SERVE_RESULT_MAX (STATS_RECORD_MAX + 6 * PATH_MAX)
 
 #define ATTR_NULL        0x00  // Binary: 00000000
 #define ATTR_READ_ONLY   0x01  // Binary: 00000001
@@ -119,14 +225,15 @@
 #define ATTR_DIRECTORY   0x10  // Binary: 00010000
 #define ATTR_ARCHIVE     0x20  // Binary: 00100000
 #define ATTR_ROOT     0x80  // Binary: 10000000
+#define ATTR_LONG_NAME   0x0F  // Binary: 00001111
 
 
 
 
 typedef uint8_t byte;
 typedef byte * byte_ptr;
-typedef size_t byte_num;
-typedef size_t byte_count;
+typedef uint64_t byte_num;
+typedef uint64_t byte_count;
 typedef size_t bit_count;
 typedef size_t sector_num;
 typedef size_t cluster_num;
@@ -135,7 +242,7 @@ typedef size_t entry_num;
 typedef enum { false, true } bool;
 typedef byte sector[BYTES_PER_SECTOR];
 typedef unsigned char * string;
-typedef uint16_t fat_entry;
+typedef uint32_t fat_entry;
 
 
 typedef struct TimeStamp {
@@ -144,8 +251,16 @@ typedef struct TimeStamp {
     uint16_t modified;
 } TimeStamp;
 
+typedef struct Extent {
+    cluster_num start;
+    size_t length;
+} Extent;
+
+#define ENTRY_INLINE_EXTENTS 3 // most files are one to three runs
+
 typedef struct Entry {
-    string filepath;
+    struct DiskImage * disk;
+    struct Entry * parent;
     byte  filename[8];
     byte  extension[3];
     byte  attributes;
@@ -157,6 +272,19 @@ typedef struct Entry {
     TimeStamp time;
     string data;
     bool deleted;
+    bool carved;
+    Extent * extents;
+    size_t n_Extents;
+    Extent inline_extents[ENTRY_INLINE_EXTENTS];
+    struct Entry * first_child;
+    struct Entry * last_child;
+    struct Entry * next_sibling;
+    size_t index;
+    size_t stream_file; // its StreamFile while streaming, 0 if it has none
+    byte * digest; // its SHA-256 with -H, NULL otherwise
+    struct Entry * duplicate_of; // an identical file it is linked to instead of written
+    bool expanded; // its directory has been parsed for the library, which does so on demand
+    bool numbered_member; // archived as fileN.EXT, its path being too long or taken already
 } Entry;
 
 typedef struct BootSector {
@@ -166,23 +294,359 @@ typedef struct BootSector {
     size_t n_SectorsPerFat;
     size_t n_BytesPerSector;
     size_t n_SectorsPerCluster;
+    size_t n_ReservedSectors;
+    cluster_num root_cluster;
 } BootSector;
 
+/**
+ * @brief   Where everything is on a volume, worked out from its boot sector
+ */
+typedef struct Geometry {
+    size_t fat_bits;            // FAT12_BITS, FAT16_BITS or FAT32_BITS
+    byte_count sector_bytes;
+    byte_count cluster_bytes;
+    byte_num fat_offset;        // the first FAT
+    byte_count fat_bytes;       // the size of one FAT
+    size_t n_Fats;
+    byte_num root_offset;       // the fixed root directory of FAT12 and FAT16
+    size_t n_RootEntries;
+    cluster_num root_cluster;   // the first cluster of the FAT32 root directory
+    byte_num data_offset;       // cluster CLUSTER_NORMAL_MIN
+    size_t n_Clusters;          // data clusters that are inside the image
+} Geometry;
+
+/**
+ * @brief   What the command line asked for, shared by every image of a run
+ */
+typedef struct Options {
+    bool carve;
+    bool scheduled; // read directories and files in the order they sit in the image
+    byte_count memory_budget; // what a stream may hold back, 0 for STREAM_DEFAULT_BUDGET
+    int archive_format; // ARCHIVE_NONE for a directory of files, else the one archive they go in
+    bool hash; // list SHA-256 digests and write identical files once
+    bool stats; // print one JSON record of stage times and counters per image
+    const char * manifest_path; // the previous run's cluster hashes, replaced by this run's, NULL without --manifest
+    bool direct; // read through the device reader even when the image is a regular file
+    const char * timeline_path; // where every entry's times go sorted, a bodyfile or with .csv a CSV, NULL without --timeline
+    Filter * filter; // which files to extract, NULL without --include, --exclude, --min-size, --max-size or --deleted
+} Options;
+
+/**
+ * @brief   What classifyEntries() found in a block of directory entries, one bit per entry
+ * @details The masks do not overlap, and bits past the end of the block are clear.
+ */
+typedef struct EntryMasks {
+    uint64_t live;
+    uint64_t deleted;   // marked ENTRY_FREE
+    uint64_t skip;      // ".", "..", volume labels and long name slots
+    uint64_t end;       // ENTRY_FREE_AND_LAST, nothing from the first of these on is in use
+} EntryMasks;
+
+/**
+ * @brief   A growable list of entries
+ */
+typedef struct EntryList {
+    Entry ** items;
+    size_t n_Items;
+    size_t capacity;
+} EntryList;
+
+/**
+ * @brief   A directory of one level being read through the ReadPlan
+ */
+typedef struct DirectoryRead {
+    Entry * directory;
+    byte_ptr data;          // its clusters, in chain order
+    size_t n_Clusters;
+} DirectoryRead;
+
+/**
+ * @brief   The output file the ReadPlan is currently writing into
+ */
+typedef struct PlanWriter {
+    const Entry * file;
+    int fd;
+} PlanWriter;
+
+/**
+ * @brief   Takes a run of the image one piece at a time, from visitImageRange()
+ */
+typedef void (*ImageVisitor)(void * a_pContext, const byte * a_pB_Data, size_t a_Length);
+
+/**
+ * @brief   Where copyImagePiece() sends the pieces of a run
+ */
+typedef struct ImageCopy {
+    int fd;             // appended to, NO_FD to only hash
+    Sha256 * hash;      // NULL to only write
+    bool ok;            // cleared by the first write that fails
+} ImageCopy;
+
+/**
+ * @brief   A file written out with -H, which identical files found later are linked to
+ */
+typedef struct HashRecord {
+    Entry * file;
+    uint64_t prehash;
+    bool hashed;                // file->digest is final
+    struct HashRecord * next;   // in the same bucket
+} HashRecord;
+
+/**
+ * @brief   The files of an image written so far, by size and pre-hash
+ */
+typedef struct Dedup {
+    pthread_mutex_t lock;
+    pthread_cond_t hashed;
+    HashRecord * buckets[DEDUP_BUCKETS];
+    size_t n_Duplicates;
+    byte_count saved_bytes;
+} Dedup;
+
+/**
+ * @brief   A file or directory whose clusters are written as the stream reaches them
+ */
+typedef struct StreamFile {
+    Entry * entry;
+    int fd;                 // NO_FD while closed
+    bool created;
+    size_t n_Clusters;
+    size_t n_Received;
+    byte_ptr directory;     // a directory's clusters, gathered until all of them are in
+} StreamFile;
+
+/**
+ * @brief   One destination of a cluster that has not been read yet
+ */
+typedef struct StreamClaim {
+    size_t file;            // index into Stream.files
+    size_t position;        // which of the file's clusters it is
+    uint32_t next;          // the next claim on the same cluster, 1-based, 0 ends the list
+} StreamClaim;
+
+/**
+ * @brief   An allocated cluster that went by before anything was known to own it
+ */
+typedef struct StreamHeld {
+    byte_ptr data;          // NULL once spilled
+    byte_num spill_offset;
+} StreamHeld;
+
+/**
+ * @brief   State of an image read front to back from a pipe
+ * @details Only the metadata is buffered. Every cluster an entry is known to own when the
+ *          cluster arrives goes straight to that entry's file, while an allocated cluster that
+ *          nobody is known to own yet is held back, because it may belong to a directory that
+ *          is found later. Held clusters live in memory up to the budget and spill to a
+ *          temporary file past it. Once every directory is parsed nothing more is held.
+ */
+typedef struct Stream {
+    int fd;
+    byte_count budget;
+    byte_count held_bytes;          // in memory, held clusters and gathered directories
+    cluster_num next_cluster;       // the next cluster to arrive
+    cluster_num last_claimed;       // the last cluster anything waits for
+    bool settled;                   // every directory is parsed
+
+    StreamFile * files;
+    size_t n_Files;
+    size_t capacity_Files;
+    StreamClaim * claims;
+    size_t n_Claims;
+    size_t capacity_Claims;
+    uint32_t * first_claim;         // per cluster, 1-based into claims
+    StreamHeld * held;
+    size_t n_Held;
+    size_t capacity_Held;
+    uint32_t * held_at;             // per cluster, 1-based into held
+    size_t n_Spilled;
+    size_t n_OpenDirectories;
+
+    FILE * spill;
+    byte_count spill_bytes;
+    byte_ptr scratch;               // one cluster read back from the spill file
+
+    size_t open_files[STREAM_OPEN_FILES];
+    size_t n_OpenFiles;
+    size_t next_victim;
+} Stream;
+
+/**
+ * @brief   Where one image's time went and what came out of it, printed with --stats
+ * @details Stage times are seconds on the monotonic clock. Counters that extraction tasks
+ *          bump are added atomically, the rest are only touched by the thread running the image.
+ */
+typedef struct Stats {
+    double boot_parse;      // boot sector and geometry
+    double fat_decode;      // the FAT and the cluster bitmap
+    double directory_walk;  // every directory, down to the last entry
+    double data_hash;       // hashing every cluster against the previous manifest
+    double data_copy;       // numbering files, following their chains and copying or queuing them
+    double output_write;    // waiting for queued writes, linking duplicates, closing the archive
+    size_t n_Directories;
+    size_t n_Deleted;       // deleted files among those listed
+    size_t n_Carved;
+    size_t n_ChangedClusters;
+    size_t n_Unchanged;     // files the previous run wrote that were left alone
+    size_t n_Damaged;       // files with sectors the device reader zero-filled
+    size_t n_Filtered;      // entries the filter left out, a pruned directory counts once
+    bool fat_cached;        // the FAT came decoded out of serve's cache
+    byte_count bytes_written;
+} Stats;
+
+/**
+ * @brief   What --manifest compares an image against
+ * @details The previous manifest is kept for its file records even when the volume's geometry
+ *          changed, every cluster then counts as changed.
+ */
+typedef struct Incremental {
+    Manifest * previous;    // NULL on the first run
+    Manifest * current;     // saved over the previous one once the image is done
+    uint64_t * changed;     // one bit per cluster number whose data differs from the previous run
+    byte_count skipped_bytes;
+} Incremental;
+
+/**
+ * @brief   A run of clusters for one hashing task
+ */
+typedef struct ClusterHashRange {
+    struct DiskImage * disk;
+    cluster_num first;
+    size_t n_Clusters;
+} ClusterHashRange;
+
 typedef struct DiskImage {
     BootSector * p_BootSector;
+    Geometry geometry;
     byte_ptr * p_FatTables;
+    fat_entry * p_NextCluster;
+    size_t n_FatEntries;
+    size_t capacity_FatEntries;
+    uint32_t * p_RunLength;     // with serve, the clusters a chain takes in a row from each cluster on
+    size_t capacity_RunLengths;
+    bool runs_ready;            // whether p_RunLength describes the open image
+    uint64_t * p_AllocatedClusters;
+    uint64_t * p_ClaimedClusters;
+    size_t capacity_AllocatedWords;
     byte_ptr p_Root;
     Entry * p_RootEntry;
     byte_ptr p_DataArea;
-    size_t bytes;
+    string p_Data;
+    byte_count bytes;
+    byte_count metadata_bytes;
+    int fd;
+    bool mapped;
+    string p_ReadBuffer;
+    size_t capacity_ReadBuffer;
+    string output_directory;
+    FILE * listing;
+    size_t n_Files;
+    ThreadPool * pool;
+    Arena * arena;
+    const Options * options;
+    Stream * stream;
+    ReadPlan * plan;
+    OutputWriter * writer;     // creates fileN.EXT in output_directory and batches their writes
+    Archive * archive;          // takes the place of output_directory with --format
+    Dedup * dedup;              // with -H
+    EntryList emitted;          // with -H, files in index order until their digests are listed
+    EntryList * next_level;     // where subdirectories go while parsing level by level
+    string image_path;
+    Stats stats;
+    FatReport fat_report;       // what merging the FAT copies and checking the chains found
+    FILE * fat_issues;          // where check prints every issue, NULL to only count them
+    Incremental * incremental;  // with --manifest
+    DeviceReport device;        // what the device reader could not read, empty for other images
+    DeviceReader * reader;      // reads a device image's clusters on demand, NULL for other images
+    FatCache * fat_cache;       // with serve, decoded FATs shared by every lane
+    FatCacheKey image_key;      // the open image, for fat_cache
+    bool cacheable;             // whether image_key identifies an unchanged file
+    Timeline * timeline;        // with --timeline, the times of every entry emitted
+    const char * timeline_label; // in a batch, the image name put in front of its timeline paths
 } DiskImage;
 
+/**
+ * @brief   Shared state of a batch run
+ * @details A reader thread opens images into free DiskImage slots and queues them, lanes take
+ *          them off the queue, parse and extract, and hand the slot back for the next image.
+ *          The number of slots bounds how many images are in flight at once.
+ */
+typedef struct Batch {
+    char ** paths;
+    size_t n_Paths;
+    string output_root;
+    const Options * options;
+
+    DiskImage ** slots;
+    size_t n_Slots;
+    DiskImage ** free_slots;
+    size_t n_Free;
+    DiskImage ** ready;
+    size_t * ready_index;
+    size_t ready_head;
+    size_t n_Ready;
+    bool reading_done;
+    size_t n_Failed;
+    Timeline ** timelines;  // with --timeline, each processed image's, by position in the batch
+
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t image_ready;
+} Batch;
+
+/**
+ * @brief   One connection to serve, freed once it is closed and its last job answered
+ */
+typedef struct ServeClient {
+    struct Server * server;
+    int fd;
+    size_t n_Jobs;              // numbers the client's jobs in the order it sent them
+    size_t n_Refs;              // the connection's reader and each of its unanswered jobs
+    pthread_mutex_t write_lock; // results go out one whole line at a time
+} ServeClient;
+
+/**
+ * @brief   One job line, "image<TAB>output[<TAB>options]", with the line holding its strings
+ */
+typedef struct ServeJob {
+    ServeClient * client;
+    size_t id;
+    char * line;
+    char * image;
+    char * output;
+    Options options;
+} ServeJob;
+
+/**
+ * @brief   Shared state of serve
+ * @details Each connection has a reader thread that parses job lines into a bounded queue, and
+ *          a fixed set of lanes, each with a DiskImage kept warm from job to job, takes jobs off
+ *          it. A reader blocks while the queue is full and stops reading its socket, so a
+ *          client sending faster than the lanes extract is held back by its own socket.
+ */
+typedef struct Server {
+    const Options * defaults;
+    FatCache * fat_cache;
+
+    ServeJob ** queue;
+    size_t queue_head;
+    size_t n_Queued;
+    bool stopping;
+    size_t n_Jobs;
+    size_t n_Failed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t slot_free;
+} Server;
+
 
 // Directory * g_pD_Root;
-string g_ImageData;
-DiskImage * g_Disk;
+static volatile sig_atomic_t s_ServeStopping = 0;
 
-void observeAndReport(bool a_Condition, string a_Message);
+void printUsage(void);
+bool parseByteCount(const char * a_Text, byte_count * a_pBytes);
+Filter * requireFilter(Options * a_pOptions);
 bool testPointer(string a_Ptr, byte_count a_Length);
 
 bool printBinary(uint64_t a_Number, bit_count bits, bool use_Prefix);
@@ -191,14 +655,174 @@ void printData(byte_ptr const a_pB_Data, byte_num a_n_Length);
 
 int readSector(int fd, sector_num a_sector, sector * buffer);
 fat_entry get_fat_entry(sector * fat_sector, entry_num entry_number);
-
-string formatFileNaming(byte_ptr a_pB_Data, size_t a_Length);
-
-string openFile(string a_Filename);
-byte_ptr getBootSector(string a_pB_Data);
-void parseFileSystem(string a_pB_Data);
+void decodeFat(DiskImage * a_Disk, string a_pB_Data);
+void decodeFatTable(size_t a_Bits, const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries);
+void mendFat(DiskImage * a_Disk, string a_pB_Data);
+size_t fatEntryCount(const Geometry * a_pGeometry);
+void reserveFatTable(DiskImage * a_Disk, size_t a_n_Entries);
+bool loadCachedFat(DiskImage * a_Disk);
+void reserveRunLengths(DiskImage * a_Disk, size_t a_n_Entries);
+void buildRunLengths(DiskImage * a_Disk);
+void printFatIssue(void * a_pContext, int a_Kind, uint32_t a_First, uint32_t a_Last, uint32_t a_Value);
+int runCheckCommand(DiskImage * a_Disk, string a_ImagePath);
+void unpackFatScalar(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Pairs);
+void decodeFat12(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries);
+void decodeFat16(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries);
+void decodeFat32(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries);
+void buildClusterBitmap(DiskImage * a_Disk);
+bool isClusterAllocated(const DiskImage * a_Disk, cluster_num a_Cluster);
+size_t freeRunLength(const DiskImage * a_Disk, cluster_num a_Start, size_t a_n_Max);
+size_t countFreeClusters(const DiskImage * a_Disk);
+size_t clearRunLength(const uint64_t * a_pWords, size_t a_n_Bits, size_t a_Start, size_t a_n_Max);
+size_t nextClearBit(const uint64_t * a_pWords, size_t a_n_Bits, size_t a_Start);
+void claimClusters(DiskImage * a_Disk, cluster_num a_Start, size_t a_Length);
+void carveUnallocated(DiskImage * a_Disk);
+int clusterSignature(const DiskImage * a_Disk, cluster_num a_Cluster);
+byte_count carvedLength(const DiskImage * a_Disk, cluster_num a_Cluster, int a_Signature, byte_count a_Limit);
+Entry * makeCarvedEntry(DiskImage * a_Disk, Entry ** a_pFolder, cluster_num a_Cluster, int a_Signature, byte_count a_Length);
+
+void formatFileNaming(byte_ptr a_pB_Data, size_t a_Length, byte_ptr a_pB_Formatted);
+uint16_t combineTwoBytes(byte bigByte, byte littleByte);
+uint32_t combineFourBytes(byte_ptr a_pB_Data);
+int64_t dosTimestamp(uint16_t a_Date, uint16_t a_Time);
+size_t trimmedLength(const byte * a_pB_Name, size_t a_Length);
+
+DiskImage * createDiskImage(void);
+void destroyDiskImage(DiskImage * a_Disk);
+void processImage(DiskImage * a_Disk, string a_ImagePath, string a_OutputDirectory, FILE * a_Listing);
+void processOpenedImage(DiskImage * a_Disk);
+double secondsSince(const struct timespec * a_pStart);
+void printStats(const DiskImage * a_Disk);
+int formatStats(const DiskImage * a_Disk, char * a_Buffer, size_t a_Capacity);
+size_t jsonEscape(const char * a_Text, char * a_Buffer, size_t a_Capacity);
+bool isScheduled(const DiskImage * a_Disk);
+void parseScheduled(DiskImage * a_Disk);
+void parseDirectoryLevel(DiskImage * a_Disk, const EntryList * a_Level);
+void deliverDirectoryPiece(void * a_pContext, const ReadPiece * a_pPiece, const byte * a_pB_Data);
+void planExtraction(Entry * a_Entry);
+void extractScheduled(DiskImage * a_Disk);
+void deliverFilePiece(void * a_pContext, const ReadPiece * a_pPiece, const byte * a_pB_Data);
+void appendEntry(EntryList * a_List, Entry * a_Entry);
+bool isStreamInput(string a_ImagePath);
+void streamImage(DiskImage * a_Disk, string a_ImagePath);
+size_t readStream(int a_Fd, byte_ptr a_pB_Buffer, size_t a_Length);
+void planStreamedEntry(DiskImage * a_Disk, Entry * a_Entry);
+void receiveStreamedCluster(DiskImage * a_Disk, cluster_num a_Cluster, const byte * a_pB_Data);
+void deliverStreamedCluster(DiskImage * a_Disk, size_t a_File, size_t a_Position, const byte * a_pB_Data);
+void parseStreamedDirectory(DiskImage * a_Disk, size_t a_File);
+void holdStreamedCluster(Stream * a_Stream, cluster_num a_Cluster, const byte * a_pB_Data, byte_count a_Length);
+const byte * heldClusterData(Stream * a_Stream, cluster_num a_Cluster, byte_count a_Length);
+void releaseHeldCluster(Stream * a_Stream, cluster_num a_Cluster, byte_count a_Length);
+void settleStream(Stream * a_Stream, byte_count a_ClusterBytes);
+int streamFileDescriptor(DiskImage * a_Disk, size_t a_File);
+bool streamPartPath(const DiskImage * a_Disk, size_t a_File, char * a_Buffer, size_t a_Capacity);
+void finishStreamedFile(Entry * a_Entry);
+void reserveItems(void ** a_pItems, size_t * a_pCapacity, size_t a_n_Needed, size_t a_ItemBytes);
+bool writeAt(int a_Fd, const byte * a_pB_Data, byte_count a_Length, byte_num a_Offset);
+size_t materializePath(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity);
+
+string openFile(DiskImage * a_Disk, string a_Filename);
+string openDeviceImage(DiskImage * a_Disk, string a_Filename);
+string reserveReadBuffer(DiskImage * a_Disk, size_t a_Bytes);
+void closeFile(DiskImage * a_Disk);
+void prefetchMetadata(DiskImage * a_Disk);
+byte_ptr getBootSector(DiskImage * a_Disk, string a_pB_Data);
+void readBootSector(const byte * a_pB_Data, BootSector * a_pBoot);
+bool computeGeometry(const BootSector * a_pBoot, byte_count a_ImageBytes, Geometry * a_pGeometry);
+void floppyGeometry(Geometry * a_pGeometry, byte_count a_ImageBytes);
+byte_count metadataSpan(const byte * a_pB_Data, byte_count a_ImageBytes);
+void parseFileSystem(DiskImage * a_Disk, string a_pB_Data);
+void prepareFileSystem(DiskImage * a_Disk, string a_pB_Data);
 void handleDirectory(Entry * a_ParentEntry, byte_ptr a_sector, size_t depth, bool a_ParentDeleted);
+bool handleDirectoryEntries(Entry * a_ParentEntry, byte_ptr a_pB_Entries, size_t a_n_Entries, size_t depth, bool a_ParentDeleted);
+void handleChildEntry(Entry * a_ParentEntry, Entry * a_ChildEntry);
+bool isSelected(const Entry * a_Entry);
+void classifyEntries(const byte * a_pB_Entries, size_t a_n_Entries, EntryMasks * a_pMasks);
 void makeData(Entry * a_Entry, string a_pDiskSector);
+byte_num clusterOffset(const DiskImage * a_Disk, cluster_num a_Cluster);
+byte_ptr getClusterData(const DiskImage * a_Disk, cluster_num a_Cluster);
+void readImage(const DiskImage * a_Disk, byte_num a_Offset, size_t a_Length, byte_ptr a_pB_Buffer);
+byte_ptr imageBytes(const DiskImage * a_Disk, byte_num a_Offset, size_t a_Length, byte_ptr * a_ppCopy);
+void visitImageRange(const DiskImage * a_Disk, byte_num a_Offset, byte_count a_Length, ImageVisitor a_Visit, void * a_pContext);
+void copyImagePiece(void * a_pContext, const byte * a_pB_Data, size_t a_Length);
+cluster_num getNextCluster(const DiskImage * a_Disk, cluster_num a_Cluster);
+bool isValidCluster(const DiskImage * a_Disk, cluster_num a_Cluster);
+void buildExtents(Entry * a_Entry, size_t a_n_MaxClusters);
+void recoverExtent(Entry * a_Entry, size_t a_n_MaxClusters);
+void freeExtents(Entry * a_Entry);
+void reportDamage(Entry * a_Entry);
+
+void makeOutputDirectory(string a_DirectoryPath);
+void openOutput(DiskImage * a_Disk);
+bool closeArchiveOutput(DiskImage * a_Disk);
+void archiveOutput(Entry * a_Entry);
+void writeOutputFile(Entry * a_Entry, HashRecord * a_pRecord);
+bool isHashing(const DiskImage * a_Disk);
+void prepareDedup(DiskImage * a_Disk);
+void destroyDedup(Dedup * a_pDedup);
+void listFile(Entry * a_Entry);
+void printListing(DiskImage * a_Disk);
+byte_count recoverableBytes(const Entry * a_Entry);
+void hashEntry(Entry * a_Entry);
+HashRecord * dedupFile(Entry * a_Entry);
+void publishDigest(DiskImage * a_Disk, HashRecord * a_pRecord);
+void linkDuplicates(DiskImage * a_Disk);
+void writeOutput(Entry * a_Entry);
+void prepareIncremental(DiskImage * a_Disk);
+void hashClustersTask(void * a_pArgument);
+uint64_t entrySignature(const Entry * a_Entry, const char * a_Path);
+bool touchesChangedCluster(const Entry * a_Entry, byte_count a_Bytes);
+bool skipUnchangedOutput(Entry * a_Entry);
+void finishIncremental(DiskImage * a_Disk);
+void destroyIncremental(DiskImage * a_Disk);
+const char * deltaName(unsigned a_Status);
+bool outputPathFor(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity);
+bool outputNameFor(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity);
+bool memberNameFor(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity);
+bool copyImageRange(const DiskImage * a_Disk, int a_OutputFd, byte_num a_Offset, byte_count a_Length);
+bool printFileLine(const Entry * const e);
+
+void addChild(Entry * a_ParentEntry, Entry * a_ChildEntry);
+void runTask(DiskImage * a_Disk, TaskFunction a_Function, void * a_pArgument);
+void waitForTasks(DiskImage * a_Disk);
+void directoryTask(void * a_pArgument);
+void extractTask(void * a_pArgument);
+void extractFile(Entry * a_Entry);
+void emitDirectory(Entry * a_DirectoryEntry);
+void addTimelineEntry(const Entry * a_Entry);
+unsigned entryStatus(const Entry * const e);
+const char * statusName(unsigned a_Status);
+
+bool stampImage(string a_ImagePath, CatalogStamp * a_pStamp);
+bool catalogPathFor(string a_ImagePath, char * a_Buffer, size_t a_Capacity);
+void indexImage(DiskImage * a_Disk, string a_ImagePath, const char * a_CatalogPath, const CatalogStamp * a_pStamp);
+void catalogDirectory(CatalogBuilder * a_pBuilder, Entry * a_DirectoryEntry);
+Catalog * loadCatalog(DiskImage * a_Disk, string a_ImagePath, bool a_Rebuild);
+int runCatalogCommand(DiskImage * a_Disk, const char * a_Command, char ** a_Arguments, int a_n_Arguments);
+
+void expandDirectory(Entry * a_Directory);
+Entry * lookupEntry(DiskImage * a_Disk, const char * a_Path);
+size_t formatEntryName(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity);
+void fillVolumeStat(const Entry * a_Entry, VolumeStat * a_pStat);
+void recoverVolume(Volume * a_pVolume);
+
+void addBatchPath(Batch * a_Batch, const char * a_Path);
+bool collectBatchPaths(Batch * a_Batch, string a_Source);
+bool processBatchImage(Batch * a_Batch, DiskImage * a_Disk, size_t a_Index);
+size_t runBatch(string a_Source, string a_OutputRoot, size_t a_n_Lanes, const Options * a_Options);
+void * batchReaderMain(void * a_pArgument);
+void * batchLaneMain(void * a_pArgument);
+
+int runServer(const char * a_SocketPath, size_t a_n_Lanes, const Options * a_Options);
+void stopServer(int a_Signal);
+void * serveClientMain(void * a_pArgument);
+void * serveLaneMain(void * a_pArgument);
+const char * parseServeJob(ServeJob * a_Job);
+bool queueServeJob(Server * a_Server, ServeJob * a_Job);
+void runServeJob(DiskImage * a_Disk, ServeJob * a_Job);
+void sendServeResult(ServeJob * a_Job, const DiskImage * a_Disk, const char * a_Status, const char * a_Error);
+void releaseServeClient(ServeClient * a_Client);
+void freeServeJob(ServeJob * a_Job);
 
 Entry * generateEntry(Entry * a_ParentEntry, byte_ptr a_byteLocation, size_t depth, bool a_ParentDeleted);
 
@@ -209,53 +833,290 @@ bool isSystem(const Entry * const e);
 bool isVolumeLabel(const Entry * const e);
 bool isDirectory(const Entry * const e);
 bool isArchive(const Entry * const e);
+bool isLongName(const Entry * const e);
+
+/**
+ * @brief   What openVolume() hands out, an image with its boot sector and FAT decoded
+ */
+struct Volume {
+    DiskImage * disk;
+    char * path;
+};
+
+/**
+ * @brief   A file opened for reading, its extents are built by the first read
+ */
+struct VolumeFile {
+    Volume * volume;
+    Entry * entry;
+    byte_num * run_ends; // the file offset each extent ends at, NULL until the first read
+};
 
+/**
+ * @brief   A directory being listed, its entries are parsed when it is opened
+ */
+struct VolumeDirectory {
+    Volume * volume;
+    Entry * next;
+};
+
+#ifndef NOTJUSTCATS_LIBRARY
 /**
  * @brief Takes a file system image and outputs the files and directories
 */
 int main(int argc, char * argv[])
 {
+    size_t n_Threads = ZERO;
+    bool batch = false;
+    Options options;
+    memset(&options, ZERO, sizeof(Options));
+
+    static const struct option s_LongOptions[] = {
+        { "format", required_argument, NULL, 'f' },
+        { "hash", no_argument, NULL, 'H' },
+        { "stats", no_argument, NULL, 'S' },
+        { "manifest", required_argument, NULL, 'M' },
+        { "direct", no_argument, NULL, 'D' },
+        { "timeline", required_argument, NULL, 'T' },
+        { "include", required_argument, NULL, 'I' },
+        { "exclude", required_argument, NULL, 'X' },
+        { "min-size", required_argument, NULL, 'z' },
+        { "max-size", required_argument, NULL, 'Z' },
+        { "deleted", required_argument, NULL, 'd' },
+        { NULL, ZERO, NULL, ZERO },
+    };
+
+    byte_count min_size = ZERO;
+    byte_count max_size = UINT64_MAX;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "j:bcsm:f:H", s_LongOptions, NULL)) != -1)
+    {
+        if (option == 'j') {
+            char * end = NULL;
+            long requested = strtol(optarg, &end, 10);
+            observeAndReport(end != optarg && *end == NULL_CHAR && requested > 0, "Error: -j expects a positive thread count");
+            n_Threads = (size_t)requested;
+            continue;
+        }
+        if (option == 'b') {
+            batch = true;
+            continue;
+        }
+        if (option == 'c') {
+            options.carve = true;
+            continue;
+        }
+        if (option == 's') {
+            options.scheduled = true;
+            continue;
+        }
+        if (option == 'H') {
+            options.hash = true;
+            continue;
+        }
+        if (option == 'S') {
+            options.stats = true;
+            continue;
+        }
+        if (option == 'M') {
+            options.manifest_path = optarg;
+            continue;
+        }
+        if (option == 'D') {
+            options.direct = true;
+            continue;
+        }
+        if (option == 'T') {
+            options.timeline_path = optarg;
+            continue;
+        }
+        if (option == 'I') {
+            observeAndReport(filterInclude(requireFilter(&options), optarg), "Error: --include expects a pattern");
+            continue;
+        }
+        if (option == 'X') {
+            observeAndReport(filterExclude(requireFilter(&options), optarg), "Error: --exclude expects a pattern");
+            continue;
+        }
+        if (option == 'z' || option == 'Z') {
+            byte_count bytes = ZERO;
+            observeAndReport(parseByteCount(optarg, &bytes), "Error: --min-size and --max-size expect a size such as 64K");
+            if (option == 'z') min_size = bytes;
+            else max_size = bytes;
+            filterSizeRange(requireFilter(&options), min_size, max_size);
+            continue;
+        }
+        if (option == 'd') {
+            int mode = FILTER_DELETED_ALL;
+            if (strcmp(optarg, "only") == ZERO) mode = FILTER_DELETED_ONLY;
+            else if (strcmp(optarg, "none") == ZERO) mode = FILTER_DELETED_NONE;
+            else observeAndReport(strcmp(optarg, "all") == ZERO, "Error: --deleted expects all, only or none");
+            filterDeleted(requireFilter(&options), mode);
+            continue;
+        }
+        if (option == 'f') {
+            options.archive_format = archiveFormatByName(optarg);
+            observeAndReport(options.archive_format != ARCHIVE_NONE, "Error: --format expects tar or cpio");
+            continue;
+        }
+        if (option == 'm') {
+            byte_count requested = ZERO;
+            observeAndReport(parseByteCount(optarg, &requested) && requested > 0, "Error: -m expects a memory budget such as 256M");
+            options.memory_budget = requested;
+            continue;
+        }
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+
+    // Carving looks at every unclaimed cluster, including those of files left unread
+    observeAndReport(options.filter == NULL || !options.carve, "Error: filters cannot be combined with -c");
+
+    // index, ls and extract work through the catalog kept next to the image
+    if (argc - optind >= 2 && !batch) {
+        const char * command = argv[optind];
+        if (strcmp(command, COMMAND_SERVE) == ZERO && argc - optind == 2) {
+            // A timeline gathers a whole run, and serve never finishes one
+            observeAndReport(options.timeline_path == NULL, "Error: --timeline cannot be combined with serve");
+            int status = runServer(argv[optind + 1], n_Threads > ZERO ? n_Threads : 1, &options);
+            destroyFilter(options.filter);
+            return status;
+        }
+
+        // A catalog describes the whole image, and check reads all of it
+        bool const whole = strcmp(command, COMMAND_CHECK) == ZERO || strcmp(command, COMMAND_INDEX) == ZERO
+            || strcmp(command, COMMAND_LIST) == ZERO || strcmp(command, COMMAND_EXTRACT) == ZERO;
+        observeAndReport(!whole || options.filter == NULL, "Error: filters cannot be combined with check, index, ls or extract");
+
+        if (strcmp(command, COMMAND_CHECK) == ZERO && argc - optind == 2) {
+            DiskImage * disk = createDiskImage();
+            disk->options = &options;
+            int status = runCheckCommand(disk, (string)argv[optind + 1]);
+            destroyDiskImage(disk);
+            return status;
+        }
+        if (strcmp(command, COMMAND_INDEX) == ZERO || strcmp(command, COMMAND_LIST) == ZERO || strcmp(command, COMMAND_EXTRACT) == ZERO) {
+            DiskImage * disk = createDiskImage();
+            disk->pool = n_Threads > 1 ? createThreadPool(n_Threads) : NULL;
+            disk->options = &options;
+            int status = runCatalogCommand(disk, command, argv + optind + 1, argc - optind - 1);
+            destroyThreadPool(disk->pool);
+            disk->pool = NULL;
+            destroyDiskImage(disk);
+            return status;
+        }
+    }
+
     // Validate command line arguments
-    if (argc != 3) {
-        printf("Usage: ./notjustcats <disk_image_filename> <output_directory_path>\n");
+    if (argc - optind != 2) {
+        printUsage();
         exit(EXIT_FAILURE);
     }
 
-    char * pc_ImagePath = argv[1];
-    char * pc_OutputDirectoryName = argv[2];
+    char * pc_ImagePath = argv[optind];
+    char * pc_OutputDirectoryName = argv[optind + 1];
+
+    // An archive is written front to back, which neither reading out of order can do
+    if (options.archive_format != ARCHIVE_NONE) {
+        observeAndReport(!options.scheduled && (batch || !isStreamInput((string)pc_ImagePath)), "Error: --format cannot be combined with -s or a streamed image");
+    }
+
+    // and so is a digest, which is taken as each file is written
+    if (options.hash) {
+        observeAndReport(!options.scheduled && (batch || !isStreamInput((string)pc_ImagePath)), "Error: -H cannot be combined with -s or a streamed image");
+    }
 
-    fprintf(stderr, "Image file: %s\n", pc_ImagePath);
-    fprintf(stderr, "Output directory: %s\n", pc_OutputDirectoryName);
+    // and so is skipping unchanged files, which needs every file written by writeOutput() and
+    // one manifest per image
+    if (options.manifest_path != NULL) {
+        observeAndReport(!batch && !options.scheduled && !options.hash && options.archive_format == ARCHIVE_NONE && !isStreamInput((string)pc_ImagePath),
+            "Error: --manifest cannot be combined with -b, -s, -H, --format or a streamed image");
+    }
 
-    g_Disk = (DiskImage *)malloc(sizeof(DiskImage));
-    observeAndReport(g_Disk != NULL, "DiskImage is null");
+    // A stream is read as it arrives, there is no device to read around its bad sectors
+    if (options.direct) {
+        observeAndReport(batch || !isStreamInput((string)pc_ImagePath), "Error: --direct cannot be combined with a streamed image");
+    }
 
-    g_Disk->p_Root = (byte_ptr)malloc(sizeof(byte));
-    observeAndReport(g_Disk->p_Root != NULL, "p_Root is null");
+    // A batch source is a manifest of image paths, a directory of *.img files or a glob
+    if (batch) {
+        size_t n_Failed = runBatch((string)pc_ImagePath, (string)pc_OutputDirectoryName, n_Threads > ZERO ? n_Threads : 1, &options);
+        destroyFilter(options.filter);
+        return n_Failed == ZERO ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    g_ImageData = openFile(pc_ImagePath);
+    logInfo("Image file: %s\n", pc_ImagePath);
+    logInfo("Output directory: %s\n", pc_OutputDirectoryName);
 
-    parseFileSystem(g_ImageData);
+    DiskImage * disk = createDiskImage();
+    disk->pool = n_Threads > 1 ? createThreadPool(n_Threads) : NULL;
+    disk->options = &options;
 
-    // // Output
-    // printDirectory(g_pD_Root->head);
+    // With the archive on standard output the listing moves out of its way
+    bool const archiveToStdout = options.archive_format != ARCHIVE_NONE && strcmp(pc_OutputDirectoryName, ARCHIVE_STDOUT_PATH) == ZERO;
+    if (options.timeline_path != NULL) {
+        disk->timeline = createTimeline();
+        observeAndReport(disk->timeline != NULL, "Error allocating memory for timeline");
+    }
+    processImage(disk, (string)pc_ImagePath, (string)pc_OutputDirectoryName, archiveToStdout ? stderr : stdout);
+    if (options.timeline_path != NULL) {
+        observeAndReport(writeTimeline(disk->timeline, options.timeline_path, timelineFormatForPath(options.timeline_path)), "Error writing timeline");
+    }
 
-    // // Write output to pc_OutputDirectoryName
-    // writeOutput(pc_OutputDirectoryName);
+    destroyThreadPool(disk->pool);
+    disk->pool = NULL;
+    destroyDiskImage(disk);
+    destroyFilter(options.filter);
 
     return(EXIT_SUCCESS);
 }
 
+#endif // NOTJUSTCATS_LIBRARY
+
 /**
- * @brief Custom assert function
- * @param a_Condition   The condition to check
- * @param a_Message     The message to print if the condition is false
-*/
-void observeAndReport(bool a_Condition, string a_Message)
+ * @brief   Prints how to call the program
+ */
+void printUsage(void)
+{
+    printf("Usage: ./notjustcats [-j threads] [-b] [-c] [-s] [-m budget] [-H] [--stats] [--format=tar|cpio] [--manifest=path] [--direct] [--timeline=path] [--include=glob] [--exclude=glob] [--min-size=N] [--max-size=N] [--deleted=all|only|none] <disk_image_filename|batch_source|-> <output_directory_path|archive_path|->\n");
+    printf("       ./notjustcats [-j threads] index <disk_image_filename>\n");
+    printf("       ./notjustcats ls <disk_image_filename>\n");
+    printf("       ./notjustcats check <disk_image_filename>\n");
+    printf("       ./notjustcats [-j lanes] [options] serve <socket_path>\n");
+    printf("       ./notjustcats extract <disk_image_filename> <path> <output_filename>\n");
+}
+
+/**
+ * @brief   Reads a count of bytes, optionally followed by K, M or G
+ * @param a_Text    The count
+ * @param a_pBytes  Receives the bytes
+ * @return  Whether a_Text was a count
+ */
+bool parseByteCount(const char * a_Text, byte_count * a_pBytes)
+{
+    char * end = NULL;
+    unsigned long long requested = strtoull(a_Text, &end, 10);
+    int shift = ZERO;
+    if (*end == 'K' || *end == 'k') shift = 10;
+    else if (*end == 'M' || *end == 'm') shift = 20;
+    else if (*end == 'G' || *end == 'g') shift = 30;
+    if (shift != ZERO) end++;
+    if (end == a_Text || *end != NULL_CHAR || *a_Text == '-') return false;
+    *a_pBytes = (byte_count)requested << shift;
+    return true;
+}
+
+/**
+ * @brief   Gives the options a filter the first time a filtering option asks for one
+ * @param a_pOptions    The options
+ * @return  The filter
+ */
+Filter * requireFilter(Options * a_pOptions)
 {
-    if (a_Condition) return;
-    fprintf(stderr, "Assertion failed: %s\n", a_Message);
-    exit(EXIT_FAILURE);
+    if (a_pOptions->filter == NULL) a_pOptions->filter = createFilter();
+    observeAndReport(a_pOptions->filter != NULL, "Error allocating memory for filter");
+    return a_pOptions->filter;
 }
 
 /**
@@ -280,331 +1141,4889 @@ bool testPointer(string ptr, byte_count length)
 }
 
 /**
- * @brief   Opens a file and returns a pointer to the data
- * @param a_Filename    The name of the file to open
- * @return  A pointer to a dynamically allocated array of bytes containing the data
+ * @brief   Allocates an empty DiskImage
+ * @details Everything an image needs is hung off its DiskImage, so several can be live at once.
+ *          A DiskImage can be reused for image after image, keeping its buffers.
+ * @return  The new DiskImage
  */
-string openFile(string a_Filename)
+DiskImage * createDiskImage(void)
 {
-    FILE * pF_Input = fopen(a_Filename, "rb");
-    observeAndReport(pF_Input != NULL, "Error opening file");
+    DiskImage * disk = (DiskImage *)calloc(1, sizeof(DiskImage));
+    observeAndReport(disk != NULL, "DiskImage is null");
 
-    fseek(pF_Input, ZERO, SEEK_END);
-    long l_FileSize = ftell(pF_Input);
-    rewind(pF_Input);
-
-    string pData = (string)malloc(l_FileSize);
-    observeAndReport(pData != NULL, "Error allocating memory for file");
-
-    size_t readSize = fread(pData, sizeof(byte), l_FileSize, pF_Input);
-    observeAndReport(readSize == l_FileSize, "Error reading file");
-    fprintf(stderr, "Read file of size %zu\n", readSize);
-
-    g_Disk->bytes = readSize;
+    disk->fd = NO_FD;
+    return disk;
+}
 
-    fclose(pF_Input);
-    return pData;
+/**
+ * @brief   Frees a DiskImage and the buffers it kept between images
+ * @param a_Disk    The DiskImage to free, its image must be closed
+ */
+void destroyDiskImage(DiskImage * a_Disk)
+{
+    if (a_Disk == NULL) return;
+    free(a_Disk->p_BootSector);
+    free(a_Disk->p_FatTables);
+    free(a_Disk->p_NextCluster);
+    free(a_Disk->p_RunLength);
+    free(a_Disk->p_AllocatedClusters);
+    free(a_Disk->p_ReadBuffer);
+    clearDeviceReport(&a_Disk->device);
+    destroyIncremental(a_Disk);
+    destroyReadPlan(a_Disk->plan);
+    destroyOutputWriter(a_Disk->writer);
+    destroyDedup(a_Disk->dedup);
+    free(a_Disk->emitted.items);
+    destroyArena(a_Disk->arena);
+    destroyTimeline(a_Disk->timeline);
+    free(a_Disk);
 }
 
 /**
- * @brief   Prints the data in a file
- * @param a_pB_Data     The data to print
- * @param a_n_Length    The length of the data
-*/
-void printData(byte_ptr a_pB_Data, byte_num a_n_Length)
+ * @brief   Recovers every file of one image
+ * @param a_Disk            The DiskImage to work in
+ * @param a_ImagePath       The image to read
+ * @param a_OutputDirectory Where the fileN.EXT files go
+ * @param a_Listing         Where the FILE lines go
+ */
+void processImage(DiskImage * a_Disk, string a_ImagePath, string a_OutputDirectory, FILE * a_Listing)
 {
+    a_Disk->output_directory = a_OutputDirectory;
+    a_Disk->listing = a_Listing;
+    openOutput(a_Disk);
 
-    for (byte_num i = 0; i < a_n_Length; i++)
+    // A pipe cannot be mapped or read twice, so it is recovered in one pass as it comes in
+    if (isStreamInput(a_ImagePath))
     {
-        printf("%02X ", a_pB_Data[i]);
-        if (i % 16 == 15) printf("\n"); // Print a new line every 16 bytes //TODO: magic number
+        streamImage(a_Disk, a_ImagePath);
+        return;
     }
-    printf("\n");
+
+    a_Disk->p_Data = openFile(a_Disk, a_ImagePath);
+    processOpenedImage(a_Disk);
 }
 
 /**
- * @brief   Formats file name or extension to be uppercase and space padded
- * @param a_byteLocation     The data to format, non-null terminated
- * @param a_Length      The length of the data
- * @return  The formatted data
+ * @brief   Parses, lists and extracts an image that openFile() has already opened, then closes it
+ * @param a_Disk    The DiskImage holding the open image and its output settings
  */
-string formatFileNaming(byte_ptr a_byteLocation, byte_num a_Length)
+void processOpenedImage(DiskImage * a_Disk)
 {
-    observeAndReport(a_byteLocation != NULL, "Error: a_byteLocation is null");
-    observeAndReport(a_Length == ENTRY_FILENAME_BYTES || a_Length == ENTRY_EXTENSION_BYTES, "Error: a_Length is not 8 or 3");
-    observeAndReport(a_byteLocation != DOT_CHAR, "Error: a_byteLocation is a dot");
+    a_Disk->n_Files = ZERO;
+    memset(&a_Disk->stats, ZERO, sizeof(Stats));
+    struct timespec stage_start;
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
 
-    string formatted = (string)malloc(a_Length);
-    observeAndReport(formatted != NULL, "Error allocating memory for formatted file name");
+    if (a_Disk->archive == NULL)
+    {
+        if (a_Disk->writer == NULL) a_Disk->writer = createOutputWriter();
+        observeAndReport(a_Disk->writer != NULL, "Error allocating memory for output writer");
+        observeAndReport(outputSetDirectory(a_Disk->writer, (char *)a_Disk->output_directory) == ZERO, "Error opening output directory");
+    }
+    if (isHashing(a_Disk)) prepareDedup(a_Disk);
 
-    size_t i;
-    for (i = 0; i < a_Length; i++)
+    if (isScheduled(a_Disk))
     {
-        if (a_byteLocation + i == SPACE_CHAR) { break; }
-        formatted[i] = toupper((unsigned char)a_byteLocation[i]); // might be trouble, was (unsigned char)
+        if (a_Disk->plan == NULL) a_Disk->plan = createReadPlan();
+        observeAndReport(a_Disk->plan != NULL, "Error allocating memory for read plan");
+        parseScheduled(a_Disk);
     }
+    else parseFileSystem(a_Disk, a_Disk->p_Data);
+    waitForTasks(a_Disk);
+    a_Disk->stats.directory_walk = secondsSince(&stage_start) - a_Disk->stats.boot_parse - a_Disk->stats.fat_decode;
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
 
-    // Pad with spaces if i < a_Length
-    for (; i < a_Length; i++)
+    // Every cluster is hashed before the first file is written so that unchanged ones can be skipped
+    if (a_Disk->options != NULL && a_Disk->options->manifest_path != NULL)
     {
-        formatted[i] = SPACE_CHAR;
+        prepareIncremental(a_Disk);
+        a_Disk->stats.data_hash = secondsSince(&stage_start);
+        clock_gettime(CLOCK_MONOTONIC, &stage_start);
     }
 
-    return formatted;
-}
+    // Output, numbered and listed in directory order no matter which thread parsed what
+    emitDirectory(a_Disk->p_RootEntry);
+    if (isScheduled(a_Disk)) extractScheduled(a_Disk);
+    waitForTasks(a_Disk);
+
+    // Carving goes last so that it only sees what recovery through the directories left over
+    if (a_Disk->options != NULL && a_Disk->options->carve)
+    {
+        carveUnallocated(a_Disk);
+        waitForTasks(a_Disk);
+    }
+    a_Disk->stats.data_copy = secondsSince(&stage_start);
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
 
+    // Queued writes point into the image, so they all land before it is closed
+    if (a_Disk->archive != NULL) observeAndReport(closeArchiveOutput(a_Disk), "Error writing archive");
+    else
+    {
+        observeAndReport(outputFlush(a_Disk->writer) == ZERO, "Error writing output file");
+
+        // Duplicates are linked to originals that are complete by now
+        if (isHashing(a_Disk))
+        {
+            linkDuplicates(a_Disk);
+            observeAndReport(outputFlush(a_Disk->writer) == ZERO, "Error writing output file");
+        }
+    }
+    a_Disk->stats.output_write = secondsSince(&stage_start);
+    if (isHashing(a_Disk)) printListing(a_Disk);
+    if (a_Disk->incremental != NULL) finishIncremental(a_Disk);
+    printStats(a_Disk);
+
+    // Every Entry, name and extent list of the image goes in one shot
+    resetArena(a_Disk->arena);
+    a_Disk->p_RootEntry = NULL;
+    closeFile(a_Disk);
+}
 
 /**
- * Combines a big byte and a little byte to form a 16-bit integer.
- *
- * @param bigByte The big byte (bigger 8 bits).
- * @param littleByte The little byte (littleer 8 bits).
- * @return The combined 16-bit integer.
+ * @brief   Measures the time since a stage started
+ * @param a_pStart  When the stage started, from CLOCK_MONOTONIC
+ * @return  The seconds since a_pStart
  */
-uint16_t combineTwoBytes(byte bigByte, byte littleByte)
+double secondsSince(const struct timespec * a_pStart)
 {
-    return (uint16_t)(bigByte << 8) | littleByte;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - a_pStart->tv_sec) + (double)(now.tv_nsec - a_pStart->tv_nsec) / 1e9;
 }
 
 /**
- * @brief   Gets the boot sector from the data
- * @param a_pB_Data The data to get the boot sector from
- * @return  A pointer to the boot sector
+ * @brief   Prints the stage times and counters of an image as one line of JSON on stderr
+ * @details Only with --stats. The line goes out in one write so that batch lanes do not
+ *          interleave theirs.
+ * @param a_Disk    The image just processed
  */
-byte_ptr getBootSector(string a_pB_Data)
+void printStats(const DiskImage * a_Disk)
 {
-    bool check1 = a_pB_Data[BOOT_SIGNATURE_OFFSET1] == BOOT_SIGNATURE_CONSTANT1;
-    bool check2 = a_pB_Data[BOOT_SIGNATURE_OFFSET2] == BOOT_SIGNATURE_CONSTANT2;
-    fprintf(stderr, "Boot Signature Byte 1 is %02X\n", a_pB_Data[BOOT_SIGNATURE_OFFSET1]);
-    fprintf(stderr, "Boot Signature Byte 2 is %02X\n", a_pB_Data[BOOT_SIGNATURE_OFFSET2]);
-    observeAndReport(check1, "Error: Boot Signature Byte 1 is not 0x55");
-    observeAndReport(check2, "Error: Boot Signature Byte 2 is not 0xAA");
-
-
-    byte const bytes_per_sector_big = a_pB_Data[BOOT_BYTES_PER_SECTOR_OFFSET2];
-    byte const bytes_per_sector_lil = a_pB_Data[BOOT_BYTES_PER_SECTOR_OFFSET1];
-    size_t const bytes_per_sector = combineTwoBytes(bytes_per_sector_big, bytes_per_sector_lil);
-
-    size_t const sectors_per_cluster = a_pB_Data[BOOT_SECTORS_PER_CLUSTER_OFFSET];
-
-    size_t const fat_count = a_pB_Data[BOOT_FAT_COUNT_OFFSET];
-
-    byte const rd_entry_count_big = a_pB_Data[BOOT_RD_ENTRY_COUNT_OFFSET2];
-    byte const rd_entry_count_lil = a_pB_Data[BOOT_RD_ENTRY_COUNT_OFFSET1];
-    size_t const rd_entry_count = combineTwoBytes(rd_entry_count_big, rd_entry_count_lil);
-
-    byte const sectors_in_disk_big = a_pB_Data[BOOT_SECTORS_IN_DISK_OFFSET2];
-    byte const sectors_in_disk_lil = a_pB_Data[BOOT_SECTORS_IN_DISK_OFFSET1];
-    size_t const sectors_in_disk = combineTwoBytes(sectors_in_disk_big, sectors_in_disk_lil);
+    if (a_Disk->options == NULL || !a_Disk->options->stats) return;
 
-    byte const sectors_per_fat_big = a_pB_Data[BOOT_SECTORS_PER_FAT_OFFSET2];
-    byte const sectors_per_fat_lil = a_pB_Data[BOOT_SECTORS_PER_FAT_OFFSET1];
-    size_t const sectors_per_fat = combineTwoBytes(sectors_per_fat_big, sectors_per_fat_lil);
+    char record[STATS_RECORD_MAX];
+    int const length = formatStats(a_Disk, record, sizeof(record));
+    if (length > ZERO) fwrite(record, 1, (size_t)length, stderr);
+}
 
-    g_Disk->p_BootSector = (BootSector *)malloc(sizeof(BootSector));
-    observeAndReport(g_Disk->p_BootSector != NULL, "Error allocating memory for boot sector");
+/**
+ * @brief   Writes the stage times and counters of an image as one line of JSON
+ * @details Peak RSS is that of the whole process, not just this image.
+ * @param a_Disk        The image just processed
+ * @param a_Buffer      Receives the line, ending in a newline
+ * @param a_Capacity    The size of a_Buffer, STATS_RECORD_MAX always suffices
+ * @return  The length of the line, or 0 if it did not fit
+ */
+int formatStats(const DiskImage * a_Disk, char * a_Buffer, size_t a_Capacity)
+{
+    struct rusage usage;
+    memset(&usage, ZERO, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+
+    char image[PATH_MAX * 2];
+    jsonEscape(a_Disk->image_path != NULL ? (char *)a_Disk->image_path : "", image, sizeof(image));
+
+    Stats const * stats = &a_Disk->stats;
+    size_t const n_Duplicates = a_Disk->dedup != NULL && isHashing(a_Disk) ? a_Disk->dedup->n_Duplicates : ZERO;
+    int written = snprintf(a_Buffer, a_Capacity, "{\"image\":\"%s\",\"fat_bits\":%zu,\"clusters\":%zu,\"free_clusters\":%zu,"
+        "\"directories\":%zu,\"files\":%zu,\"deleted\":%zu,\"carved\":%zu,\"duplicates\":%zu,\"bytes_written\":%llu,"
+        "\"changed_clusters\":%zu,\"unchanged_files\":%zu,\"bad_bytes\":%llu,\"damaged_files\":%zu,"
+        "\"fat_issues\":%zu,\"fat_repairs\":%zu,\"filtered\":%zu,"
+        "\"boot_parse_ms\":%.3f,\"fat_decode_ms\":%.3f,\"directory_walk_ms\":%.3f,\"data_hash_ms\":%.3f,\"data_copy_ms\":%.3f,\"output_write_ms\":%.3f,"
+        "\"peak_rss_kb\":%ld}\n",
+        image, a_Disk->geometry.fat_bits, a_Disk->geometry.n_Clusters, countFreeClusters(a_Disk),
+        stats->n_Directories, a_Disk->n_Files, stats->n_Deleted, stats->n_Carved, n_Duplicates, (unsigned long long)stats->bytes_written,
+        stats->n_ChangedClusters, stats->n_Unchanged, (unsigned long long)a_Disk->device.bad_bytes, stats->n_Damaged,
+        fatIssueCount(&a_Disk->fat_report), a_Disk->fat_report.n_Repaired, stats->n_Filtered,
+        stats->boot_parse * 1e3, stats->fat_decode * 1e3, stats->directory_walk * 1e3, stats->data_hash * 1e3, stats->data_copy * 1e3, stats->output_write * 1e3,
+        usage.ru_maxrss);
+    return written > ZERO && (size_t)written < a_Capacity ? written : ZERO;
+}
 
-    g_Disk->p_BootSector->n_Fats = fat_count;
-    g_Disk->p_BootSector->n_RootEntries = rd_entry_count;
-    g_Disk->p_BootSector->n_Sectors = sectors_in_disk;
-    g_Disk->p_BootSector->n_SectorsPerFat = sectors_per_fat;
-    g_Disk->p_BootSector->n_BytesPerSector = bytes_per_sector;
-    g_Disk->p_BootSector->n_SectorsPerCluster = sectors_per_cluster;
+/**
+ * @brief   Escapes text for a JSON string
+ * @param a_Text        The text
+ * @param a_Buffer      Where the escaped text goes, without quotes
+ * @param a_Capacity    The size of a_Buffer, text that does not fit is cut short
+ * @return  The length of the escaped text
+ */
+size_t jsonEscape(const char * a_Text, char * a_Buffer, size_t a_Capacity)
+{
+    size_t length = ZERO;
+    for (const unsigned char * c = (const unsigned char *)a_Text; *c != NULL_CHAR; c++)
+    {
+        char escaped[8];
+        if (*c == '"' || *c == '\\') snprintf(escaped, sizeof(escaped), "\\%c", *c);
+        else if (*c < 0x20) snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+        else snprintf(escaped, sizeof(escaped), "%c", *c);
+
+        size_t const n = strlen(escaped);
+        if (length + n >= a_Capacity) break;
+        memcpy(a_Buffer + length, escaped, n);
+        length += n;
+    }
+    if (a_Capacity > ZERO) a_Buffer[length] = NULL_CHAR;
+    return length;
+}
 
-    return (byte_ptr)(g_Disk->p_BootSector);
+/**
+ * @brief   Tells whether an image is read through its ReadPlan
+ * @details A device image is not, its clusters have to go through the device reader.
+ * @param a_Disk    The image
+ * @return  Whether directories and files are read in the order they sit in the image
+ */
+bool isScheduled(const DiskImage * a_Disk)
+{
+    return a_Disk->options != NULL && a_Disk->options->scheduled && a_Disk->stream == NULL && a_Disk->reader == NULL;
 }
 
 /**
- * @brief   Locates and parses the root directory's entries
- * @param a_pB_Data The data to parse`
+ * @brief   Parses the directory tree one level at a time
+ * @details The root is parsed as usual. Every subdirectory it names goes on the next level
+ *          instead of becoming a task, and the clusters of a whole level are then read in image
+ *          order before any of its directories is parsed. That keeps the reads moving forward
+ *          through the image, level after level, rather than jumping between directories.
+ * @param a_Disk    The image, already opened
  */
-void parseFileSystem(string a_pB_Data)
+void parseScheduled(DiskImage * a_Disk)
 {
-    byte_num const root_offset = ROOT_SECTOR_START * SECTOR_SIZE;
-    size_t depth = ZERO;
+    prepareFileSystem(a_Disk, a_Disk->p_Data);
 
-    getBootSector(g_ImageData);
-    observeAndReport(g_Disk->p_BootSector != NULL, "Error: g_Disk->p_BootSector is null");
-
-    g_Disk->p_RootEntry = (Entry *)malloc(sizeof(Entry));
-    observeAndReport(g_Disk->p_RootEntry != NULL, "Error allocating memory for root directory entry");
-
-    memset(g_Disk->p_RootEntry->filename, NULL, ENTRY_FILENAME_BYTES);
-    memset(g_Disk->p_RootEntry->extension, NULL, ENTRY_EXTENSION_BYTES);
-    g_Disk->p_RootEntry->filepath = strdup(FORWARD_SLASH_STRING);
-    g_Disk->p_RootEntry->depth = depth;
-    g_Disk->p_RootEntry->first_cluster = CLUSTER_ROOT;
-    g_Disk->p_RootEntry->size = DIRECTORY_FILE_SIZE;
-    g_Disk->p_RootEntry->deleted = false;
-    g_Disk->p_RootEntry->attributes = ATTR_ROOT | ATTR_DIRECTORY | ATTR_SYSTEM;
-    g_Disk->p_RootEntry->data = NULL;
-
-    g_Disk->p_Root = a_pB_Data + root_offset;
-    byte_ptr i_child = g_Disk->p_Root;
-
-    handleDirectory(g_Disk->p_RootEntry, i_child, depth, false);
-
-    // while (i_child != ENTRY_FREE_AND_LAST)
-    // {
-    //     Entry * i_childEntry = generateEntry(g_Disk->p_RootEntry, i_child, depth, false);
-    //     observeAndReport(i_childEntry != NULL, "Error generating entry");
-    //     printEntry(i_childEntry);
-    //
-    //     strcat(i_childEntry->filepath, ".");
-    //     strcat(i_childEntry->filepath, i_childEntry->extension);
-    //
-    //     sector_num first_data_sector_num = FIRST_DATA_SECTOR_NUM + i_childEntry->first_cluster - CLUSTER_NORMAL_MIN;
-    //     byte_num first_data_sector_offset = first_data_sector_num * SECTOR_SIZE;
-    //     byte_ptr first_data_sector = a_pB_Data + first_data_sector_offset;
-    //
-    //     // Detect if i_childEntry is a directory
-    //     if (isDirectory(i_childEntry))
-    //     {
-    //         handleDirectory(i_childEntry, first_data_sector, depth, false);
-    //         i_child += ENTRY_SIZE;
-    //         continue;
-    //     }
-    //
-    //     makeData(i_childEntry, first_data_sector);
-    //     i_child += ENTRY_SIZE;
-    // }
-}
+    EntryList current;
+    EntryList next;
+    memset(&current, ZERO, sizeof(EntryList));
+    memset(&next, ZERO, sizeof(EntryList));
+    a_Disk->next_level = &next;
 
+    Entry * root = a_Disk->p_RootEntry;
+    if (root->first_cluster == CLUSTER_ROOT) handleDirectory(root, a_Disk->p_Root, root->depth, false);
+    else appendEntry(&next, root);
 
+    while (next.n_Items > ZERO)
+    {
+        EntryList const level = next;
+        next = current;
+        next.n_Items = ZERO;
+        current = level;
+        parseDirectoryLevel(a_Disk, &current);
+    }
 
+    a_Disk->next_level = NULL;
+    free(current.items);
+    free(next.items);
+}
 
 /**
- * @brief   Handles a directory
- * @param a_ParentEntry  The directory entry to handle
- * @param a_sector           The sector to handle
+ * @brief   Reads the clusters of one level of directories in image order, then parses them
+ * @param a_Disk    The image
+ * @param a_Level   The directories of the level, parsed in this order
  */
-void handleDirectory(Entry * a_ParentEntry, byte_ptr a_dataSector, size_t depth, bool parentDeleted)
+void parseDirectoryLevel(DiskImage * a_Disk, const EntryList * a_Level)
 {
-    depth++;
-    size_t entry_count = ZERO;
-    byte_ptr i_child = a_dataSector;
-    while (depth <= 1 && entry_count < g_Disk->p_BootSector->n_RootEntries)
-    {
-        Entry * i_childEntry = generateEntry(a_ParentEntry, i_child, depth, parentDeleted);
+    byte_count const cluster_bytes = a_Disk->geometry.cluster_bytes;
+    DirectoryRead * reads = (DirectoryRead *)calloc(a_Level->n_Items, sizeof(DirectoryRead));
+    observeAndReport(reads != NULL, "Error allocating memory for directory level");
 
-        if (i_childEntry->filename == ENTRY_FREE_AND_LAST)
-        {
-            free(i_childEntry->filepath);
-            free(i_childEntry->filename);
-            free(i_childEntry->extension);
-            free(i_childEntry->filepath);
-            free(i_childEntry);
-            break;
-        }
+    for (size_t i = 0; i < a_Level->n_Items; i++)
+    {
+        Entry * directory = a_Level->items[i];
+        reads[i].directory = directory;
+        if (directory->depth + 1 > MAX_DIRECTORY_DEPTH) continue;
 
-        strcat(i_childEntry->filepath, a_ParentEntry->filepath);
+        // A deleted directory has no size to go by, only its first cluster is trusted
+        buildExtents(directory, directory->deleted ? 1 : SIZE_MAX);
+        for (size_t k = 0; k < directory->n_Extents; k++) reads[i].n_Clusters += directory->extents[k].length;
 
-        sector_num i_first_sector_num = FIRST_DATA_SECTOR_NUM + i_childEntry->first_cluster - CLUSTER_NORMAL_MIN;
-        byte_num i_first_sector_offset = i_first_sector_num * SECTOR_SIZE;
-        byte_ptr i_first_sector = a_dataSector + i_first_sector_offset;
+        reads[i].data = (byte_ptr)malloc(reads[i].n_Clusters * cluster_bytes);
+        observeAndReport(reads[i].data != NULL || reads[i].n_Clusters == ZERO, "Error allocating memory for directory");
 
-        if (isDirectory(i_childEntry))
+        byte_num position = ZERO;
+        for (size_t k = 0; k < directory->n_Extents; k++)
         {
-            handleDirectory(i_childEntry, i_first_sector, depth, false);
-            entry_count++;
-            i_childEntry += ENTRY_SIZE;
-            continue;
+            Extent const * extent = &directory->extents[k];
+            byte_num const offset = clusterOffset(a_Disk, extent->start);
+            readPlanAdd(a_Disk->plan, offset, extent->length * cluster_bytes, &reads[i], position);
+            position += extent->length * cluster_bytes;
         }
-
-        makeData(i_childEntry, i_first_sector);
-        i_child += ENTRY_SIZE;
-        entry_count++;
-        printEntry(i_childEntry);
+        freeExtents(directory);
     }
-}
+
+    int const status = runReadPlan(a_Disk->plan, a_Disk->fd, a_Disk->mapped ? NULL : a_Disk->p_Data, deliverDirectoryPiece, NULL);
+    observeAndReport(status == ZERO, "Error reading directories");
+
+    size_t const entries_per_cluster = (size_t)(cluster_bytes / ENTRY_SIZE);
+    for (size_t i = 0; i < a_Level->n_Items; i++)
+    {
+        Entry * directory = reads[i].directory;
+        if (reads[i].data != NULL)
+        {
+            handleDirectoryEntries(directory, reads[i].data, reads[i].n_Clusters * entries_per_cluster, directory->depth + 1, directory->deleted);
+        }
+        free(reads[i].data);
+    }
+    free(reads);
+}
+
+/**
+ * @brief   Copies a run of directory clusters read by the ReadPlan into its directory
+ * @param a_pContext    Unused
+ * @param a_pPiece      The run, its target is a DirectoryRead
+ * @param a_pB_Data     The run's data
+ */
+void deliverDirectoryPiece(void * a_pContext, const ReadPiece * a_pPiece, const byte * a_pB_Data)
+{
+    (void)a_pContext;
+    DirectoryRead * read = (DirectoryRead *)a_pPiece->target;
+    memcpy(read->data + a_pPiece->target_offset, a_pB_Data, a_pPiece->length);
+}
+
+/**
+ * @brief   Creates a numbered file's output and adds its clusters to the image's ReadPlan
+ * @details The output is created empty here so that files with nothing to read still exist.
+ * @param a_Entry   The file, already numbered by emitDirectory()
+ */
+void planExtraction(Entry * a_Entry)
+{
+    DiskImage * disk = a_Entry->disk;
+    char outputPath[OUTPUT_FILENAME_MAX];
+    observeAndReport(outputPathFor(a_Entry, outputPath, sizeof(outputPath)), "Error: output path is too long");
+    int fd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, OUTPUT_FILE_MODE);
+    observeAndReport(fd != NO_FD, "Error creating output file");
+    close(fd);
+
+    byte_ptr first_sector = NULL;
+    if (isValidCluster(disk, a_Entry->first_cluster)) first_sector = getClusterData(disk, a_Entry->first_cluster);
+    makeData(a_Entry, first_sector);
+    reportDamage(a_Entry);
+
+    byte_count remaining = a_Entry->size;
+    byte_num position = ZERO;
+    for (size_t i = 0; i < a_Entry->n_Extents && remaining > ZERO; i++)
+    {
+        Extent const * extent = &a_Entry->extents[i];
+        byte_count const run_bytes = extent->length * disk->geometry.cluster_bytes;
+        byte_count const length = remaining < run_bytes ? remaining : run_bytes;
+        byte_num const offset = clusterOffset(disk, extent->start);
+        readPlanAdd(disk->plan, offset, length, a_Entry, position);
+
+        position += length;
+        remaining -= length;
+    }
+    freeExtents(a_Entry);
+}
+
+/**
+ * @brief   Reads every planned file piece in image order and writes each into its file
+ * @param a_Disk    The image, with every file planned by planExtraction()
+ */
+void extractScheduled(DiskImage * a_Disk)
+{
+    PlanWriter writer = { NULL, NO_FD };
+    int const status = runReadPlan(a_Disk->plan, a_Disk->fd, a_Disk->mapped ? NULL : a_Disk->p_Data, deliverFilePiece, &writer);
+    if (writer.fd != NO_FD) close(writer.fd);
+    observeAndReport(status == ZERO, "Error reading image");
+}
+
+/**
+ * @brief   Writes a piece read by the ReadPlan at its offset in its file
+ * @details Pieces arrive in image order, which mostly keeps a file's pieces together, so the
+ *          last file written to stays open.
+ * @param a_pContext    The PlanWriter
+ * @param a_pPiece      The piece, its target is the file's Entry
+ * @param a_pB_Data     The piece's data
+ */
+void deliverFilePiece(void * a_pContext, const ReadPiece * a_pPiece, const byte * a_pB_Data)
+{
+    PlanWriter * writer = (PlanWriter *)a_pContext;
+    const Entry * file = (const Entry *)a_pPiece->target;
+    if (writer->file != file)
+    {
+        if (writer->fd != NO_FD) close(writer->fd);
+
+        char outputPath[OUTPUT_FILENAME_MAX];
+        observeAndReport(outputPathFor(file, outputPath, sizeof(outputPath)), "Error: output path is too long");
+        writer->fd = open(outputPath, O_WRONLY);
+        observeAndReport(writer->fd != NO_FD, "Error opening output file");
+        writer->file = file;
+    }
+    observeAndReport(writeAt(writer->fd, a_pB_Data, a_pPiece->length, a_pPiece->target_offset), "Error writing output file");
+}
+
+/**
+ * @brief   Appends an entry to a list
+ * @param a_List    The list
+ * @param a_Entry   The entry
+ */
+void appendEntry(EntryList * a_List, Entry * a_Entry)
+{
+    reserveItems((void **)&a_List->items, &a_List->capacity, a_List->n_Items + 1, sizeof(Entry *));
+    a_List->items[a_List->n_Items++] = a_Entry;
+}
+
+/**
+ * @brief   Tells whether an image has to be read as a stream
+ * @param a_ImagePath   The image path given on the command line
+ * @return  Whether the image is standard input, a pipe, a socket or a character device
+ */
+bool isStreamInput(string a_ImagePath)
+{
+    if (strcmp((char *)a_ImagePath, STREAM_PATH) == ZERO) return true;
+
+    struct stat st;
+    if (stat((char *)a_ImagePath, &st) != ZERO) return false;
+    return S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode) || S_ISCHR(st.st_mode);
+}
+
+/**
+ * @brief   Recovers every file of an image read once, front to back
+ * @details The reserved area, FATs and root directory are read into memory and parsed as
+ *          usual, which tells where the files of the root directory are. The data area is then
+ *          read a chunk at a time and every cluster goes to the files waiting for it. A
+ *          subdirectory is parsed as soon as its last cluster is in, which plans its entries in
+ *          turn. Files are written to temporary names and renamed to fileN.EXT once the whole
+ *          tree is known, so the numbering and listing match a seekable image. Deleted files
+ *          get back only what has not gone by when their entry is found, and carving is not
+ *          done on a stream.
+ * @param a_Disk        The DiskImage to work in, its output settings already set
+ * @param a_ImagePath   The stream, STREAM_PATH for standard input
+ */
+void streamImage(DiskImage * a_Disk, string a_ImagePath)
+{
+    Stream stream;
+    memset(&stream, ZERO, sizeof(Stream));
+    bool const isStdin = strcmp((char *)a_ImagePath, STREAM_PATH) == ZERO;
+    stream.fd = isStdin ? STDIN_FILENO : open((char *)a_ImagePath, O_RDONLY);
+    observeAndReport(stream.fd != NO_FD, "Error opening file");
+    stream.budget = a_Disk->options != NULL && a_Disk->options->memory_budget > ZERO ? a_Disk->options->memory_budget : STREAM_DEFAULT_BUDGET;
+    a_Disk->stream = &stream;
+    a_Disk->n_Files = ZERO;
+    a_Disk->mapped = false;
+    a_Disk->image_path = a_ImagePath;
+    memset(&a_Disk->stats, ZERO, sizeof(Stats));
+
+    // Only the boot sector tells how much more there is in front of the data area
+    if (a_Disk->capacity_ReadBuffer < SECTOR_SIZE)
+    {
+        free(a_Disk->p_ReadBuffer);
+        a_Disk->p_ReadBuffer = (string)malloc(SECTOR_SIZE);
+        a_Disk->capacity_ReadBuffer = a_Disk->p_ReadBuffer != NULL ? SECTOR_SIZE : ZERO;
+    }
+    observeAndReport(a_Disk->p_ReadBuffer != NULL, "Error allocating memory for file");
+    observeAndReport(readStream(stream.fd, a_Disk->p_ReadBuffer, SECTOR_SIZE) == SECTOR_SIZE, "Error: stream ends before its boot sector");
+
+    BootSector boot;
+    Geometry geometry;
+    readBootSector(a_Disk->p_ReadBuffer, &boot);
+    byte_count volume_bytes = (byte_count)boot.n_Sectors * boot.n_BytesPerSector;
+    if (!computeGeometry(&boot, volume_bytes, &geometry))
+    {
+        volume_bytes = (byte_count)(DATA_SECTOR_START + DATA_SECTOR_LENGTH) * SECTOR_SIZE;
+        floppyGeometry(&geometry, volume_bytes);
+    }
+
+    size_t const metadata_bytes = (size_t)geometry.data_offset;
+    if (a_Disk->capacity_ReadBuffer < metadata_bytes)
+    {
+        string grown = (string)realloc(a_Disk->p_ReadBuffer, metadata_bytes);
+        observeAndReport(grown != NULL, "Error allocating memory for file");
+        a_Disk->p_ReadBuffer = grown;
+        a_Disk->capacity_ReadBuffer = metadata_bytes;
+    }
+    size_t const rest = metadata_bytes - SECTOR_SIZE;
+    observeAndReport(readStream(stream.fd, a_Disk->p_ReadBuffer + SECTOR_SIZE, rest) == rest, "Error: stream ends before its data area");
+    logInfo("Streaming %s, buffered %zu bytes of metadata\n", (char *)a_ImagePath, metadata_bytes);
+
+    // The data area is never addressed through p_Data, only the size of the volume matters
+    a_Disk->p_Data = a_Disk->p_ReadBuffer;
+    a_Disk->bytes = volume_bytes;
+    a_Disk->metadata_bytes = metadata_bytes;
+    prepareFileSystem(a_Disk, a_Disk->p_Data);
+
+    // Directories are parsed as their clusters arrive, so the walk counts as copying here
+    struct timespec stage_start;
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
+
+    byte_count const cluster_bytes = a_Disk->geometry.cluster_bytes;
+    stream.first_claim = (uint32_t *)calloc(a_Disk->n_FatEntries, sizeof(uint32_t));
+    stream.held_at = (uint32_t *)calloc(a_Disk->n_FatEntries, sizeof(uint32_t));
+    stream.scratch = (byte_ptr)malloc(cluster_bytes);
+    size_t const chunk_clusters = STREAM_CHUNK_BYTES > cluster_bytes ? (size_t)(STREAM_CHUNK_BYTES / cluster_bytes) : 1;
+    byte_ptr chunk = (byte_ptr)malloc(chunk_clusters * cluster_bytes);
+    observeAndReport(stream.first_claim != NULL && stream.held_at != NULL && stream.scratch != NULL && chunk != NULL,
+        "Error allocating memory for stream");
+    stream.next_cluster = CLUSTER_NORMAL_MIN;
+
+    Entry * root = a_Disk->p_RootEntry;
+    if (root->first_cluster == CLUSTER_ROOT) handleDirectory(root, a_Disk->p_Root, root->depth, false);
+    else planStreamedEntry(a_Disk, root);
+    if (stream.n_OpenDirectories == ZERO) settleStream(&stream, cluster_bytes);
+
+    // Once every directory is parsed, the rest of the stream holds nothing anyone waits for
+    cluster_num cluster = CLUSTER_NORMAL_MIN;
+    cluster_num const end = CLUSTER_NORMAL_MIN + a_Disk->geometry.n_Clusters;
+    while (cluster < end && !(stream.settled && cluster > stream.last_claimed))
+    {
+        size_t const wanted = end - cluster < chunk_clusters ? end - cluster : chunk_clusters;
+        size_t const got = readStream(stream.fd, chunk, wanted * cluster_bytes);
+        size_t const n_Got = (size_t)(got / cluster_bytes);
+        for (size_t i = 0; i < n_Got; i++) receiveStreamedCluster(a_Disk, cluster + i, chunk + i * cluster_bytes);
+        cluster += n_Got;
+
+        if (n_Got < wanted)
+        {
+            logError("Stream ended after %zu of %zu clusters\n", cluster - CLUSTER_NORMAL_MIN, a_Disk->geometry.n_Clusters);
+            break;
+        }
+    }
+    logInfo("Streamed %zu clusters, held back %zu, spilled %zu\n", cluster - CLUSTER_NORMAL_MIN, stream.n_Held, stream.n_Spilled);
+    a_Disk->stats.data_copy = secondsSince(&stage_start);
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
+
+    emitDirectory(root);
+
+    for (size_t i = 1; i < stream.n_Files; i++)
+    {
+        if (stream.files[i].fd != NO_FD) close(stream.files[i].fd);
+        if (stream.files[i].directory != NULL) free(stream.files[i].directory);
+    }
+    settleStream(&stream, cluster_bytes);
+    free(stream.files);
+    free(stream.claims);
+    free(stream.first_claim);
+    free(stream.held);
+    free(stream.held_at);
+    free(stream.scratch);
+    free(chunk);
+    if (!isStdin) close(stream.fd);
+    a_Disk->stats.output_write = secondsSince(&stage_start);
+    printStats(a_Disk);
+
+    resetArena(a_Disk->arena);
+    a_Disk->p_RootEntry = NULL;
+    a_Disk->p_Data = NULL;
+    a_Disk->stream = NULL;
+}
+
+/**
+ * @brief   Reads from a stream until a buffer is full or the stream ends
+ * @param a_Fd          The stream
+ * @param a_pB_Buffer   Where the bytes go
+ * @param a_Length      How many bytes to read
+ * @return  The number of bytes read, short only at the end of the stream
+ */
+size_t readStream(int a_Fd, byte_ptr a_pB_Buffer, size_t a_Length)
+{
+    size_t done = ZERO;
+    while (done < a_Length)
+    {
+        ssize_t n = read(a_Fd, a_pB_Buffer + done, a_Length - done);
+        if (n < 0 && errno == EINTR) continue;
+        observeAndReport(n >= 0, "Error reading stream");
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return done;
+}
+
+/**
+ * @brief   Works out where an entry's clusters go before the stream reaches them
+ * @details Clusters still ahead get a claim. Clusters already behind are taken from the held
+ *          ones, a deleted file's free clusters are never held so those are lost. A directory
+ *          missing any of its clusters is skipped, a partial directory cannot be parsed.
+ * @param a_Disk    The streamed image
+ * @param a_Entry   The entry just found
+ */
+void planStreamedEntry(DiskImage * a_Disk, Entry * a_Entry)
+{
+    Stream * stream = a_Disk->stream;
+    byte_count const cluster_bytes = a_Disk->geometry.cluster_bytes;
+    bool const directory = isDirectory(a_Entry);
+
+    size_t max_clusters;
+    if (directory)
+    {
+        bool const reused = a_Entry->deleted && isClusterAllocated(a_Disk, a_Entry->first_cluster);
+        if (!isValidCluster(a_Disk, a_Entry->first_cluster) || reused || a_Entry->depth + 1 > MAX_DIRECTORY_DEPTH) return;
+        max_clusters = a_Entry->deleted ? 1 : SIZE_MAX;
+    }
+    else max_clusters = (size_t)((a_Entry->size + cluster_bytes - 1) / cluster_bytes);
+
+    buildExtents(a_Entry, max_clusters);
+
+    size_t n_Clusters = ZERO;
+    bool complete = true;
+    for (size_t i = 0; i < a_Entry->n_Extents; i++)
+    {
+        Extent const * extent = &a_Entry->extents[i];
+        n_Clusters += extent->length;
+        for (cluster_num c = extent->start; c < extent->start + extent->length; c++)
+        {
+            if (c < stream->next_cluster && stream->held_at[c] == ZERO) complete = false;
+        }
+    }
+    if (n_Clusters == ZERO || (directory && !complete))
+    {
+        if (directory) logError("Skipping a directory the stream went past before it was found\n");
+        freeExtents(a_Entry);
+        return;
+    }
+
+    if (stream->n_Files == ZERO) stream->n_Files = 1; // 0 means no StreamFile
+    reserveItems((void **)&stream->files, &stream->capacity_Files, stream->n_Files + 1, sizeof(StreamFile));
+    size_t const file = stream->n_Files++;
+    memset(&stream->files[file], ZERO, sizeof(StreamFile));
+    stream->files[file].entry = a_Entry;
+    stream->files[file].fd = NO_FD;
+    stream->files[file].n_Clusters = n_Clusters;
+    a_Entry->stream_file = file;
+    if (directory) stream->n_OpenDirectories++;
+
+    size_t position = ZERO;
+    for (size_t i = 0; i < a_Entry->n_Extents; i++)
+    {
+        Extent const extent = a_Entry->extents[i];
+        for (cluster_num c = extent.start; c < extent.start + extent.length; c++, position++)
+        {
+            if (c >= stream->next_cluster)
+            {
+                reserveItems((void **)&stream->claims, &stream->capacity_Claims, stream->n_Claims + 1, sizeof(StreamClaim));
+                StreamClaim * claim = &stream->claims[stream->n_Claims++];
+                claim->file = file;
+                claim->position = position;
+                claim->next = stream->first_claim[c];
+                stream->first_claim[c] = (uint32_t)stream->n_Claims;
+                if (c > stream->last_claimed) stream->last_claimed = c;
+                continue;
+            }
+            if (stream->held_at[c] == ZERO) continue;
+
+            deliverStreamedCluster(a_Disk, file, position, heldClusterData(stream, c, cluster_bytes));
+            releaseHeldCluster(stream, c, cluster_bytes);
+        }
+    }
+    freeExtents(a_Entry);
+}
+
+/**
+ * @brief   Hands a cluster that just arrived to everything waiting for it
+ * @param a_Disk    The streamed image
+ * @param a_Cluster The cluster
+ * @param a_pB_Data Its data
+ */
+void receiveStreamedCluster(DiskImage * a_Disk, cluster_num a_Cluster, const byte * a_pB_Data)
+{
+    Stream * stream = a_Disk->stream;
+    stream->next_cluster = a_Cluster + 1;
+
+    uint32_t claim = a_Cluster < a_Disk->n_FatEntries ? stream->first_claim[a_Cluster] : ZERO;
+    if (claim == ZERO)
+    {
+        if (!stream->settled && isClusterAllocated(a_Disk, a_Cluster)) holdStreamedCluster(stream, a_Cluster, a_pB_Data, a_Disk->geometry.cluster_bytes);
+        return;
+    }
+
+    // Parsing a directory adds claims, so the list is walked by index
+    for (; claim != ZERO; claim = stream->claims[claim - 1].next)
+    {
+        deliverStreamedCluster(a_Disk, stream->claims[claim - 1].file, stream->claims[claim - 1].position, a_pB_Data);
+    }
+}
+
+/**
+ * @brief   Puts one cluster of a file or directory where it belongs
+ * @details A file's cluster is written at its offset in the file, cut to the file's size. A
+ *          directory's cluster is gathered, and the directory is parsed once all of them are in.
+ * @param a_Disk        The streamed image
+ * @param a_File        The StreamFile the cluster belongs to
+ * @param a_Position    Which of its clusters this is
+ * @param a_pB_Data     The cluster's data
+ */
+void deliverStreamedCluster(DiskImage * a_Disk, size_t a_File, size_t a_Position, const byte * a_pB_Data)
+{
+    Stream * stream = a_Disk->stream;
+    StreamFile * file = &stream->files[a_File];
+    byte_count const cluster_bytes = a_Disk->geometry.cluster_bytes;
+    byte_num const offset = (byte_num)a_Position * cluster_bytes;
+
+    if (!isDirectory(file->entry))
+    {
+        if (offset >= file->entry->size) return;
+        byte_count const length = file->entry->size - offset < cluster_bytes ? file->entry->size - offset : cluster_bytes;
+        observeAndReport(writeAt(streamFileDescriptor(a_Disk, a_File), a_pB_Data, length, offset), "Error writing output file");
+        a_Disk->stats.bytes_written += length;
+        return;
+    }
+
+    if (file->directory == NULL)
+    {
+        file->directory = (byte_ptr)malloc(file->n_Clusters * cluster_bytes);
+        observeAndReport(file->directory != NULL, "Error allocating memory for directory");
+        stream->held_bytes += file->n_Clusters * cluster_bytes;
+    }
+    memcpy(file->directory + offset, a_pB_Data, cluster_bytes);
+    if (++file->n_Received == file->n_Clusters) parseStreamedDirectory(a_Disk, a_File);
+}
+
+/**
+ * @brief   Parses a directory whose clusters have all been gathered
+ * @param a_Disk    The streamed image
+ * @param a_File    The directory's StreamFile
+ */
+void parseStreamedDirectory(DiskImage * a_Disk, size_t a_File)
+{
+    Stream * stream = a_Disk->stream;
+    byte_count const cluster_bytes = a_Disk->geometry.cluster_bytes;
+
+    // Planning the entries can grow the file list, so nothing is kept pointing into it
+    Entry * directory = stream->files[a_File].entry;
+    byte_ptr data = stream->files[a_File].directory;
+    size_t const n_Clusters = stream->files[a_File].n_Clusters;
+    stream->files[a_File].directory = NULL;
+
+    size_t const entries_per_cluster = (size_t)(cluster_bytes / ENTRY_SIZE);
+    for (size_t i = 0; i < n_Clusters; i++)
+    {
+        bool ended = handleDirectoryEntries(directory, data + i * cluster_bytes, entries_per_cluster, directory->depth + 1, directory->deleted);
+        if (ended) break;
+    }
+    free(data);
+    stream->held_bytes -= n_Clusters * cluster_bytes;
+
+    if (--stream->n_OpenDirectories == ZERO) settleStream(stream, cluster_bytes);
+}
+
+/**
+ * @brief   Keeps an allocated cluster that nothing is known to own yet
+ * @param a_Stream  The stream
+ * @param a_Cluster The cluster
+ * @param a_pB_Data Its data
+ * @param a_Length  The size of a cluster
+ */
+void holdStreamedCluster(Stream * a_Stream, cluster_num a_Cluster, const byte * a_pB_Data, byte_count a_Length)
+{
+    reserveItems((void **)&a_Stream->held, &a_Stream->capacity_Held, a_Stream->n_Held + 1, sizeof(StreamHeld));
+    StreamHeld * held = &a_Stream->held[a_Stream->n_Held];
+    held->data = NULL;
+
+    if (a_Stream->held_bytes + a_Length <= a_Stream->budget) held->data = (byte_ptr)malloc(a_Length);
+    if (held->data != NULL)
+    {
+        memcpy(held->data, a_pB_Data, a_Length);
+        a_Stream->held_bytes += a_Length;
+    }
+    else
+    {
+        if (a_Stream->spill == NULL) a_Stream->spill = tmpfile();
+        observeAndReport(a_Stream->spill != NULL, "Error creating stream spill file");
+        held->spill_offset = a_Stream->spill_bytes;
+        observeAndReport(writeAt(fileno(a_Stream->spill), a_pB_Data, a_Length, held->spill_offset), "Error writing stream spill file");
+        a_Stream->spill_bytes += a_Length;
+        a_Stream->n_Spilled++;
+    }
+    a_Stream->held_at[a_Cluster] = (uint32_t)++a_Stream->n_Held;
+}
+
+/**
+ * @brief   Gets the data of a held cluster back
+ * @param a_Stream  The stream
+ * @param a_Cluster The cluster, which must be held
+ * @param a_Length  The size of a cluster
+ * @return  The data, a spilled cluster is read into a buffer the next call reuses
+ */
+const byte * heldClusterData(Stream * a_Stream, cluster_num a_Cluster, byte_count a_Length)
+{
+    StreamHeld const * held = &a_Stream->held[a_Stream->held_at[a_Cluster] - 1];
+    if (held->data != NULL) return held->data;
+
+    byte_count done = ZERO;
+    while (done < a_Length)
+    {
+        ssize_t n = pread(fileno(a_Stream->spill), a_Stream->scratch + done, a_Length - done, (off_t)(held->spill_offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        observeAndReport(n > 0, "Error reading stream spill file");
+        done += (byte_count)n;
+    }
+    return a_Stream->scratch;
+}
+
+/**
+ * @brief   Lets go of a held cluster once it has been handed to its owner
+ * @param a_Stream  The stream
+ * @param a_Cluster The cluster
+ * @param a_Length  The size of a cluster
+ */
+void releaseHeldCluster(Stream * a_Stream, cluster_num a_Cluster, byte_count a_Length)
+{
+    StreamHeld * held = &a_Stream->held[a_Stream->held_at[a_Cluster] - 1];
+    if (held->data != NULL)
+    {
+        free(held->data);
+        held->data = NULL;
+        a_Stream->held_bytes -= a_Length;
+    }
+    a_Stream->held_at[a_Cluster] = ZERO;
+}
+
+/**
+ * @brief   Drops everything held once no directory is left to parse
+ * @details Nothing can claim a cluster that has gone by anymore, so whatever is still held
+ *          belongs to no entry.
+ * @param a_Stream      The stream
+ * @param a_ClusterBytes The size of a cluster
+ */
+void settleStream(Stream * a_Stream, byte_count a_ClusterBytes)
+{
+    for (size_t i = 0; i < a_Stream->n_Held; i++)
+    {
+        if (a_Stream->held[i].data == NULL) continue;
+        free(a_Stream->held[i].data);
+        a_Stream->held[i].data = NULL;
+        a_Stream->held_bytes -= a_ClusterBytes;
+    }
+    if (a_Stream->spill != NULL) fclose(a_Stream->spill);
+    a_Stream->spill = NULL;
+    a_Stream->settled = true;
+}
+
+/**
+ * @brief   Gets a descriptor for a streamed file's temporary output
+ * @details At most STREAM_OPEN_FILES are open at once, the one opened longest ago is closed
+ *          to make room and reopened if more of its clusters come.
+ * @param a_Disk    The streamed image
+ * @param a_File    The StreamFile
+ * @return  The descriptor
+ */
+int streamFileDescriptor(DiskImage * a_Disk, size_t a_File)
+{
+    Stream * stream = a_Disk->stream;
+    StreamFile * file = &stream->files[a_File];
+    if (file->fd != NO_FD) return file->fd;
+
+    if (stream->n_OpenFiles == STREAM_OPEN_FILES)
+    {
+        StreamFile * victim = &stream->files[stream->open_files[stream->next_victim]];
+        if (victim->fd != NO_FD) close(victim->fd);
+        victim->fd = NO_FD;
+        stream->open_files[stream->next_victim] = a_File;
+        stream->next_victim = (stream->next_victim + 1) % STREAM_OPEN_FILES;
+    }
+    else stream->open_files[stream->n_OpenFiles++] = a_File;
+
+    char path[OUTPUT_FILENAME_MAX];
+    observeAndReport(streamPartPath(a_Disk, a_File, path, sizeof(path)), "Error: output path is too long");
+    file->fd = open(path, O_WRONLY | O_CREAT | (file->created ? ZERO : O_TRUNC), OUTPUT_FILE_MODE);
+    observeAndReport(file->fd != NO_FD, "Error creating output file");
+    file->created = true;
+    return file->fd;
+}
+
+/**
+ * @brief   Names the temporary output of a streamed file
+ * @param a_Disk        The streamed image
+ * @param a_File        The StreamFile
+ * @param a_Buffer      Receives the path
+ * @param a_Capacity    The size of a_Buffer
+ * @return  Whether the path fit
+ */
+bool streamPartPath(const DiskImage * a_Disk, size_t a_File, char * a_Buffer, size_t a_Capacity)
+{
+    int written = snprintf(a_Buffer, a_Capacity, "%s/" STREAM_PART_NAME, (char *)a_Disk->output_directory, a_File);
+    return written > ZERO && (size_t)written < a_Capacity;
+}
+
+/**
+ * @brief   Moves a streamed file to its fileN.EXT name, or creates it empty if nothing came
+ * @param a_Entry   The file, already numbered by emitDirectory()
+ */
+void finishStreamedFile(Entry * a_Entry)
+{
+    Stream * stream = a_Entry->disk->stream;
+    char outputPath[OUTPUT_FILENAME_MAX];
+    observeAndReport(outputPathFor(a_Entry, outputPath, sizeof(outputPath)), "Error: output path is too long");
+
+    StreamFile * file = a_Entry->stream_file != ZERO ? &stream->files[a_Entry->stream_file] : NULL;
+    if (file != NULL && file->created)
+    {
+        if (file->fd != NO_FD) close(file->fd);
+        file->fd = NO_FD;
+
+        char partPath[OUTPUT_FILENAME_MAX];
+        observeAndReport(streamPartPath(a_Entry->disk, a_Entry->stream_file, partPath, sizeof(partPath)), "Error: output path is too long");
+        observeAndReport(rename(partPath, outputPath) == ZERO, "Error renaming output file");
+        return;
+    }
+
+    int fd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, OUTPUT_FILE_MODE);
+    observeAndReport(fd != NO_FD, "Error creating output file");
+    close(fd);
+}
+
+/**
+ * @brief   Makes sure a growable array has room
+ * @param a_pItems      The array, moved when it grows
+ * @param a_pCapacity   Its capacity in items
+ * @param a_n_Needed    The number of items it must hold
+ * @param a_ItemBytes   The size of an item
+ */
+void reserveItems(void ** a_pItems, size_t * a_pCapacity, size_t a_n_Needed, size_t a_ItemBytes)
+{
+    if (*a_pCapacity >= a_n_Needed) return;
+    size_t capacity = *a_pCapacity > ZERO ? *a_pCapacity * 2 : 64;
+    while (capacity < a_n_Needed) capacity *= 2;
+
+    void * grown = realloc(*a_pItems, capacity * a_ItemBytes);
+    observeAndReport(grown != NULL, "Error allocating memory for stream");
+    *a_pItems = grown;
+    *a_pCapacity = capacity;
+}
+
+/**
+ * @brief   Writes a buffer at an offset of a file
+ * @param a_Fd      The file
+ * @param a_pB_Data The bytes to write
+ * @param a_Length  The number of bytes
+ * @param a_Offset  Where in the file they go
+ * @return  Whether every byte was written
+ */
+bool writeAt(int a_Fd, const byte * a_pB_Data, byte_count a_Length, byte_num a_Offset)
+{
+    while (a_Length > ZERO)
+    {
+        ssize_t n = pwrite(a_Fd, a_pB_Data, a_Length, (off_t)a_Offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        a_pB_Data += n;
+        a_Length -= (byte_count)n;
+        a_Offset += (byte_num)n;
+    }
+    return true;
+}
+
+/**
+ * @brief   Writes out the full path of an entry
+ * @details Entries only keep their parent and 8.3 name, so the path is built here, when it is
+ *          about to be printed, by walking up to the root.
+ * @param a_Entry       The entry whose path to build
+ * @param a_Buffer      Where to write the path
+ * @param a_Capacity    The size of a_Buffer, ENTRY_PATH_MAX always suffices
+ * @return  The length of the path
+ */
+size_t materializePath(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity)
+{
+    const Entry * lineage[MAX_DIRECTORY_DEPTH + 1];
+    size_t n_Lineage = ZERO;
+    for (const Entry * i_Entry = a_Entry; i_Entry->parent != NULL && n_Lineage <= MAX_DIRECTORY_DEPTH; i_Entry = i_Entry->parent)
+    {
+        lineage[n_Lineage++] = i_Entry;
+    }
+
+    size_t length = ZERO;
+    if (n_Lineage == ZERO && a_Capacity > 1) a_Buffer[length++] = FORWARD_SLASH_CHAR;
+
+    while (n_Lineage > ZERO)
+    {
+        const Entry * i_Entry = lineage[--n_Lineage];
+        size_t const name_length = trimmedLength(i_Entry->filename, ENTRY_FILENAME_BYTES);
+        size_t const extension_length = trimmedLength(i_Entry->extension, ENTRY_EXTENSION_BYTES);
+        if (length + 1 + name_length + 1 + extension_length >= a_Capacity) break;
+
+        a_Buffer[length++] = FORWARD_SLASH_CHAR;
+        memcpy(a_Buffer + length, i_Entry->filename, name_length);
+        length += name_length;
+
+        if (extension_length > ZERO) {
+            a_Buffer[length++] = DOT_CHAR;
+            memcpy(a_Buffer + length, i_Entry->extension, extension_length);
+            length += extension_length;
+        }
+    }
+
+    a_Buffer[length] = NULL_CHAR;
+    return length;
+}
+
+/**
+ * @brief   Opens a file and returns a pointer to the data
+ * @details The image is mapped read-only instead of being copied onto the heap, so the parser
+ *          works straight on the page cache. The descriptor stays open for copyImageRange().
+ *          Anything that cannot be mapped falls back to one buffered read into the DiskImage's
+ *          read buffer, which is kept for the next image. Block devices, and any image with
+ *          --direct, go through openDeviceImage() instead.
+ * @param a_Disk        The DiskImage to open the image into
+ * @param a_Filename    The name of the file to open
+ * @return  A pointer to the image data, either the mapping or the read buffer
+ */
+string openFile(DiskImage * a_Disk, string a_Filename)
+{
+    a_Disk->mapped = false;
+    a_Disk->p_Data = NULL;
+    a_Disk->cacheable = false;
+    clearDeviceReport(&a_Disk->device);
+
+    int fd = open((char *)a_Filename, O_RDONLY);
+    observeAndReport(fd != NO_FD, "Error opening file");
+    a_Disk->fd = fd;
+    a_Disk->image_path = a_Filename;
+
+    struct stat st;
+    observeAndReport(fstat(fd, &st) == ZERO, "Error getting file size");
+    if (S_ISBLK(st.st_mode) || (a_Disk->options != NULL && a_Disk->options->direct))
+    {
+        close(fd);
+        a_Disk->fd = NO_FD;
+        return openDeviceImage(a_Disk, a_Filename);
+    }
+    observeAndReport(st.st_size > ZERO, "Error: file is empty");
+    size_t fileSize = (size_t)st.st_size;
+
+    // Lets serve recognise the same unchanged file and reuse its decoded FAT
+    memset(&a_Disk->image_key, ZERO, sizeof(FatCacheKey));
+    a_Disk->image_key.device = (uint64_t)st.st_dev;
+    a_Disk->image_key.inode = (uint64_t)st.st_ino;
+    a_Disk->image_key.size = (uint64_t)st.st_size;
+    a_Disk->image_key.mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    a_Disk->image_key.mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    a_Disk->image_key.ctime_sec = (int64_t)st.st_ctim.tv_sec;
+    a_Disk->image_key.ctime_nsec = (int64_t)st.st_ctim.tv_nsec;
+    a_Disk->cacheable = S_ISREG(st.st_mode);
+
+    a_Disk->bytes = fileSize;
+
+    string pData = (string)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, ZERO);
+    if (pData != MAP_FAILED)
+    {
+        // Directory clusters are visited out of order and file clusters never go through the
+        // mapping, so readahead across the whole image would only waste page cache
+        madvise(pData, fileSize, MADV_RANDOM);
+
+        // The reserved area, FATs and root directory are always needed up front
+        a_Disk->metadata_bytes = metadataSpan(pData, fileSize);
+        madvise(pData, a_Disk->metadata_bytes, MADV_WILLNEED);
+
+        a_Disk->mapped = true;
+        a_Disk->p_Data = pData;
+        logDebug("Mapped file of size %zu\n", fileSize);
+        return pData;
+    }
+
+    pData = reserveReadBuffer(a_Disk, fileSize);
+
+    size_t readSize = ZERO;
+    while (readSize < fileSize)
+    {
+        ssize_t n = read(fd, pData + readSize, fileSize - readSize);
+        if (n < 0 && errno == EINTR) continue;
+        observeAndReport(n > 0, "Error reading file");
+        readSize += (size_t)n;
+    }
+    logDebug("Read file of size %zu\n", readSize);
+
+    a_Disk->p_Data = pData;
+    return pData;
+}
+
+/**
+ * @brief   Opens a block device, or an image with --direct, through the device reader
+ * @details Only the reserved area, FATs and fixed root directory are read up front, with
+ *          O_DIRECT into the read buffer. Clusters are read as they are needed, a chunk at a
+ *          time into the reader's fixed pool, so memory does not grow with the device, and the
+ *          descriptor stays open for them. Sectors that will not read are zero-filled and kept
+ *          in the DiskImage's device report for reportDamage(), and a chunk read again goes
+ *          around them instead of retrying them.
+ * @param a_Disk        The DiskImage to open the image into
+ * @param a_Filename    The device or image
+ * @return  A pointer to the image's metadata, the read buffer
+ */
+string openDeviceImage(DiskImage * a_Disk, string a_Filename)
+{
+    int direct = ZERO;
+    int fd = openDevice((char *)a_Filename, &direct);
+    observeAndReport(fd != NO_FD, "Error opening device");
+    a_Disk->fd = fd;
+
+    uint64_t deviceBytes = ZERO;
+    size_t sectorBytes = ZERO;
+    observeAndReport(deviceGeometry(fd, &deviceBytes, &sectorBytes) == ZERO, "Error getting device size");
+    observeAndReport(deviceBytes > ZERO, "Error: device is empty");
+
+    a_Disk->reader = createDeviceReader(fd, deviceBytes, sectorBytes, &a_Disk->device);
+    observeAndReport(a_Disk->reader != NULL, "Error allocating memory for device reader");
+    a_Disk->device.direct = direct;
+    a_Disk->bytes = (byte_count)deviceBytes;
+
+    byte boot[SECTOR_SIZE];
+    readImage(a_Disk, ZERO, sizeof(boot), boot);
+    a_Disk->metadata_bytes = metadataSpan(boot, a_Disk->bytes);
+    observeAndReport(a_Disk->metadata_bytes <= SIZE_MAX, "Error: device metadata does not fit in memory");
+
+    string pData = reserveReadBuffer(a_Disk, (size_t)a_Disk->metadata_bytes);
+    observeAndReport(readDeviceHead(a_Disk->reader, pData, a_Disk->metadata_bytes) == ZERO, "Error reading device");
+    a_Disk->p_Data = pData;
+
+    logInfo("Opened device of size %llu in %zu-byte sectors%s, read %llu bytes of metadata, %zu bad ranges, %llu bytes zero-filled\n",
+        (unsigned long long)deviceBytes, sectorBytes, direct ? " with O_DIRECT" : "", (unsigned long long)a_Disk->metadata_bytes,
+        a_Disk->device.n_Bad, (unsigned long long)a_Disk->device.bad_bytes);
+    return pData;
+}
+
+/**
+ * @brief   Makes sure the DiskImage's read buffer holds at least a_Bytes
+ * @details The buffer is aligned for O_DIRECT and rounded up to a whole DEVICE_ALIGNMENT, which
+ *          the device reader needs and the other readers do not mind.
+ * @param a_Disk    The DiskImage whose buffer to grow
+ * @param a_Bytes   The size of the image, or of a device image's metadata
+ * @return  The buffer
+ */
+string reserveReadBuffer(DiskImage * a_Disk, size_t a_Bytes)
+{
+    size_t const capacity = (a_Bytes + DEVICE_ALIGNMENT - 1) / DEVICE_ALIGNMENT * DEVICE_ALIGNMENT;
+    bool const aligned = ((uintptr_t)a_Disk->p_ReadBuffer % DEVICE_ALIGNMENT) == ZERO;
+    if (a_Disk->capacity_ReadBuffer < capacity || !aligned)
+    {
+        free(a_Disk->p_ReadBuffer);
+        void * buffer = NULL;
+        a_Disk->p_ReadBuffer = posix_memalign(&buffer, DEVICE_ALIGNMENT, capacity) == ZERO ? (string)buffer : NULL;
+        a_Disk->capacity_ReadBuffer = a_Disk->p_ReadBuffer != NULL ? capacity : ZERO;
+    }
+    observeAndReport(a_Disk->p_ReadBuffer != NULL, "Error allocating memory for file");
+    return a_Disk->p_ReadBuffer;
+}
+
+/**
+ * @brief   Releases the image opened by openFile()
+ * @param a_Disk    The DiskImage whose image to close, its buffers are kept
+ */
+void closeFile(DiskImage * a_Disk)
+{
+    if (a_Disk->mapped && a_Disk->p_Data != NULL) munmap(a_Disk->p_Data, a_Disk->bytes);
+    a_Disk->mapped = false;
+    destroyDeviceReader(a_Disk->reader);
+    a_Disk->reader = NULL;
+
+    if (a_Disk->fd != NO_FD) close(a_Disk->fd);
+    a_Disk->fd = NO_FD;
+    a_Disk->p_Data = NULL;
+}
+
+/**
+ * @brief   Faults the reserved area, FATs and root directory of an open image into memory
+ * @details Lets the batch reader take the image's first page faults instead of a lane
+ * @param a_Disk    The DiskImage holding the open image
+ */
+void prefetchMetadata(DiskImage * a_Disk)
+{
+    if (!a_Disk->mapped) return;
+
+    byte_count const metadataBytes = a_Disk->metadata_bytes;
+
+#ifdef MADV_POPULATE_READ
+    if (madvise(a_Disk->p_Data, metadataBytes, MADV_POPULATE_READ) == ZERO) return;
+#endif
+    volatile byte sink = ZERO;
+    for (byte_num i = 0; i < metadataBytes; i += SECTOR_SIZE) sink ^= a_Disk->p_Data[i];
+    (void)sink;
+}
+
+/**
+ * @brief   Prints the data in a file
+ * @param a_pB_Data     The data to print
+ * @param a_n_Length    The length of the data
+*/
+void printData(byte_ptr a_pB_Data, byte_num a_n_Length)
+{
+
+    for (byte_num i = 0; i < a_n_Length; i++)
+    {
+        printf("%02X ", a_pB_Data[i]);
+        if (i % 16 == 15) printf("\n"); // Print a new line every 16 bytes //TODO: magic number
+    }
+    printf("\n");
+}
+
+/**
+ * @brief   Formats file name or extension to be uppercase and space padded
+ * @param a_byteLocation     The data to format, non-null terminated
+ * @param a_Length      The length of the data
+ * @param a_pB_Formatted    Where to write the formatted data, a_Length bytes
+ */
+void formatFileNaming(byte_ptr a_byteLocation, byte_num a_Length, byte_ptr a_pB_Formatted)
+{
+    observeAndReport(a_byteLocation != NULL, "Error: a_byteLocation is null");
+    observeAndReport(a_Length == ENTRY_FILENAME_BYTES || a_Length == ENTRY_EXTENSION_BYTES, "Error: a_Length is not 8 or 3");
+
+    byte_ptr formatted = a_pB_Formatted;
+
+    size_t i;
+    for (i = 0; i < a_Length; i++)
+    {
+        if (a_byteLocation[i] == SPACE_CHAR) { break; }
+        formatted[i] = toupper((unsigned char)a_byteLocation[i]); // might be trouble, was (unsigned char)
+    }
+
+    // Pad with spaces if i < a_Length
+    for (; i < a_Length; i++)
+    {
+        formatted[i] = SPACE_CHAR;
+    }
+}
+
+
+/**
+ * Combines a big byte and a little byte to form a 16-bit integer.
+ *
+ * @param bigByte The big byte (bigger 8 bits).
+ * @param littleByte The little byte (littleer 8 bits).
+ * @return The combined 16-bit integer.
+ */
+uint16_t combineTwoBytes(byte bigByte, byte littleByte)
+{
+    return (uint16_t)(bigByte << 8) | littleByte;
+}
+
+/**
+ * @brief   Reads a little-endian 32-bit integer
+ * @param a_pB_Data The first (least significant) byte
+ * @return  The combined 32-bit integer
+ */
+uint32_t combineFourBytes(byte_ptr a_pB_Data)
+{
+    return (uint32_t)a_pB_Data[0]
+        | (uint32_t)a_pB_Data[1] << 8
+        | (uint32_t)a_pB_Data[2] << 16
+        | (uint32_t)a_pB_Data[3] << 24;
+}
+
+static int32_t s_DosMonthDays[DOS_DATE_MONTHS];  // days from 1970 to the 1st of each year and month, -1 for no month
+static int32_t s_DosHourSeconds[256];           // seconds of the high byte of a FAT time
+static int32_t s_DosMinuteSeconds[256];         // seconds of the low byte of a FAT time
+static pthread_once_t s_DosTablesOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief   Fills the tables dosTimestamp() looks dates and times up in
+ */
+static void buildDosTables(void)
+{
+    for (size_t i = 0; i < DOS_DATE_MONTHS; i++)
+    {
+        int64_t const month = (int64_t)(i & 0x0F);
+        if (month < 1 || month > 12) {
+            s_DosMonthDays[i] = -1;
+            continue;
+        }
+
+        // Days since 1970-01-01, with years starting in March so that leap days fall last
+        int64_t const year = DOS_EPOCH_YEAR + (int64_t)(i >> 4) - (month <= 2 ? 1 : 0);
+        int64_t const era = year / 400;
+        int64_t const year_of_era = year - era * 400;
+        int64_t const day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5;
+        int64_t const day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+        s_DosMonthDays[i] = (int32_t)(era * 146097 + day_of_era - 719468);
+    }
+
+    // The minutes straddle the two bytes, three bits above and three below
+    for (size_t b = 0; b < 256; b++)
+    {
+        s_DosHourSeconds[b] = (int32_t)((b >> 3) * 3600 + (b & 0x07) * 8 * 60);
+        s_DosMinuteSeconds[b] = (int32_t)((b >> 5) * 60 + (b & 0x1F) * 2);
+    }
+}
+
+/**
+ * @brief   Turns a FAT date and time into seconds since the Unix epoch
+ * @details FAT keeps local time without a zone, it is taken as UTC. The year and month and
+ *          each byte of the time are looked up in tables built on first use. A day past the
+ *          end of its month runs on into the next one.
+ * @param a_Date    Years since 1980 in bits 15-9, the month in bits 8-5 and the day in bits 4-0
+ * @param a_Time    Hours in bits 15-11, minutes in bits 10-5 and seconds halved in bits 4-0
+ * @return  The seconds, or 0 if the date is unset
+ */
+int64_t dosTimestamp(uint16_t a_Date, uint16_t a_Time)
+{
+    pthread_once(&s_DosTablesOnce, buildDosTables);
+
+    int32_t const month_days = s_DosMonthDays[a_Date >> 5];
+    int64_t const day = a_Date & 0x1F;
+    if (month_days < 0 || day < 1) return ZERO;
+
+    return ((int64_t)month_days + day - 1) * SECONDS_PER_DAY + s_DosHourSeconds[a_Time >> 8] + s_DosMinuteSeconds[a_Time & 0xFF];
+}
+
+/**
+ * @brief   Counts the characters of a space padded name field
+ * @param a_pB_Name The name field
+ * @param a_Length  The width of the field
+ * @return  The length of the name without its padding
+ */
+size_t trimmedLength(const byte * a_pB_Name, size_t a_Length)
+{
+    while (a_Length > ZERO && (a_pB_Name[a_Length - 1] == SPACE_CHAR || a_pB_Name[a_Length - 1] == NULL_CHAR)) a_Length--;
+    return a_Length;
+}
+
+/**
+ * @brief   Gets the boot sector from the data
+ * @param a_Disk    The image the boot sector belongs to
+ * @param a_pB_Data The data to get the boot sector from
+ * @return  A pointer to the boot sector
+ */
+byte_ptr getBootSector(DiskImage * a_Disk, string a_pB_Data)
+{
+    observeAndReport(a_Disk->bytes >= SECTOR_SIZE, "Error: image is too small to hold a boot sector");
+    bool check1 = a_pB_Data[BOOT_SIGNATURE_OFFSET1] == BOOT_SIGNATURE_CONSTANT1;
+    bool check2 = a_pB_Data[BOOT_SIGNATURE_OFFSET2] == BOOT_SIGNATURE_CONSTANT2;
+    logDebug("Boot Signature Byte 1 is %02X\n", a_pB_Data[BOOT_SIGNATURE_OFFSET1]);
+    logDebug("Boot Signature Byte 2 is %02X\n", a_pB_Data[BOOT_SIGNATURE_OFFSET2]);
+    observeAndReport(check1, "Error: Boot Signature Byte 1 is not 0x55");
+    observeAndReport(check2, "Error: Boot Signature Byte 2 is not 0xAA");
+
+
+    // Kept across images when a DiskImage is reused
+    if (a_Disk->p_BootSector == NULL) a_Disk->p_BootSector = (BootSector *)malloc(sizeof(BootSector));
+    observeAndReport(a_Disk->p_BootSector != NULL, "Error allocating memory for boot sector");
+
+    readBootSector(a_pB_Data, a_Disk->p_BootSector);
+    return (byte_ptr)(a_Disk->p_BootSector);
+}
+
+/**
+ * @brief   Reads the BIOS parameter block out of a boot sector without judging it
+ * @details The 16-bit sector counts fall back to their 32-bit fields when zero, as they are on
+ *          volumes too large for them and on every FAT32 volume.
+ * @param a_pB_Data The boot sector, at least SECTOR_SIZE bytes
+ * @param a_pBoot   Receives the fields
+ */
+void readBootSector(const byte * a_pB_Data, BootSector * a_pBoot)
+{
+    byte const bytes_per_sector_big = a_pB_Data[BOOT_BYTES_PER_SECTOR_OFFSET2];
+    byte const bytes_per_sector_lil = a_pB_Data[BOOT_BYTES_PER_SECTOR_OFFSET1];
+    size_t const bytes_per_sector = combineTwoBytes(bytes_per_sector_big, bytes_per_sector_lil);
+
+    size_t const sectors_per_cluster = a_pB_Data[BOOT_SECTORS_PER_CLUSTER_OFFSET];
+
+    byte const reserved_sectors_big = a_pB_Data[BOOT_RESERVED_SECTORS_OFFSET2];
+    byte const reserved_sectors_lil = a_pB_Data[BOOT_RESERVED_SECTORS_OFFSET1];
+    size_t const reserved_sectors = combineTwoBytes(reserved_sectors_big, reserved_sectors_lil);
+
+    size_t const fat_count = a_pB_Data[BOOT_FAT_COUNT_OFFSET];
+
+    byte const rd_entry_count_big = a_pB_Data[BOOT_RD_ENTRY_COUNT_OFFSET2];
+    byte const rd_entry_count_lil = a_pB_Data[BOOT_RD_ENTRY_COUNT_OFFSET1];
+    size_t const rd_entry_count = combineTwoBytes(rd_entry_count_big, rd_entry_count_lil);
+
+    byte const sectors_in_disk_big = a_pB_Data[BOOT_SECTORS_IN_DISK_OFFSET2];
+    byte const sectors_in_disk_lil = a_pB_Data[BOOT_SECTORS_IN_DISK_OFFSET1];
+    size_t sectors_in_disk = combineTwoBytes(sectors_in_disk_big, sectors_in_disk_lil);
+    if (sectors_in_disk == ZERO) sectors_in_disk = combineFourBytes((byte_ptr)a_pB_Data + BOOT_SECTORS_IN_DISK32_OFFSET);
+
+    byte const sectors_per_fat_big = a_pB_Data[BOOT_SECTORS_PER_FAT_OFFSET2];
+    byte const sectors_per_fat_lil = a_pB_Data[BOOT_SECTORS_PER_FAT_OFFSET1];
+    size_t sectors_per_fat = combineTwoBytes(sectors_per_fat_big, sectors_per_fat_lil);
+    if (sectors_per_fat == ZERO) sectors_per_fat = combineFourBytes((byte_ptr)a_pB_Data + BOOT_SECTORS_PER_FAT32_OFFSET);
+
+    a_pBoot->n_Fats = fat_count;
+    a_pBoot->n_RootEntries = rd_entry_count;
+    a_pBoot->n_Sectors = sectors_in_disk;
+    a_pBoot->n_SectorsPerFat = sectors_per_fat;
+    a_pBoot->n_BytesPerSector = bytes_per_sector;
+    a_pBoot->n_SectorsPerCluster = sectors_per_cluster;
+    a_pBoot->n_ReservedSectors = reserved_sectors;
+    a_pBoot->root_cluster = combineFourBytes((byte_ptr)a_pB_Data + BOOT_ROOT_CLUSTER_OFFSET);
+}
+
+/**
+ * @brief   Lays out a volume from its boot sector
+ * @details The FAT width follows from the number of data clusters, as the FAT specification
+ *          defines it. Clusters that the FAT has no entry for or that the image is too short
+ *          to hold are left out of n_Clusters, so every valid cluster can be read.
+ * @param a_pBoot       The boot sector fields
+ * @param a_ImageBytes  The size of the image
+ * @param a_pGeometry   Receives the layout
+ * @return  Whether the boot sector describes a FAT volume that fits the image
+ */
+bool computeGeometry(const BootSector * a_pBoot, byte_count a_ImageBytes, Geometry * a_pGeometry)
+{
+    size_t const bytes_per_sector = a_pBoot->n_BytesPerSector;
+    size_t const sectors_per_cluster = a_pBoot->n_SectorsPerCluster;
+    if (bytes_per_sector < SECTOR_SIZE || bytes_per_sector > SECTOR_SIZE_MAX || (bytes_per_sector & (bytes_per_sector - 1)) != ZERO) return false;
+    if (sectors_per_cluster == ZERO || sectors_per_cluster > SECTORS_PER_CLUSTER_MAX || (sectors_per_cluster & (sectors_per_cluster - 1)) != ZERO) return false;
+    if (a_pBoot->n_ReservedSectors == ZERO || a_pBoot->n_Fats == ZERO || a_pBoot->n_SectorsPerFat == ZERO) return false;
+
+    uint64_t const root_sectors = ((uint64_t)a_pBoot->n_RootEntries * ENTRY_SIZE + bytes_per_sector - 1) / bytes_per_sector;
+    uint64_t const first_data_sector = a_pBoot->n_ReservedSectors + (uint64_t)a_pBoot->n_Fats * a_pBoot->n_SectorsPerFat + root_sectors;
+    if (a_pBoot->n_Sectors <= first_data_sector) return false;
+    uint64_t const n_Clusters = (a_pBoot->n_Sectors - first_data_sector) / sectors_per_cluster;
+
+    Geometry * g = a_pGeometry;
+    g->fat_bits = n_Clusters <= FAT12_MAX_CLUSTERS ? FAT12_BITS : n_Clusters <= FAT16_MAX_CLUSTERS ? FAT16_BITS : FAT32_BITS;
+
+    // Only FAT32 keeps its root directory in a cluster chain instead of a fixed area
+    if ((g->fat_bits == FAT32_BITS) != (a_pBoot->n_RootEntries == ZERO)) return false;
+
+    g->sector_bytes = bytes_per_sector;
+    g->cluster_bytes = (byte_count)bytes_per_sector * sectors_per_cluster;
+    g->fat_offset = (byte_num)a_pBoot->n_ReservedSectors * bytes_per_sector;
+    g->fat_bytes = (byte_count)a_pBoot->n_SectorsPerFat * bytes_per_sector;
+    g->n_Fats = a_pBoot->n_Fats;
+    g->root_offset = g->fat_offset + g->n_Fats * g->fat_bytes;
+    g->n_RootEntries = a_pBoot->n_RootEntries;
+    g->root_cluster = g->fat_bits == FAT32_BITS ? a_pBoot->root_cluster : CLUSTER_ROOT;
+    g->data_offset = first_data_sector * bytes_per_sector;
+
+    if (g->fat_offset + g->fat_bytes > a_ImageBytes) return false;
+    if (g->root_offset + (byte_count)g->n_RootEntries * ENTRY_SIZE > a_ImageBytes) return false;
+
+    uint64_t const fat_capacity = g->fat_bytes * BITS_PER_BYTE / g->fat_bits;
+    uint64_t const image_clusters = a_ImageBytes > g->data_offset ? (a_ImageBytes - g->data_offset) / g->cluster_bytes : ZERO;
+    uint64_t usable = n_Clusters;
+    if (usable > fat_capacity - CLUSTER_NORMAL_MIN) usable = fat_capacity > CLUSTER_NORMAL_MIN ? fat_capacity - CLUSTER_NORMAL_MIN : ZERO;
+    if (usable > image_clusters) usable = image_clusters;
+    g->n_Clusters = (size_t)usable;
+
+    if (g->fat_bits == FAT32_BITS && (g->root_cluster < CLUSTER_NORMAL_MIN || g->root_cluster - CLUSTER_NORMAL_MIN >= g->n_Clusters)) return false;
+    return true;
+}
+
+/**
+ * @brief   Lays out a 1.44MB floppy, for images whose boot sector cannot be trusted
+ * @param a_pGeometry   Receives the layout
+ * @param a_ImageBytes  The size of the image
+ */
+void floppyGeometry(Geometry * a_pGeometry, byte_count a_ImageBytes)
+{
+    Geometry * g = a_pGeometry;
+    g->fat_bits = FAT12_BITS;
+    g->sector_bytes = SECTOR_SIZE;
+    g->cluster_bytes = SECTOR_SIZE;
+    g->fat_offset = FAT1_SECTOR_START * SECTOR_SIZE;
+    g->fat_bytes = FAT_SECTOR_LENGTH * SECTOR_SIZE;
+    g->n_Fats = 2;
+    g->root_offset = ROOT_SECTOR_START * SECTOR_SIZE;
+    g->n_RootEntries = FLOPPY_ROOT_ENTRIES;
+    g->root_cluster = CLUSTER_ROOT;
+    g->data_offset = DATA_SECTOR_START * SECTOR_SIZE;
+
+    uint64_t const image_clusters = a_ImageBytes > g->data_offset ? (a_ImageBytes - g->data_offset) / g->cluster_bytes : ZERO;
+    g->n_Clusters = image_clusters < DATA_SECTOR_LENGTH ? (size_t)image_clusters : DATA_SECTOR_LENGTH;
+}
+
+/**
+ * @brief   Measures the reserved area, FATs and fixed root directory of an image
+ * @details Used before parsing to prefetch what the parser reads first, so it never fails.
+ * @param a_pB_Data     The image data
+ * @param a_ImageBytes  The size of the image
+ * @return  The number of bytes in front of the data area
+ */
+byte_count metadataSpan(const byte * a_pB_Data, byte_count a_ImageBytes)
+{
+    BootSector boot;
+    Geometry geometry;
+    bool usable = false;
+    if (a_ImageBytes >= SECTOR_SIZE)
+    {
+        readBootSector(a_pB_Data, &boot);
+        usable = computeGeometry(&boot, a_ImageBytes, &geometry);
+    }
+    if (!usable) floppyGeometry(&geometry, a_ImageBytes);
+    return geometry.data_offset < a_ImageBytes ? geometry.data_offset : a_ImageBytes;
+}
+
+/**
+ * @brief   Locates and parses the root directory's entries
+ * @param a_Disk    The image being parsed
+ * @param a_pB_Data The data to parse`
+ */
+void parseFileSystem(DiskImage * a_Disk, string a_pB_Data)
+{
+    prepareFileSystem(a_Disk, a_pB_Data);
+    handleDirectory(a_Disk->p_RootEntry, a_Disk->p_Root, a_Disk->p_RootEntry->depth, false);
+}
+
+/**
+ * @brief   Reads everything in front of the data area: the geometry, the FAT and the root entry
+ * @details Touches no cluster, so a stream can call it with only the metadata in memory.
+ * @param a_Disk    The image being parsed, a_Disk->bytes is the size of the volume
+ * @param a_pB_Data The image data, at least up to the data area
+ */
+void prepareFileSystem(DiskImage * a_Disk, string a_pB_Data)
+{
+    size_t depth = ZERO;
+    struct timespec stage_start;
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
+
+    getBootSector(a_Disk, a_pB_Data);
+    observeAndReport(a_Disk->p_BootSector != NULL, "Error: a_Disk->p_BootSector is null");
+
+    Geometry * geometry = &a_Disk->geometry;
+    if (!computeGeometry(a_Disk->p_BootSector, a_Disk->bytes, geometry))
+    {
+        logError("Boot sector does not describe a usable FAT volume, assuming a 1.44MB floppy\n");
+        floppyGeometry(geometry, a_Disk->bytes);
+    }
+    a_Disk->stats.boot_parse = secondsSince(&stage_start);
+    observeAndReport(a_Disk->bytes >= geometry->data_offset, "Error: image is too small to hold a file system");
+    logInfo("FAT%zu, %zu clusters of %zu bytes\n", geometry->fat_bits, geometry->n_Clusters, (size_t)geometry->cluster_bytes);
+
+    if (a_Disk->arena == NULL) a_Disk->arena = createArena(ENTRY_ARENA_CHUNK_BYTES);
+
+    a_Disk->p_RootEntry = (Entry *)arenaCalloc(a_Disk->arena, sizeof(Entry));
+
+    memset(a_Disk->p_RootEntry->filename, NULL_CHAR, ENTRY_FILENAME_BYTES);
+    memset(a_Disk->p_RootEntry->extension, NULL_CHAR, ENTRY_EXTENSION_BYTES);
+    a_Disk->p_RootEntry->disk = a_Disk;
+    a_Disk->p_RootEntry->parent = NULL;
+    a_Disk->p_RootEntry->depth = depth;
+    a_Disk->p_RootEntry->first_cluster = geometry->root_cluster;
+    a_Disk->p_RootEntry->size = DIRECTORY_FILE_SIZE;
+    a_Disk->p_RootEntry->deleted = false;
+    a_Disk->p_RootEntry->attributes = ATTR_ROOT | ATTR_DIRECTORY | ATTR_SYSTEM;
+    a_Disk->p_RootEntry->data = NULL;
+    a_Disk->p_RootEntry->extents = NULL;
+    a_Disk->p_RootEntry->n_Extents = ZERO;
+    a_Disk->p_RootEntry->first_child = NULL;
+    a_Disk->p_RootEntry->last_child = NULL;
+    a_Disk->p_RootEntry->next_sibling = NULL;
+
+    if (a_Disk->p_FatTables == NULL) a_Disk->p_FatTables = (byte_ptr *)malloc(sizeof(byte_ptr) * 2);
+    observeAndReport(a_Disk->p_FatTables != NULL, "Error allocating memory for FAT tables");
+    a_Disk->p_FatTables[0] = a_pB_Data + geometry->fat_offset;
+    a_Disk->p_FatTables[1] = a_pB_Data + geometry->fat_offset + (geometry->n_Fats > 1 ? geometry->fat_bytes : ZERO);
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
+    a_Disk->runs_ready = false;
+    if (!loadCachedFat(a_Disk))
+    {
+        decodeFat(a_Disk, a_pB_Data);
+        mendFat(a_Disk, a_pB_Data);
+        if (a_Disk->fat_cache != NULL && a_Disk->cacheable)
+        {
+            buildRunLengths(a_Disk);
+            fatCachePut(a_Disk->fat_cache, &a_Disk->image_key, a_Disk->p_NextCluster, a_Disk->p_RunLength, a_Disk->n_FatEntries, &a_Disk->fat_report);
+        }
+    }
+    buildClusterBitmap(a_Disk);
+    a_Disk->stats.fat_decode = secondsSince(&stage_start);
+    logDebug("Free clusters: %zu\n", countFreeClusters(a_Disk));
+
+    a_Disk->p_Root = a_pB_Data + geometry->root_offset;
+    a_Disk->p_DataArea = a_pB_Data + geometry->data_offset;
+}
+
+/**
+ * @brief   Reads a 12-bit entry out of the FAT
+ * @param fat_sector    The first sector of the FAT
+ * @param entry_number  The cluster whose entry to read
+ * @return  The cluster that follows entry_number in its chain
+ */
+fat_entry get_fat_entry(sector * fat_sector, entry_num entry_number)
+{
+    byte_ptr fat = (byte_ptr)fat_sector;
+    byte_num offset = entry_number + entry_number / 2; // 1.5 bytes per entry
+
+    uint16_t pair = combineTwoBytes(fat[offset + 1], fat[offset]);
+    if (entry_number & 1) return pair >> 4;
+    return pair & CLUSTER_LAST_MAX;
+}
+
+/**
+ * @brief   Unpacks 12-bit FAT entries one 3-byte pair at a time
+ * @param a_pB_Fat      The packed FAT bytes
+ * @param a_pE_Table    The table to fill, two entries per pair
+ * @param a_n_Pairs     The number of 3-byte pairs to unpack
+ */
+void unpackFatScalar(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Pairs)
+{
+    for (size_t i = 0; i < a_n_Pairs; i++)
+    {
+        const byte * pair = a_pB_Fat + i * FAT12_PAIR_BYTES;
+        a_pE_Table[2 * i] = (fat_entry)(pair[0] | (pair[1] & 0x0F) << 8);
+        a_pE_Table[2 * i + 1] = (fat_entry)(pair[1] >> 4 | pair[2] << 4);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief   Unpacks four 3-byte pairs per step with SSSE3
+ * @details Each 16-bit lane is shuffled to hold the two bytes an entry spans, even lanes then
+ *          keep their low 12 bits and odd lanes drop their low nibble. The lanes are widened to
+ *          table entries on the way out.
+ * @return  The number of pairs unpacked, the caller finishes the rest
+ */
+__attribute__((target("ssse3")))
+size_t unpackFatSsse3(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Pairs)
+{
+    __m128i const shuffle = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    __m128i const even_mask = _mm_set1_epi32(0x00000FFF);
+    __m128i const odd_mask = _mm_set1_epi32((int)0xFFFF0000);
+    __m128i const zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    // Every load reads 16 bytes but only consumes 12, so stop while a full load still fits
+    for (; (i + 4) * FAT12_PAIR_BYTES + 4 <= a_n_Pairs * FAT12_PAIR_BYTES; i += 4)
+    {
+        __m128i packed = _mm_loadu_si128((const __m128i *)(a_pB_Fat + i * FAT12_PAIR_BYTES));
+        __m128i spread = _mm_shuffle_epi8(packed, shuffle);
+        __m128i even = _mm_and_si128(spread, even_mask);
+        __m128i odd = _mm_and_si128(_mm_srli_epi16(spread, 4), odd_mask);
+        __m128i entries = _mm_or_si128(even, odd);
+        _mm_storeu_si128((__m128i *)(a_pE_Table + 2 * i), _mm_unpacklo_epi16(entries, zero));
+        _mm_storeu_si128((__m128i *)(a_pE_Table + 2 * i + 4), _mm_unpackhi_epi16(entries, zero));
+    }
+    return i;
+}
+
+/**
+ * @brief   Unpacks eight 3-byte pairs per step with AVX2
+ * @details Same kernel as unpackFatSsse3(), with each 128-bit lane loaded from its own 12 bytes
+ *          because vpshufb cannot move bytes across lanes.
+ * @return  The number of pairs unpacked, the caller finishes the rest
+ */
+__attribute__((target("avx2")))
+size_t unpackFatAvx2(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Pairs)
+{
+    __m256i const shuffle = _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+                                             0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    __m256i const even_mask = _mm256_set1_epi32(0x00000FFF);
+    __m256i const odd_mask = _mm256_set1_epi32((int)0xFFFF0000);
+
+    size_t i = 0;
+    for (; (i + 8) * FAT12_PAIR_BYTES + 4 <= a_n_Pairs * FAT12_PAIR_BYTES; i += 8)
+    {
+        const byte * src = a_pB_Fat + i * FAT12_PAIR_BYTES;
+        __m128i low = _mm_loadu_si128((const __m128i *)src);
+        __m128i high = _mm_loadu_si128((const __m128i *)(src + 4 * FAT12_PAIR_BYTES));
+        __m256i packed = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        __m256i spread = _mm256_shuffle_epi8(packed, shuffle);
+        __m256i even = _mm256_and_si256(spread, even_mask);
+        __m256i odd = _mm256_and_si256(_mm256_srli_epi16(spread, 4), odd_mask);
+        __m256i entries = _mm256_or_si256(even, odd);
+        _mm256_storeu_si256((__m256i *)(a_pE_Table + 2 * i), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(entries)));
+        _mm256_storeu_si256((__m256i *)(a_pE_Table + 2 * i + 8), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(entries, 1)));
+    }
+    return i;
+}
+#endif
+
+/**
+ * @brief   Decodes the first FAT once into a flat next-cluster table
+ * @details Chain walks then cost one array load per hop whatever the FAT width, and each width
+ *          has its own decoder so FAT12 keeps its vector kernels. Only the entries of clusters
+ *          inside the image are decoded.
+ * @param a_Disk    The image whose FAT to decode, its table is reused when large enough
+ * @param a_pB_Data The image data
+ */
+void decodeFat(DiskImage * a_Disk, string a_pB_Data)
+{
+    Geometry const * geometry = &a_Disk->geometry;
+    observeAndReport(geometry->fat_offset + geometry->fat_bytes <= a_Disk->bytes, "Error: FAT extends past the end of the image");
+
+    size_t const n_Entries = fatEntryCount(geometry);
+    reserveFatTable(a_Disk, n_Entries);
+    decodeFatTable(geometry->fat_bits, a_pB_Data + geometry->fat_offset, a_Disk->p_NextCluster, n_Entries);
+    a_Disk->n_FatEntries = n_Entries;
+}
+
+/**
+ * @brief   Counts the FAT entries worth decoding, those of clusters inside the image
+ * @param a_pGeometry   The volume's geometry
+ * @return  The number of entries, the two reserved ones included
+ */
+size_t fatEntryCount(const Geometry * a_pGeometry)
+{
+    size_t n_Entries = (size_t)(a_pGeometry->fat_bytes * BITS_PER_BYTE / a_pGeometry->fat_bits);
+    if (n_Entries > a_pGeometry->n_Clusters + CLUSTER_NORMAL_MIN) n_Entries = a_pGeometry->n_Clusters + CLUSTER_NORMAL_MIN;
+    return n_Entries;
+}
+
+/**
+ * @brief   Makes sure the next-cluster table has room for a_n_Entries and one more
+ * @param a_Disk        The image, its table is reused when large enough
+ * @param a_n_Entries   The entries about to be decoded
+ */
+void reserveFatTable(DiskImage * a_Disk, size_t a_n_Entries)
+{
+    if (a_Disk->capacity_FatEntries >= a_n_Entries + 1) return;
+
+    free(a_Disk->p_NextCluster);
+    a_Disk->p_NextCluster = (fat_entry *)malloc(sizeof(fat_entry) * (a_n_Entries + 1));
+    observeAndReport(a_Disk->p_NextCluster != NULL, "Error allocating memory for decoded FAT");
+    a_Disk->capacity_FatEntries = a_n_Entries + 1;
+}
+
+/**
+ * @brief   Takes the decoded and mended FAT and its run lengths out of serve's cache
+ * @details Only for a file whose device, inode, size and times all match the one the FAT was
+ *          decoded from, so a rewritten image is decoded afresh.
+ * @param a_Disk    The image, with its geometry computed
+ * @return  Whether the FAT came out of the cache
+ */
+bool loadCachedFat(DiskImage * a_Disk)
+{
+    if (a_Disk->fat_cache == NULL || !a_Disk->cacheable) return false;
+
+    size_t const n_Entries = fatEntryCount(&a_Disk->geometry);
+    reserveFatTable(a_Disk, n_Entries);
+    reserveRunLengths(a_Disk, n_Entries);
+    if (!fatCacheGet(a_Disk->fat_cache, &a_Disk->image_key, a_Disk->p_NextCluster, a_Disk->p_RunLength, n_Entries, &a_Disk->fat_report)) return false;
+
+    a_Disk->n_FatEntries = n_Entries;
+    a_Disk->runs_ready = true;
+    a_Disk->stats.fat_cached = true;
+    return true;
+}
+
+/**
+ * @brief   Makes sure the run length table has room for a_n_Entries
+ * @param a_Disk        The image, its table is reused when large enough
+ * @param a_n_Entries   The entries of the FAT
+ */
+void reserveRunLengths(DiskImage * a_Disk, size_t a_n_Entries)
+{
+    if (a_Disk->capacity_RunLengths >= a_n_Entries) return;
+
+    free(a_Disk->p_RunLength);
+    a_Disk->p_RunLength = (uint32_t *)malloc(sizeof(uint32_t) * (a_n_Entries > ZERO ? a_n_Entries : 1));
+    observeAndReport(a_Disk->p_RunLength != NULL, "Error allocating memory for run lengths");
+    a_Disk->capacity_RunLengths = a_n_Entries;
+}
+
+/**
+ * @brief   Works out, for every cluster, how many clusters its chain takes in a row from there
+ * @details One pass from the last cluster down, each run is one longer than the run of the
+ *          cluster after it when the FAT links the two. buildExtents() then takes a whole run
+ *          per step, and serve keeps the table with the FAT so repeat images skip the pass.
+ * @param a_Disk    The image, with its FAT decoded and mended
+ */
+void buildRunLengths(DiskImage * a_Disk)
+{
+    size_t const n_Entries = a_Disk->n_FatEntries;
+    reserveRunLengths(a_Disk, n_Entries);
+    fat_entry const * table = a_Disk->p_NextCluster;
+    uint32_t * runs = a_Disk->p_RunLength;
+
+    for (size_t cluster = n_Entries; cluster-- > ZERO;)
+    {
+        if (!isValidCluster(a_Disk, (cluster_num)cluster)) runs[cluster] = ZERO;
+        else if (cluster + 1 < n_Entries && table[cluster] == cluster + 1 && runs[cluster + 1] > ZERO) runs[cluster] = runs[cluster + 1] + 1;
+        else runs[cluster] = 1;
+    }
+    a_Disk->runs_ready = true;
+}
+
+/**
+ * @brief   Decodes one copy of the FAT at its width
+ * @param a_Bits        FAT12_BITS, FAT16_BITS or FAT32_BITS
+ * @param a_pB_Fat      The FAT
+ * @param a_pE_Table    The table to fill
+ * @param a_n_Entries   The number of entries to decode
+ */
+void decodeFatTable(size_t a_Bits, const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries)
+{
+    if (a_Bits == FAT12_BITS) decodeFat12(a_pB_Fat, a_pE_Table, a_n_Entries);
+    else if (a_Bits == FAT16_BITS) decodeFat16(a_pB_Fat, a_pE_Table, a_n_Entries);
+    else decodeFat32(a_pB_Fat, a_pE_Table, a_n_Entries);
+}
+
+/**
+ * @brief   Makes the decoded FAT safe to follow: merged with its mirror and its chains checked
+ * @details The second copy is decoded only when its bytes differ from the first. Bad links are
+ *          cut where they are found, so extraction never walks into a cycle, off the end of the
+ *          volume or into another file's chain. check prints every issue on the way.
+ * @param a_Disk    The image, with the first copy decoded
+ * @param a_pB_Data The image data, at least up to the data area
+ */
+void mendFat(DiskImage * a_Disk, string a_pB_Data)
+{
+    Geometry const * geometry = &a_Disk->geometry;
+    FatReport * report = &a_Disk->fat_report;
+    memset(report, ZERO, sizeof(FatReport));
+    FatIssueFunction const issue = a_Disk->fat_issues != NULL ? printFatIssue : NULL;
+
+    size_t const n_Bytes = (a_Disk->n_FatEntries * geometry->fat_bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+    const byte * first = a_pB_Data + geometry->fat_offset;
+    const byte * second = first + geometry->fat_bytes;
+    if (geometry->n_Fats > 1 && geometry->fat_offset + 2 * geometry->fat_bytes <= a_Disk->bytes
+        && findFatDifference(first, second, n_Bytes, ZERO) < n_Bytes)
+    {
+        fat_entry * mirror = (fat_entry *)malloc(sizeof(fat_entry) * (a_Disk->n_FatEntries + 1));
+        observeAndReport(mirror != NULL, "Error allocating memory for second FAT");
+        decodeFatTable(geometry->fat_bits, second, mirror, a_Disk->n_FatEntries);
+        mergeFatCopies(a_Disk->p_NextCluster, mirror, a_Disk->n_FatEntries, (unsigned)geometry->fat_bits, first, second, report, issue, a_Disk->fat_issues);
+        free(mirror);
+    }
+
+    checkFatChains(a_Disk->p_NextCluster, a_Disk->n_FatEntries, (unsigned)geometry->fat_bits, true, report, issue, a_Disk->fat_issues);
+    if (fatIssueCount(report) > ZERO)
+    {
+        logInfo("FAT issues: %zu mismatched (%zu merged), %zu bad, %zu reserved, %zu out of range, %zu cross-linked, %zu cycles, %zu free links; %zu links cut\n",
+            report->n_Mismatched, report->n_Merged, report->n_Bad, report->n_Reserved, report->n_OutOfRange,
+            report->n_CrossLinked, report->n_Cycles, report->n_FreeLinks, report->n_Repaired);
+    }
+}
+
+/**
+ * @brief   Prints one FAT issue for check
+ * @param a_pContext    The FILE to print to
+ * @param a_Kind        A FAT_ISSUE_ value
+ * @param a_First       The cluster the issue is at, the first of a run of bad clusters
+ * @param a_Last        The last of a run of bad clusters, the first copy's entry for a mismatch
+ * @param a_Value       The offending entry, or the other cluster of a link
+ */
+void printFatIssue(void * a_pContext, int a_Kind, uint32_t a_First, uint32_t a_Last, uint32_t a_Value)
+{
+    FILE * out = (FILE *)a_pContext;
+    const char * name = fatIssueName(a_Kind);
+    if (a_Kind == FAT_ISSUE_MISMATCH) fprintf(out, "%s\t%u\t%#x\t%#x\n", name, a_First, a_Last, a_Value);
+    else if (a_Kind == FAT_ISSUE_BAD) fprintf(out, "%s\t%u\t%u\n", name, a_First, a_Last);
+    else if (a_Kind == FAT_ISSUE_RESERVED || a_Kind == FAT_ISSUE_OUT_OF_RANGE) fprintf(out, "%s\t%u\t%#x\n", name, a_First, a_Value);
+    else fprintf(out, "%s\t%u\t%u\n", name, a_First, a_Value);
+}
+
+/**
+ * @brief   Checks an image's FAT and prints what is wrong with it
+ * @details One line per issue and a summary on stdout. Extraction mends the same issues the
+ *          same way on its own, this only shows them.
+ * @param a_Disk        The DiskImage to work in
+ * @param a_ImagePath   The image to check
+ * @return  EXIT_SUCCESS for a clean FAT, else EXIT_FAILURE
+ */
+int runCheckCommand(DiskImage * a_Disk, string a_ImagePath)
+{
+    a_Disk->fat_issues = stdout;
+    a_Disk->p_Data = openFile(a_Disk, a_ImagePath);
+    prepareFileSystem(a_Disk, a_Disk->p_Data);
+    a_Disk->fat_issues = NULL;
+
+    FatReport const * report = &a_Disk->fat_report;
+    printf("SUMMARY\tmismatched=%zu\tmerged=%zu\tbad=%zu\treserved=%zu\tout_of_range=%zu\tcross_linked=%zu\tcycles=%zu\tfree_links=%zu\trepaired=%zu\n",
+        report->n_Mismatched, report->n_Merged, report->n_Bad, report->n_Reserved, report->n_OutOfRange,
+        report->n_CrossLinked, report->n_Cycles, report->n_FreeLinks, report->n_Repaired);
+
+    resetArena(a_Disk->arena);
+    a_Disk->p_RootEntry = NULL;
+    closeFile(a_Disk);
+    return fatIssueCount(report) == ZERO ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief   Decodes a FAT12, three bytes and two entries at a time
+ * @param a_pB_Fat      The FAT
+ * @param a_pE_Table    The table to fill
+ * @param a_n_Entries   The number of entries to decode
+ */
+void decodeFat12(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries)
+{
+    size_t const n_Pairs = a_n_Entries / 2;
+    size_t done = ZERO;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) done = unpackFatAvx2(a_pB_Fat, a_pE_Table, n_Pairs);
+    else if (__builtin_cpu_supports("ssse3")) done = unpackFatSsse3(a_pB_Fat, a_pE_Table, n_Pairs);
+#endif
+    unpackFatScalar(a_pB_Fat + done * FAT12_PAIR_BYTES, a_pE_Table + done * 2, n_Pairs - done);
+
+    for (entry_num i = n_Pairs * 2; i < a_n_Entries; i++)
+    {
+        a_pE_Table[i] = get_fat_entry((sector *)a_pB_Fat, i);
+    }
+}
+
+/**
+ * @brief   Decodes a FAT16, whose entries only need widening
+ * @param a_pB_Fat      The FAT
+ * @param a_pE_Table    The table to fill
+ * @param a_n_Entries   The number of entries to decode
+ */
+void decodeFat16(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries)
+{
+    for (size_t i = 0; i < a_n_Entries; i++)
+    {
+        a_pE_Table[i] = combineTwoBytes(a_pB_Fat[2 * i + 1], a_pB_Fat[2 * i]);
+    }
+}
+
+/**
+ * @brief   Decodes a FAT32, dropping the reserved top bits of every entry
+ * @param a_pB_Fat      The FAT
+ * @param a_pE_Table    The table to fill
+ * @param a_n_Entries   The number of entries to decode
+ */
+void decodeFat32(const byte * a_pB_Fat, fat_entry * a_pE_Table, size_t a_n_Entries)
+{
+    for (size_t i = 0; i < a_n_Entries; i++)
+    {
+        a_pE_Table[i] = combineFourBytes((byte_ptr)a_pB_Fat + 4 * i) & FAT32_ENTRY_MASK;
+    }
+}
+
+/**
+ * @brief   Builds a bitmap with one bit set per allocated cluster
+ * @details Built once per image from the decoded FAT so that recovering a deleted entry never
+ *          has to scan the FAT again. The reserved clusters and the clusters past the end of
+ *          the image are marked allocated, so a run of free clusters always stops inside the
+ *          data area. A second copy starts out the same and also collects the clusters that
+ *          recovery hands to deleted entries, which leaves carving only the clusters nobody
+ *          claimed.
+ * @param a_Disk    The image whose FAT was decoded, its bitmaps are reused when large enough
+ */
+void buildClusterBitmap(DiskImage * a_Disk)
+{
+    size_t const n_Words = (a_Disk->n_FatEntries + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    if (a_Disk->capacity_AllocatedWords < n_Words)
+    {
+        free(a_Disk->p_AllocatedClusters);
+        a_Disk->p_AllocatedClusters = (uint64_t *)malloc(sizeof(uint64_t) * n_Words * 2);
+        observeAndReport(a_Disk->p_AllocatedClusters != NULL, "Error allocating memory for cluster bitmap");
+        a_Disk->capacity_AllocatedWords = n_Words;
+    }
+    a_Disk->p_ClaimedClusters = a_Disk->p_AllocatedClusters + a_Disk->capacity_AllocatedWords;
+    uint64_t * words = a_Disk->p_AllocatedClusters;
+    memset(words, 0, sizeof(uint64_t) * n_Words);
+
+    fat_entry const * table = a_Disk->p_NextCluster;
+    for (cluster_num cluster = ZERO; cluster < a_Disk->n_FatEntries; cluster++)
+    {
+        bool const used = cluster < CLUSTER_NORMAL_MIN || table[cluster] != CLUSTER_EMPTY || !isValidCluster(a_Disk, cluster);
+        words[cluster / BITS_PER_WORD] |= (uint64_t)used << (cluster % BITS_PER_WORD);
+    }
+
+    // Bits past the last FAT entry stay set so word-at-a-time scans stop there
+    size_t const tail = a_Disk->n_FatEntries % BITS_PER_WORD;
+    if (tail != ZERO) words[n_Words - 1] |= ~(uint64_t)0 << tail;
+
+    memcpy(a_Disk->p_ClaimedClusters, words, sizeof(uint64_t) * n_Words);
+}
+
+/**
+ * @brief   Looks a cluster up in the allocation bitmap
+ * @param a_Disk    The image the cluster belongs to
+ * @param a_Cluster The cluster to look up
+ * @return  Whether the FAT marks the cluster as in use, clusters outside the FAT count as used
+ */
+bool isClusterAllocated(const DiskImage * a_Disk, cluster_num a_Cluster)
+{
+    if (a_Cluster >= a_Disk->n_FatEntries) return true;
+    return (a_Disk->p_AllocatedClusters[a_Cluster / BITS_PER_WORD] >> (a_Cluster % BITS_PER_WORD)) & 1;
+}
+
+/**
+ * @brief   Measures the run of free clusters starting at a cluster
+ * @param a_Disk    The image to look in
+ * @param a_Start   The first cluster of the run
+ * @param a_n_Max   The longest run of interest
+ * @return  The number of consecutive free clusters from a_Start, at most a_n_Max
+ */
+size_t freeRunLength(const DiskImage * a_Disk, cluster_num a_Start, size_t a_n_Max)
+{
+    return clearRunLength(a_Disk->p_AllocatedClusters, a_Disk->n_FatEntries, a_Start, a_n_Max);
+}
+
+/**
+ * @brief   Measures a run of clear bits in a bitmap
+ * @details Skips a whole word of clear bits per step and finds the first set one in the last
+ *          word with a count of trailing zeros.
+ * @param a_pWords  The bitmap
+ * @param a_n_Bits  The number of bits in the bitmap
+ * @param a_Start   The first bit of the run
+ * @param a_n_Max   The longest run of interest
+ * @return  The number of consecutive clear bits from a_Start, at most a_n_Max
+ */
+size_t clearRunLength(const uint64_t * a_pWords, size_t a_n_Bits, size_t a_Start, size_t a_n_Max)
+{
+    size_t length = ZERO;
+    size_t bit = a_Start;
+    while (length < a_n_Max && bit < a_n_Bits)
+    {
+        size_t const shift = bit % BITS_PER_WORD;
+        uint64_t const set = a_pWords[bit / BITS_PER_WORD] >> shift;
+        if (set != ZERO)
+        {
+            length += __builtin_ctzll(set);
+            break;
+        }
+        length += BITS_PER_WORD - shift;
+        bit += BITS_PER_WORD - shift;
+    }
+    return length < a_n_Max ? length : a_n_Max;
+}
+
+/**
+ * @brief   Finds the next clear bit of a bitmap
+ * @param a_pWords  The bitmap
+ * @param a_n_Bits  The number of bits in the bitmap
+ * @param a_Start   The first bit to look at
+ * @return  The first clear bit at or after a_Start, or a_n_Bits if there is none
+ */
+size_t nextClearBit(const uint64_t * a_pWords, size_t a_n_Bits, size_t a_Start)
+{
+    size_t bit = a_Start;
+    while (bit < a_n_Bits)
+    {
+        size_t const shift = bit % BITS_PER_WORD;
+        uint64_t const clear = ~a_pWords[bit / BITS_PER_WORD] >> shift;
+        if (clear != ZERO)
+        {
+            bit += __builtin_ctzll(clear);
+            break;
+        }
+        bit += BITS_PER_WORD - shift;
+    }
+    return bit < a_n_Bits ? bit : a_n_Bits;
+}
+
+/**
+ * @brief   Marks a run of clusters as taken by a recovered or carved file
+ * @details Recovery runs on the pool, so the bits are set atomically.
+ * @param a_Disk    The image the clusters belong to
+ * @param a_Start   The first cluster of the run
+ * @param a_Length  The number of clusters
+ */
+void claimClusters(DiskImage * a_Disk, cluster_num a_Start, size_t a_Length)
+{
+    for (cluster_num cluster = a_Start; cluster < a_Start + a_Length && cluster < a_Disk->n_FatEntries; cluster++)
+    {
+        __atomic_or_fetch(&a_Disk->p_ClaimedClusters[cluster / BITS_PER_WORD], (uint64_t)1 << (cluster % BITS_PER_WORD), __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief   Counts the free clusters of an image
+ * @param a_Disk    The image whose bitmap was built
+ * @return  The number of clusters the FAT marks as free
+ */
+size_t countFreeClusters(const DiskImage * a_Disk)
+{
+    size_t const n_Words = (a_Disk->n_FatEntries + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    size_t n_Free = ZERO;
+    for (size_t i = 0; i < n_Words; i++)
+    {
+        n_Free += BITS_PER_WORD - __builtin_popcountll(a_Disk->p_AllocatedClusters[i]);
+    }
+    return n_Free;
+}
+
+/**
+ * @brief   Checks that a cluster number refers to data inside the image
+ * @param a_Disk    The image the cluster belongs to
+ * @param a_Cluster The cluster to check
+ * @return  Whether the cluster can be read
+ */
+bool isValidCluster(const DiskImage * a_Disk, cluster_num a_Cluster)
+{
+    // End of chain and bad cluster markers are above the cluster count at every FAT width
+    return a_Cluster >= CLUSTER_NORMAL_MIN && a_Cluster - CLUSTER_NORMAL_MIN < a_Disk->geometry.n_Clusters;
+}
+
+/**
+ * @brief   Finds where a cluster starts in the image
+ * @param a_Disk    The image the cluster belongs to
+ * @param a_Cluster The cluster to locate, must be valid
+ * @return  The offset of the first byte of the cluster
+ */
+byte_num clusterOffset(const DiskImage * a_Disk, cluster_num a_Cluster)
+{
+    Geometry const * geometry = &a_Disk->geometry;
+    return geometry->data_offset + (byte_num)(a_Cluster - CLUSTER_NORMAL_MIN) * geometry->cluster_bytes;
+}
+
+/**
+ * @brief   Finds the data of a cluster inside the image
+ * @param a_Disk    The image the cluster belongs to
+ * @param a_Cluster The cluster to locate, must be valid
+ * @return  A pointer to the first byte of the cluster, or NULL for a device image, which only
+ *          holds its metadata in memory
+ */
+byte_ptr getClusterData(const DiskImage * a_Disk, cluster_num a_Cluster)
+{
+    if (a_Disk->reader != NULL) return NULL;
+    return a_Disk->p_Data + clusterOffset(a_Disk, a_Cluster);
+}
+
+/**
+ * @brief   Copies a run of the image into a buffer
+ * @param a_Disk        The image
+ * @param a_Offset      Where the run starts
+ * @param a_Length      Its length
+ * @param a_pB_Buffer   Receives the run
+ */
+void readImage(const DiskImage * a_Disk, byte_num a_Offset, size_t a_Length, byte_ptr a_pB_Buffer)
+{
+    if (a_Disk->reader == NULL) memcpy(a_pB_Buffer, a_Disk->p_Data + a_Offset, a_Length);
+    else observeAndReport(readDevice(a_Disk->reader, a_pB_Buffer, a_Offset, a_Length) == ZERO, "Error reading device");
+}
+
+/**
+ * @brief   Gives a run of the image, copying it out only when the image is not in memory
+ * @param a_Disk        The image
+ * @param a_Offset      Where the run starts
+ * @param a_Length      Its length
+ * @param a_ppCopy      Set to the copy the caller has to free, NULL when none was needed
+ * @return  The run's bytes
+ */
+byte_ptr imageBytes(const DiskImage * a_Disk, byte_num a_Offset, size_t a_Length, byte_ptr * a_ppCopy)
+{
+    *a_ppCopy = NULL;
+    if (a_Disk->reader == NULL) return a_Disk->p_Data + a_Offset;
+
+    byte_ptr copy = (byte_ptr)malloc(a_Length > ZERO ? a_Length : 1);
+    observeAndReport(copy != NULL, "Error allocating memory for device read");
+    bool const read = readDevice(a_Disk->reader, copy, a_Offset, a_Length) == ZERO;
+    if (!read) free(copy);
+    observeAndReport(read, "Error reading device");
+    *a_ppCopy = copy;
+    return copy;
+}
+
+/**
+ * @brief   Hands a run of the image to a visitor
+ * @details An image in memory goes over in one piece. A device image is copied out of its
+ *          reader IMAGE_PIECE_BYTES at a time, so a run of any length takes no more than that.
+ * @param a_Disk        The image
+ * @param a_Offset      Where the run starts
+ * @param a_Length      Its length
+ * @param a_Visit       Called on each piece in order
+ * @param a_pContext    Passed to a_Visit
+ */
+void visitImageRange(const DiskImage * a_Disk, byte_num a_Offset, byte_count a_Length, ImageVisitor a_Visit, void * a_pContext)
+{
+    if (a_Disk->reader == NULL)
+    {
+        a_Visit(a_pContext, a_Disk->p_Data + a_Offset, (size_t)a_Length);
+        return;
+    }
+
+    size_t const capacity = a_Length < IMAGE_PIECE_BYTES ? (size_t)a_Length : IMAGE_PIECE_BYTES;
+    if (capacity == ZERO) return;
+    byte_ptr piece = (byte_ptr)malloc(capacity);
+    observeAndReport(piece != NULL, "Error allocating memory for device read");
+    while (a_Length > ZERO)
+    {
+        size_t const length = a_Length < capacity ? (size_t)a_Length : capacity;
+        bool const read = readDevice(a_Disk->reader, piece, a_Offset, length) == ZERO;
+        if (!read) free(piece);
+        observeAndReport(read, "Error reading device");
+        a_Visit(a_pContext, piece, length);
+        a_Offset += length;
+        a_Length -= length;
+    }
+    free(piece);
+}
+
+/**
+ * @brief   Appends a piece of the image to a file and hashes it, for visitImageRange()
+ * @param a_pContext    The ImageCopy
+ * @param a_pB_Data     The piece
+ * @param a_Length      Its length
+ */
+void copyImagePiece(void * a_pContext, const byte * a_pB_Data, size_t a_Length)
+{
+    ImageCopy * copy = (ImageCopy *)a_pContext;
+    if (copy->hash != NULL) sha256Update(copy->hash, a_pB_Data, a_Length);
+    while (copy->fd != NO_FD && copy->ok && a_Length > ZERO)
+    {
+        ssize_t n = write(copy->fd, a_pB_Data, a_Length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) copy->ok = false;
+        else
+        {
+            a_pB_Data += n;
+            a_Length -= (size_t)n;
+        }
+    }
+}
+
+/**
+ * @brief   Follows a cluster chain by one link
+ * @param a_Disk    The image the cluster belongs to
+ * @param a_Cluster The current cluster
+ * @return  The next cluster in the chain
+ */
+cluster_num getNextCluster(const DiskImage * a_Disk, cluster_num a_Cluster)
+{
+    if (a_Cluster >= a_Disk->n_FatEntries) return CLUSTER_NONEXISTENT;
+    return a_Disk->p_NextCluster[a_Cluster];
+}
+
+/**
+ * @brief   Handles a directory
+ * @param a_ParentEntry  The directory entry to handle
+ * @param a_sector           The sector to handle
+ */
+void handleDirectory(Entry * a_ParentEntry, byte_ptr a_dataSector, size_t depth, bool parentDeleted)
+{
+    DiskImage * disk = a_ParentEntry->disk;
+    depth++;
+    if (depth > MAX_DIRECTORY_DEPTH) return;
+
+    if (a_ParentEntry->first_cluster == CLUSTER_ROOT)
+    {
+        handleDirectoryEntries(a_ParentEntry, a_dataSector, disk->geometry.n_RootEntries, depth, parentDeleted);
+        return;
+    }
+
+    // A deleted directory has no size to go by, only its first cluster is trusted
+    size_t const max_clusters = a_ParentEntry->deleted ? 1 : SIZE_MAX;
+    buildExtents(a_ParentEntry, max_clusters);
+
+    size_t const entries_per_cluster = (size_t)(disk->geometry.cluster_bytes / ENTRY_SIZE);
+    for (size_t i = 0; i < a_ParentEntry->n_Extents; i++)
+    {
+        Extent const * extent = &a_ParentEntry->extents[i];
+        byte_ptr copy = NULL;
+        byte_ptr entries = imageBytes(disk, clusterOffset(disk, extent->start), (size_t)(extent->length * disk->geometry.cluster_bytes), &copy);
+        bool ended = handleDirectoryEntries(a_ParentEntry, entries, extent->length * entries_per_cluster, depth, parentDeleted);
+        free(copy);
+        if (ended) break;
+    }
+    freeExtents(a_ParentEntry);
+}
+
+/**
+ * @brief   Handles a run of consecutive directory entries
+ * @details The entries are classified ENTRY_BLOCK at a time first, and only live and deleted
+ *          ones are made into Entries, in directory order.
+ * @param a_ParentEntry     The directory the entries belong to
+ * @param a_pB_Entries      The first entry
+ * @param a_n_Entries       How many entries to handle
+ * @param depth             The depth of the entries
+ * @param a_ParentDeleted   Whether or not the parent entry is deleted
+ * @return  Whether the end of directory marker was reached
+ */
+bool handleDirectoryEntries(Entry * a_ParentEntry, byte_ptr a_pB_Entries, size_t a_n_Entries, size_t depth, bool a_ParentDeleted)
+{
+    for (size_t block = ZERO; block < a_n_Entries; block += ENTRY_BLOCK)
+    {
+        size_t const n_Block = a_n_Entries - block < ENTRY_BLOCK ? a_n_Entries - block : ENTRY_BLOCK;
+        EntryMasks masks;
+        classifyEntries(a_pB_Entries + block * ENTRY_SIZE, n_Block, &masks);
+
+        // Only live and deleted entries before the end marker become Entries
+        uint64_t const before_end = masks.end != ZERO ? ((uint64_t)1 << __builtin_ctzll(masks.end)) - 1 : ~(uint64_t)ZERO;
+        uint64_t wanted = (masks.live | masks.deleted) & before_end;
+        while (wanted != ZERO)
+        {
+            byte_ptr i_child = a_pB_Entries + (block + (size_t)__builtin_ctzll(wanted)) * ENTRY_SIZE;
+            wanted &= wanted - 1;
+            handleChildEntry(a_ParentEntry, generateEntry(a_ParentEntry, i_child, depth, a_ParentDeleted));
+        }
+        if (masks.end != ZERO) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief   Adds an entry to its directory and sees to its clusters or subdirectory
+ * @param a_ParentEntry The directory
+ * @param a_ChildEntry  A live or deleted entry found in it
+ */
+void handleChildEntry(Entry * a_ParentEntry, Entry * a_ChildEntry)
+{
+    DiskImage * disk = a_ParentEntry->disk;
+
+    // What the filter leaves out is never read, nor numbered, listed or extracted
+    if (disk->options != NULL && disk->options->filter != NULL && !isSelected(a_ChildEntry))
+    {
+        __atomic_add_fetch(&disk->stats.n_Filtered, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    addChild(a_ParentEntry, a_ChildEntry);
+
+    // A stream has to know where every entry's clusters go before they arrive
+    if (disk->stream != NULL)
+    {
+        planStreamedEntry(disk, a_ChildEntry);
+        return;
+    }
+
+    // A deleted directory whose first cluster was reused holds someone else's data
+    bool const reused = a_ChildEntry->deleted && isClusterAllocated(disk, a_ChildEntry->first_cluster);
+    if (isDirectory(a_ChildEntry) && isValidCluster(disk, a_ChildEntry->first_cluster) && !reused)
+    {
+        if (disk->next_level != NULL) appendEntry(disk->next_level, a_ChildEntry);
+        else runTask(disk, directoryTask, a_ChildEntry);
+    }
+}
+
+/**
+ * @brief   Tells whether the filter keeps an entry
+ * @param a_Entry   A file, or a directory that is kept if something below it could be selected
+ * @return  Whether the entry is kept
+ */
+bool isSelected(const Entry * a_Entry)
+{
+    char path[ENTRY_PATH_MAX];
+    materializePath(a_Entry, path, sizeof(path));
+    Filter const * filter = a_Entry->disk->options->filter;
+    if (isDirectory(a_Entry)) return filterEntersDirectory(filter, path, a_Entry->deleted);
+    return filterSelectsFile(filter, path, a_Entry->size, a_Entry->deleted);
+}
+
+/**
+ * @brief   Sorts a block of directory entries by their first name byte and attribute byte
+ * @details With SSE2, four entries at a time: their first 16 bytes are loaded and transposed so
+ *          that one register holds bytes 0-3 of each and another bytes 8-11, which puts the
+ *          name byte at the bottom and the attribute byte at the top of each lane. Nothing is
+ *          formatted or allocated, so skipped slots and the free space after the end marker
+ *          cost a few instructions each.
+ * @param a_pB_Entries  The first entry
+ * @param a_n_Entries   How many entries, at most ENTRY_BLOCK
+ * @param a_pMasks      Receives one bit per entry, bit 0 for the first
+ */
+void classifyEntries(const byte * a_pB_Entries, size_t a_n_Entries, EntryMasks * a_pMasks)
+{
+    uint64_t deleted = ZERO;
+    uint64_t skip = ZERO;
+    uint64_t end = ZERO;
+    size_t i = ZERO;
+#if defined(__SSE2__)
+    __m128i const low_byte = _mm_set1_epi32(0xFF);
+    __m128i const free_and_last = _mm_set1_epi32(ENTRY_FREE_AND_LAST);
+    __m128i const free_marker = _mm_set1_epi32(ENTRY_FREE);
+    __m128i const self = _mm_set1_epi32(FILENAME_SELF_DIRECTORY);
+    __m128i const label = _mm_set1_epi32(ATTR_VOLUME_LABEL);
+    for (; i + 4 <= a_n_Entries; i += 4)
+    {
+        const byte * block = a_pB_Entries + i * ENTRY_SIZE;
+        __m128i const e0 = _mm_loadu_si128((const __m128i *)block);
+        __m128i const e1 = _mm_loadu_si128((const __m128i *)(block + ENTRY_SIZE));
+        __m128i const e2 = _mm_loadu_si128((const __m128i *)(block + 2 * ENTRY_SIZE));
+        __m128i const e3 = _mm_loadu_si128((const __m128i *)(block + 3 * ENTRY_SIZE));
+        __m128i const heads = _mm_unpacklo_epi64(_mm_unpacklo_epi32(e0, e1), _mm_unpacklo_epi32(e2, e3));
+        __m128i const tails = _mm_unpacklo_epi64(_mm_unpackhi_epi32(e0, e1), _mm_unpackhi_epi32(e2, e3));
+
+        __m128i const first = _mm_and_si128(heads, low_byte);
+        __m128i const attributes = _mm_srli_epi32(tails, 24);
+        __m128i const skipped = _mm_or_si128(_mm_cmpeq_epi32(first, self), _mm_cmpeq_epi32(_mm_and_si128(attributes, label), label));
+
+        end |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(first, free_and_last))) << i;
+        deleted |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(first, free_marker))) << i;
+        skip |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(skipped)) << i;
+    }
+#endif
+    for (; i < a_n_Entries; i++)
+    {
+        const byte * entry = a_pB_Entries + i * ENTRY_SIZE;
+        byte const first = entry[ENTRY_FILENAME_OFFSET];
+        if (first == ENTRY_FREE_AND_LAST) end |= (uint64_t)1 << i;
+        if (first == ENTRY_FREE) deleted |= (uint64_t)1 << i;
+        if (first == FILENAME_SELF_DIRECTORY || (entry[ENTRY_ATTRIBUTES_OFFSET] & ATTR_VOLUME_LABEL)) skip |= (uint64_t)1 << i;
+    }
+
+    // A long name slot has the volume label bit too, and either kind may be marked deleted
+    uint64_t const in_block = a_n_Entries >= ENTRY_BLOCK ? ~(uint64_t)ZERO : ((uint64_t)1 << a_n_Entries) - 1;
+    a_pMasks->end = end;
+    a_pMasks->skip = skip & ~end;
+    a_pMasks->deleted = deleted & ~skip;
+    a_pMasks->live = in_block & ~(end | skip | deleted);
+}
+
+/**
+ * @brief   Appends an entry to its directory, keeping directory order
+ * @param a_ParentEntry The directory
+ * @param a_ChildEntry  The entry found in it
+ */
+void addChild(Entry * a_ParentEntry, Entry * a_ChildEntry)
+{
+    a_ChildEntry->next_sibling = NULL;
+    if (a_ParentEntry->last_child == NULL) a_ParentEntry->first_child = a_ChildEntry;
+    else a_ParentEntry->last_child->next_sibling = a_ChildEntry;
+    a_ParentEntry->last_child = a_ChildEntry;
+}
+
+/**
+ * @brief   Runs a task on the image's pool, or right away when it has none
+ * @param a_Disk        The image the task works on
+ * @param a_Function    The task
+ * @param a_pArgument   The task's argument
+ */
+void runTask(DiskImage * a_Disk, TaskFunction a_Function, void * a_pArgument)
+{
+    if (a_Disk->pool == NULL) {
+        a_Function(a_pArgument);
+        return;
+    }
+    submitTask(a_Disk->pool, a_Function, a_pArgument);
+}
+
+/**
+ * @brief   Waits for every task handed to runTask() for the image so far
+ * @param a_Disk    The image whose tasks to wait for
+ */
+void waitForTasks(DiskImage * a_Disk)
+{
+    if (a_Disk->pool != NULL) waitThreadPool(a_Disk->pool);
+}
+
+/**
+ * @brief   Parses one subdirectory, each of its own subdirectories becomes another task
+ * @param a_pArgument   The directory's Entry
+ */
+void directoryTask(void * a_pArgument)
+{
+    Entry * directory = (Entry *)a_pArgument;
+    byte_ptr first_sector = getClusterData(directory->disk, directory->first_cluster);
+    handleDirectory(directory, first_sector, directory->depth, directory->deleted);
+}
+
+/**
+ * @brief   Copies one file out of the image
+ * @param a_pArgument   The file's Entry, already numbered by emitDirectory()
+ */
+void extractTask(void * a_pArgument)
+{
+    Entry * file = (Entry *)a_pArgument;
+
+    byte_ptr first_sector = NULL;
+    if (isValidCluster(file->disk, file->first_cluster)) first_sector = getClusterData(file->disk, file->first_cluster);
+
+    // A device image only learns of its bad sectors by reading them, which writing the file does
+    makeData(file, first_sector);
+    writeOutput(file);
+    reportDamage(file);
+    freeExtents(file);
+}
+
+/**
+ * @brief   Extracts a numbered file on the pool, or right away when the output is an archive
+ * @param a_Entry   The file
+ */
+void extractFile(Entry * a_Entry)
+{
+    // An archive is one stream, so its files go in one at a time and in order
+    if (a_Entry->disk->archive != NULL) extractTask(a_Entry);
+    else runTask(a_Entry->disk, extractTask, a_Entry);
+}
+
+/**
+ * @brief   Numbers, lists and extracts the files under a parsed directory in directory order
+ * @details Runs after parsing has finished, so the fileN numbering and the listing are the
+ *          same however the directories were split across threads.
+ * @param a_DirectoryEntry  The directory to emit
+ */
+void emitDirectory(Entry * a_DirectoryEntry)
+{
+    for (Entry * child = a_DirectoryEntry->first_child; child != NULL; child = child->next_sibling)
+    {
+        if (a_DirectoryEntry->disk->timeline != NULL) addTimelineEntry(child);
+
+        if (isDirectory(child))
+        {
+            a_DirectoryEntry->disk->stats.n_Directories++;
+            emitDirectory(child);
+            continue;
+        }
+
+        if (child->deleted) a_DirectoryEntry->disk->stats.n_Deleted++;
+        child->index = a_DirectoryEntry->disk->n_Files++;
+        listFile(child);
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+        printEntry(child);
+#endif
+        if (a_DirectoryEntry->disk->stream != NULL) finishStreamedFile(child);
+        else if (isScheduled(a_DirectoryEntry->disk)) planExtraction(child);
+        else extractFile(child);
+    }
+}
+
+/**
+ * @brief   Adds an emitted directory or file to the image's timeline
+ * @details FAT keeps only the day of the last access, so it counts from midnight. In a batch
+ *          the path starts with the image name and a colon.
+ * @param a_Entry   The entry
+ */
+void addTimelineEntry(const Entry * a_Entry)
+{
+    DiskImage * disk = a_Entry->disk;
+    char path[PATH_MAX];
+    size_t offset = ZERO;
+    if (disk->timeline_label != NULL)
+    {
+        int labeled = snprintf(path, sizeof(path), "%s:", disk->timeline_label);
+        if (labeled > ZERO && (size_t)labeled < sizeof(path) - ENTRY_PATH_MAX) offset = (size_t)labeled;
+    }
+    materializePath(a_Entry, path + offset, sizeof(path) - offset);
+
+    TimelineEntry item;
+    item.path = path;
+    item.size = a_Entry->size;
+    item.meta = a_Entry->first_cluster;
+    item.directory = isDirectory(a_Entry);
+    item.read_only = (a_Entry->attributes & ATTR_READ_ONLY) != ZERO;
+    item.deleted = a_Entry->deleted;
+    item.modified = dosTimestamp(a_Entry->date.modified, a_Entry->time.modified);
+    item.accessed = dosTimestamp(a_Entry->date.accessed, ZERO);
+    item.created = dosTimestamp(a_Entry->date.created, a_Entry->time.created);
+    timelineAdd(disk->timeline, &item);
+}
+
+/**
+ * @brief   Recovers files from the clusters that neither the FAT nor recovery accounts for
+ * @details Walks the unclaimed clusters in disk order and checks each for a known file header.
+ *          A file found this way reaches at most to the end of its run of unclaimed clusters,
+ *          or to the next cluster that starts a file of its own, and ends at its footer when
+ *          it has one in that span. Carved files are listed after the rest, under /CARVED.
+ * @param a_Disk    The image, parsed and with every deleted entry already recovered
+ */
+void carveUnallocated(DiskImage * a_Disk)
+{
+    Entry * folder = NULL;
+    uint64_t const * claimed = a_Disk->p_ClaimedClusters;
+    size_t const n_Clusters = a_Disk->n_FatEntries;
+    byte_count const cluster_bytes = a_Disk->geometry.cluster_bytes;
+
+    cluster_num cluster = nextClearBit(claimed, n_Clusters, CLUSTER_NORMAL_MIN);
+    while (cluster < n_Clusters)
+    {
+        int signature = clusterSignature(a_Disk, cluster);
+        if (signature == CARVE_NO_MATCH)
+        {
+            cluster = nextClearBit(claimed, n_Clusters, cluster + 1);
+            continue;
+        }
+
+        size_t const run = clearRunLength(claimed, n_Clusters, cluster, SIZE_MAX);
+        size_t span = 1;
+        while (span < run && clusterSignature(a_Disk, cluster + span) == CARVE_NO_MATCH) span++;
+
+        byte_count length = carvedLength(a_Disk, cluster, signature, span * cluster_bytes);
+        if (length == ZERO) length = span * cluster_bytes; // no footer, keep what can be kept
+        if (length > UINT32_MAX) length = UINT32_MAX; // FAT file sizes are 32-bit
+
+        Entry * file = makeCarvedEntry(a_Disk, &folder, cluster, signature, length);
+        file->index = a_Disk->n_Files++;
+        a_Disk->stats.n_Carved++;
+        listFile(file);
+        extractFile(file);
+
+        size_t const used = (size_t)((length + cluster_bytes - 1) / cluster_bytes);
+        claimClusters(a_Disk, cluster, used);
+        cluster = nextClearBit(claimed, n_Clusters, cluster + used);
+    }
+}
+
+/**
+ * @brief   Checks whether a cluster starts with a known file header
+ * @param a_Disk    The image
+ * @param a_Cluster The cluster
+ * @return  The matching signature, or CARVE_NO_MATCH
+ */
+int clusterSignature(const DiskImage * a_Disk, cluster_num a_Cluster)
+{
+    byte_count const cluster_bytes = a_Disk->geometry.cluster_bytes;
+    if (a_Disk->reader == NULL) return matchSignature(getClusterData(a_Disk, a_Cluster), (size_t)cluster_bytes);
+
+    byte header[CARVE_HEADER_MAX];
+    size_t const length = cluster_bytes < CARVE_HEADER_MAX ? (size_t)cluster_bytes : CARVE_HEADER_MAX;
+    readImage(a_Disk, clusterOffset(a_Disk, a_Cluster), length, header);
+    return matchSignature(header, length);
+}
+
+/**
+ * @brief   Finds where a carved file ends
+ * @details A device image is searched IMAGE_PIECE_BYTES at a time, each window overlapping
+ *          the next by CARVE_TAIL_MAX so that a footer is always seen whole in one of them.
+ * @param a_Disk        The image
+ * @param a_Cluster     Where the file starts
+ * @param a_Signature   The signature it starts with
+ * @param a_Limit       How far the file may extend
+ * @return  The length of the file including its footer, or 0 if no footer was found
+ */
+byte_count carvedLength(const DiskImage * a_Disk, cluster_num a_Cluster, int a_Signature, byte_count a_Limit)
+{
+    if (a_Disk->reader == NULL) return findSignatureEnd(a_Signature, getClusterData(a_Disk, a_Cluster), (size_t)a_Limit);
+
+    size_t const capacity = a_Limit < IMAGE_PIECE_BYTES ? (size_t)a_Limit : IMAGE_PIECE_BYTES;
+    byte_ptr window = (byte_ptr)malloc(capacity);
+    observeAndReport(window != NULL, "Error allocating memory for device read");
+
+    byte_num const start = clusterOffset(a_Disk, a_Cluster);
+    byte_count position = ZERO;
+    byte_count end = ZERO;
+    for (;;)
+    {
+        size_t const length = a_Limit - position < capacity ? (size_t)(a_Limit - position) : capacity;
+        bool const read = readDevice(a_Disk->reader, window, start + position, length) == ZERO;
+        if (!read) free(window);
+        observeAndReport(read, "Error reading device");
+
+        bool const last = position + length == a_Limit;
+        end = findSignatureEndIn(a_Signature, window, length, (size_t)position, last ? length : length - CARVE_TAIL_MAX);
+        if (end != ZERO || last) break;
+        position += length - CARVE_TAIL_MAX;
+    }
+    free(window);
+    return end < a_Limit ? end : a_Limit;
+}
+
+/**
+ * @brief   Makes the Entry of a carved file
+ * @param a_Disk        The image the file was carved from
+ * @param a_pFolder     The /CARVED directory, created on the first call
+ * @param a_Cluster     The cluster the file starts at, which also names it
+ * @param a_Signature   The signature the file matched
+ * @param a_Length      The length of the file
+ * @return  The new entry
+ */
+Entry * makeCarvedEntry(DiskImage * a_Disk, Entry ** a_pFolder, cluster_num a_Cluster, int a_Signature, byte_count a_Length)
+{
+    if (*a_pFolder == NULL)
+    {
+        Entry * folder = (Entry *)arenaCalloc(a_Disk->arena, sizeof(Entry));
+        folder->disk = a_Disk;
+        folder->parent = a_Disk->p_RootEntry;
+        folder->depth = 1;
+        folder->attributes = ATTR_DIRECTORY;
+        memset(folder->filename, SPACE_CHAR, ENTRY_FILENAME_BYTES);
+        memset(folder->extension, SPACE_CHAR, ENTRY_EXTENSION_BYTES);
+        memcpy(folder->filename, CARVED_DIRECTORY_NAME, sizeof(CARVED_DIRECTORY_NAME) - 1);
+        *a_pFolder = folder;
+    }
+
+    Entry * file = (Entry *)arenaCalloc(a_Disk->arena, sizeof(Entry));
+    file->disk = a_Disk;
+    file->parent = *a_pFolder;
+    file->depth = 2;
+    file->carved = true;
+    file->first_cluster = (fat_entry)a_Cluster;
+    file->size = (uint32_t)a_Length;
+
+    char name[ENTRY_FILENAME_BYTES + 1];
+    int const n_Name = snprintf(name, sizeof(name), "%zu", a_Cluster);
+    memset(file->filename, SPACE_CHAR, ENTRY_FILENAME_BYTES);
+    memset(file->extension, SPACE_CHAR, ENTRY_EXTENSION_BYTES);
+    memcpy(file->filename, name, (size_t)n_Name < ENTRY_FILENAME_BYTES ? (size_t)n_Name : ENTRY_FILENAME_BYTES);
+
+    const char * extension = signatureExtension(a_Signature);
+    size_t const n_Extension = strlen(extension);
+    memcpy(file->extension, extension, n_Extension < ENTRY_EXTENSION_BYTES ? n_Extension : ENTRY_EXTENSION_BYTES);
+    return file;
+}
+
+/**
+ * @brief   Records which version of an image a catalog describes
+ * @param a_ImagePath   The image
+ * @param a_pStamp      Receives the image's size and modification time
+ * @return  Whether the image could be examined
+ */
+bool stampImage(string a_ImagePath, CatalogStamp * a_pStamp)
+{
+    struct stat info;
+    if (stat((char *)a_ImagePath, &info) != ZERO) return false;
+
+    a_pStamp->image_size = (uint64_t)info.st_size;
+    a_pStamp->mtime_sec = (int64_t)info.st_mtim.tv_sec;
+    a_pStamp->mtime_nsec = (int64_t)info.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief   Names the catalog that belongs to an image
+ * @param a_ImagePath   The image
+ * @param a_Buffer      Receives the catalog path
+ * @param a_Capacity    The size of a_Buffer
+ * @return  Whether the path fit
+ */
+bool catalogPathFor(string a_ImagePath, char * a_Buffer, size_t a_Capacity)
+{
+    int written = snprintf(a_Buffer, a_Capacity, "%s%s", (char *)a_ImagePath, CATALOG_SUFFIX);
+    return written > ZERO && (size_t)written < a_Capacity;
+}
+
+/**
+ * @brief   Parses an image once and saves everything ls and extract need as its catalog
+ * @param a_Disk        The DiskImage to parse in
+ * @param a_ImagePath   The image
+ * @param a_CatalogPath Where the catalog goes
+ * @param a_pStamp      The image's stamp, taken before it was opened
+ */
+void indexImage(DiskImage * a_Disk, string a_ImagePath, const char * a_CatalogPath, const CatalogStamp * a_pStamp)
+{
+    a_Disk->p_Data = openFile(a_Disk, a_ImagePath);
+    parseFileSystem(a_Disk, a_Disk->p_Data);
+    waitForTasks(a_Disk);
+
+    CatalogBuilder * builder = createCatalogBuilder();
+    catalogDirectory(builder, a_Disk->p_RootEntry);
+    observeAndReport(writeCatalog(builder, a_CatalogPath, a_pStamp), "Error writing catalog");
+    logInfo("Indexed %s into %s\n", (char *)a_ImagePath, a_CatalogPath);
+    destroyCatalogBuilder(builder);
+
+    resetArena(a_Disk->arena);
+    a_Disk->p_RootEntry = NULL;
+    closeFile(a_Disk);
+}
+
+/**
+ * @brief   Adds the entries under a parsed directory to a catalog in listing order
+ * @details Files are stored with the image byte ranges writeOutput() would copy, already cut
+ *          to the file's size, so extracting from the catalog needs no geometry.
+ * @param a_pBuilder        The catalog being built
+ * @param a_DirectoryEntry  The directory to add
+ */
+void catalogDirectory(CatalogBuilder * a_pBuilder, Entry * a_DirectoryEntry)
+{
+    char path[ENTRY_PATH_MAX];
+    for (Entry * child = a_DirectoryEntry->first_child; child != NULL; child = child->next_sibling)
+    {
+        size_t const length = materializePath(child, path, sizeof(path));
+        catalogAddEntry(a_pBuilder, path, length, child->attributes, entryStatus(child), child->size);
+
+        if (isDirectory(child))
+        {
+            catalogDirectory(a_pBuilder, child);
+            continue;
+        }
+
+        DiskImage * disk = child->disk;
+        byte_ptr first_sector = NULL;
+        if (isValidCluster(disk, child->first_cluster)) first_sector = getClusterData(disk, child->first_cluster);
+        makeData(child, first_sector);
+
+        byte_count remaining = child->size;
+        for (size_t i = 0; i < child->n_Extents && remaining > ZERO; i++)
+        {
+            byte_count const run_bytes = child->extents[i].length * disk->geometry.cluster_bytes;
+            byte_count const run_length = remaining < run_bytes ? remaining : run_bytes;
+            byte_num const offset = clusterOffset(disk, child->extents[i].start);
+            catalogAddExtent(a_pBuilder, offset, run_length);
+            remaining -= run_length;
+        }
+        freeExtents(child);
+    }
+}
+
+/**
+ * @brief   Opens the catalog of an image, building it first when it is missing or out of date
+ * @param a_Disk        The DiskImage to parse in if the catalog has to be built
+ * @param a_ImagePath   The image
+ * @param a_Rebuild     Whether to build the catalog even if a current one exists
+ * @return  The mapped catalog
+ */
+Catalog * loadCatalog(DiskImage * a_Disk, string a_ImagePath, bool a_Rebuild)
+{
+    char catalogPath[PATH_MAX];
+    CatalogStamp stamp;
+    observeAndReport(stampImage(a_ImagePath, &stamp), "Error opening file");
+    observeAndReport(catalogPathFor(a_ImagePath, catalogPath, sizeof(catalogPath)), "Error: catalog path is too long");
+
+    Catalog * catalog = a_Rebuild ? NULL : openCatalog(catalogPath, &stamp);
+    if (catalog != NULL) return catalog;
+
+    indexImage(a_Disk, a_ImagePath, catalogPath, &stamp);
+    catalog = openCatalog(catalogPath, &stamp);
+    observeAndReport(catalog != NULL, "Error opening catalog");
+    return catalog;
+}
+
+/**
+ * @brief   Runs index, ls or extract
+ * @param a_Disk        The DiskImage to work in
+ * @param a_Command     The command
+ * @param a_Arguments   The command's arguments, the image first
+ * @param a_n_Arguments The number of arguments
+ * @return  The exit status
+ */
+int runCatalogCommand(DiskImage * a_Disk, const char * a_Command, char ** a_Arguments, int a_n_Arguments)
+{
+    string image = (string)a_Arguments[0];
+
+    if (strcmp(a_Command, COMMAND_INDEX) == ZERO && a_n_Arguments == 1)
+    {
+        closeCatalog(loadCatalog(a_Disk, image, true));
+        return EXIT_SUCCESS;
+    }
+
+    if (strcmp(a_Command, COMMAND_LIST) == ZERO && a_n_Arguments == 1)
+    {
+        Catalog * catalog = loadCatalog(a_Disk, image, false);
+        for (size_t i = 0; i < catalogCount(catalog); i++)
+        {
+            if (catalogAttributes(catalog, i) & ATTR_DIRECTORY) continue;
+            size_t length = ZERO;
+            const char * path = catalogPath(catalog, i, &length);
+            printf("FILE\t%s\t%.*s\t%u\n", statusName(catalogStatus(catalog, i)), (int)length, path, catalogSize(catalog, i));
+        }
+        closeCatalog(catalog);
+        return EXIT_SUCCESS;
+    }
+
+    if (strcmp(a_Command, COMMAND_EXTRACT) == ZERO && a_n_Arguments == 3)
+    {
+        Catalog * catalog = loadCatalog(a_Disk, image, false);
+        const char * wanted = a_Arguments[1];
+        size_t const found = catalogLookup(catalog, wanted, strlen(wanted));
+        if (found == CATALOG_NOT_FOUND || (catalogAttributes(catalog, found) & ATTR_DIRECTORY))
+        {
+            logError("No file %s in %s\n", wanted, (char *)image);
+            closeCatalog(catalog);
+            return EXIT_FAILURE;
+        }
+
+        int fd = open(a_Arguments[2], O_WRONLY | O_CREAT | O_TRUNC, OUTPUT_FILE_MODE);
+        observeAndReport(fd != NO_FD, "Error creating output file");
+        a_Disk->p_Data = openFile(a_Disk, image);
+
+        const uint64_t * offsets = NULL;
+        const uint64_t * lengths = NULL;
+        size_t const n_Extents = catalogExtents(catalog, found, &offsets, &lengths);
+        for (size_t i = 0; i < n_Extents; i++)
+        {
+            observeAndReport(copyImageRange(a_Disk, fd, (byte_num)offsets[i], (byte_count)lengths[i]), "Error writing output file");
+        }
+
+        close(fd);
+        closeFile(a_Disk);
+        closeCatalog(catalog);
+        return EXIT_SUCCESS;
+    }
+
+    printUsage();
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief   Opens an image for random access, reading only its boot sector and FAT
+ * @param a_Path    The image
+ * @return  The volume, or NULL if the image cannot be opened or is not a FAT volume
+ */
+Volume * openVolume(const char * a_Path)
+{
+    Volume * volume = (Volume *)calloc(1, sizeof(Volume));
+    if (volume == NULL) return NULL;
+
+    jmp_buf recovery;
+    t_pRecoveryPoint = &recovery;
+    if (setjmp(recovery) != 0)
+    {
+        t_pRecoveryPoint = NULL;
+        closeVolume(volume);
+        return NULL;
+    }
+
+    volume->path = strdup(a_Path);
+    observeAndReport(volume->path != NULL, "Error allocating memory for volume");
+    volume->disk = createDiskImage();
+    volume->disk->p_Data = openFile(volume->disk, (string)volume->path);
+    prepareFileSystem(volume->disk, volume->disk->p_Data);
+    t_pRecoveryPoint = NULL;
+    return volume;
+}
+
+/**
+ * @brief   Closes a volume, whatever was opened on it has to be closed first
+ * @param a_pVolume The volume, may be NULL
+ */
+void closeVolume(Volume * a_pVolume)
+{
+    if (a_pVolume == NULL) return;
+    if (a_pVolume->disk != NULL) closeFile(a_pVolume->disk);
+    destroyDiskImage(a_pVolume->disk);
+    free(a_pVolume->path);
+    free(a_pVolume);
+}
+
+/**
+ * @brief   Undoes what a call that failed partway left behind on its volume
+ * @param a_pVolume The volume
+ */
+void recoverVolume(Volume * a_pVolume)
+{
+    t_pRecoveryPoint = NULL;
+    a_pVolume->disk->next_level = NULL;
+}
+
+/**
+ * @brief   Describes the entry at a path
+ * @param a_pVolume The volume
+ * @param a_Path    The path, "/" for the root directory
+ * @param a_pStat   Receives the description
+ * @return  0, or -1 if there is no such entry
+ */
+int volumeStat(Volume * a_pVolume, const char * a_Path, VolumeStat * a_pStat)
+{
+    jmp_buf recovery;
+    t_pRecoveryPoint = &recovery;
+    if (setjmp(recovery) != 0)
+    {
+        recoverVolume(a_pVolume);
+        return -1;
+    }
+
+    Entry const * entry = lookupEntry(a_pVolume->disk, a_Path);
+    t_pRecoveryPoint = NULL;
+    if (entry == NULL) return -1;
+    fillVolumeStat(entry, a_pStat);
+    return ZERO;
+}
+
+/**
+ * @brief   Opens a directory to list its entries in directory order
+ * @param a_pVolume The volume
+ * @param a_Path    The directory, "/" for the root directory
+ * @return  The listing, or NULL if there is no such directory
+ */
+VolumeDirectory * openVolumeDirectory(Volume * a_pVolume, const char * a_Path)
+{
+    jmp_buf recovery;
+    t_pRecoveryPoint = &recovery;
+    if (setjmp(recovery) != 0)
+    {
+        recoverVolume(a_pVolume);
+        return NULL;
+    }
+
+    Entry * entry = lookupEntry(a_pVolume->disk, a_Path);
+    if (entry != NULL && isDirectory(entry)) expandDirectory(entry);
+    t_pRecoveryPoint = NULL;
+    if (entry == NULL || !isDirectory(entry)) return NULL;
+
+    VolumeDirectory * directory = (VolumeDirectory *)calloc(1, sizeof(VolumeDirectory));
+    if (directory == NULL) return NULL;
+    directory->volume = a_pVolume;
+    directory->next = entry->first_child;
+    return directory;
+}
+
+/**
+ * @brief   Describes the next entry of a directory
+ * @param a_pDirectory  The listing
+ * @param a_pStat       Receives the description
+ * @return  1, or 0 once every entry has been described
+ */
+int readVolumeDirectory(VolumeDirectory * a_pDirectory, VolumeStat * a_pStat)
+{
+    if (a_pDirectory->next == NULL) return ZERO;
+    fillVolumeStat(a_pDirectory->next, a_pStat);
+    a_pDirectory->next = a_pDirectory->next->next_sibling;
+    return 1;
+}
+
+/**
+ * @brief   Ends a directory listing
+ * @param a_pDirectory  The listing, may be NULL
+ */
+void closeVolumeDirectory(VolumeDirectory * a_pDirectory)
+{
+    free(a_pDirectory);
+}
+
+/**
+ * @brief   Opens a file for reading, without reading any of it yet
+ * @param a_pVolume The volume
+ * @param a_Path    The file
+ * @return  The file, or NULL if there is no such file
+ */
+VolumeFile * openVolumeFile(Volume * a_pVolume, const char * a_Path)
+{
+    jmp_buf recovery;
+    t_pRecoveryPoint = &recovery;
+    if (setjmp(recovery) != 0)
+    {
+        recoverVolume(a_pVolume);
+        return NULL;
+    }
+
+    Entry * entry = lookupEntry(a_pVolume->disk, a_Path);
+    t_pRecoveryPoint = NULL;
+    if (entry == NULL || isDirectory(entry)) return NULL;
+
+    VolumeFile * file = (VolumeFile *)calloc(1, sizeof(VolumeFile));
+    if (file == NULL) return NULL;
+    file->volume = a_pVolume;
+    file->entry = entry;
+    return file;
+}
+
+/**
+ * @brief   Reads part of a file, like pread
+ * @details The first read of a file follows its chain once and keeps the extents on its Entry
+ *          for every later read and reopen. A read finds its first extent by binary search. A
+ *          file ends at its recorded size, or earlier where its chain runs out.
+ * @param a_pFile   The file
+ * @param a_pBuffer Receives the bytes
+ * @param a_Length  The most bytes to read
+ * @param a_Offset  Where in the file to start
+ * @return  The number of bytes read, 0 at the end of the file, or -1 on a damaged image
+ */
+int64_t readVolumeFile(VolumeFile * a_pFile, void * a_pBuffer, size_t a_Length, uint64_t a_Offset)
+{
+    Entry * entry = a_pFile->entry;
+    DiskImage * disk = entry->disk;
+
+    jmp_buf recovery;
+    t_pRecoveryPoint = &recovery;
+    if (setjmp(recovery) != 0)
+    {
+        recoverVolume(a_pFile->volume);
+        return -1;
+    }
+
+    byte_count const cluster_bytes = disk->geometry.cluster_bytes;
+    if (entry->extents == NULL) buildExtents(entry, (size_t)((entry->size + cluster_bytes - 1) / cluster_bytes));
+    if (a_pFile->run_ends == NULL)
+    {
+        a_pFile->run_ends = (byte_num *)malloc((entry->n_Extents + 1) * sizeof(byte_num));
+        observeAndReport(a_pFile->run_ends != NULL, "Error allocating memory for extents");
+        byte_num end = ZERO;
+        for (size_t i = 0; i < entry->n_Extents; i++)
+        {
+            end += entry->extents[i].length * cluster_bytes;
+            a_pFile->run_ends[i] = end;
+        }
+    }
+
+    byte_count const readable = recoverableBytes(entry);
+    if (a_Offset >= readable) return ZERO;
+    if (a_Length > readable - a_Offset) a_Length = (size_t)(readable - a_Offset);
+
+    size_t low = ZERO;
+    size_t high = entry->n_Extents;
+    while (low < high)
+    {
+        size_t const middle = low + (high - low) / 2;
+        if (a_pFile->run_ends[middle] <= a_Offset) low = middle + 1;
+        else high = middle;
+    }
+
+    size_t copied = ZERO;
+    for (size_t i = low; copied < a_Length; i++)
+    {
+        byte_num const position = a_Offset + copied;
+        byte_num const run_start = i > ZERO ? a_pFile->run_ends[i - 1] : ZERO;
+        byte_count const available = a_pFile->run_ends[i] - position;
+        size_t const length = a_Length - copied < available ? a_Length - copied : (size_t)available;
+        readImage(disk, clusterOffset(disk, entry->extents[i].start) + (position - run_start), length, (byte_ptr)a_pBuffer + copied);
+        copied += length;
+    }
+    t_pRecoveryPoint = NULL;
+    return (int64_t)copied;
+}
+
+/**
+ * @brief   Closes a file, its extents stay with the volume
+ * @param a_pFile   The file, may be NULL
+ */
+void closeVolumeFile(VolumeFile * a_pFile)
+{
+    if (a_pFile == NULL) return;
+    free(a_pFile->run_ends);
+    free(a_pFile);
+}
+
+/**
+ * @brief   Parses the entries of one directory, the first time it is asked for
+ * @details Subdirectories found on the way are only collected, not parsed, so a lookup reads
+ *          no directory that is not on its path.
+ * @param a_Directory   The directory
+ */
+void expandDirectory(Entry * a_Directory)
+{
+    if (a_Directory->expanded) return;
+    a_Directory->expanded = true;
+
+    // The same directories handleDirectoryEntries() would not descend into have no entries
+    DiskImage * disk = a_Directory->disk;
+    bool const root = a_Directory->parent == NULL;
+    bool const reused = a_Directory->deleted && isClusterAllocated(disk, a_Directory->first_cluster);
+    if (!root && (!isValidCluster(disk, a_Directory->first_cluster) || reused)) return;
+
+    EntryList collected;
+    memset(&collected, ZERO, sizeof(EntryList));
+    disk->next_level = &collected;
+    handleDirectory(a_Directory, root ? disk->p_Root : getClusterData(disk, a_Directory->first_cluster), a_Directory->depth, a_Directory->deleted);
+    disk->next_level = NULL;
+    free(collected.items);
+}
+
+/**
+ * @brief   Finds an entry by its path, parsing only the directories along it
+ * @param a_Disk    The image, with its file system prepared
+ * @param a_Path    The path, components compared without regard to case
+ * @return  The entry, or NULL if there is none
+ */
+Entry * lookupEntry(DiskImage * a_Disk, const char * a_Path)
+{
+    Entry * entry = a_Disk->p_RootEntry;
+    const char * component = a_Path;
+    while (entry != NULL)
+    {
+        while (*component == FORWARD_SLASH_CHAR) component++;
+        if (*component == NULL_CHAR) return entry;
+        if (!isDirectory(entry)) return NULL;
+
+        size_t const length = strcspn(component, FORWARD_SLASH_STRING);
+        expandDirectory(entry);
+
+        // A deleted entry of the same name only stands in for a live one that is not there
+        Entry * found = NULL;
+        for (Entry * child = entry->first_child; child != NULL; child = child->next_sibling)
+        {
+            char name[ENTRY_NAME_MAX + 1];
+            if (formatEntryName(child, name, sizeof(name)) != length || strncasecmp(name, component, length) != ZERO) continue;
+            if (found == NULL || (found->deleted && !child->deleted)) found = child;
+        }
+        entry = found;
+        component += length;
+    }
+    return NULL;
+}
+
+/**
+ * @brief   Writes out an entry's name as it is listed, "NAME.EXT"
+ * @param a_Entry       The entry
+ * @param a_Buffer      Receives the name
+ * @param a_Capacity    The size of a_Buffer, ENTRY_NAME_MAX + 1 always suffices
+ * @return  The length of the name
+ */
+size_t formatEntryName(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity)
+{
+    size_t const name_length = trimmedLength(a_Entry->filename, ENTRY_FILENAME_BYTES);
+    size_t const extension_length = trimmedLength(a_Entry->extension, ENTRY_EXTENSION_BYTES);
+    int written = snprintf(a_Buffer, a_Capacity, "%.*s%s%.*s", (int)name_length, (char *)a_Entry->filename,
+        extension_length > ZERO ? "." : "", (int)extension_length, (char *)a_Entry->extension);
+    return written > ZERO ? (size_t)written : ZERO;
+}
+
+/**
+ * @brief   Describes an entry for the library
+ * @param a_Entry   The entry
+ * @param a_pStat   Receives the description
+ */
+void fillVolumeStat(const Entry * a_Entry, VolumeStat * a_pStat)
+{
+    memset(a_pStat, ZERO, sizeof(VolumeStat));
+    if (a_Entry->parent == NULL) strcpy(a_pStat->name, FORWARD_SLASH_STRING);
+    else formatEntryName(a_Entry, a_pStat->name, sizeof(a_pStat->name));
+    a_pStat->attributes = a_Entry->attributes;
+    a_pStat->size = a_Entry->size;
+    a_pStat->first_cluster = a_Entry->first_cluster;
+    a_pStat->modified = dosTimestamp(a_Entry->date.modified, a_Entry->time.modified);
+    a_pStat->directory = isDirectory(a_Entry);
+    a_pStat->deleted = a_Entry->deleted;
+}
+
+/**
+ * @brief   Adds one image path to a batch
+ * @param a_Batch   The batch
+ * @param a_Path    The path, copied
+ */
+void addBatchPath(Batch * a_Batch, const char * a_Path)
+{
+    char ** grown = (char **)realloc(a_Batch->paths, sizeof(char *) * (a_Batch->n_Paths + 1));
+    observeAndReport(grown != NULL, "Error allocating memory for batch paths");
+    a_Batch->paths = grown;
+    a_Batch->paths[a_Batch->n_Paths] = strdup(a_Path);
+    observeAndReport(a_Batch->paths[a_Batch->n_Paths] != NULL, "Error allocating memory for batch path");
+    a_Batch->n_Paths++;
+}
+
+/**
+ * @brief   Collects the images of a batch
+ * @details A directory contributes its *.img files, a pattern containing *, ? or [ is globbed,
+ *          and anything else is read as a manifest with one image path per line. Blank lines
+ *          and lines starting with # are skipped.
+ * @param a_Batch   The batch to fill
+ * @param a_Source  The directory, glob or manifest
+ * @return  Whether at least one image was found
+ */
+bool collectBatchPaths(Batch * a_Batch, string a_Source)
+{
+    char const * source = (char const *)a_Source;
+    char pattern[PATH_MAX];
+    struct stat st;
+
+    bool const isDirectory = stat(source, &st) == ZERO && S_ISDIR(st.st_mode);
+    if (isDirectory || strpbrk(source, "*?[") != NULL)
+    {
+        if (isDirectory) {
+            int written = snprintf(pattern, sizeof(pattern), "%s/%s", source, BATCH_IMAGE_GLOB);
+            observeAndReport(written > ZERO && (size_t)written < sizeof(pattern), "Error: batch directory path is too long");
+        }
+        else {
+            observeAndReport(strlen(source) < sizeof(pattern), "Error: batch pattern is too long");
+            strcpy(pattern, source);
+        }
+
+        glob_t matches;
+        if (glob(pattern, ZERO, NULL, &matches) == ZERO)
+        {
+            for (size_t i = 0; i < matches.gl_pathc; i++) addBatchPath(a_Batch, matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+        return a_Batch->n_Paths > ZERO;
+    }
+
+    FILE * manifest = fopen(source, "r");
+    observeAndReport(manifest != NULL, "Error opening batch manifest");
+
+    char * line = NULL;
+    size_t capacity = ZERO;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, manifest)) != -1)
+    {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) line[--length] = NULL_CHAR;
+        if (length == 0 || line[0] == '#') continue;
+        addBatchPath(a_Batch, line);
+    }
+    free(line);
+    fclose(manifest);
+    return a_Batch->n_Paths > ZERO;
+}
+
+/**
+ * @brief   Opens the batch's images one after another into free slots
+ * @param a_pArgument   The Batch
+ * @return  NULL
+ */
+void * batchReaderMain(void * a_pArgument)
+{
+    Batch * batch = (Batch *)a_pArgument;
+
+    for (size_t i = 0; i < batch->n_Paths; i++)
+    {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->n_Free == ZERO) pthread_cond_wait(&batch->slot_free, &batch->lock);
+        DiskImage * disk = batch->free_slots[--batch->n_Free];
+        pthread_mutex_unlock(&batch->lock);
+
+        jmp_buf recovery;
+        t_pRecoveryPoint = &recovery;
+        if (setjmp(recovery) != 0)
+        {
+            t_pRecoveryPoint = NULL;
+            logError("Skipping unreadable image %s\n", batch->paths[i]);
+            closeFile(disk);
+
+            pthread_mutex_lock(&batch->lock);
+            batch->n_Failed++;
+            batch->free_slots[batch->n_Free++] = disk;
+            pthread_mutex_unlock(&batch->lock);
+            continue;
+        }
+
+        openFile(disk, (string)batch->paths[i]);
+        prefetchMetadata(disk);
+        t_pRecoveryPoint = NULL;
+
+        pthread_mutex_lock(&batch->lock);
+        size_t tail = (batch->ready_head + batch->n_Ready) % batch->n_Slots;
+        batch->ready[tail] = disk;
+        batch->ready_index[tail] = i;
+        batch->n_Ready++;
+        pthread_cond_signal(&batch->image_ready);
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->reading_done = true;
+    pthread_cond_broadcast(&batch->image_ready);
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+/**
+ * @brief   Parses and extracts one opened image of a batch
+ * @details Files go to <output_root>/<image name>, or <output_root>/<image name>.tar or .cpio with
+ *          --format, and the listing to <output_root>/<image name>.txt
+ * @param a_Batch   The batch
+ * @param a_Disk    The slot holding the opened image
+ * @param a_Index   The image's position in the batch
+ * @return  Whether the image was processed completely
+ */
+bool processBatchImage(Batch * a_Batch, DiskImage * a_Disk, size_t a_Index)
+{
+    char name[PATH_MAX];
+    char outputDirectory[PATH_MAX];
+    char listingPath[PATH_MAX];
+    char archivePath[PATH_MAX];
+
+    strncpy(name, a_Batch->paths[a_Index], sizeof(name) - 1);
+    name[sizeof(name) - 1] = NULL_CHAR;
+    char * stem = basename(name);
+    char * extension = strrchr(stem, DOT_CHAR);
+    if (extension != NULL && extension != stem) *extension = NULL_CHAR;
+
+    int written = snprintf(outputDirectory, sizeof(outputDirectory), "%s/%s", (char *)a_Batch->output_root, stem);
+    int listed = snprintf(listingPath, sizeof(listingPath), "%s%s", outputDirectory, BATCH_LISTING_SUFFIX);
+    int const format = a_Batch->options->archive_format;
+    int archived = snprintf(archivePath, sizeof(archivePath), "%s.%s", outputDirectory, archiveExtension(format));
+    if (written <= ZERO || listed <= ZERO || (size_t)listed >= sizeof(listingPath) || archived <= ZERO || (size_t)archived >= sizeof(archivePath))
+    {
+        logError("Skipping %s, output path is too long\n", a_Batch->paths[a_Index]);
+        closeFile(a_Disk);
+        return false;
+    }
+
+    FILE * listing = fopen(listingPath, "w");
+    if (listing == NULL)
+    {
+        logError("Skipping %s, cannot create %s\n", a_Batch->paths[a_Index], listingPath);
+        closeFile(a_Disk);
+        return false;
+    }
+
+    // An image's entries join the batch timeline only once it is processed completely
+    if (a_Batch->timelines != NULL)
+    {
+        if (a_Disk->timeline == NULL) a_Disk->timeline = createTimeline();
+        else resetTimeline(a_Disk->timeline);
+        if (a_Disk->timeline == NULL)
+        {
+            logError("Skipping %s, out of memory for its timeline\n", a_Batch->paths[a_Index]);
+            closeFile(a_Disk);
+            fclose(listing);
+            return false;
+        }
+        a_Disk->timeline_label = stem;
+    }
+
+    jmp_buf recovery;
+    t_pRecoveryPoint = &recovery;
+    if (setjmp(recovery) != 0)
+    {
+        t_pRecoveryPoint = NULL;
+        a_Disk->timeline_label = NULL;
+        logError("Abandoned corrupt image %s\n", a_Batch->paths[a_Index]);
+        if (a_Disk->arena != NULL) resetArena(a_Disk->arena);
+        a_Disk->p_RootEntry = NULL;
+        if (a_Disk->writer != NULL) outputFlush(a_Disk->writer);
+        destroyIncremental(a_Disk);
+        closeArchiveOutput(a_Disk);
+        closeFile(a_Disk);
+        fclose(listing);
+        return false;
+    }
+
+    a_Disk->output_directory = (string)(format != ARCHIVE_NONE ? archivePath : outputDirectory);
+    a_Disk->listing = listing;
+    openOutput(a_Disk);
+    processOpenedImage(a_Disk);
+    t_pRecoveryPoint = NULL;
+
+    if (a_Batch->timelines != NULL)
+    {
+        a_Batch->timelines[a_Index] = a_Disk->timeline;
+        a_Disk->timeline = NULL;
+        a_Disk->timeline_label = NULL;
+    }
+
+    fclose(listing);
+    return true;
+}
+
+/**
+ * @brief   Takes opened images off the ready queue until the reader is done
+ * @param a_pArgument   The Batch
+ * @return  NULL
+ */
+void * batchLaneMain(void * a_pArgument)
+{
+    Batch * batch = (Batch *)a_pArgument;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->n_Ready == ZERO && !batch->reading_done) pthread_cond_wait(&batch->image_ready, &batch->lock);
+        if (batch->n_Ready == ZERO) {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        DiskImage * disk = batch->ready[batch->ready_head];
+        size_t index = batch->ready_index[batch->ready_head];
+        batch->ready_head = (batch->ready_head + 1) % batch->n_Slots;
+        batch->n_Ready--;
+        pthread_mutex_unlock(&batch->lock);
+
+        bool processed = processBatchImage(batch, disk, index);
+
+        pthread_mutex_lock(&batch->lock);
+        if (!processed) batch->n_Failed++;
+        batch->free_slots[batch->n_Free++] = disk;
+        pthread_cond_signal(&batch->slot_free);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief   Recovers the files of many images in one process
+ * @details One reader thread opens images ahead of a_n_Lanes lanes that parse and extract them.
+ *          DiskImage slots, with their decoded FAT and read buffers, are recycled between
+ *          images, and a corrupt or unreadable image is skipped instead of ending the run.
+ * @param a_Source      The manifest, directory or glob naming the images
+ * @param a_OutputRoot  The directory receiving one output directory and listing per image
+ * @param a_n_Lanes     How many images are parsed and extracted at once
+ * @param a_Options     The options every image is processed with
+ * @return  The number of images that could not be processed
+ */
+size_t runBatch(string a_Source, string a_OutputRoot, size_t a_n_Lanes, const Options * a_Options)
+{
+    Batch batch;
+    memset(&batch, ZERO, sizeof(Batch));
+    batch.output_root = a_OutputRoot;
+    batch.options = a_Options;
+
+    makeOutputDirectory(a_OutputRoot);
+    observeAndReport(collectBatchPaths(&batch, a_Source), "Error: no images found for batch");
+
+    batch.n_Slots = a_n_Lanes * (1 + BATCH_PREFETCH_PER_LANE);
+    batch.slots = (DiskImage **)calloc(batch.n_Slots, sizeof(DiskImage *));
+    batch.free_slots = (DiskImage **)calloc(batch.n_Slots, sizeof(DiskImage *));
+    batch.ready = (DiskImage **)calloc(batch.n_Slots, sizeof(DiskImage *));
+    batch.ready_index = (size_t *)calloc(batch.n_Slots, sizeof(size_t));
+    pthread_t * lanes = (pthread_t *)calloc(a_n_Lanes, sizeof(pthread_t));
+    if (a_Options->timeline_path != NULL) batch.timelines = (Timeline **)calloc(batch.n_Paths, sizeof(Timeline *));
+    observeAndReport(batch.slots != NULL && batch.free_slots != NULL && batch.ready != NULL
+        && batch.ready_index != NULL && lanes != NULL && (a_Options->timeline_path == NULL || batch.timelines != NULL), "Error allocating memory for batch");
+
+    for (size_t i = 0; i < batch.n_Slots; i++)
+    {
+        batch.slots[i] = createDiskImage();
+        batch.slots[i]->options = a_Options;
+        batch.free_slots[batch.n_Free++] = batch.slots[i];
+    }
+
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.slot_free, NULL);
+    pthread_cond_init(&batch.image_ready, NULL);
+
+    pthread_t reader;
+    observeAndReport(pthread_create(&reader, NULL, batchReaderMain, &batch) == ZERO, "Error starting batch reader");
+    for (size_t i = 0; i < a_n_Lanes; i++)
+    {
+        observeAndReport(pthread_create(&lanes[i], NULL, batchLaneMain, &batch) == ZERO, "Error starting batch lane");
+    }
+
+    pthread_join(reader, NULL);
+    for (size_t i = 0; i < a_n_Lanes; i++) pthread_join(lanes[i], NULL);
+
+    logInfo("Batch finished: %zu images, %zu failed\n", batch.n_Paths, batch.n_Failed);
+
+    // Merged in batch order, so that entries with the same time come out the same every run
+    if (batch.timelines != NULL)
+    {
+        Timeline * timeline = createTimeline();
+        observeAndReport(timeline != NULL, "Error allocating memory for timeline");
+        for (size_t i = 0; i < batch.n_Paths; i++)
+        {
+            if (batch.timelines[i] == NULL) continue;
+            timelineAppend(timeline, batch.timelines[i]);
+            destroyTimeline(batch.timelines[i]);
+        }
+        observeAndReport(writeTimeline(timeline, a_Options->timeline_path, timelineFormatForPath(a_Options->timeline_path)), "Error writing timeline");
+        destroyTimeline(timeline);
+        free(batch.timelines);
+    }
+
+    for (size_t i = 0; i < batch.n_Slots; i++) destroyDiskImage(batch.slots[i]);
+    for (size_t i = 0; i < batch.n_Paths; i++) free(batch.paths[i]);
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.slot_free);
+    pthread_cond_destroy(&batch.image_ready);
+    free(batch.paths);
+    free(batch.slots);
+    free(batch.free_slots);
+    free(batch.ready);
+    free(batch.ready_index);
+    free(lanes);
+
+    return batch.n_Failed;
+}
+
+/**
+ * @brief   Runs extraction jobs sent over a UNIX domain socket until SIGINT or SIGTERM
+ * @details A client writes one job per line, "image<TAB>output[<TAB>options]", and reads one
+ *          line of JSON per job as it finishes, in the order jobs finish, each carrying the
+ *          number of the job it answers. Options are any of -c -s -H --direct --format=tar|cpio
+ *          --manifest=path, separated by spaces and added to those serve was started with.
+ *          Files go to output, or into the archive named output with --format, and the listing
+ *          to output.txt. Lanes keep their DiskImage, with its buffers and decoded FAT, from job
+ *          to job, and share a cache of decoded FATs keyed by image file identity.
+ * @param a_SocketPath  Where to listen, a socket left there by an earlier server is replaced
+ * @param a_n_Lanes     How many jobs run at once
+ * @param a_Options     What every job starts from
+ * @return  EXIT_SUCCESS once stopped and every queued job is answered
+ */
+int runServer(const char * a_SocketPath, size_t a_n_Lanes, const Options * a_Options)
+{
+    Server server;
+    memset(&server, ZERO, sizeof(Server));
+    server.defaults = a_Options;
+    server.fat_cache = createFatCache(SERVE_FAT_CACHE_BYTES);
+    server.queue = (ServeJob **)calloc(SERVE_QUEUE_DEPTH, sizeof(ServeJob *));
+    pthread_t * lanes = (pthread_t *)calloc(a_n_Lanes, sizeof(pthread_t));
+    observeAndReport(server.fat_cache != NULL && server.queue != NULL && lanes != NULL, "Error allocating memory for server");
+
+    struct sockaddr_un address;
+    memset(&address, ZERO, sizeof(address));
+    address.sun_family = AF_UNIX;
+    observeAndReport(strlen(a_SocketPath) < sizeof(address.sun_path), "Error: socket path is too long");
+    strcpy(address.sun_path, a_SocketPath);
+
+    struct stat st;
+    if (lstat(a_SocketPath, &st) == ZERO && S_ISSOCK(st.st_mode)) unlink(a_SocketPath);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, ZERO);
+    observeAndReport(listener != NO_FD, "Error creating socket");
+    observeAndReport(bind(listener, (struct sockaddr *)&address, sizeof(address)) == ZERO, "Error binding socket");
+    observeAndReport(listen(listener, SERVE_BACKLOG) == ZERO, "Error listening on socket");
+
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.job_ready, NULL);
+    pthread_cond_init(&server.slot_free, NULL);
+
+    // The stop signals stay blocked everywhere and are only let through while this thread
+    // waits in ppoll(), so one that arrives between checking the flag and waiting still wakes it
+    sigset_t stopSignals;
+    sigset_t waitMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &waitMask);
+    sigdelset(&waitMask, SIGINT);
+    sigdelset(&waitMask, SIGTERM);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (size_t i = 0; i < a_n_Lanes; i++)
+    {
+        observeAndReport(pthread_create(&lanes[i], NULL, serveLaneMain, &server) == ZERO, "Error starting serve lane");
+    }
+
+    struct sigaction stop;
+    memset(&stop, ZERO, sizeof(stop));
+    stop.sa_handler = stopServer;
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    logInfo("Serving on %s with %zu lanes\n", a_SocketPath, a_n_Lanes);
+
+    pthread_attr_t detached;
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+    while (!s_ServeStopping)
+    {
+        struct pollfd waiting = { .fd = listener, .events = POLLIN, .revents = ZERO };
+        if (ppoll(&waiting, 1, NULL, &waitMask) <= ZERO) continue;
+
+        // The listener does not block, a connection that went away before it was taken is skipped
+        int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == NO_FD) continue;
+
+        ServeClient * client = (ServeClient *)calloc(1, sizeof(ServeClient));
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        client->server = &server;
+        client->fd = fd;
+        client->n_Refs = 1;
+        pthread_mutex_init(&client->write_lock, NULL);
+
+        // Readers are never joined, one still waiting on an idle client ends with the process
+        pthread_t reader;
+        if (pthread_create(&reader, &detached, serveClientMain, client) != ZERO) releaseServeClient(client);
+    }
+    pthread_attr_destroy(&detached);
+    close(listener);
+    unlink(a_SocketPath);
+
+    // Queued jobs are still run and answered, readers waiting for room give up
+    pthread_mutex_lock(&server.lock);
+    server.stopping = true;
+    pthread_cond_broadcast(&server.job_ready);
+    pthread_cond_broadcast(&server.slot_free);
+    pthread_mutex_unlock(&server.lock);
+    for (size_t i = 0; i < a_n_Lanes; i++) pthread_join(lanes[i], NULL);
+
+    logInfo("Server stopped: %zu jobs, %zu failed\n", server.n_Jobs, server.n_Failed);
+    destroyFatCache(server.fat_cache);
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.job_ready);
+    pthread_cond_destroy(&server.slot_free);
+    free(server.queue);
+    free(lanes);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief   Asks the server to stop accepting connections
+ * @param a_Signal  SIGINT or SIGTERM
+ */
+void stopServer(int a_Signal)
+{
+    (void)a_Signal;
+    s_ServeStopping = 1;
+}
+
+/**
+ * @brief   Reads one client's job lines into the queue until it closes its end
+ * @details Lines that are not jobs are answered as rejected right away and take no lane.
+ * @param a_pArgument   The ServeClient
+ * @return  NULL
+ */
+void * serveClientMain(void * a_pArgument)
+{
+    ServeClient * client = (ServeClient *)a_pArgument;
+    Server * server = client->server;
+
+    int fd = dup(client->fd);
+    FILE * in = fd != NO_FD ? fdopen(fd, "r") : NULL;
+    if (in == NULL && fd != NO_FD) close(fd);
+
+    char * line = NULL;
+    size_t capacity = ZERO;
+    ssize_t length;
+    while (in != NULL && (length = getline(&line, &capacity, in)) != -1)
+    {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) line[--length] = NULL_CHAR;
+        if (length == 0 || line[0] == '#') continue;
+
+        ServeJob * job = (ServeJob *)calloc(1, sizeof(ServeJob));
+        if (job == NULL) break;
+        job->client = client;
+        job->id = ++client->n_Jobs;
+        job->options = *server->defaults;
+        job->line = strdup(line);
+        __atomic_add_fetch(&client->n_Refs, 1, __ATOMIC_ACQ_REL);
+
+        const char * error = job->line != NULL ? parseServeJob(job) : "out of memory";
+        if (error == NULL && !queueServeJob(server, job)) error = "server is stopping";
+        if (error != NULL)
+        {
+            sendServeResult(job, NULL, "rejected", error);
+            freeServeJob(job);
+        }
+    }
+
+    free(line);
+    if (in != NULL) fclose(in);
+    releaseServeClient(client);
+    return NULL;
+}
+
+/**
+ * @brief   Splits a job line and applies its options
+ * @param a_Job     The job, with its line and the server's default options
+ * @return  NULL, or why the job cannot run
+ */
+const char * parseServeJob(ServeJob * a_Job)
+{
+    char * rest = NULL;
+    a_Job->image = strtok_r(a_Job->line, "\t", &rest);
+    a_Job->output = strtok_r(NULL, "\t", &rest);
+    char * arguments = strtok_r(NULL, "\t", &rest);
+    if (a_Job->image == NULL || a_Job->output == NULL || strtok_r(NULL, "\t", &rest) != NULL) return "expected image<TAB>output[<TAB>options]";
+    if (isStreamInput((string)a_Job->image)) return "streamed images cannot be served";
+    if (strcmp(a_Job->output, ARCHIVE_STDOUT_PATH) == ZERO) return "output cannot be standard output";
+
+    Options * options = &a_Job->options;
+    char * next = NULL;
+    for (char * argument = arguments != NULL ? strtok_r(arguments, " ", &next) : NULL; argument != NULL; argument = strtok_r(NULL, " ", &next))
+    {
+        if (strcmp(argument, "-c") == ZERO) options->carve = true;
+        else if (strcmp(argument, "-s") == ZERO) options->scheduled = true;
+        else if (strcmp(argument, "-H") == ZERO) options->hash = true;
+        else if (strcmp(argument, "--direct") == ZERO) options->direct = true;
+        else if (strncmp(argument, "--format=", 9) == ZERO)
+        {
+            options->archive_format = archiveFormatByName(argument + 9);
+            if (options->archive_format == ARCHIVE_NONE) return "--format expects tar or cpio";
+        }
+        else if (strncmp(argument, "--manifest=", 11) == ZERO && argument[11] != NULL_CHAR) options->manifest_path = argument + 11;
+        else return "unknown option";
+    }
+
+    // The same combinations main() turns down
+    if ((options->archive_format != ARCHIVE_NONE || options->hash) && options->scheduled) return "--format and -H cannot be combined with -s";
+    if (options->manifest_path != NULL && (options->scheduled || options->hash || options->archive_format != ARCHIVE_NONE)) return "--manifest cannot be combined with -s, -H or --format";
+    if (options->filter != NULL && options->carve) return "-c cannot be combined with filters";
+    return NULL;
+}
+
+/**
+ * @brief   Hands a job to the lanes, waiting while the queue is full
+ * @param a_Server  The server
+ * @param a_Job     The job
+ * @return  Whether the job was queued, false once the server is stopping
+ */
+bool queueServeJob(Server * a_Server, ServeJob * a_Job)
+{
+    pthread_mutex_lock(&a_Server->lock);
+    while (a_Server->n_Queued == SERVE_QUEUE_DEPTH && !a_Server->stopping) pthread_cond_wait(&a_Server->slot_free, &a_Server->lock);
+    bool const queued = !a_Server->stopping;
+    if (queued)
+    {
+        a_Server->queue[(a_Server->queue_head + a_Server->n_Queued) % SERVE_QUEUE_DEPTH] = a_Job;
+        a_Server->n_Queued++;
+        pthread_cond_signal(&a_Server->job_ready);
+    }
+    pthread_mutex_unlock(&a_Server->lock);
+    return queued;
+}
+
+/**
+ * @brief   Takes jobs off the queue until the server stops and the queue is empty
+ * @param a_pArgument   The Server
+ * @return  NULL
+ */
+void * serveLaneMain(void * a_pArgument)
+{
+    Server * server = (Server *)a_pArgument;
+    DiskImage * disk = createDiskImage();
+    disk->fat_cache = server->fat_cache;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&server->lock);
+        while (server->n_Queued == ZERO && !server->stopping) pthread_cond_wait(&server->job_ready, &server->lock);
+        if (server->n_Queued == ZERO) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        ServeJob * job = server->queue[server->queue_head];
+        server->queue_head = (server->queue_head + 1) % SERVE_QUEUE_DEPTH;
+        server->n_Queued--;
+        pthread_cond_signal(&server->slot_free);
+        pthread_mutex_unlock(&server->lock);
+
+        runServeJob(disk, job);
+        freeServeJob(job);
+    }
+
+    disk->options = NULL;
+    destroyDiskImage(disk);
+    return NULL;
+}
+
+/**
+ * @brief   Parses and extracts the image of one job and answers it
+ * @param a_Disk    The lane's DiskImage
+ * @param a_Job     The job
+ */
+void runServeJob(DiskImage * a_Disk, ServeJob * a_Job)
+{
+    Server * server = a_Job->client->server;
+    __atomic_add_fetch(&server->n_Jobs, 1, __ATOMIC_RELAXED);
+
+    // The listing is in the DiskImage rather than a local so that it survives the longjmp
+    a_Disk->listing = NULL;
+    jmp_buf recovery;
+    t_pRecoveryPoint = &recovery;
+    if (setjmp(recovery) != 0)
+    {
+        t_pRecoveryPoint = NULL;
+        if (a_Disk->arena != NULL) resetArena(a_Disk->arena);
+        a_Disk->p_RootEntry = NULL;
+        if (a_Disk->writer != NULL) outputFlush(a_Disk->writer);
+        destroyIncremental(a_Disk);
+        closeArchiveOutput(a_Disk);
+        closeFile(a_Disk);
+        if (a_Disk->listing != NULL) fclose(a_Disk->listing);
+        a_Disk->listing = NULL;
+        __atomic_add_fetch(&server->n_Failed, 1, __ATOMIC_RELAXED);
+        sendServeResult(a_Job, NULL, "failed", t_pFailure);
+        return;
+    }
+
+    // The image is opened first, so that a job whose image cannot be read leaves nothing behind
+    a_Disk->options = &a_Job->options;
+    openFile(a_Disk, (string)a_Job->image);
+
+    char listingPath[PATH_MAX];
+    int listed = snprintf(listingPath, sizeof(listingPath), "%s%s", a_Job->output, BATCH_LISTING_SUFFIX);
+    observeAndReport(listed > ZERO && (size_t)listed < sizeof(listingPath), "Error: output path is too long");
+    a_Disk->listing = fopen(listingPath, "w");
+    observeAndReport(a_Disk->listing != NULL, "Error creating listing");
+
+    a_Disk->output_directory = (string)a_Job->output;
+    openOutput(a_Disk);
+    processOpenedImage(a_Disk);
+    t_pRecoveryPoint = NULL;
+
+    fclose(a_Disk->listing);
+    a_Disk->listing = NULL;
+    sendServeResult(a_Job, a_Disk, "ok", NULL);
+}
+
+/**
+ * @brief   Answers a job with one line of JSON
+ * @details A finished job carries the image's --stats record, any other the reason it did not
+ *          finish. The line goes out whole, a client that has gone away is not written to.
+ * @param a_Job     The job
+ * @param a_Disk    The DiskImage that processed it, NULL if it did not finish
+ * @param a_Status  "ok", "failed" or "rejected"
+ * @param a_Error   Why it did not finish, NULL if it did
+ */
+void sendServeResult(ServeJob * a_Job, const DiskImage * a_Disk, const char * a_Status, const char * a_Error)
+{
+    char image[2 * PATH_MAX];
+    char output[2 * PATH_MAX];
+    char error[2 * PATH_MAX];
+    char record[STATS_RECORD_MAX];
+    char result[SERVE_RESULT_MAX];
+    jsonEscape(a_Job->image != NULL ? a_Job->image : "", image, sizeof(image));
+    jsonEscape(a_Job->output != NULL ? a_Job->output : "", output, sizeof(output));
+    jsonEscape(a_Error != NULL ? a_Error : "", error, sizeof(error));
+
+    int length;
+    if (a_Disk != NULL)
+    {
+        int recorded = formatStats(a_Disk, record, sizeof(record));
+        if (recorded > ZERO) record[recorded - 1] = NULL_CHAR;
+        else strcpy(record, "{}");
+        length = snprintf(result, sizeof(result), "{\"job\":%zu,\"status\":\"%s\",\"image\":\"%s\",\"output\":\"%s\",\"files\":%zu,\"fat_cached\":%s,\"stats\":%s}\n",
+            a_Job->id, a_Status, image, output, a_Disk->n_Files, a_Disk->stats.fat_cached ? "true" : "false", record);
+    }
+    else
+    {
+        length = snprintf(result, sizeof(result), "{\"job\":%zu,\"status\":\"%s\",\"image\":\"%s\",\"output\":\"%s\",\"error\":\"%s\"}\n",
+            a_Job->id, a_Status, image, output, error);
+    }
+    if (length <= ZERO || (size_t)length >= sizeof(result)) return;
+
+    ServeClient * client = a_Job->client;
+    pthread_mutex_lock(&client->write_lock);
+    size_t sent = ZERO;
+    while (sent < (size_t)length)
+    {
+        ssize_t n = send(client->fd, result + sent, (size_t)length - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        sent += (size_t)n;
+    }
+    pthread_mutex_unlock(&client->write_lock);
+}
+
+/**
+ * @brief   Drops one reference to a client, closing and freeing it with the last
+ * @param a_Client  The client
+ */
+void releaseServeClient(ServeClient * a_Client)
+{
+    if (__atomic_sub_fetch(&a_Client->n_Refs, 1, __ATOMIC_ACQ_REL) != ZERO) return;
+    close(a_Client->fd);
+    pthread_mutex_destroy(&a_Client->write_lock);
+    free(a_Client);
+}
+
+/**
+ * @brief   Frees an answered job and its hold on its client
+ * @param a_Job     The job
+ */
+void freeServeJob(ServeJob * a_Job)
+{
+    ServeClient * client = a_Job->client;
+    free(a_Job->line);
+    free(a_Job);
+    releaseServeClient(client);
+}
+
+/**
+ * @brief   Generates an entry from a byte location
+ * @param a_ParentEntry  The parent entry
+ * @param a_byteLocation The byte location to generate the entry from
+ * @param depth          The depth of the entry
+ * @param a_ParentDeleted Whether or not the parent entry is deleted
+ * @return  The generated entry
+
+*/
+Entry * generateEntry(Entry * a_ParentEntry, byte_ptr a_byteLocation, size_t depth, bool a_ParentDeleted)
+{
+    observeAndReport(a_byteLocation != NULL, "Error: a_byteLocation is null");
+
+    byte first_cluster_bigbyte = a_byteLocation[ENTRY_FIRST_CLUSTER_OFFSET2];
+    byte first_cluster_littlebyte = a_byteLocation[ENTRY_FIRST_CLUSTER_OFFSET1];
+    byte attributes = ATTR_NULL | a_byteLocation[ENTRY_ATTRIBUTES_OFFSET];
+
+    Entry * e = (Entry *)arenaAlloc(a_ParentEntry->disk->arena, sizeof(Entry));
+
+    e->disk = a_ParentEntry->disk;
+    e->parent = a_ParentEntry;
+    e->attributes = attributes;
+    e->first_cluster = combineTwoBytes(first_cluster_bigbyte, first_cluster_littlebyte);
+    if (a_ParentEntry->disk->geometry.fat_bits == FAT32_BITS)
+    {
+        // FAT12 and FAT16 use these two bytes for other things
+        fat_entry const high = combineTwoBytes(a_byteLocation[ENTRY_FIRST_CLUSTER_HIGH_OFFSET2], a_byteLocation[ENTRY_FIRST_CLUSTER_HIGH_OFFSET1]);
+        e->first_cluster |= high << 16;
+    }
+    e->size = combineFourBytes(a_byteLocation + ENTRY_SIZE_OFFSET);
+    e->depth = depth;
+    e->deleted = a_ParentDeleted;
+    e->carved = false;
+    e->data = NULL;
+    e->extents = NULL;
+    e->n_Extents = ZERO;
+    e->first_child = NULL;
+    e->last_child = NULL;
+    e->next_sibling = NULL;
+    e->index = ZERO;
+    e->stream_file = ZERO;
+    e->digest = NULL;
+    e->duplicate_of = NULL;
+    e->expanded = false;
+    e->numbered_member = false;
+    e->date.created = combineTwoBytes(a_byteLocation[ENTRY_DATE_CREATED_OFFSET + 1], a_byteLocation[ENTRY_DATE_CREATED_OFFSET]);
+    e->date.accessed = combineTwoBytes(a_byteLocation[ENTRY_LAST_ACCESSED_OFFSET + 1], a_byteLocation[ENTRY_LAST_ACCESSED_OFFSET]);
+    e->date.modified = combineTwoBytes(a_byteLocation[ENTRY_DATE_MODIFIED_OFFSET + 1], a_byteLocation[ENTRY_DATE_MODIFIED_OFFSET]);
+    e->time.created = combineTwoBytes(a_byteLocation[ENTRY_TIME_CREATED_OFFSET + 1], a_byteLocation[ENTRY_TIME_CREATED_OFFSET]);
+    e->time.accessed = ZERO; // FAT only keeps the day of the last access
+    e->time.modified = combineTwoBytes(a_byteLocation[ENTRY_TIME_MODIFIED_OFFSET + 1], a_byteLocation[ENTRY_TIME_MODIFIED_OFFSET]);
+    formatFileNaming(a_byteLocation, ENTRY_FILENAME_BYTES, e->filename);
+    formatFileNaming(a_byteLocation + ENTRY_EXTENSION_OFFSET, ENTRY_EXTENSION_BYTES, e->extension);
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    printBinary(e->attributes, BITS_PER_BYTE, true);
+#endif
+
+    if (a_byteLocation[ENTRY_FILENAME_OFFSET] == FILENAME_DELETED)
+    {
+        e->deleted = true;
+        e->filename[0] = UNDERSCORE_CHAR;
+    }
+
+    return e;
+}
+
+/**
+ * @brief   Makes the data for a file
+ * @details The data is not copied, the entry points straight into the image
+ * @param a_Entry       The entry to make the data for
+ * @param a_pDiskSector The disk sector to make the data from, null for empty files
+ */
+void makeData(Entry * a_Entry, byte_ptr a_pDiskSector)
+{
+    observeAndReport(a_Entry != NULL, "Error: a_Entry is null");
+
+    a_Entry->data = a_pDiskSector;
+
+    byte_count const cluster_bytes = a_Entry->disk->geometry.cluster_bytes;
+    size_t const clusters_needed = (size_t)((a_Entry->size + cluster_bytes - 1) / cluster_bytes);
+    buildExtents(a_Entry, clusters_needed);
+}
+
+/**
+ * @brief   Flags a file whose clusters include sectors the device reader zero-filled
+ * @details Prints DAMAGED, its path, output name and the bytes lost, on stderr next to the
+ *          listing. Only images read by openDeviceImage() can have any.
+ * @param a_Entry   The file, with its extents built by makeData()
+ */
+void reportDamage(Entry * a_Entry)
+{
+    DiskImage * disk = a_Entry->disk;
+    if (disk->reader == NULL || __atomic_load_n(&disk->device.n_Bad, __ATOMIC_RELAXED) == ZERO) return;
+
+    byte_count const cluster_bytes = disk->geometry.cluster_bytes;
+    byte_count remaining = recoverableBytes(a_Entry);
+    byte_count damaged = ZERO;
+    for (size_t i = 0; i < a_Entry->n_Extents && remaining > ZERO; i++)
+    {
+        byte_count const run_bytes = a_Entry->extents[i].length * cluster_bytes;
+        byte_count const length = remaining < run_bytes ? remaining : run_bytes;
+        damaged += deviceBadBytes(disk->reader, clusterOffset(disk, a_Entry->extents[i].start), length);
+        remaining -= length;
+    }
+    if (damaged == ZERO) return;
+
+    char path[ENTRY_PATH_MAX];
+    char name[OUTPUT_FILENAME_MAX];
+    materializePath(a_Entry, path, sizeof(path));
+    if (!outputNameFor(a_Entry, name, sizeof(name))) name[ZERO] = NULL_CHAR;
+    fprintf(stderr, "DAMAGED\t%s\t%s\t%llu\n", path, name, (unsigned long long)damaged);
+    __atomic_add_fetch(&disk->stats.n_Damaged, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief   Rebuilds the clusters of a deleted entry
+ * @details Deleting an entry zeroes its chain in the FAT, so the chain is guessed instead: the
+ *          data is taken to start at the first cluster and to continue through the clusters
+ *          after it for as long as they are still free. A first cluster that has since been
+ *          reused recovers nothing, and the run stops at the first cluster in use again.
+ * @param a_Entry           The deleted entry, it gets at most one extent
+ * @param a_n_MaxClusters   The most clusters its size calls for
+ */
+void recoverExtent(Entry * a_Entry, size_t a_n_MaxClusters)
+{
+    DiskImage * disk = a_Entry->disk;
+    cluster_num const first = a_Entry->first_cluster;
+    if (a_n_MaxClusters == ZERO || !isValidCluster(disk, first) || isClusterAllocated(disk, first)) return;
+
+    a_Entry->extents[0].start = first;
+    a_Entry->extents[0].length = freeRunLength(disk, first, a_n_MaxClusters);
+    a_Entry->n_Extents = 1;
+    claimClusters(disk, first, a_Entry->extents[0].length);
+}
+
+/**
+ * @brief   Collects an entry's cluster chain as runs of contiguous clusters
+ * @details Stops at the end of the chain, at the first cluster outside the image, or once
+ *          a_n_MaxClusters clusters have been collected. Up to ENTRY_INLINE_EXTENTS runs are
+ *          kept inside the entry itself, longer lists move to the heap. With run lengths at
+ *          hand a whole run is taken per step, otherwise one cluster.
+ * @param a_Entry           The entry whose chain to collect
+ * @param a_n_MaxClusters   The most clusters to follow
+ */
+void buildExtents(Entry * a_Entry, size_t a_n_MaxClusters)
+{
+    a_Entry->extents = a_Entry->inline_extents;
+    a_Entry->n_Extents = ZERO;
+    size_t capacity = ENTRY_INLINE_EXTENTS;
+
+    DiskImage * disk = a_Entry->disk;
+    if (a_Entry->carved)
+    {
+        // A carved file is one run by construction, its length is all there is to go by
+        a_Entry->extents[0].start = a_Entry->first_cluster;
+        a_Entry->extents[0].length = a_n_MaxClusters;
+        a_Entry->n_Extents = a_n_MaxClusters > ZERO ? 1 : ZERO;
+        return;
+    }
+    if (a_Entry->deleted)
+    {
+        recoverExtent(a_Entry, a_n_MaxClusters);
+        return;
+    }
+
+    cluster_num cluster = a_Entry->first_cluster;
+    size_t n_Clusters = ZERO;
+    size_t const limit = a_n_MaxClusters < disk->n_FatEntries ? a_n_MaxClusters : disk->n_FatEntries;
+    while (n_Clusters < limit && isValidCluster(disk, cluster))
+    {
+        size_t run = 1;
+        if (disk->runs_ready && cluster < disk->n_FatEntries)
+        {
+            run = disk->p_RunLength[cluster];
+            if (run > limit - n_Clusters) run = limit - n_Clusters;
+        }
+
+        Extent * last = a_Entry->n_Extents > ZERO ? &a_Entry->extents[a_Entry->n_Extents - 1] : NULL;
+        if (last != NULL && last->start + last->length == cluster)
+        {
+            last->length += run;
+        }
+        else
+        {
+            if (a_Entry->n_Extents == capacity)
+            {
+                capacity *= 2;
+                Extent * grown = (Extent *)arenaAlloc(disk->arena, sizeof(Extent) * capacity);
+                memcpy(grown, a_Entry->extents, sizeof(Extent) * a_Entry->n_Extents);
+                a_Entry->extents = grown;
+            }
+            a_Entry->extents[a_Entry->n_Extents].start = cluster;
+            a_Entry->extents[a_Entry->n_Extents].length = run;
+            a_Entry->n_Extents++;
+        }
+
+        n_Clusters += run;
+        cluster = getNextCluster(disk, (cluster_num)(cluster + run - 1));
+    }
+}
+
+/**
+ * @brief   Drops an entry's extent list, a list that outgrew the inline storage stays in the arena
+ * @param a_Entry   The entry whose extents to drop
+ */
+void freeExtents(Entry * a_Entry)
+{
+    a_Entry->extents = NULL;
+    a_Entry->n_Extents = ZERO;
+}
+
+/**
+ * @brief   Creates the output directory if it does not exist yet
+ * @param a_DirectoryPath   The directory to create
+ */
+void makeOutputDirectory(string a_DirectoryPath)
+{
+    int result = mkdir((char *)a_DirectoryPath, OUTPUT_DIRECTORY_MODE);
+    observeAndReport(result == ZERO || errno == EEXIST, "Error creating output directory");
+}
+
+/**
+ * @brief   Gets an image's output ready, a directory or, with --format, an archive
+ * @param a_Disk    The image, with its options and output_directory set
+ */
+void openOutput(DiskImage * a_Disk)
+{
+    int const format = a_Disk->options != NULL ? a_Disk->options->archive_format : ARCHIVE_NONE;
+    if (format == ARCHIVE_NONE)
+    {
+        makeOutputDirectory(a_Disk->output_directory);
+        return;
+    }
+
+    char * path = (char *)a_Disk->output_directory;
+    int fd = STDOUT_FILENO;
+    if (strcmp(path, ARCHIVE_STDOUT_PATH) != ZERO) fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, OUTPUT_FILE_MODE);
+    observeAndReport(fd != NO_FD, "Error creating archive");
+
+    a_Disk->archive = createArchive(fd, format);
+    observeAndReport(a_Disk->archive != NULL, "Error allocating memory for archive");
+}
 
 /**
- * @brief   Generates an entry from a byte location
- * @param a_ParentEntry  The parent entry
- * @param a_byteLocation The byte location to generate the entry from
- * @param depth          The depth of the entry
- * @param a_ParentDeleted Whether or not the parent entry is deleted
- * @return  The generated entry
+ * @brief   Ends an image's archive and closes it, unless it is standard output
+ * @param a_Disk    The image, which may have no archive
+ * @return  Whether the end of the archive was written
+ */
+bool closeArchiveOutput(DiskImage * a_Disk)
+{
+    if (a_Disk->archive == NULL) return true;
+
+    int const fd = archiveFd(a_Disk->archive);
+    bool finished = finishArchive(a_Disk->archive) == ZERO;
+    if (fd != STDOUT_FILENO && close(fd) != ZERO) finished = false;
+    destroyArchive(a_Disk->archive);
+    a_Disk->archive = NULL;
+    return finished;
+}
 
-*/
-Entry * generateEntry(Entry * a_ParentEntry, byte_ptr a_byteLocation, size_t depth, bool a_ParentDeleted)
+/**
+ * @brief   Appends a file to the image's archive under its path, its body copied from the image fd
+ * @details The path is the one the listing prints, without its leading slash. One the header
+ *          cannot hold, or one an earlier member already has, as deleted siblings can once
+ *          their first character is replaced, goes in as fileN.EXT instead.
+ * @param a_Entry   The file, with its extents built
+ */
+void archiveOutput(Entry * a_Entry)
 {
-    observeAndReport(a_byteLocation != NULL, "Error: a_byteLocation is null");
+    DiskImage * disk = a_Entry->disk;
+    char memberName[OUTPUT_FILENAME_MAX];
+    observeAndReport(memberNameFor(a_Entry, memberName, sizeof(memberName)), "Error: output path is too long");
+    if (!archiveNameUsable(disk->archive, memberName))
+    {
+        a_Entry->numbered_member = true;
+        observeAndReport(memberNameFor(a_Entry, memberName, sizeof(memberName)), "Error: output path is too long");
+    }
+    int64_t const mtime = dosTimestamp(a_Entry->date.modified, a_Entry->time.modified);
 
-    byte_ptr first_cluster_bigbyte = a_byteLocation + ENTRY_FIRST_CLUSTER_OFFSET2;
-    byte_ptr first_cluster_littlebyte = a_byteLocation + ENTRY_FIRST_CLUSTER_OFFSET1;
-    byte attributes = ATTR_NULL | a_byteLocation[ENTRY_ATTRIBUTES_OFFSET];
-    printBinary(attributes, BITS_PER_BYTE, true);
+    // Files go in one at a time, so an identical earlier one is always hashed and named already
+    HashRecord * record = a_Entry->digest != NULL ? dedupFile(a_Entry) : NULL;
+    if (a_Entry->duplicate_of != NULL)
+    {
+        char originalName[OUTPUT_FILENAME_MAX];
+        observeAndReport(memberNameFor(a_Entry->duplicate_of, originalName, sizeof(originalName)), "Error: output path is too long");
+        if (archiveLinkFile(disk->archive, memberName, originalName, mtime) == ZERO) return;
+    }
 
-    string formattedName = formatFileNaming(a_byteLocation, ENTRY_FILENAME_BYTES);
-    string formattedExtension = formatFileNaming(a_byteLocation + ENTRY_EXTENSION_OFFSET, ENTRY_EXTENSION_BYTES);
+    // The header carries the size up front, which falls short of the entry's when its chain does
+    byte_count const recoverable = recoverableBytes(a_Entry);
+    observeAndReport(archiveBeginFile(disk->archive, memberName, recoverable, mtime) == ZERO, "Error writing archive");
 
-    Entry * e = (Entry *)malloc(sizeof(Entry));
-    observeAndReport(e != NULL, "Error allocating memory for entry");
+    Sha256 hash;
+    if (record != NULL) sha256Init(&hash);
 
-    e->attributes = attributes;
-    e->filepath = strdup(a_ParentEntry->filepath);
-    e->first_cluster = combineTwoBytes(first_cluster_bigbyte, first_cluster_littlebyte);
-    e->size = combineTwoBytes(a_byteLocation + ENTRY_FIRST_CLUSTER_OFFSET2, a_byteLocation + ENTRY_FIRST_CLUSTER_OFFSET1);
-    e->depth = depth;
-    e->deleted = a_ParentDeleted;
-    memset(e->filename, NULL_CHAR, ENTRY_FILENAME_BYTES);
-    memset(e->extension, ENTRY_NO_EXTENSION, ENTRY_EXTENSION_BYTES);
-    printBinary(e->attributes, BITS_PER_BYTE, true);
+    byte_count remaining = recoverable;
+    for (size_t i = 0; i < a_Entry->n_Extents && remaining > ZERO; i++)
+    {
+        Extent const * extent = &a_Entry->extents[i];
+        byte_count const run_bytes = extent->length * disk->geometry.cluster_bytes;
+        byte_count const length = remaining < run_bytes ? remaining : run_bytes;
+        byte_num const offset = clusterOffset(disk, extent->start);
+        if (disk->reader != NULL)
+        {
+            // A device image's run only passes through a buffer, so it is hashed on the way out
+            ImageCopy copy = { archiveFd(disk->archive), record != NULL ? &hash : NULL, true };
+            visitImageRange(disk, offset, length, copyImagePiece, &copy);
+            observeAndReport(copy.ok, "Error writing archive");
+        }
+        else
+        {
+            observeAndReport(copyImageRange(disk, archiveFd(disk->archive), offset, length), "Error writing archive");
+            if (record != NULL) sha256Update(&hash, disk->p_Data + offset, (size_t)length);
+        }
+
+        remaining -= length;
+    }
+    disk->stats.bytes_written += recoverable - remaining;
+
+    if (record != NULL)
+    {
+        sha256Final(&hash, a_Entry->digest);
+        publishDigest(disk, record);
+    }
+}
+
+/**
+ * @brief   Writes a file's contents to the output directory as fileN.EXT
+ * @details With -H a file identical to one already written is not written, it is linked to
+ *          the original once everything is flushed. With --manifest a file whose output the
+ *          previous run left unchanged is not written either.
+ * @param a_Entry   The file to write
+ */
+void writeOutput(Entry * a_Entry)
+{
+    observeAndReport(a_Entry != NULL, "Error: a_Entry is null");
+    if (a_Entry->disk->archive != NULL)
+    {
+        archiveOutput(a_Entry);
+        return;
+    }
+    if (a_Entry->disk->incremental != NULL && skipUnchangedOutput(a_Entry)) return;
 
+    HashRecord * record = a_Entry->digest != NULL ? dedupFile(a_Entry) : NULL;
+    if (a_Entry->duplicate_of != NULL) return;
+    writeOutputFile(a_Entry, record);
+}
+
+/**
+ * @brief   Writes a file to the output directory, hashing it on the way when asked to
+ * @param a_Entry   The file to write, with its extents built
+ * @param a_pRecord Where to publish the file's digest, NULL if it needs no hashing
+ */
+void writeOutputFile(Entry * a_Entry, HashRecord * a_pRecord)
+{
+    char outputName[OUTPUT_FILENAME_MAX];
+    observeAndReport(outputNameFor(a_Entry, outputName, sizeof(outputName)), "Error: output path is too long");
 
+    OutputWriter * writer = a_Entry->disk->writer;
+    int fd = outputCreate(writer, outputName);
+    observeAndReport(fd != NO_FD, "Error creating output file");
 
-    if (formattedName == DOUBLE_DOT_CHAR) { return e; } //TODO: wtf do i put
+    // With a ring the writes and the close are only queued here, straight from the image data,
+    // which a device image does not hold
+    bool const queued = outputUsesRing(writer) && a_Entry->disk->reader == NULL;
+    unsigned const file = queued ? outputBegin(writer, fd) : ZERO;
 
-    // strcat(e->filepath, FORWARD_SLASH_STRING);
+    Sha256 hash;
+    if (a_pRecord != NULL) sha256Init(&hash);
 
-    if (formattedName == DOT_CHAR)
+    // One transfer per run of contiguous clusters, hashed while the ring writes it
+    byte_count remaining = a_Entry->size;
+    byte_num position = ZERO;
+    for (size_t i = 0; i < a_Entry->n_Extents && remaining > ZERO; i++)
     {
-        strcat(e->filepath, formattedName);
-        return e;
+        Extent const * extent = &a_Entry->extents[i];
+        byte_count const run_bytes = extent->length * a_Entry->disk->geometry.cluster_bytes;
+        byte_count const length = remaining < run_bytes ? remaining : run_bytes;
+        byte_num const offset = clusterOffset(a_Entry->disk, extent->start);
+        if (a_Entry->disk->reader != NULL)
+        {
+            ImageCopy copy = { fd, a_pRecord != NULL ? &hash : NULL, true };
+            visitImageRange(a_Entry->disk, offset, length, copyImagePiece, &copy);
+            observeAndReport(copy.ok, "Error writing output file");
+        }
+        else
+        {
+            byte_ptr const p_Run = a_Entry->disk->p_Data + offset;
+            if (queued) outputWrite(writer, file, p_Run, length, position);
+            else observeAndReport(copyImageRange(a_Entry->disk, fd, offset, length), "Error writing output file");
+            if (a_pRecord != NULL) sha256Update(&hash, p_Run, (size_t)length);
+        }
+
+        remaining -= length;
+        position += length;
     }
 
-    if (formattedName == ENTRY_FREE || formattedName == ENTRY_FREE_AND_LAST)
+    if (queued) outputEnd(writer, file);
+    else close(fd);
+    __atomic_add_fetch(&a_Entry->disk->stats.bytes_written, position, __ATOMIC_RELAXED);
+
+    if (a_pRecord != NULL)
     {
-        e->deleted = true;
+        sha256Final(&hash, a_Entry->digest);
+        publishDigest(a_Entry->disk, a_pRecord);
+    }
+}
+
+/**
+ * @brief   Loads the previous manifest and hashes every data cluster against it
+ * @details The data area is split into runs of clusters hashed on the pool. A cluster whose hash
+ *          differs from the previous run's, or every cluster when there was no previous run
+ *          with the same geometry, is marked changed.
+ * @param a_Disk    The image, parsed and with no file written yet
+ */
+void prepareIncremental(DiskImage * a_Disk)
+{
+    Incremental * incremental = (Incremental *)calloc(1, sizeof(Incremental));
+    observeAndReport(incremental != NULL, "Error allocating memory for manifest");
+    a_Disk->incremental = incremental;
+
+    Geometry const * geometry = &a_Disk->geometry;
+    size_t const n_Clusters = geometry->n_Clusters;
+    incremental->previous = readManifest(a_Disk->options->manifest_path);
+    incremental->current = createManifest(geometry->cluster_bytes, n_Clusters);
+    incremental->changed = (uint64_t *)calloc((n_Clusters + CLUSTER_NORMAL_MIN) / BITS_PER_WORD + 1, sizeof(uint64_t));
+    observeAndReport(incremental->changed != NULL, "Error allocating memory for manifest");
+
+    size_t per_task = (size_t)(MANIFEST_CHUNK_BYTES / geometry->cluster_bytes);
+    if (per_task == ZERO) per_task = 1;
+    size_t const n_Tasks = (n_Clusters + per_task - 1) / per_task;
+    ClusterHashRange * ranges = (ClusterHashRange *)arenaAlloc(a_Disk->arena, (n_Tasks + 1) * sizeof(ClusterHashRange));
+    observeAndReport(ranges != NULL, "Error allocating memory for manifest");
+    for (size_t i = 0; i < n_Tasks; i++)
+    {
+        ranges[i].disk = a_Disk;
+        ranges[i].first = CLUSTER_NORMAL_MIN + i * per_task;
+        ranges[i].n_Clusters = i + 1 < n_Tasks ? per_task : n_Clusters - i * per_task;
+        runTask(a_Disk, hashClustersTask, &ranges[i]);
+    }
+    waitForTasks(a_Disk);
+
+    Manifest * previous = incremental->previous;
+    bool const comparable = previous != NULL && manifestClusterBytes(previous) == geometry->cluster_bytes
+        && manifestClusterCount(previous) == n_Clusters;
+    uint64_t const * before = comparable ? manifestClusterHashes(previous) : NULL;
+    uint64_t const * after = manifestClusterHashes(incremental->current);
+    for (size_t i = 0; i < n_Clusters; i++)
+    {
+        if (before != NULL && before[i] == after[i]) continue;
+        cluster_num const cluster = CLUSTER_NORMAL_MIN + i;
+        incremental->changed[cluster / BITS_PER_WORD] |= (uint64_t)1 << (cluster % BITS_PER_WORD);
+        a_Disk->stats.n_ChangedClusters++;
+    }
+}
+
+/**
+ * @brief   Hashes a run of clusters into the current manifest
+ * @param a_pArgument   The ClusterHashRange
+ */
+void hashClustersTask(void * a_pArgument)
+{
+    ClusterHashRange const * range = (ClusterHashRange const *)a_pArgument;
+    DiskImage const * disk = range->disk;
+    uint64_t * hashes = manifestClusterHashes(disk->incremental->current);
+    size_t const cluster_bytes = (size_t)disk->geometry.cluster_bytes;
+
+    // A device image's clusters are copied out a piece at a time, whole clusters to a piece
+    size_t const per_piece = IMAGE_PIECE_BYTES > cluster_bytes ? IMAGE_PIECE_BYTES / cluster_bytes : 1;
+    for (size_t i = 0; i < range->n_Clusters; i += per_piece)
+    {
+        size_t const n_Clusters = range->n_Clusters - i < per_piece ? range->n_Clusters - i : per_piece;
+        byte_ptr copy = NULL;
+        byte_ptr data = imageBytes(disk, clusterOffset(disk, range->first + i), n_Clusters * cluster_bytes, &copy);
+        for (size_t k = 0; k < n_Clusters; k++)
+        {
+            hashes[range->first + i + k - CLUSTER_NORMAL_MIN] = quickHash(data + k * cluster_bytes, cluster_bytes, ZERO);
+        }
+        free(copy);
     }
+}
+
+/**
+ * @brief   Hashes what a file's output depends on apart from its data
+ * @param a_Entry   The file, with its extents built
+ * @param a_Path    Its full path
+ * @return  A hash of its path, directory entry fields and extents
+ */
+uint64_t entrySignature(const Entry * a_Entry, const char * a_Path)
+{
+    uint64_t const fields[] = {
+        a_Entry->size, a_Entry->first_cluster, a_Entry->attributes, a_Entry->deleted, a_Entry->carved,
+        a_Entry->date.created, a_Entry->date.accessed, a_Entry->date.modified,
+        a_Entry->time.created, a_Entry->time.accessed, a_Entry->time.modified,
+    };
+    uint64_t signature = quickHash(a_Path, strlen(a_Path), ZERO);
+    signature = quickHash(fields, sizeof(fields), signature);
+    return quickHash(a_Entry->extents, a_Entry->n_Extents * sizeof(Extent), signature);
+}
 
-    strncpy(e->filename, formattedName, ENTRY_FILENAME_BYTES);
-    //e->filename = formattedName;
-    strcat(e->filepath, formattedName);
-    strncpy(e->extension, formattedExtension, ENTRY_EXTENSION_BYTES);
+/**
+ * @brief   Tells whether any cluster a file's output is read from changed since the previous run
+ * @param a_Entry   The file, with its extents built
+ * @param a_Bytes   The number of bytes written for it
+ * @return  Whether one of those clusters changed
+ */
+bool touchesChangedCluster(const Entry * a_Entry, byte_count a_Bytes)
+{
+    DiskImage const * disk = a_Entry->disk;
+    uint64_t const * changed = disk->incremental->changed;
+    byte_count const cluster_bytes = disk->geometry.cluster_bytes;
+    size_t remaining = (size_t)((a_Bytes + cluster_bytes - 1) / cluster_bytes);
 
-    if (e->extension != ENTRY_NO_EXTENSION) {
-        strcat(e->filepath, ".");
-        strncat(e->filepath, e->extension, ENTRY_EXTENSION_BYTES);
+    for (size_t i = 0; i < a_Entry->n_Extents && remaining > ZERO; i++)
+    {
+        Extent const * extent = &a_Entry->extents[i];
+        size_t const length = extent->length < remaining ? extent->length : remaining;
+        for (cluster_num cluster = extent->start; cluster < extent->start + length; cluster++)
+        {
+            if (!isValidCluster(disk, cluster)) return true;
+            if (changed[cluster / BITS_PER_WORD] & ((uint64_t)1 << (cluster % BITS_PER_WORD))) return true;
+        }
+        remaining -= length;
     }
+    return false;
+}
 
-    return e;
+/**
+ * @brief   Records a file in the current manifest and tells whether its output can be left alone
+ * @details A file is skipped when the previous run wrote the same number under the same name
+ *          with the same signature, none of its clusters changed, and its output is still there
+ *          with the right size.
+ * @param a_Entry   The file, with its extents built
+ * @return  Whether the previous run's output stands
+ */
+bool skipUnchangedOutput(Entry * a_Entry)
+{
+    DiskImage * disk = a_Entry->disk;
+    Incremental * incremental = disk->incremental;
+
+    char name[OUTPUT_FILENAME_MAX];
+    observeAndReport(outputNameFor(a_Entry, name, sizeof(name)), "Error: output path is too long");
+    char path[ENTRY_PATH_MAX];
+    materializePath(a_Entry, path, sizeof(path));
+
+    uint64_t const signature = entrySignature(a_Entry, path);
+    byte_count const bytes = recoverableBytes(a_Entry);
+
+    unsigned status = MANIFEST_NEW;
+    uint64_t previous_signature = ZERO;
+    uint64_t previous_bytes = ZERO;
+    const char * previous_name = NULL;
+    if (incremental->previous != NULL
+        && manifestFile(incremental->previous, a_Entry->index, &previous_signature, &previous_bytes, &previous_name, NULL) != MANIFEST_NONE)
+    {
+        bool const same = previous_signature == signature && previous_bytes == bytes && strcmp(previous_name, name) == ZERO
+            && !touchesChangedCluster(a_Entry, bytes) && outputExists(disk->writer, name, bytes);
+        status = same ? MANIFEST_UNCHANGED : MANIFEST_CHANGED;
+    }
+    manifestSetFile(incremental->current, a_Entry->index, signature, bytes, name, path, status);
+
+    if (status != MANIFEST_UNCHANGED) return false;
+    __atomic_add_fetch(&disk->stats.n_Unchanged, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&incremental->skipped_bytes, bytes, __ATOMIC_RELAXED);
+    return true;
 }
 
 /**
- * @brief   Makes the data for a file
- * @param a_Entry       The entry to make the data for
- * @param a_pDiskSector The disk sector to make the data from
+ * @brief   Prints the delta report, removes stale outputs and saves the current manifest
+ * @details One DELTA line per file that was written or removed on stderr, then a summary. An
+ *          output of the previous run that no file of this run is written under is removed.
+ * @param a_Disk    The image, extracted and flushed
  */
-void makeData(Entry * a_Entry, byte_ptr a_pDiskSector)
+void finishIncremental(DiskImage * a_Disk)
 {
-    fprintf(stderr, "Making data\n");
-    observeAndReport(a_Entry != NULL, "Error: a_Entry is null");
-    observeAndReport(a_pDiskSector != NULL, "Error: a_pDiskSector is null");
+    Incremental * incremental = a_Disk->incremental;
+    Manifest * current = incremental->current;
+    Manifest * previous = incremental->previous;
+
+    size_t counts[MANIFEST_UNCHANGED + 1] = { ZERO };
+    size_t n_Removed = ZERO;
+    size_t n_Records = manifestFileCount(current);
+    if (previous != NULL && manifestFileCount(previous) > n_Records) n_Records = manifestFileCount(previous);
+
+    for (size_t i = 0; i < n_Records; i++)
+    {
+        const char * name = NULL;
+        const char * path = NULL;
+        unsigned const status = manifestFile(current, i, NULL, NULL, &name, &path);
+        counts[status]++;
+        if (status != MANIFEST_NONE && status != MANIFEST_UNCHANGED) fprintf(stderr, "DELTA\t%s\t%s\t%s\n", deltaName(status), name, path);
+
+        const char * previous_name = NULL;
+        const char * previous_path = NULL;
+        if (previous == NULL || manifestFile(previous, i, NULL, NULL, &previous_name, &previous_path) == MANIFEST_NONE) continue;
+        if (status != MANIFEST_NONE && strcmp(previous_name, name) == ZERO) continue;
+
+        outputRemove(a_Disk->writer, previous_name);
+        fprintf(stderr, "DELTA\tREMOVED\t%s\t%s\n", previous_name, previous_path);
+        n_Removed++;
+    }
+    fprintf(stderr, "DELTA\tSUMMARY\tnew=%zu\tchanged=%zu\tunchanged=%zu\tremoved=%zu\tchanged_clusters=%zu\tskipped_bytes=%llu\n",
+        counts[MANIFEST_NEW], counts[MANIFEST_CHANGED], counts[MANIFEST_UNCHANGED], n_Removed,
+        a_Disk->stats.n_ChangedClusters, (unsigned long long)incremental->skipped_bytes);
+
+    bool const written = writeManifest(current, a_Disk->options->manifest_path);
+    destroyIncremental(a_Disk);
+    observeAndReport(written, "Error writing manifest");
+}
+
+/**
+ * @brief   Frees what --manifest kept for an image, whether or not the image was finished
+ * @param a_Disk    The image, its incremental state may be NULL
+ */
+void destroyIncremental(DiskImage * a_Disk)
+{
+    Incremental * incremental = a_Disk->incremental;
+    if (incremental == NULL) return;
+    destroyManifest(incremental->current);
+    destroyManifest(incremental->previous);
+    free(incremental->changed);
+    free(incremental);
+    a_Disk->incremental = NULL;
+}
+
+/**
+ * @param a_Status  A MANIFEST_ status other than MANIFEST_NONE
+ * @return  How the delta report names it
+ */
+const char * deltaName(unsigned a_Status)
+{
+    if (a_Status == MANIFEST_NEW) return "NEW";
+    if (a_Status == MANIFEST_CHANGED) return "CHANGED";
+    return "UNCHANGED";
+}
+
+/**
+ * @brief   Tells whether files are hashed and deduplicated
+ * @param a_Disk    The image
+ * @return  Whether -H was given
+ */
+bool isHashing(const DiskImage * a_Disk)
+{
+    return a_Disk->options != NULL && a_Disk->options->hash;
+}
+
+/**
+ * @brief   Gets the duplicate table and the deferred listing ready for an image
+ * @param a_Disk    The image, whose earlier records went with the arena
+ */
+void prepareDedup(DiskImage * a_Disk)
+{
+    if (a_Disk->dedup == NULL)
+    {
+        a_Disk->dedup = (Dedup *)calloc(1, sizeof(Dedup));
+        observeAndReport(a_Disk->dedup != NULL, "Error allocating memory for duplicate table");
+        pthread_mutex_init(&a_Disk->dedup->lock, NULL);
+        pthread_cond_init(&a_Disk->dedup->hashed, NULL);
+    }
+    memset(a_Disk->dedup->buckets, ZERO, sizeof(a_Disk->dedup->buckets));
+    a_Disk->dedup->n_Duplicates = ZERO;
+    a_Disk->dedup->saved_bytes = ZERO;
+    a_Disk->emitted.n_Items = ZERO;
+}
+
+/**
+ * @brief   Frees a duplicate table
+ * @param a_pDedup  The table, may be NULL
+ */
+void destroyDedup(Dedup * a_pDedup)
+{
+    if (a_pDedup == NULL) return;
+    pthread_mutex_destroy(&a_pDedup->lock);
+    pthread_cond_destroy(&a_pDedup->hashed);
+    free(a_pDedup);
+}
+
+/**
+ * @brief   Lists a numbered file, or with -H keeps it for printListing() until its digest is known
+ * @param a_Entry   The file
+ */
+void listFile(Entry * a_Entry)
+{
+    DiskImage * disk = a_Entry->disk;
+    if (!isHashing(disk))
+    {
+        printFileLine(a_Entry);
+        return;
+    }
+
+    a_Entry->digest = (byte *)arenaAlloc(disk->arena, SHA256_DIGEST_BYTES);
+    observeAndReport(a_Entry->digest != NULL, "Error allocating memory for digest");
+    appendEntry(&disk->emitted, a_Entry);
+}
+
+/**
+ * @brief   Prints the listing lines listFile() held back, now with their digests
+ * @param a_Disk    The image, extracted and flushed
+ */
+void printListing(DiskImage * a_Disk)
+{
+    for (size_t i = 0; i < a_Disk->emitted.n_Items; i++) printFileLine(a_Disk->emitted.items[i]);
+
+    logInfo("Found %zu duplicate files, %llu bytes not written\n", a_Disk->dedup->n_Duplicates, (unsigned long long)a_Disk->dedup->saved_bytes);
+}
+
+/**
+ * @brief   Counts the bytes of a file its extents reach
+ * @param a_Entry   The file, with its extents built
+ * @return  Its size, or less when its chain is shorter than its size
+ */
+byte_count recoverableBytes(const Entry * a_Entry)
+{
+    byte_count recoverable = ZERO;
+    for (size_t i = 0; i < a_Entry->n_Extents; i++) recoverable += a_Entry->extents[i].length * a_Entry->disk->geometry.cluster_bytes;
+    return recoverable < a_Entry->size ? recoverable : a_Entry->size;
+}
+
+/**
+ * @brief   Takes the SHA-256 of what would be written for a file
+ * @param a_Entry   The file, with its extents built and its digest buffer set
+ */
+void hashEntry(Entry * a_Entry)
+{
+    Sha256 hash;
+    sha256Init(&hash);
+
+    byte_count remaining = a_Entry->size;
+    for (size_t i = 0; i < a_Entry->n_Extents && remaining > ZERO; i++)
+    {
+        byte_count const run_bytes = a_Entry->extents[i].length * a_Entry->disk->geometry.cluster_bytes;
+        byte_count const length = remaining < run_bytes ? remaining : run_bytes;
+        ImageCopy copy = { NO_FD, &hash, true };
+        visitImageRange(a_Entry->disk, clusterOffset(a_Entry->disk, a_Entry->extents[i].start), length, copyImagePiece, &copy);
+        remaining -= length;
+    }
+    sha256Final(&hash, a_Entry->digest);
+}
+
+/**
+ * @brief   Looks for a file of the image already written with the same contents
+ * @details A pre-hash of the size and the first few KB tells almost every pair of different
+ *          files apart without reading them in full. A file with no candidate is registered
+ *          right away and hashed while it is written, so it is read once. A file with
+ *          candidates is hashed first and compared with each of them, waiting for those still
+ *          being written to finish hashing.
+ * @param a_Entry   The file, with its extents built and its digest buffer set
+ * @return  The record to publish once the file is written and hashed, or NULL if it already is
+ *          hashed, in which case duplicate_of says whether it needs writing at all
+ */
+HashRecord * dedupFile(Entry * a_Entry)
+{
+    DiskImage * disk = a_Entry->disk;
+    Dedup * dedup = disk->dedup;
+    byte_count const recoverable = recoverableBytes(a_Entry);
+
+    uint64_t prehash = (uint64_t)recoverable;
+    if (recoverable > ZERO)
+    {
+        byte_count const first_run = a_Entry->extents[0].length * disk->geometry.cluster_bytes;
+        byte_count length = recoverable < first_run ? recoverable : first_run;
+        if (length > DEDUP_PREHASH_BYTES) length = DEDUP_PREHASH_BYTES;
+        byte_ptr copy = NULL;
+        prehash = quickHash(imageBytes(disk, clusterOffset(disk, a_Entry->extents[0].start), (size_t)length, &copy), (size_t)length, (uint64_t)recoverable);
+        free(copy);
+    }
+
+    HashRecord * record = (HashRecord *)arenaAlloc(disk->arena, sizeof(HashRecord));
+    observeAndReport(record != NULL, "Error allocating memory for duplicate table");
+    record->file = a_Entry;
+    record->prehash = prehash;
+    record->hashed = false;
+    size_t const bucket = (size_t)(prehash & (DEDUP_BUCKETS - 1));
+
+    pthread_mutex_lock(&dedup->lock);
+    HashRecord * candidates = dedup->buckets[bucket];
+    bool candidate = false;
+    for (HashRecord * other = candidates; other != NULL && !candidate; other = other->next) candidate = other->prehash == prehash;
+    if (!candidate || recoverable == ZERO)
+    {
+        record->next = candidates;
+        dedup->buckets[bucket] = record;
+        pthread_mutex_unlock(&dedup->lock);
+        return record;
+    }
+    pthread_mutex_unlock(&dedup->lock);
+
+    hashEntry(a_Entry);
+
+    // Only records that were in the bucket before are compared, they are never unlinked
+    pthread_mutex_lock(&dedup->lock);
+    for (HashRecord * other = candidates; other != NULL; other = other->next)
+    {
+        if (other->prehash != prehash) continue;
+        while (!other->hashed) pthread_cond_wait(&dedup->hashed, &dedup->lock);
+        if (memcmp(other->file->digest, a_Entry->digest, SHA256_DIGEST_BYTES) != ZERO) continue;
+
+        a_Entry->duplicate_of = other->file;
+        dedup->n_Duplicates++;
+        dedup->saved_bytes += recoverable;
+        pthread_mutex_unlock(&dedup->lock);
+        return NULL;
+    }
+
+    record->hashed = true;
+    record->next = dedup->buckets[bucket];
+    dedup->buckets[bucket] = record;
+    pthread_mutex_unlock(&dedup->lock);
+    return NULL;
+}
+
+/**
+ * @brief   Marks a file's digest as final, for the files waiting to compare against it
+ * @param a_Disk    The image
+ * @param a_pRecord The record dedupFile() returned for the file
+ */
+void publishDigest(DiskImage * a_Disk, HashRecord * a_pRecord)
+{
+    pthread_mutex_lock(&a_Disk->dedup->lock);
+    a_pRecord->hashed = true;
+    pthread_cond_broadcast(&a_Disk->dedup->hashed);
+    pthread_mutex_unlock(&a_Disk->dedup->lock);
+}
+
+/**
+ * @brief   Creates the files found to duplicate another as reflinks or hard links to it
+ * @details A file that can be linked neither way is written after all.
+ * @param a_Disk    The image, with every original flushed
+ */
+void linkDuplicates(DiskImage * a_Disk)
+{
+    size_t n_Reflinked = ZERO;
+    size_t n_HardLinked = ZERO;
+    size_t n_Written = ZERO;
+
+    for (size_t i = 0; i < a_Disk->emitted.n_Items; i++)
+    {
+        Entry * file = a_Disk->emitted.items[i];
+        if (file->duplicate_of == NULL) continue;
+
+        char originalName[OUTPUT_FILENAME_MAX];
+        char outputName[OUTPUT_FILENAME_MAX];
+        observeAndReport(outputNameFor(file->duplicate_of, originalName, sizeof(originalName)), "Error: output path is too long");
+        observeAndReport(outputNameFor(file, outputName, sizeof(outputName)), "Error: output path is too long");
+
+        int const linked = outputDuplicate(a_Disk->writer, originalName, outputName);
+        if (linked == OUTPUT_REFLINKED) n_Reflinked++;
+        else if (linked == OUTPUT_HARDLINKED) n_HardLinked++;
+        else
+        {
+            byte_ptr first_sector = NULL;
+            if (isValidCluster(a_Disk, file->first_cluster)) first_sector = getClusterData(a_Disk, file->first_cluster);
+            makeData(file, first_sector);
+            writeOutputFile(file, NULL);
+            freeExtents(file);
+            n_Written++;
+        }
+    }
+
+    if (n_Reflinked + n_HardLinked + n_Written > ZERO)
+    {
+        logInfo("Linked duplicates: %zu reflinked, %zu hard linked, %zu written\n", n_Reflinked, n_HardLinked, n_Written);
+    }
+}
+
+/**
+ * @brief   Names the fileN.EXT a numbered file is written to
+ * @param a_Entry       The file, already numbered by emitDirectory()
+ * @param a_Buffer      Receives the path
+ * @param a_Capacity    The size of a_Buffer
+ * @return  Whether the path fit
+ */
+bool outputPathFor(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity)
+{
+    char name[OUTPUT_FILENAME_MAX];
+    if (!outputNameFor(a_Entry, name, sizeof(name))) return false;
+    int written = snprintf(a_Buffer, a_Capacity, "%s/%s", (char *)a_Entry->disk->output_directory, name);
+    return written > ZERO && (size_t)written < a_Capacity;
+}
+
+/**
+ * @brief   Names a numbered file fileN.EXT, relative to the output directory
+ * @param a_Entry       The file, already numbered by emitDirectory()
+ * @param a_Buffer      Receives the name
+ * @param a_Capacity    The size of a_Buffer
+ * @return  Whether the name fit
+ */
+bool outputNameFor(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity)
+{
+    size_t const extension_length = trimmedLength(a_Entry->extension, ENTRY_EXTENSION_BYTES);
+    int written = snprintf(a_Buffer, a_Capacity, "file%zu%s%.*s",
+        a_Entry->index, extension_length > ZERO ? "." : "", (int)extension_length, (char *)a_Entry->extension);
+    return written > ZERO && (size_t)written < a_Capacity;
+}
+
+/**
+ * @brief   Names the member a file is archived as, its path relative to the root
+ * @param a_Entry       The file, already numbered by emitDirectory()
+ * @param a_Buffer      Receives the name
+ * @param a_Capacity    The size of a_Buffer
+ * @return  Whether the name fit
+ */
+bool memberNameFor(const Entry * a_Entry, char * a_Buffer, size_t a_Capacity)
+{
+    if (a_Entry->numbered_member) return outputNameFor(a_Entry, a_Buffer, a_Capacity);
+
+    char path[ENTRY_PATH_MAX];
+    size_t const length = materializePath(a_Entry, path, sizeof(path));
+    if (length < 2 || length > a_Capacity) return false;
+    memcpy(a_Buffer, path + 1, length);
+    return true;
+}
+
+/**
+ * @brief   Copies a range of the image into an output file without a user-space buffer
+ * @details Tries copy_file_range first, then sendfile, and only writes from the image data
+ *          when neither is supported between the two files. A device image is copied out of
+ *          its device reader instead, a piece at a time.
+ * @param a_Disk        The image to copy from
+ * @param a_OutputFd    The file to append to
+ * @param a_Offset      The image offset to copy from
+ * @param a_Length      The number of bytes to copy
+ * @return  Whether every byte was copied
+ */
+bool copyImageRange(const DiskImage * a_Disk, int a_OutputFd, byte_num a_Offset, byte_count a_Length)
+{
+    static bool s_CopyFileRangeUnsupported = false;
+    static bool s_SendfileUnsupported = false;
+
+    if (a_Offset > a_Disk->bytes || a_Length > a_Disk->bytes - a_Offset) return false;
+
+    // The descriptor of a device image would read straight past its bad sectors
+    if (a_Disk->reader != NULL)
+    {
+        ImageCopy copy = { a_OutputFd, NULL, true };
+        visitImageRange(a_Disk, a_Offset, a_Length, copyImagePiece, &copy);
+        return copy.ok;
+    }
+
+    bool const inMemory = a_Disk->fd == NO_FD;
+    loff_t offset = (loff_t)a_Offset;
+    while (a_Length > ZERO && !inMemory && !s_CopyFileRangeUnsupported)
+    {
+        ssize_t n = copy_file_range(a_Disk->fd, &offset, a_OutputFd, NULL, a_Length, ZERO);
+        if (n > 0) { a_Length -= (byte_count)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) return false;
+        s_CopyFileRangeUnsupported = true;
+    }
+
+    while (a_Length > ZERO && !inMemory && !s_SendfileUnsupported)
+    {
+        off_t sendOffset = (off_t)offset;
+        ssize_t n = sendfile(a_OutputFd, a_Disk->fd, &sendOffset, a_Length);
+        if (n > 0) { a_Length -= (byte_count)n; offset = sendOffset; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != ENOSYS && errno != EINVAL) return false;
+        s_SendfileUnsupported = true;
+    }
+
+    while (a_Length > ZERO)
+    {
+        ssize_t n = write(a_OutputFd, a_Disk->p_Data + offset, a_Length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        a_Length -= (byte_count)n;
+        offset += n;
+    }
+    return true;
+}
+
+/**
+ * @brief   Prints the listing line for a recovered file
+ * @param e The file to list
+ * @return  Whether the line was printed
+ */
+bool printFileLine(const Entry * const e)
+{
+    char path[ENTRY_PATH_MAX];
+    materializePath(e, path, sizeof(path));
+
+    // -H adds the SHA-256 of what was written as a last column
+    char digest[SHA256_HEX_BYTES] = "";
+    if (e->digest != NULL) formatDigest(e->digest, digest);
 
-    // Allocate memory for data
-    // a_Entry->size = a_pDiskSector[28] | a_pDiskSector[29] << 8 | a_pDiskSector[30] << 16 | a_pDiskSector[31] << 24;
-    fprintf(stderr, "Allocated memory for data\n");
+    int printed = fprintf(e->disk->listing, "FILE\t%s\t%s\t%u%s%s\n", statusName(entryStatus(e)), path, e->size,
+        e->digest != NULL ? "\t" : "", digest);
+    return printed > ZERO;
+}
 
-    // Allocate memory for data
-    a_Entry->data = (string)malloc(SECTOR_SIZE);
-    observeAndReport(a_Entry->data != NULL, "Error allocating memory for data");
-    fprintf(stderr, "Allocated memory for data\n");
+/**
+ * @brief   Tells how an entry was found
+ * @param e The entry
+ * @return  CATALOG_NORMAL, CATALOG_DELETED or CATALOG_CARVED
+ */
+unsigned entryStatus(const Entry * const e)
+{
+    if (e->carved) return CATALOG_CARVED;
+    return e->deleted ? CATALOG_DELETED : CATALOG_NORMAL;
+}
 
-    // Copy data
-    memcpy(a_Entry->data, a_pDiskSector, SECTOR_SIZE);
-    fprintf(stderr, "Copied data\n");
+/**
+ * @brief   Names a status in the listing
+ * @param a_Status  The status
+ * @return  The listed name
+ */
+const char * statusName(unsigned a_Status)
+{
+    if (a_Status == CATALOG_CARVED) return "CARVED";
+    return a_Status == CATALOG_DELETED ? "DELETED" : "NORMAL";
 }
 
 bool printBinary(uint64_t a_Number, size_t bits, bool use_Prefix)
@@ -614,13 +6033,13 @@ bool printBinary(uint64_t a_Number, size_t bits, bool use_Prefix)
 
     unsigned int mask = 1UL << (bits - 1); // Set the mask to the highest bit of the specified range
 
-    if (use_Prefix) printf("0b");
+    if (use_Prefix) fprintf(stderr, "0b");
     for (size_t i = 0; i < bits; i++)
     {
-        printf("%d", (a_Number & mask) ? 1 : 0); // Check if the current bit is 1 or 0
+        fprintf(stderr, "%d", (a_Number & mask) ? 1 : 0); // Check if the current bit is 1 or 0
         mask >>= 1; // Move the mask one bit to the right
     }
-    printf("\n");
+    fprintf(stderr, "\n");
     return true;
 }
 
@@ -631,9 +6050,25 @@ bool isDirectory(const Entry * const e)
     return (result > 0);
 }
 
+bool isVolumeLabel(const Entry * const e)
+{
+    observeAndReport(e != NULL, "Error: e is null, cannot check if volume label");
+    uint8_t result = (e->attributes & ATTR_VOLUME_LABEL);
+    return (result > 0);
+}
+
+bool isLongName(const Entry * const e)
+{
+    observeAndReport(e != NULL, "Error: e is null, cannot check if long name");
+    return (e->attributes & ATTR_LONG_NAME) == ATTR_LONG_NAME;
+}
+
 bool printEntry(const Entry * e)
 {
-    fprintf(stderr, "\tFilepath: %s\n", e->filepath);
+    char path[ENTRY_PATH_MAX];
+    materializePath(e, path, sizeof(path));
+
+    fprintf(stderr, "\tFilepath: %s\n", path);
     fprintf(stderr, "\tFilename: ");
     for (int i = 0; i < 8; i++) fprintf(stderr, "%c", e->filename[i]);
     fprintf(stderr, "\n\tExtension: ");
@@ -646,4 +6081,5 @@ bool printEntry(const Entry * e)
         e->date.created, e->date.accessed, e->date.modified);
     fprintf(stderr, "\tTime - Created: %u, Accessed: %u, Modified: %u\n",
         e->time.created, e->time.accessed, e->time.modified);
+    return true;
 }
\ No newline at end of file
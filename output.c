@@ -0,0 +1,588 @@
+#define _GNU_SOURCE // O_DIRECTORY, O_CLOEXEC, syscall
+#include <stdlib.h> // malloc, calloc, free
+#include <string.h> // memset
+#include <errno.h> // errno, EINTR, EAGAIN, EBUSY
+#include <fcntl.h> // open, openat, O_WRONLY, O_CREAT, O_TRUNC
+#include <unistd.h> // close, pwrite, syscall
+#include <pthread.h> // pthread_mutex_t
+#include <sched.h> // sched_yield
+#include <sys/ioctl.h> // ioctl
+#include <sys/stat.h> // fstatat, S_ISREG
+#if defined(__linux__)
+#include <linux/fs.h> // FICLONE
+#endif
+#if defined(__linux__) && !defined(OUTPUT_NO_RING) && __has_include(<linux/io_uring.h>)
+#define OUTPUT_RING 1
+#include <sys/mman.h> // mmap, munmap
+#include <sys/syscall.h> // __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <linux/io_uring.h> // struct io_uring_params, struct io_uring_sqe, IORING_OP_WRITE
+#endif
+
+#include "output.h"
+
+#define OUTPUT_RING_ENTRIES 128
+#define OUTPUT_FILE_MODE 0644
+#define OUTPUT_MAX_WRITE (1u << 30) // the length of a ring write is 32-bit
+#define OUTPUT_PROBE_OPS 256
+
+typedef struct OutputRequest {
+    unsigned file;
+    int close;
+    const unsigned char * data;
+    size_t length;
+    uint64_t offset;
+} OutputRequest;
+
+typedef struct OutputFile {
+    int fd;
+    unsigned n_Pending;         // writes queued and not completed
+    int ended;                  // no more writes are coming
+} OutputFile;
+
+struct OutputWriter {
+    int directory_fd;
+    size_t n_Failed;
+    pthread_mutex_t lock;
+
+    int ring_fd;                // -1 without a ring
+#ifdef OUTPUT_RING
+    unsigned sq_entries;
+    unsigned cq_entries;
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_mask;
+    unsigned * sq_array;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned * cq_mask;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    void * sq_ring;
+    size_t sq_ring_bytes;
+    void * cq_ring;
+    size_t cq_ring_bytes;
+    size_t sqes_bytes;
+
+    int ring_failed;            // the kernel refused the ring, files begun on it finish with pwrite
+    unsigned n_Unsubmitted;
+    unsigned n_InFlight;        // requests taken and not yet completed
+    OutputRequest * requests;
+    unsigned * free_requests;
+    unsigned n_FreeRequests;
+    OutputFile * files;
+    unsigned * free_files;
+    unsigned n_FreeFiles;
+#endif
+};
+
+static int writeFully(int a_Fd, const unsigned char * a_pData, size_t a_Length, uint64_t a_Offset)
+{
+    while (a_Length > 0)
+    {
+        ssize_t n = pwrite(a_Fd, a_pData, a_Length, (off_t)a_Offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        a_pData += n;
+        a_Length -= (size_t)n;
+        a_Offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+#ifdef OUTPUT_RING
+static void reapCompletions(OutputWriter * a_pWriter);
+static void abandonRing(OutputWriter * a_pWriter);
+
+/**
+ * @brief   Sets up the ring, or leaves a_pWriter->ring_fd at -1 where io_uring cannot be used
+ */
+static void setupRing(OutputWriter * a_pWriter)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, OUTPUT_RING_ENTRIES, &params);
+    if (fd < 0) return;
+
+    // Writes and closes on a ring need 5.6, which is also when the probe appeared
+    struct io_uring_probe * probe = (struct io_uring_probe *)calloc(1, sizeof(struct io_uring_probe) + OUTPUT_PROBE_OPS * sizeof(struct io_uring_probe_op));
+    int supported = probe != NULL && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, OUTPUT_PROBE_OPS) >= 0
+        && probe->last_op >= IORING_OP_WRITE && probe->last_op >= IORING_OP_CLOSE
+        && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) && (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!supported)
+    {
+        close(fd);
+        return;
+    }
+
+    OutputWriter * w = a_pWriter;
+    w->sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    w->cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int const single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && w->cq_ring_bytes > w->sq_ring_bytes) w->sq_ring_bytes = w->cq_ring_bytes;
+    w->sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    w->sq_ring = mmap(NULL, w->sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    w->cq_ring = single ? w->sq_ring : mmap(NULL, w->cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    w->sqes = (struct io_uring_sqe *)mmap(NULL, w->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    w->sq_entries = params.sq_entries;
+    w->cq_entries = params.cq_entries;
+    w->requests = (OutputRequest *)calloc(w->cq_entries, sizeof(OutputRequest));
+    w->free_requests = (unsigned *)calloc(w->cq_entries, sizeof(unsigned));
+    w->files = (OutputFile *)calloc(w->cq_entries, sizeof(OutputFile));
+    w->free_files = (unsigned *)calloc(w->cq_entries, sizeof(unsigned));
+
+    if (w->sq_ring == MAP_FAILED || w->cq_ring == MAP_FAILED || w->sqes == MAP_FAILED
+        || w->requests == NULL || w->free_requests == NULL || w->files == NULL || w->free_files == NULL)
+    {
+        if (w->sq_ring != MAP_FAILED) munmap(w->sq_ring, w->sq_ring_bytes);
+        if (!single && w->cq_ring != MAP_FAILED) munmap(w->cq_ring, w->cq_ring_bytes);
+        if (w->sqes != MAP_FAILED) munmap(w->sqes, w->sqes_bytes);
+        free(w->requests);
+        free(w->free_requests);
+        free(w->files);
+        free(w->free_files);
+        close(fd);
+        return;
+    }
+
+    unsigned char * sq = (unsigned char *)w->sq_ring;
+    unsigned char * cq = (unsigned char *)w->cq_ring;
+    w->sq_head = (unsigned *)(sq + params.sq_off.head);
+    w->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    w->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    w->sq_array = (unsigned *)(sq + params.sq_off.array);
+    w->cq_head = (unsigned *)(cq + params.cq_off.head);
+    w->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    w->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    w->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    for (unsigned i = 0; i < w->cq_entries; i++)
+    {
+        w->free_requests[i] = w->cq_entries - 1 - i;
+        w->free_files[i] = w->cq_entries - 1 - i;
+    }
+    w->n_FreeRequests = w->cq_entries;
+    w->n_FreeFiles = w->cq_entries;
+    w->ring_fd = fd;
+}
+
+/**
+ * @brief   Submits everything queued and waits for at least a_n_Wait completions, then reaps
+ */
+static void submitRing(OutputWriter * a_pWriter, unsigned a_n_Wait)
+{
+    for (;;)
+    {
+        unsigned const flags = a_n_Wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int submitted = (int)syscall(__NR_io_uring_enter, a_pWriter->ring_fd, a_pWriter->n_Unsubmitted, a_n_Wait, flags, NULL, 0);
+        if (submitted < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        {
+            reapCompletions(a_pWriter);
+            continue;
+        }
+        if (submitted < 0)
+        {
+            abandonRing(a_pWriter);
+            return;
+        }
+        a_pWriter->n_Unsubmitted -= (unsigned)submitted;
+        break;
+    }
+    reapCompletions(a_pWriter);
+}
+
+/**
+ * @brief   Makes room for one more request and its submission entry
+ * @details Submitting reaps, and completing may queue closes, so both are checked again until
+ *          nothing more has to be submitted before the request is taken.
+ * @return  0 if the ring failed on the way
+ */
+static int reserveRequest(OutputWriter * a_pWriter)
+{
+    while (!a_pWriter->ring_failed && (a_pWriter->n_FreeRequests == 0 || a_pWriter->n_Unsubmitted >= a_pWriter->sq_entries))
+    {
+        submitRing(a_pWriter, a_pWriter->n_FreeRequests == 0 ? 1 : 0);
+    }
+    return !a_pWriter->ring_failed;
+}
+
+/**
+ * @brief   Takes a request and its submission entry, after reserveRequest()
+ */
+static struct io_uring_sqe * takeRequest(OutputWriter * a_pWriter, unsigned * a_pRequest)
+{
+    unsigned const request = a_pWriter->free_requests[--a_pWriter->n_FreeRequests];
+    a_pWriter->n_InFlight++;
+    *a_pRequest = request;
+
+    unsigned const tail = *a_pWriter->sq_tail;
+    unsigned const index = tail & *a_pWriter->sq_mask;
+    struct io_uring_sqe * sqe = &a_pWriter->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = request;
+    a_pWriter->sq_array[index] = index;
+    __atomic_store_n(a_pWriter->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    a_pWriter->n_Unsubmitted++;
+    return sqe;
+}
+
+static void queueClose(OutputWriter * a_pWriter, unsigned a_File)
+{
+    if (!reserveRequest(a_pWriter))
+    {
+        if (close(a_pWriter->files[a_File].fd) != 0) a_pWriter->n_Failed++;
+        a_pWriter->free_files[a_pWriter->n_FreeFiles++] = a_File;
+        return;
+    }
+
+    unsigned request;
+    struct io_uring_sqe * sqe = takeRequest(a_pWriter, &request);
+    a_pWriter->requests[request].file = a_File;
+    a_pWriter->requests[request].close = 1;
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = a_pWriter->files[a_File].fd;
+}
+
+/**
+ * @brief   Finishes one request: a short or failed write is completed with pwrite, and a file
+ *          whose last write is done gets its close queued
+ */
+static void completeRequest(OutputWriter * a_pWriter, unsigned a_Request, int a_Result)
+{
+    OutputRequest const request = a_pWriter->requests[a_Request];
+    a_pWriter->free_requests[a_pWriter->n_FreeRequests++] = a_Request;
+    a_pWriter->n_InFlight--;
+    OutputFile * file = &a_pWriter->files[request.file];
+
+    if (request.close)
+    {
+        if (a_Result < 0 && close(file->fd) != 0) a_pWriter->n_Failed++;
+        a_pWriter->free_files[a_pWriter->n_FreeFiles++] = request.file;
+        return;
+    }
+
+    size_t const done = a_Result > 0 ? (size_t)a_Result : 0;
+    if (done < request.length && writeFully(file->fd, request.data + done, request.length - done, request.offset + done) != 0)
+    {
+        a_pWriter->n_Failed++;
+    }
+    if (--file->n_Pending == 0 && file->ended) queueClose(a_pWriter, request.file);
+}
+
+static void reapCompletions(OutputWriter * a_pWriter)
+{
+    unsigned head = *a_pWriter->cq_head;
+    while (head != __atomic_load_n(a_pWriter->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe const * cqe = &a_pWriter->cqes[head & *a_pWriter->cq_mask];
+        unsigned const request = (unsigned)cqe->user_data;
+        int const result = cqe->res;
+
+        // The slot goes back first, completing may queue more work
+        __atomic_store_n(a_pWriter->cq_head, ++head, __ATOMIC_RELEASE);
+        completeRequest(a_pWriter, request, result);
+        head = *a_pWriter->cq_head;
+    }
+}
+
+/**
+ * @brief   Gives up on a ring the kernel will not enter anymore, finishing what was taken on it
+ * @details Every write still taken is done again with pwrite, which at worst writes the same bytes
+ *          twice, and every close the kernel never saw is done here. Files begun on the ring
+ *          finish with pwrite and close, and new ones do not use it.
+ */
+static void abandonRing(OutputWriter * a_pWriter)
+{
+    OutputWriter * w = a_pWriter;
+    __atomic_store_n(&w->ring_failed, 1, __ATOMIC_RELAXED);
+
+    unsigned char * taken = (unsigned char *)malloc(w->cq_entries);
+    unsigned char * submitted = (unsigned char *)malloc(w->cq_entries);
+    if (taken == NULL || submitted == NULL)
+    {
+        // Without the bookkeeping the taken requests cannot be told apart, and are lost
+        free(taken);
+        free(submitted);
+        w->n_Failed += w->n_InFlight;
+        w->n_InFlight = 0;
+        return;
+    }
+    memset(taken, 1, w->cq_entries);
+    memset(submitted, 1, w->cq_entries);
+    for (unsigned i = 0; i < w->n_FreeRequests; i++) taken[w->free_requests[i]] = 0;
+    for (unsigned i = 0; i < w->n_Unsubmitted; i++)
+    {
+        unsigned const index = (*w->sq_tail - w->n_Unsubmitted + i) & *w->sq_mask;
+        submitted[(unsigned)w->sqes[index].user_data] = 0;
+    }
+    w->n_Unsubmitted = 0;
+
+    // Each completes as if the kernel had failed it, but a close it was handed stays its own
+    for (unsigned request = 0; request < w->cq_entries; request++)
+    {
+        if (!taken[request]) continue;
+        int const closed = w->requests[request].close && submitted[request];
+        completeRequest(w, request, closed ? 0 : -1);
+    }
+    free(taken);
+    free(submitted);
+}
+#endif
+
+/**
+ * @brief   Creates a writer, with a ring where the kernel offers one
+ * @return  The writer, or NULL if out of memory
+ */
+OutputWriter * createOutputWriter(void)
+{
+    OutputWriter * writer = (OutputWriter *)calloc(1, sizeof(OutputWriter));
+    if (writer == NULL) return NULL;
+
+    writer->directory_fd = -1;
+    writer->ring_fd = -1;
+    pthread_mutex_init(&writer->lock, NULL);
+#ifdef OUTPUT_RING
+    setupRing(writer);
+#endif
+    return writer;
+}
+
+/**
+ * @brief   Points the writer at the directory outputCreate() creates files in
+ * @param a_pWriter     The writer, with nothing left to flush from the previous directory
+ * @param a_Directory   The directory
+ * @return  0, or -1 if the directory cannot be opened
+ */
+int outputSetDirectory(OutputWriter * a_pWriter, const char * a_Directory)
+{
+    if (a_pWriter->directory_fd != -1) close(a_pWriter->directory_fd);
+    a_pWriter->directory_fd = open(a_Directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return a_pWriter->directory_fd == -1 ? -1 : 0;
+}
+
+/**
+ * @brief   Tells whether files begun now have their writes and close go through io_uring
+ * @param a_pWriter The writer
+ * @return  Non-zero with a ring the kernel still takes
+ */
+int outputUsesRing(const OutputWriter * a_pWriter)
+{
+    if (a_pWriter->ring_fd == -1) return 0;
+#ifdef OUTPUT_RING
+    if (__atomic_load_n(&a_pWriter->ring_failed, __ATOMIC_RELAXED)) return 0;
+#endif
+    return 1;
+}
+
+/**
+ * @brief   Creates a file in the writer's directory, replacing any file of the same name
+ * @param a_pWriter The writer
+ * @param a_Name    The file name, relative to the directory
+ * @return  The descriptor, or -1
+ */
+int outputCreate(OutputWriter * a_pWriter, const char * a_Name)
+{
+    // A name left by an earlier run may be a hard link to another output, truncating it would
+    // empty both
+    unlinkat(a_pWriter->directory_fd, a_Name, 0);
+    return openat(a_pWriter->directory_fd, a_Name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, OUTPUT_FILE_MODE);
+}
+
+/**
+ * @brief   Hands a created file over to the writer, which closes it after outputEnd()
+ * @param a_pWriter The writer
+ * @param a_Fd      A descriptor outputCreate() returned
+ * @return  The handle to pass to outputWrite() and outputEnd()
+ */
+unsigned outputBegin(OutputWriter * a_pWriter, int a_Fd)
+{
+#ifdef OUTPUT_RING
+    if (a_pWriter->ring_fd != -1)
+    {
+        pthread_mutex_lock(&a_pWriter->lock);
+        while (a_pWriter->n_FreeFiles == 0)
+        {
+            if (!a_pWriter->ring_failed)
+            {
+                submitRing(a_pWriter, 1);
+                continue;
+            }
+            // Only another thread's outputEnd() frees a file now
+            pthread_mutex_unlock(&a_pWriter->lock);
+            sched_yield();
+            pthread_mutex_lock(&a_pWriter->lock);
+        }
+        unsigned const file = a_pWriter->free_files[--a_pWriter->n_FreeFiles];
+        a_pWriter->files[file].fd = a_Fd;
+        a_pWriter->files[file].n_Pending = 0;
+        a_pWriter->files[file].ended = 0;
+        pthread_mutex_unlock(&a_pWriter->lock);
+        return file;
+    }
+#endif
+    return (unsigned)a_Fd;
+}
+
+/**
+ * @brief   Writes to a file, on the ring or right away with pwrite without one
+ * @param a_pWriter The writer
+ * @param a_File    The handle from outputBegin()
+ * @param a_pData   The bytes, which must stay in place until outputFlush()
+ * @param a_Length  The number of bytes
+ * @param a_Offset  Where in the file they go
+ */
+void outputWrite(OutputWriter * a_pWriter, unsigned a_File, const void * a_pData, size_t a_Length, uint64_t a_Offset)
+{
+    const unsigned char * data = (const unsigned char *)a_pData;
+#ifdef OUTPUT_RING
+    if (a_pWriter->ring_fd != -1)
+    {
+        pthread_mutex_lock(&a_pWriter->lock);
+        for (size_t done = 0; done < a_Length; done += OUTPUT_MAX_WRITE)
+        {
+            if (!reserveRequest(a_pWriter))
+            {
+                if (writeFully(a_pWriter->files[a_File].fd, data + done, a_Length - done, a_Offset + done) != 0) a_pWriter->n_Failed++;
+                break;
+            }
+            size_t const length = a_Length - done < OUTPUT_MAX_WRITE ? a_Length - done : OUTPUT_MAX_WRITE;
+            unsigned request;
+            struct io_uring_sqe * sqe = takeRequest(a_pWriter, &request);
+            OutputRequest * r = &a_pWriter->requests[request];
+            r->file = a_File;
+            r->close = 0;
+            r->data = data + done;
+            r->length = length;
+            r->offset = a_Offset + done;
+            a_pWriter->files[a_File].n_Pending++;
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = a_pWriter->files[a_File].fd;
+            sqe->addr = (uint64_t)(uintptr_t)r->data;
+            sqe->len = (unsigned)length;
+            sqe->off = r->offset;
+        }
+        pthread_mutex_unlock(&a_pWriter->lock);
+        return;
+    }
+#endif
+    if (writeFully((int)a_File, data, a_Length, a_Offset) != 0) __atomic_add_fetch(&a_pWriter->n_Failed, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief   Says no more writes are coming for a file, so it can be closed once they are done
+ * @param a_pWriter The writer
+ * @param a_File    The handle from outputBegin()
+ */
+void outputEnd(OutputWriter * a_pWriter, unsigned a_File)
+{
+#ifdef OUTPUT_RING
+    if (a_pWriter->ring_fd != -1)
+    {
+        pthread_mutex_lock(&a_pWriter->lock);
+        a_pWriter->files[a_File].ended = 1;
+        if (a_pWriter->files[a_File].n_Pending == 0) queueClose(a_pWriter, a_File);
+        pthread_mutex_unlock(&a_pWriter->lock);
+        return;
+    }
+#endif
+    if (close((int)a_File) != 0) __atomic_add_fetch(&a_pWriter->n_Failed, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief   Waits until every queued write and close has completed
+ * @param a_pWriter The writer
+ * @return  0, or -1 if anything since the last flush failed
+ */
+int outputFlush(OutputWriter * a_pWriter)
+{
+    pthread_mutex_lock(&a_pWriter->lock);
+#ifdef OUTPUT_RING
+    if (a_pWriter->ring_fd != -1)
+    {
+        while (a_pWriter->n_InFlight > 0 && !a_pWriter->ring_failed) submitRing(a_pWriter, 1);
+    }
+#endif
+    size_t const n_Failed = __atomic_exchange_n(&a_pWriter->n_Failed, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&a_pWriter->lock);
+    return n_Failed == 0 ? 0 : -1;
+}
+
+/**
+ * @brief   Tells whether a regular file of a given size is already in the writer's directory
+ * @param a_pWriter The writer
+ * @param a_Name    The file name, relative to the directory
+ * @param a_Size    The size it should have
+ * @return  Non-zero if it is there with that size
+ */
+int outputExists(const OutputWriter * a_pWriter, const char * a_Name, uint64_t a_Size)
+{
+    struct stat info;
+    if (fstatat(a_pWriter->directory_fd, a_Name, &info, AT_SYMLINK_NOFOLLOW) != 0) return 0;
+    return S_ISREG(info.st_mode) && (uint64_t)info.st_size == a_Size;
+}
+
+/**
+ * @brief   Removes a file from the writer's directory, if it is there
+ * @param a_pWriter The writer
+ * @param a_Name    The file name, relative to the directory
+ */
+void outputRemove(OutputWriter * a_pWriter, const char * a_Name)
+{
+    unlinkat(a_pWriter->directory_fd, a_Name, 0);
+}
+
+/**
+ * @brief   Makes a file in the writer's directory with the same contents as another one there
+ * @details A reflink shares the blocks but leaves the two files independent, so it is tried
+ *          first. A hard link works on more file systems. The source has to be complete, so
+ *          this comes after outputFlush().
+ * @param a_pWriter The writer
+ * @param a_Source  The existing file
+ * @param a_Name    The file to make
+ * @return  OUTPUT_REFLINKED, OUTPUT_HARDLINKED, or OUTPUT_NOT_LINKED if the caller has to write it
+ */
+int outputDuplicate(OutputWriter * a_pWriter, const char * a_Source, const char * a_Name)
+{
+#ifdef FICLONE
+    int source = openat(a_pWriter->directory_fd, a_Source, O_RDONLY | O_CLOEXEC);
+    if (source != -1)
+    {
+        int target = outputCreate(a_pWriter, a_Name);
+        int const cloned = target != -1 && ioctl(target, FICLONE, source) == 0;
+        if (target != -1) close(target);
+        close(source);
+        if (cloned) return OUTPUT_REFLINKED;
+    }
+#endif
+    unlinkat(a_pWriter->directory_fd, a_Name, 0);
+    if (linkat(a_pWriter->directory_fd, a_Source, a_pWriter->directory_fd, a_Name, 0) == 0) return OUTPUT_HARDLINKED;
+    return OUTPUT_NOT_LINKED;
+}
+
+/**
+ * @brief   Flushes and frees a writer
+ * @param a_pWriter The writer, may be NULL
+ */
+void destroyOutputWriter(OutputWriter * a_pWriter)
+{
+    if (a_pWriter == NULL) return;
+    outputFlush(a_pWriter);
+#ifdef OUTPUT_RING
+    if (a_pWriter->ring_fd != -1)
+    {
+        munmap(a_pWriter->sqes, a_pWriter->sqes_bytes);
+        if (a_pWriter->cq_ring != a_pWriter->sq_ring) munmap(a_pWriter->cq_ring, a_pWriter->cq_ring_bytes);
+        munmap(a_pWriter->sq_ring, a_pWriter->sq_ring_bytes);
+        close(a_pWriter->ring_fd);
+        free(a_pWriter->requests);
+        free(a_pWriter->free_requests);
+        free(a_pWriter->files);
+        free(a_pWriter->free_files);
+    }
+#endif
+    if (a_pWriter->directory_fd != -1) close(a_pWriter->directory_fd);
+    pthread_mutex_destroy(&a_pWriter->lock);
+    free(a_pWriter);
+}
@@ -0,0 +1,35 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+/**
+ * @brief   Creates output files relative to one directory and batches their writes and closes
+ * @details Files are created with openat on a descriptor of the output directory, so the
+ *          directory path is resolved once per image instead of once per file. Where io_uring
+ *          is available, writes and closes are queued on a ring and submitted many per system
+ *          call, and a file is closed on the ring once its last write has completed. Queued
+ *          data must stay in place until outputFlush() returns. Without a ring, the same calls
+ *          write with pwrite and close right away.
+ */
+typedef struct OutputWriter OutputWriter;
+
+#define OUTPUT_NOT_LINKED 0
+#define OUTPUT_REFLINKED 1
+#define OUTPUT_HARDLINKED 2
+
+OutputWriter * createOutputWriter(void);
+int outputSetDirectory(OutputWriter * a_pWriter, const char * a_Directory);
+int outputUsesRing(const OutputWriter * a_pWriter);
+int outputCreate(OutputWriter * a_pWriter, const char * a_Name);
+unsigned outputBegin(OutputWriter * a_pWriter, int a_Fd);
+void outputWrite(OutputWriter * a_pWriter, unsigned a_File, const void * a_pData, size_t a_Length, uint64_t a_Offset);
+void outputEnd(OutputWriter * a_pWriter, unsigned a_File);
+int outputFlush(OutputWriter * a_pWriter);
+int outputExists(const OutputWriter * a_pWriter, const char * a_Name, uint64_t a_Size);
+void outputRemove(OutputWriter * a_pWriter, const char * a_Name);
+int outputDuplicate(OutputWriter * a_pWriter, const char * a_Source, const char * a_Name);
+void destroyOutputWriter(OutputWriter * a_pWriter);
+
+#endif // OUTPUT_H
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE // posix_fadvise
+#include <stdlib.h> // malloc, free, qsort
+#include <stdio.h> // fprintf
+#include <errno.h> // errno, EINTR
+#include <fcntl.h> // posix_fadvise, POSIX_FADV_WILLNEED
+#include <unistd.h> // pread
+
+#include "readplan.h"
+#include "report.h"
+
+#define READ_PLAN_WINDOW (4 * 1024 * 1024) // the largest single read
+#define READ_PLAN_GAP (64 * 1024) // reading through a gap this small is cheaper than seeking past it
+#define READ_PLAN_INITIAL_CAPACITY 64
+
+struct ReadPlan {
+    ReadPiece * pieces;
+    size_t n_Pieces;
+    size_t capacity;
+    unsigned char * window;
+};
+
+static int compareByOffset(const void * a_pLeft, const void * a_pRight)
+{
+    const ReadPiece * left = (const ReadPiece *)a_pLeft;
+    const ReadPiece * right = (const ReadPiece *)a_pRight;
+    if (left->offset != right->offset) return left->offset < right->offset ? -1 : 1;
+    return 0;
+}
+
+static int readFully(int a_Fd, unsigned char * a_pB_Buffer, uint64_t a_Length, uint64_t a_Offset)
+{
+    uint64_t done = 0;
+    while (done < a_Length)
+    {
+        ssize_t n = pread(a_Fd, a_pB_Buffer + done, (size_t)(a_Length - done), (off_t)(a_Offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (uint64_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief   Creates an empty plan
+ * @return  The plan, or NULL if out of memory
+ */
+ReadPlan * createReadPlan(void)
+{
+    return (ReadPlan *)calloc(1, sizeof(ReadPlan));
+}
+
+/**
+ * @brief   Adds a piece to read
+ * @param a_pPlan           The plan
+ * @param a_Offset          Where the piece starts in the file
+ * @param a_Length          Its length
+ * @param a_pTarget         Handed back with the piece
+ * @param a_TargetOffset    Handed back with the piece
+ */
+void readPlanAdd(ReadPlan * a_pPlan, uint64_t a_Offset, uint64_t a_Length, void * a_pTarget, uint64_t a_TargetOffset)
+{
+    if (a_Length == 0) return;
+    if (a_pPlan->n_Pieces == a_pPlan->capacity)
+    {
+        size_t capacity = a_pPlan->capacity > 0 ? a_pPlan->capacity * 2 : READ_PLAN_INITIAL_CAPACITY;
+        a_pPlan->pieces = (ReadPiece *)growArray(a_pPlan->pieces, capacity, sizeof(ReadPiece), "Error allocating memory for read plan");
+        a_pPlan->capacity = capacity;
+    }
+
+    ReadPiece * piece = &a_pPlan->pieces[a_pPlan->n_Pieces++];
+    piece->offset = a_Offset;
+    piece->length = a_Length;
+    piece->target = a_pTarget;
+    piece->target_offset = a_TargetOffset;
+}
+
+/**
+ * @brief   Counts the pieces waiting in a plan
+ * @param a_pPlan   The plan
+ * @return  The number of pieces added since the plan last ran
+ */
+size_t readPlanCount(const ReadPlan * a_pPlan)
+{
+    return a_pPlan->n_Pieces;
+}
+
+/**
+ * @brief   Reads every piece in file order and hands each to a_Deliver, then empties the plan
+ * @details A piece longer than the read window is read and delivered in window-sized parts,
+ *          with the part's offsets adjusted. The data passed to a_Deliver is only valid
+ *          during the call.
+ * @param a_pPlan       The plan
+ * @param a_Fd          The file to read
+ * @param a_pB_InMemory The whole file if it is already in memory, which skips the reads
+ * @param a_Deliver     Called once per piece, in file order
+ * @param a_pContext    Passed to a_Deliver
+ * @return  0, or -1 if a read failed
+ */
+int runReadPlan(ReadPlan * a_pPlan, int a_Fd, const unsigned char * a_pB_InMemory, ReadDelivery a_Deliver, void * a_pContext)
+{
+    ReadPiece * pieces = a_pPlan->pieces;
+    size_t const n_Pieces = a_pPlan->n_Pieces;
+    a_pPlan->n_Pieces = 0;
+    qsort(pieces, n_Pieces, sizeof(ReadPiece), compareByOffset);
+
+    if (a_pB_InMemory != NULL)
+    {
+        for (size_t i = 0; i < n_Pieces; i++) a_Deliver(a_pContext, &pieces[i], a_pB_InMemory + pieces[i].offset);
+        return 0;
+    }
+
+    if (a_pPlan->window == NULL) a_pPlan->window = (unsigned char *)malloc(READ_PLAN_WINDOW);
+    if (a_pPlan->window == NULL) return -1;
+
+    size_t n_Reads = 0;
+    uint64_t n_Bytes = 0;
+    size_t i = 0;
+    while (i < n_Pieces)
+    {
+        uint64_t const start = pieces[i].offset;
+        uint64_t end = start + pieces[i].length;
+        size_t next = i + 1;
+        while (end - start <= READ_PLAN_WINDOW && next < n_Pieces && pieces[next].offset <= end + READ_PLAN_GAP)
+        {
+            uint64_t const piece_end = pieces[next].offset + pieces[next].length;
+            uint64_t const grown_end = piece_end > end ? piece_end : end;
+            if (grown_end - start > READ_PLAN_WINDOW) break;
+            end = grown_end;
+            next++;
+        }
+
+        if (next < n_Pieces) posix_fadvise(a_Fd, (off_t)pieces[next].offset, READ_PLAN_WINDOW, POSIX_FADV_WILLNEED);
+
+        if (end - start > READ_PLAN_WINDOW)
+        {
+            // Only a single piece can be longer than the window
+            ReadPiece part = pieces[i];
+            for (uint64_t done = 0; done < pieces[i].length; done += READ_PLAN_WINDOW)
+            {
+                part.offset = pieces[i].offset + done;
+                part.target_offset = pieces[i].target_offset + done;
+                part.length = pieces[i].length - done < READ_PLAN_WINDOW ? pieces[i].length - done : READ_PLAN_WINDOW;
+                if (readFully(a_Fd, a_pPlan->window, part.length, part.offset) != 0) return -1;
+                a_Deliver(a_pContext, &part, a_pPlan->window);
+                n_Reads++;
+                n_Bytes += part.length;
+            }
+        }
+        else
+        {
+            if (readFully(a_Fd, a_pPlan->window, end - start, start) != 0) return -1;
+            for (size_t k = i; k < next; k++) a_Deliver(a_pContext, &pieces[k], a_pPlan->window + (pieces[k].offset - start));
+            n_Reads++;
+            n_Bytes += end - start;
+        }
+        i = next;
+    }
+
+    fprintf(stderr, "Read %zu pieces in %zu reads of %llu bytes\n", n_Pieces, n_Reads, (unsigned long long)n_Bytes);
+    return 0;
+}
+
+/**
+ * @brief   Frees a plan
+ * @param a_pPlan   The plan, may be NULL
+ */
+void destroyReadPlan(ReadPlan * a_pPlan)
+{
+    if (a_pPlan == NULL) return;
+    free(a_pPlan->pieces);
+    free(a_pPlan->window);
+    free(a_pPlan);
+}
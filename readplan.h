@@ -0,0 +1,31 @@
+#ifndef READPLAN_H
+#define READPLAN_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+/**
+ * @brief   A batch of reads from one file, issued in the order they sit in the file
+ * @details Pieces are collected first and sorted by offset. Pieces that are close together
+ *          are then read with one large read, and the next read is announced to the kernel
+ *          before the current one is handed out, so the file is read front to back with
+ *          readahead however the pieces were collected.
+ */
+typedef struct ReadPlan ReadPlan;
+
+typedef struct ReadPiece {
+    uint64_t offset;            // where the piece is in the file being read
+    uint64_t length;
+    void * target;              // who the piece is for
+    uint64_t target_offset;     // where in the target it goes
+} ReadPiece;
+
+typedef void (*ReadDelivery)(void * a_pContext, const ReadPiece * a_pPiece, const unsigned char * a_pB_Data);
+
+ReadPlan * createReadPlan(void);
+void readPlanAdd(ReadPlan * a_pPlan, uint64_t a_Offset, uint64_t a_Length, void * a_pTarget, uint64_t a_TargetOffset);
+size_t readPlanCount(const ReadPlan * a_pPlan);
+int runReadPlan(ReadPlan * a_pPlan, int a_Fd, const unsigned char * a_pB_InMemory, ReadDelivery a_Deliver, void * a_pContext);
+void destroyReadPlan(ReadPlan * a_pPlan);
+
+#endif // READPLAN_H
@@ -0,0 +1,55 @@
+#include <stdlib.h> // realloc, exit, EXIT_FAILURE
+#include <stdio.h> // fprintf
+
+#include "report.h"
+
+__thread jmp_buf * t_pRecoveryPoint = NULL;
+__thread const char * t_pFailure = NULL;
+
+/**
+ * @brief Custom assert function
+ * @param a_Condition   The condition to check
+ * @param a_Message     The message to print if the condition is false
+*/
+void observeAndReport(int a_Condition, const char * a_Message)
+{
+    if (a_Condition) return;
+#ifndef NOTJUSTCATS_LIBRARY
+    // A library caller learns of the failure from the call that returns it
+    fprintf(stderr, "Assertion failed: %s\n", a_Message);
+#endif
+
+    // A batch abandons the image it is working on instead of the whole run
+    t_pFailure = a_Message;
+    if (t_pRecoveryPoint != NULL) longjmp(*t_pRecoveryPoint, 1);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief   Resizes an array, for callers that have to release a lock before failing
+ * @param a_ppArray     The array, left as it was if it cannot be resized
+ * @param a_Capacity    The number of elements it should hold
+ * @param a_ElementBytes The size of one element
+ * @return  0 if out of memory
+ */
+int resizeArray(void ** a_ppArray, size_t a_Capacity, size_t a_ElementBytes)
+{
+    void * resized = realloc(*a_ppArray, a_Capacity * a_ElementBytes);
+    if (resized == NULL && a_Capacity > 0) return 0;
+    *a_ppArray = resized;
+    return 1;
+}
+
+/**
+ * @brief   Resizes an array, failing through observeAndReport() if out of memory
+ * @param a_pArray      The array, may be NULL
+ * @param a_Capacity    The number of elements it should hold
+ * @param a_ElementBytes The size of one element
+ * @param a_Message     What to report if it cannot be resized
+ * @return  The resized array
+ */
+void * growArray(void * a_pArray, size_t a_Capacity, size_t a_ElementBytes, const char * a_Message)
+{
+    observeAndReport(resizeArray(&a_pArray, a_Capacity, a_ElementBytes), a_Message);
+    return a_pArray;
+}
@@ -0,0 +1,20 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stddef.h> // size_t
+#include <setjmp.h> // jmp_buf
+
+/**
+ * @brief   Where observeAndReport() jumps instead of exiting, NULL on a thread that cannot recover
+ * @details A batch or serve job sets it around each image, so a failure in any module abandons
+ *          that image and not the whole run. Nothing may fail while holding a lock, as the jump
+ *          would leave it held.
+ */
+extern __thread jmp_buf * t_pRecoveryPoint;
+extern __thread const char * t_pFailure; // the message of the last failed observeAndReport()
+
+void observeAndReport(int a_Condition, const char * a_Message);
+int resizeArray(void ** a_ppArray, size_t a_Capacity, size_t a_ElementBytes);
+void * growArray(void * a_pArray, size_t a_Capacity, size_t a_ElementBytes, const char * a_Message);
+
+#endif // REPORT_H
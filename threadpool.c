@@ -0,0 +1,267 @@
+#include <stdlib.h> // malloc, calloc, free
+#include <pthread.h> // pthread_create, pthread_mutex_t, pthread_cond_t
+
+#include "threadpool.h"
+#include "report.h"
+
+#define DEQUE_INITIAL_CAPACITY 64
+#define NOT_A_WORKER ((size_t)-1)
+
+typedef struct Task {
+    TaskFunction function;
+    void * argument;
+} Task;
+
+typedef struct TaskDeque {
+    pthread_mutex_t lock;
+    Task * tasks;
+    size_t capacity;
+    size_t top;     // next task to steal
+    size_t bottom;  // one past the owner's newest task
+} TaskDeque;
+
+typedef struct Worker {
+    ThreadPool * pool;
+    size_t id;
+    pthread_t thread;
+} Worker;
+
+struct ThreadPool {
+    size_t n_Threads;
+    Worker * workers;
+    TaskDeque * deques;
+
+    size_t n_Queued;   // tasks sitting in any deque
+    size_t n_Pending;  // tasks submitted and not yet finished
+    size_t next_Deque; // round robin target for submissions from outside the pool
+    int shutdown;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t all_done;
+};
+
+static __thread ThreadPool * t_pPool = NULL;
+static __thread size_t t_WorkerId = NOT_A_WORKER;
+
+/**
+ * @brief   Pushes a task at the owner's end of a deque
+ */
+static void pushBottom(TaskDeque * a_pDeque, Task a_Task)
+{
+    pthread_mutex_lock(&a_pDeque->lock);
+    if (a_pDeque->bottom - a_pDeque->top == a_pDeque->capacity)
+    {
+        size_t capacity = a_pDeque->capacity * 2;
+        Task * grown = (Task *)malloc(sizeof(Task) * capacity);
+        if (grown == NULL) pthread_mutex_unlock(&a_pDeque->lock);
+        observeAndReport(grown != NULL, "Error allocating memory for task deque");
+        for (size_t i = a_pDeque->top; i < a_pDeque->bottom; i++)
+        {
+            grown[i % capacity] = a_pDeque->tasks[i % a_pDeque->capacity];
+        }
+        free(a_pDeque->tasks);
+        a_pDeque->tasks = grown;
+        a_pDeque->capacity = capacity;
+    }
+    a_pDeque->tasks[a_pDeque->bottom % a_pDeque->capacity] = a_Task;
+    a_pDeque->bottom++;
+    pthread_mutex_unlock(&a_pDeque->lock);
+}
+
+/**
+ * @brief   Takes the newest task from the owner's end of a deque
+ * @return  Whether a task was taken
+ */
+static int popBottom(TaskDeque * a_pDeque, Task * a_pTask)
+{
+    int found = 0;
+    pthread_mutex_lock(&a_pDeque->lock);
+    if (a_pDeque->bottom > a_pDeque->top)
+    {
+        a_pDeque->bottom--;
+        *a_pTask = a_pDeque->tasks[a_pDeque->bottom % a_pDeque->capacity];
+        found = 1;
+    }
+    pthread_mutex_unlock(&a_pDeque->lock);
+    return found;
+}
+
+/**
+ * @brief   Takes the oldest task from the far end of another worker's deque
+ * @return  Whether a task was taken
+ */
+static int stealTop(TaskDeque * a_pDeque, Task * a_pTask)
+{
+    int found = 0;
+    pthread_mutex_lock(&a_pDeque->lock);
+    if (a_pDeque->bottom > a_pDeque->top)
+    {
+        *a_pTask = a_pDeque->tasks[a_pDeque->top % a_pDeque->capacity];
+        a_pDeque->top++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&a_pDeque->lock);
+    return found;
+}
+
+/**
+ * @brief   Finds the next task for a worker, its own first and then by stealing
+ * @return  Whether a task was found
+ */
+static int findTask(ThreadPool * a_pPool, size_t a_WorkerId, Task * a_pTask)
+{
+    if (popBottom(&a_pPool->deques[a_WorkerId], a_pTask)) return 1;
+
+    for (size_t i = 1; i < a_pPool->n_Threads; i++)
+    {
+        size_t victim = (a_WorkerId + i) % a_pPool->n_Threads;
+        if (stealTop(&a_pPool->deques[victim], a_pTask)) return 1;
+    }
+    return 0;
+}
+
+static void * workerMain(void * a_pArgument)
+{
+    Worker * self = (Worker *)a_pArgument;
+    ThreadPool * pool = self->pool;
+    t_pPool = pool;
+    t_WorkerId = self->id;
+
+    for (;;)
+    {
+        Task task;
+        if (findTask(pool, self->id, &task))
+        {
+            __atomic_sub_fetch(&pool->n_Queued, 1, __ATOMIC_ACQ_REL);
+            task.function(task.argument);
+
+            if (__atomic_sub_fetch(&pool->n_Pending, 1, __ATOMIC_ACQ_REL) == 0)
+            {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->all_done);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown && __atomic_load_n(&pool->n_Queued, __ATOMIC_ACQUIRE) == 0)
+        {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        int stop = pool->shutdown && __atomic_load_n(&pool->n_Queued, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+/**
+ * @brief   Starts a pool of worker threads
+ * @param a_n_Threads   The number of workers, at least one
+ * @return  The running pool
+ */
+ThreadPool * createThreadPool(size_t a_n_Threads)
+{
+    observeAndReport(a_n_Threads > 0, "Error: a thread pool needs at least one thread");
+
+    ThreadPool * pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+    observeAndReport(pool != NULL, "Error allocating memory for thread pool");
+
+    pool->n_Threads = a_n_Threads;
+    pool->workers = (Worker *)calloc(a_n_Threads, sizeof(Worker));
+    pool->deques = (TaskDeque *)calloc(a_n_Threads, sizeof(TaskDeque));
+    observeAndReport(pool->workers != NULL && pool->deques != NULL, "Error allocating memory for workers");
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+
+    for (size_t i = 0; i < a_n_Threads; i++)
+    {
+        TaskDeque * deque = &pool->deques[i];
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->capacity = DEQUE_INITIAL_CAPACITY;
+        deque->tasks = (Task *)malloc(sizeof(Task) * deque->capacity);
+        observeAndReport(deque->tasks != NULL, "Error allocating memory for task deque");
+    }
+
+    for (size_t i = 0; i < a_n_Threads; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        int result = pthread_create(&pool->workers[i].thread, NULL, workerMain, &pool->workers[i]);
+        observeAndReport(result == 0, "Error starting worker thread");
+    }
+    return pool;
+}
+
+/**
+ * @brief   Queues a task, on the caller's own deque when called from inside the pool
+ * @param a_pPool       The pool to run the task on
+ * @param a_Function    The task
+ * @param a_pArgument   The task's argument
+ */
+void submitTask(ThreadPool * a_pPool, TaskFunction a_Function, void * a_pArgument)
+{
+    Task task = { a_Function, a_pArgument };
+
+    size_t target = t_WorkerId;
+    if (t_pPool != a_pPool)
+    {
+        target = __atomic_fetch_add(&a_pPool->next_Deque, 1, __ATOMIC_RELAXED) % a_pPool->n_Threads;
+    }
+
+    // Count before pushing so a thief can never take the count below zero
+    __atomic_add_fetch(&a_pPool->n_Pending, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&a_pPool->n_Queued, 1, __ATOMIC_ACQ_REL);
+    pushBottom(&a_pPool->deques[target], task);
+
+    pthread_mutex_lock(&a_pPool->lock);
+    pthread_cond_signal(&a_pPool->work_available);
+    pthread_mutex_unlock(&a_pPool->lock);
+}
+
+/**
+ * @brief   Blocks until every submitted task, including the ones they spawned, has finished
+ * @param a_pPool   The pool to wait on, must not be called from one of its workers
+ */
+void waitThreadPool(ThreadPool * a_pPool)
+{
+    pthread_mutex_lock(&a_pPool->lock);
+    while (__atomic_load_n(&a_pPool->n_Pending, __ATOMIC_ACQUIRE) != 0)
+    {
+        pthread_cond_wait(&a_pPool->all_done, &a_pPool->lock);
+    }
+    pthread_mutex_unlock(&a_pPool->lock);
+}
+
+/**
+ * @brief   Finishes the queued work, stops the workers and frees the pool
+ * @param a_pPool   The pool to destroy
+ */
+void destroyThreadPool(ThreadPool * a_pPool)
+{
+    if (a_pPool == NULL) return;
+    waitThreadPool(a_pPool);
+
+    pthread_mutex_lock(&a_pPool->lock);
+    a_pPool->shutdown = 1;
+    pthread_cond_broadcast(&a_pPool->work_available);
+    pthread_mutex_unlock(&a_pPool->lock);
+
+    for (size_t i = 0; i < a_pPool->n_Threads; i++)
+    {
+        pthread_join(a_pPool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&a_pPool->deques[i].lock);
+        free(a_pPool->deques[i].tasks);
+    }
+
+    pthread_mutex_destroy(&a_pPool->lock);
+    pthread_cond_destroy(&a_pPool->work_available);
+    pthread_cond_destroy(&a_pPool->all_done);
+    free(a_pPool->workers);
+    free(a_pPool->deques);
+    free(a_pPool);
+}
@@ -0,0 +1,21 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h> // size_t
+
+/**
+ * @brief   A fixed set of worker threads with one task deque each
+ * @details Workers push and pop the tasks they spawn at the bottom of their own deque and steal
+ *          from the top of the others' when they run dry, so a task that fans out keeps its
+ *          children local until another worker is idle.
+ */
+typedef struct ThreadPool ThreadPool;
+
+typedef void (*TaskFunction)(void * a_pArgument);
+
+ThreadPool * createThreadPool(size_t a_n_Threads);
+void submitTask(ThreadPool * a_pPool, TaskFunction a_Function, void * a_pArgument);
+void waitThreadPool(ThreadPool * a_pPool);
+void destroyThreadPool(ThreadPool * a_pPool);
+
+#endif // THREADPOOL_H
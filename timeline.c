@@ -0,0 +1,379 @@
+#include <stdlib.h> // malloc, calloc, free
+#include <stdio.h> // fprintf, fopen, fputs, rename
+#include <string.h> // memcpy, strlen
+#include <time.h> // gmtime_r, struct tm
+#include <strings.h> // strcasecmp
+#include <limits.h> // PATH_MAX
+
+#include "timeline.h"
+#include "report.h"
+
+#define TIMELINE_EPOCH 315532800 // 1980-01-01T00:00:00Z, the earliest FAT date
+#define TIMELINE_INITIAL_CAPACITY 1024
+#define TIMELINE_TEMP_SUFFIX ".tmp"
+#define TIMELINE_WRITE_BUFFER (1024 * 1024)
+
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES 3 // 33 bits, enough for the 32 bits of time in a key
+
+#define EVENT_MODIFIED 1
+#define EVENT_ACCESSED 2
+#define EVENT_CREATED 8
+
+#define RECORD_DIRECTORY 1
+#define RECORD_READ_ONLY 2
+#define RECORD_DELETED 4
+
+struct Timeline {
+    size_t n_Records;
+    size_t capacity_Records;
+    size_t * path_offset;
+    uint64_t * size;
+    uint32_t * meta;
+    uint8_t * flags;
+    int64_t * modified;
+    int64_t * accessed;
+    int64_t * created;
+
+    size_t n_Events;
+    size_t capacity_Events;
+    uint64_t * keys;
+    uint32_t * event_record;
+    uint8_t * event_type;
+
+    size_t string_bytes;
+    size_t capacity_Strings;
+    char * strings;
+};
+
+static size_t addString(Timeline * a_pTimeline, const char * a_Text)
+{
+    size_t const bytes = strlen(a_Text) + 1;
+    if (a_pTimeline->string_bytes + bytes > a_pTimeline->capacity_Strings)
+    {
+        size_t capacity = a_pTimeline->capacity_Strings > 0 ? a_pTimeline->capacity_Strings : TIMELINE_INITIAL_CAPACITY;
+        while (capacity < a_pTimeline->string_bytes + bytes) capacity *= 2;
+        a_pTimeline->strings = (char *)growArray(a_pTimeline->strings, capacity, sizeof(char), "Error allocating memory for timeline");
+        a_pTimeline->capacity_Strings = capacity;
+    }
+
+    size_t const offset = a_pTimeline->string_bytes;
+    memcpy(a_pTimeline->strings + offset, a_Text, bytes);
+    a_pTimeline->string_bytes += bytes;
+    return offset;
+}
+
+static uint64_t timeKey(int64_t a_Time)
+{
+    if (a_Time < TIMELINE_EPOCH) return 0;
+    uint64_t const key = (uint64_t)(a_Time - TIMELINE_EPOCH) + 1;
+    return key < UINT32_MAX ? key : UINT32_MAX;
+}
+
+static void addEvent(Timeline * a_pTimeline, uint32_t a_Record, uint64_t a_TimeKey, uint8_t a_Type)
+{
+    observeAndReport(a_pTimeline->n_Events < UINT32_MAX, "Error: too many timeline events");
+    if (a_pTimeline->n_Events == a_pTimeline->capacity_Events)
+    {
+        size_t capacity = a_pTimeline->capacity_Events > 0 ? a_pTimeline->capacity_Events * 2 : TIMELINE_INITIAL_CAPACITY;
+        a_pTimeline->keys = (uint64_t *)growArray(a_pTimeline->keys, capacity, sizeof(uint64_t), "Error allocating memory for timeline");
+        a_pTimeline->event_record = (uint32_t *)growArray(a_pTimeline->event_record, capacity, sizeof(uint32_t), "Error allocating memory for timeline");
+        a_pTimeline->event_type = (uint8_t *)growArray(a_pTimeline->event_type, capacity, sizeof(uint8_t), "Error allocating memory for timeline");
+        a_pTimeline->capacity_Events = capacity;
+    }
+
+    size_t const event = a_pTimeline->n_Events++;
+    a_pTimeline->keys[event] = a_TimeKey << 32 | (uint64_t)event;
+    a_pTimeline->event_record[event] = a_Record;
+    a_pTimeline->event_type[event] = a_Type;
+}
+
+/**
+ * @brief   Sorts keys by their upper 32 bits, keeping the order of keys that share them
+ * @details Three 11-bit passes, all counted in one read of the keys. A pass whose digit is the
+ *          same in every key, such as the top one for times within a few years, is skipped.
+ * @param a_pKeys       The keys
+ * @param a_pScratch    Room for as many keys
+ * @param a_n_Keys      How many there are
+ */
+static void radixSort(uint64_t * a_pKeys, uint64_t * a_pScratch, size_t a_n_Keys)
+{
+    size_t (* counts_by_pass)[RADIX_BUCKETS] = (size_t (*)[RADIX_BUCKETS])calloc(RADIX_PASSES, sizeof(*counts_by_pass));
+    observeAndReport(counts_by_pass != NULL, "Error allocating memory for timeline");
+    for (size_t i = 0; i < a_n_Keys; i++)
+    {
+        uint64_t const time = a_pKeys[i] >> 32;
+        for (int pass = 0; pass < RADIX_PASSES; pass++) counts_by_pass[pass][(time >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    uint64_t * from = a_pKeys;
+    uint64_t * to = a_pScratch;
+    for (int pass = 0; pass < RADIX_PASSES; pass++)
+    {
+        unsigned const shift = 32 + pass * RADIX_BITS;
+        size_t * counts = counts_by_pass[pass];
+        if (counts[(from[0] >> shift) & (RADIX_BUCKETS - 1)] == a_n_Keys) continue;
+
+        size_t position = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++)
+        {
+            size_t const count = counts[bucket];
+            counts[bucket] = position;
+            position += count;
+        }
+        for (size_t i = 0; i < a_n_Keys; i++) to[counts[(from[i] >> shift) & (RADIX_BUCKETS - 1)]++] = from[i];
+
+        uint64_t * swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != a_pKeys) memcpy(a_pKeys, from, a_n_Keys * sizeof(uint64_t));
+    free(counts_by_pass);
+}
+
+static void formatTime(int64_t a_Time, char * a_Buffer, size_t a_Capacity)
+{
+    struct tm civil;
+    time_t const seconds = (time_t)a_Time;
+    if (a_Time == 0 || gmtime_r(&seconds, &civil) == NULL)
+    {
+        snprintf(a_Buffer, a_Capacity, "0000-00-00T00:00:00Z");
+        return;
+    }
+    snprintf(a_Buffer, a_Capacity, "%04d-%02d-%02dT%02d:%02d:%02dZ", civil.tm_year + 1900, civil.tm_mon + 1,
+        civil.tm_mday, civil.tm_hour, civil.tm_min, civil.tm_sec);
+}
+
+static const char * modeString(uint8_t a_Flags)
+{
+    if (a_Flags & RECORD_DIRECTORY) return a_Flags & RECORD_READ_ONLY ? "d/dr-xr-xr-x" : "d/drwxrwxrwx";
+    return a_Flags & RECORD_READ_ONLY ? "r/rr-xr-xr-x" : "r/rrwxrwxrwx";
+}
+
+static void writeCsvEvent(FILE * a_File, const Timeline * a_pTimeline, uint64_t a_Key)
+{
+    uint32_t const event = (uint32_t)a_Key;
+    uint32_t const record = a_pTimeline->event_record[event];
+    uint8_t const type = a_pTimeline->event_type[event];
+    uint8_t const flags = a_pTimeline->flags[record];
+    uint64_t const time = a_Key >> 32;
+
+    char date[32];
+    formatTime(time == 0 ? 0 : (int64_t)time - 1 + TIMELINE_EPOCH, date, sizeof(date));
+    fprintf(a_File, "%s,%llu,%c%c.%c,%s,0,0,%u,\"", date, (unsigned long long)a_pTimeline->size[record],
+        type & EVENT_MODIFIED ? 'm' : '.', type & EVENT_ACCESSED ? 'a' : '.', type & EVENT_CREATED ? 'b' : '.',
+        modeString(flags), a_pTimeline->meta[record]);
+
+    // Quotes inside the name are doubled
+    for (const char * c = a_pTimeline->strings + a_pTimeline->path_offset[record]; *c != '\0'; c++)
+    {
+        if (*c == '"') putc('"', a_File);
+        putc(*c, a_File);
+    }
+    fputs(flags & RECORD_DELETED ? " (deleted)\"\n" : "\"\n", a_File);
+}
+
+static void writeBodyfileRecord(FILE * a_File, const Timeline * a_pTimeline, uint32_t a_Record)
+{
+    uint8_t const flags = a_pTimeline->flags[a_Record];
+    fprintf(a_File, "0|%s%s|%u|%s|0|0|%llu|%lld|%lld|0|%lld\n",
+        a_pTimeline->strings + a_pTimeline->path_offset[a_Record], flags & RECORD_DELETED ? " (deleted)" : "",
+        a_pTimeline->meta[a_Record], modeString(flags), (unsigned long long)a_pTimeline->size[a_Record],
+        (long long)a_pTimeline->accessed[a_Record], (long long)a_pTimeline->modified[a_Record], (long long)a_pTimeline->created[a_Record]);
+}
+
+/**
+ * @brief   Creates an empty timeline
+ * @return  The timeline
+ */
+Timeline * createTimeline(void)
+{
+    Timeline * timeline = (Timeline *)calloc(1, sizeof(Timeline));
+    observeAndReport(timeline != NULL, "Error allocating memory for timeline");
+    return timeline;
+}
+
+/**
+ * @brief   Adds an entry, with one event per distinct time it has
+ * @details Times that are equal become one event carrying each of their letters, as mactime
+ *          shows them. An entry with no time set gets one event at the very start.
+ * @param a_pTimeline   The timeline
+ * @param a_pEntry      The entry, its path is copied
+ */
+void timelineAdd(Timeline * a_pTimeline, const TimelineEntry * a_pEntry)
+{
+    observeAndReport(a_pTimeline->n_Records < UINT32_MAX, "Error: too many timeline entries");
+    if (a_pTimeline->n_Records == a_pTimeline->capacity_Records)
+    {
+        size_t capacity = a_pTimeline->capacity_Records > 0 ? a_pTimeline->capacity_Records * 2 : TIMELINE_INITIAL_CAPACITY;
+        a_pTimeline->path_offset = (size_t *)growArray(a_pTimeline->path_offset, capacity, sizeof(size_t), "Error allocating memory for timeline");
+        a_pTimeline->size = (uint64_t *)growArray(a_pTimeline->size, capacity, sizeof(uint64_t), "Error allocating memory for timeline");
+        a_pTimeline->meta = (uint32_t *)growArray(a_pTimeline->meta, capacity, sizeof(uint32_t), "Error allocating memory for timeline");
+        a_pTimeline->flags = (uint8_t *)growArray(a_pTimeline->flags, capacity, sizeof(uint8_t), "Error allocating memory for timeline");
+        a_pTimeline->modified = (int64_t *)growArray(a_pTimeline->modified, capacity, sizeof(int64_t), "Error allocating memory for timeline");
+        a_pTimeline->accessed = (int64_t *)growArray(a_pTimeline->accessed, capacity, sizeof(int64_t), "Error allocating memory for timeline");
+        a_pTimeline->created = (int64_t *)growArray(a_pTimeline->created, capacity, sizeof(int64_t), "Error allocating memory for timeline");
+        a_pTimeline->capacity_Records = capacity;
+    }
+
+    uint32_t const record = (uint32_t)a_pTimeline->n_Records++;
+    a_pTimeline->path_offset[record] = addString(a_pTimeline, a_pEntry->path);
+    a_pTimeline->size[record] = a_pEntry->size;
+    a_pTimeline->meta[record] = a_pEntry->meta;
+    a_pTimeline->flags[record] = (uint8_t)((a_pEntry->directory ? RECORD_DIRECTORY : 0)
+        | (a_pEntry->read_only ? RECORD_READ_ONLY : 0) | (a_pEntry->deleted ? RECORD_DELETED : 0));
+    a_pTimeline->modified[record] = a_pEntry->modified;
+    a_pTimeline->accessed[record] = a_pEntry->accessed;
+    a_pTimeline->created[record] = a_pEntry->created;
+
+    uint64_t const keys[3] = { timeKey(a_pEntry->modified), timeKey(a_pEntry->accessed), timeKey(a_pEntry->created) };
+    uint8_t const types[3] = { EVENT_MODIFIED, EVENT_ACCESSED, EVENT_CREATED };
+    int added = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (keys[i] == 0) continue;
+
+        int seen = 0;
+        for (int j = 0; j < i; j++) seen |= keys[j] == keys[i];
+        if (seen) continue;
+
+        uint8_t type = 0;
+        for (int j = i; j < 3; j++) if (keys[j] == keys[i]) type |= types[j];
+        addEvent(a_pTimeline, record, keys[i], type);
+        added = 1;
+    }
+    if (!added) addEvent(a_pTimeline, record, 0, 0);
+}
+
+/**
+ * @brief   Adds every entry of one timeline to another, after those already there
+ * @param a_pInto   The timeline receiving the entries
+ * @param a_pFrom   The timeline to copy them from, left as it is
+ */
+void timelineAppend(Timeline * a_pInto, const Timeline * a_pFrom)
+{
+    for (size_t i = 0; i < a_pFrom->n_Records; i++)
+    {
+        TimelineEntry entry;
+        entry.path = a_pFrom->strings + a_pFrom->path_offset[i];
+        entry.size = a_pFrom->size[i];
+        entry.meta = a_pFrom->meta[i];
+        entry.directory = (a_pFrom->flags[i] & RECORD_DIRECTORY) != 0;
+        entry.read_only = (a_pFrom->flags[i] & RECORD_READ_ONLY) != 0;
+        entry.deleted = (a_pFrom->flags[i] & RECORD_DELETED) != 0;
+        entry.modified = a_pFrom->modified[i];
+        entry.accessed = a_pFrom->accessed[i];
+        entry.created = a_pFrom->created[i];
+        timelineAdd(a_pInto, &entry);
+    }
+}
+
+/**
+ * @brief   Empties a timeline, keeping its memory for the next entries
+ * @param a_pTimeline   The timeline
+ */
+void resetTimeline(Timeline * a_pTimeline)
+{
+    a_pTimeline->n_Records = 0;
+    a_pTimeline->n_Events = 0;
+    a_pTimeline->string_bytes = 0;
+}
+
+/**
+ * @brief   Picks the format a timeline path asks for
+ * @param a_Path    The path --timeline was given
+ * @return  TIMELINE_CSV for a name ending in .csv, else TIMELINE_BODYFILE
+ */
+int timelineFormatForPath(const char * a_Path)
+{
+    size_t const length = strlen(a_Path);
+    if (length >= 4 && strcasecmp(a_Path + length - 4, ".csv") == 0) return TIMELINE_CSV;
+    return TIMELINE_BODYFILE;
+}
+
+/**
+ * @return  The number of events, the lines a CSV timeline will have below its header
+ */
+size_t timelineCount(const Timeline * a_pTimeline)
+{
+    return a_pTimeline->n_Events;
+}
+
+/**
+ * @brief   Sorts the events by time and writes them out
+ * @details The file is written next to its final path and renamed over it once complete. A
+ *          bodyfile lists each entry once, where its earliest event falls.
+ * @param a_pTimeline   The timeline, its events stay sorted afterwards
+ * @param a_Path        Where to write it
+ * @param a_Format      TIMELINE_BODYFILE or TIMELINE_CSV
+ * @return  Whether it was written
+ */
+int writeTimeline(Timeline * a_pTimeline, const char * a_Path, int a_Format)
+{
+    size_t const n_Events = a_pTimeline->n_Events;
+    if (n_Events > 0)
+    {
+        uint64_t * scratch = (uint64_t *)malloc(n_Events * sizeof(uint64_t));
+        observeAndReport(scratch != NULL, "Error allocating memory for timeline");
+        radixSort(a_pTimeline->keys, scratch, n_Events);
+        free(scratch);
+    }
+
+    char temporary[PATH_MAX];
+    int length = snprintf(temporary, sizeof(temporary), "%s%s", a_Path, TIMELINE_TEMP_SUFFIX);
+    int written = length > 0 && (size_t)length < sizeof(temporary);
+
+    FILE * file = written ? fopen(temporary, "w") : NULL;
+    written = file != NULL;
+    if (written) setvbuf(file, NULL, _IOFBF, TIMELINE_WRITE_BUFFER);
+
+    if (written && a_Format == TIMELINE_CSV)
+    {
+        fputs("Date,Size,Type,Mode,UID,GID,Meta,File Name\n", file);
+        for (size_t i = 0; i < n_Events; i++) writeCsvEvent(file, a_pTimeline, a_pTimeline->keys[i]);
+    }
+    else if (written)
+    {
+        uint8_t * listed = (uint8_t *)calloc(a_pTimeline->n_Records > 0 ? a_pTimeline->n_Records : 1, sizeof(uint8_t));
+        observeAndReport(listed != NULL, "Error allocating memory for timeline");
+        for (size_t i = 0; i < n_Events; i++)
+        {
+            uint32_t const record = a_pTimeline->event_record[(uint32_t)a_pTimeline->keys[i]];
+            if (listed[record]) continue;
+            listed[record] = 1;
+            writeBodyfileRecord(file, a_pTimeline, record);
+        }
+        free(listed);
+    }
+
+    if (file != NULL)
+    {
+        int const failed = ferror(file);
+        if (fclose(file) != 0 || failed) written = 0;
+    }
+    if (written) written = rename(temporary, a_Path) == 0;
+    else if (file != NULL) remove(temporary);
+    return written;
+}
+
+/**
+ * @brief   Frees a timeline
+ * @param a_pTimeline   The timeline, may be NULL
+ */
+void destroyTimeline(Timeline * a_pTimeline)
+{
+    if (a_pTimeline == NULL) return;
+    free(a_pTimeline->path_offset);
+    free(a_pTimeline->size);
+    free(a_pTimeline->meta);
+    free(a_pTimeline->flags);
+    free(a_pTimeline->modified);
+    free(a_pTimeline->accessed);
+    free(a_pTimeline->created);
+    free(a_pTimeline->keys);
+    free(a_pTimeline->event_record);
+    free(a_pTimeline->event_type);
+    free(a_pTimeline->strings);
+    free(a_pTimeline);
+}
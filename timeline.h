@@ -0,0 +1,44 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t, int64_t
+
+#define TIMELINE_BODYFILE 0     // one line per entry in the TSK 3 bodyfile layout, by its earliest time
+#define TIMELINE_CSV 1          // one line per time of an entry in the mactime CSV layout
+
+/**
+ * @brief   One directory entry and its times, as seconds since the Unix epoch, 0 where unset
+ */
+typedef struct TimelineEntry {
+    const char * path;
+    uint64_t size;
+    uint32_t meta;          // the entry's first cluster
+    int directory;
+    int read_only;
+    int deleted;
+    int64_t modified;
+    int64_t accessed;
+    int64_t created;
+} TimelineEntry;
+
+/**
+ * @brief   Entry times collected from one or more images, written out sorted by time
+ * @details Each distinct time of an entry becomes an event, keyed by 64 bits that pack the
+ *          time above the event's number. Events are numbered in the order they were added, so
+ *          an LSD radix sort on the upper 32 bits alone orders them by time and, within a time,
+ *          in the order they were added. Unset times sort first. Times from 1980 on, all a FAT
+ *          date can hold, fit the key.
+ */
+typedef struct Timeline Timeline;
+
+Timeline * createTimeline(void);
+void timelineAdd(Timeline * a_pTimeline, const TimelineEntry * a_pEntry);
+void timelineAppend(Timeline * a_pInto, const Timeline * a_pFrom);
+void resetTimeline(Timeline * a_pTimeline);
+int timelineFormatForPath(const char * a_Path);
+size_t timelineCount(const Timeline * a_pTimeline);
+int writeTimeline(Timeline * a_pTimeline, const char * a_Path, int a_Format);
+void destroyTimeline(Timeline * a_pTimeline);
+
+#endif // TIMELINE_H
@@ -0,0 +1,178 @@
+#!/bin/sh
+# make bench: checks the golden images, then times every stage of notjustcats on generated
+# FAT12, FAT16 and FAT32 images and checks what it recovered from them.
+#
+#   BENCH_DIR       where the images and outputs go, /tmp/notjustcats-bench by default
+#   BENCH_THREADS   worker threads (-j), the number of CPUs by default
+#   BENCH_SEED      seed for the generated images, 1 by default
+
+BIN=./notjustcats
+GEN=tools/mkfatimg
+WORK=${BENCH_DIR:-/tmp/notjustcats-bench}
+THREADS=${BENCH_THREADS:-$(nproc 2>/dev/null || echo 4)}
+SEED=${BENCH_SEED:-1}
+FAILED=0
+
+mkdir -p "$WORK" || exit 1
+
+fail() {
+    echo "FAIL: $1"
+    FAILED=1
+}
+
+# The images the assignment shipped with, against their listings and output directories
+for golden in simple:simple1 simple2:simple2 random:random; do
+    image=${golden%%:*}
+    listing=${golden##*:}output.txt
+    rm -rf "$WORK/$image"
+    if ! $BIN "$image.img" "$WORK/$image" > "$WORK/$image.txt" 2> "$WORK/$image.log"; then
+        fail "$image.img: notjustcats exited with an error, see $WORK/$image.log"
+        continue
+    fi
+    cmp -s "$WORK/$image.txt" "$listing" || fail "$image.img: listing differs from $listing"
+    diff -r "$WORK/$image" "output_files_for_$image" > /dev/null || fail "$image.img: files differ from output_files_for_$image"
+    echo "ok   $image.img"
+done
+
+# Filters select from the golden images, and the files they keep match the full run's
+rm -rf "$WORK/include" "$WORK/deleted"
+$BIN --include='/IMGS/**' simple.img "$WORK/include" > "$WORK/include.txt" 2> "$WORK/include.log"
+printf 'FILE\tNORMAL\t/IMGS/KITTY.JPG\t36451\n' | cmp -s "$WORK/include.txt" - || fail "--include: listing differs, see $WORK/include.txt"
+cmp -s "$WORK/include/file0.JPG" output_files_for_simple/file3.JPG || fail "--include: file0.JPG differs from output_files_for_simple/file3.JPG"
+echo "ok   --include on simple.img"
+
+$BIN --deleted=only random.img "$WORK/deleted" > "$WORK/deleted.txt" 2> "$WORK/deleted.log"
+grep DELETED randomoutput.txt | cmp -s "$WORK/deleted.txt" - || fail "--deleted=only: listing differs, see $WORK/deleted.txt"
+for pair in 0:6 1:9 2:10; do
+    cmp -s "$WORK/deleted/file${pair%%:*}.TXT" "output_files_for_random/file${pair##*:}.TXT" \
+        || fail "--deleted=only: file${pair%%:*}.TXT differs from output_files_for_random/file${pair##*:}.TXT"
+done
+echo "ok   --deleted=only on random.img"
+
+# A second run against the same manifest finds every file unchanged, and still writes them all
+rm -rf "$WORK/manifest" "$WORK/manifest.dat"
+$BIN --manifest="$WORK/manifest.dat" random.img "$WORK/manifest" > /dev/null 2> "$WORK/manifest.log"
+$BIN --manifest="$WORK/manifest.dat" random.img "$WORK/manifest" > "$WORK/manifest.txt" 2> "$WORK/manifest.log"
+grep -q 'new=0	changed=0	unchanged=13	removed=0' "$WORK/manifest.log" || fail "--manifest: the second run did not find 13 unchanged files, see $WORK/manifest.log"
+cmp -s "$WORK/manifest.txt" randomoutput.txt || fail "--manifest: listing differs from randomoutput.txt"
+diff -r "$WORK/manifest" output_files_for_random > /dev/null || fail "--manifest: files differ from output_files_for_random"
+echo "ok   --manifest rerun on random.img"
+
+rm -rf "$WORK/timeline" "$WORK/timeline.csv"
+$BIN --timeline="$WORK/timeline.csv" random.img "$WORK/timeline" > /dev/null 2> "$WORK/timeline.log"
+cmp -s "$WORK/timeline.csv" randomtimeline.csv || fail "--timeline: differs from randomtimeline.csv"
+echo "ok   --timeline on random.img"
+
+# Links clusters in both FATs of a FAT12 image, each argument cluster=value
+link_fat12() {
+    perl -e '
+        my $image = shift @ARGV;
+        open(my $fh, "+<:raw", $image) or die "$image: $!\n";
+        read($fh, my $boot, 512) == 512 or die "$image: short read\n";
+        my ($sector, $reserved, $fats, $fat_sectors) = (unpack("v", substr($boot, 11, 2)), unpack("v", substr($boot, 14, 2)),
+            ord(substr($boot, 16, 1)), unpack("v", substr($boot, 22, 2)));
+        for my $copy (0 .. $fats - 1) {
+            for (@ARGV) {
+                my ($cluster, $value) = split /=/;
+                my $at = ($reserved + $copy * $fat_sectors) * $sector + int($cluster * 3 / 2);
+                seek($fh, $at, 0); read($fh, my $pair, 2);
+                my $word = unpack("v", $pair);
+                $word = $cluster % 2 ? ($word & 0x000F) | ($value << 4) : ($word & 0xF000) | $value;
+                seek($fh, $at, 0); print $fh pack("v", $word);
+            }
+        }' "$@"
+}
+
+# A loop entered from a chain is a cycle cut where it closes, whichever of its clusters comes
+# first, and so is a ring without a head. Only two chains sharing a cluster cross.
+cp simple.img "$WORK/loops.img"
+link_fat12 "$WORK/loops.img" 2000=2001 2001=2002 2002=2003 2003=2001 2100=2050 2050=2051 2051=2052 2052=2050 \
+    2200=2201 2201=4095 2202=2201 2300=2301 2301=2300
+$BIN check "$WORK/loops.img" > "$WORK/loops.txt" 2> "$WORK/loops.log"
+cat > "$WORK/loops.expected" <<END
+CYCLE	2003	2001
+CYCLE	2052	2050
+CYCLE	2301	2300
+CROSS_LINK	2201	2202
+SUMMARY	mismatched=0	merged=0	bad=0	reserved=0	out_of_range=0	cross_linked=1	cycles=3	free_links=0	repaired=4
+END
+cmp -s "$WORK/loops.txt" "$WORK/loops.expected" || fail "check: loops differ from $WORK/loops.expected"
+echo "ok   check on loops and cross-links"
+
+# Sends jobs to a running serve, one per argument, and prints its answers
+serve_jobs() {
+    perl -MIO::Socket::UNIX -e '
+        my $socket = IO::Socket::UNIX->new(Peer => shift @ARGV) or die "cannot connect: $!\n";
+        print $socket "$_\n" for @ARGV;
+        shutdown($socket, 1);
+        print while <$socket>;' "$@"
+}
+
+# A job that fails must leave its lane as clean as it found it for the next one
+SOCKET="$WORK/serve.sock"
+rm -rf "$WORK/serve-failed" "$WORK/serve-ok" "$WORK/serve-ok.txt" "$SOCKET"
+$BIN -j 1 serve "$SOCKET" 2> "$WORK/serve.log" &
+SERVER=$!
+tries=0
+while [ ! -S "$SOCKET" ] && [ "$tries" -lt 50 ]; do sleep 0.1; tries=$((tries + 1)); done
+serve_jobs "$SOCKET" "simple.img	$WORK/serve-failed	--manifest=$WORK/no-such-directory/manifest" \
+    "simple.img	$WORK/serve-ok" > "$WORK/serve.out" 2>> "$WORK/serve.log"
+kill "$SERVER" 2> /dev/null
+wait "$SERVER"
+grep -q '"job":1,"status":"failed"' "$WORK/serve.out" || fail "serve: a job with an unwritable manifest did not fail"
+grep -q '"job":2,"status":"ok"' "$WORK/serve.out" || fail "serve: the job after a failed one failed too, see $WORK/serve.out"
+cmp -s "$WORK/serve-ok.txt" simple1output.txt || fail "serve: listing differs from simple1output.txt"
+diff -r "$WORK/serve-ok" output_files_for_simple > /dev/null || fail "serve: files differ from output_files_for_simple"
+echo "ok   serve after a failed job"
+
+# name, then generator options: files, depth, fragmentation, deleted and duplicate ratios, average size
+BENCHES="
+fat12 -t 12 -n 150 -d 3 -F 0.3 -x 0.1 -u 0.2 -a 4K
+fat16 -t 16 -n 4000 -d 4 -F 0.2 -x 0.1 -u 0.2 -a 8K
+fat32 -t 32 -z 320M -n 20000 -d 6 -F 0.2 -x 0.1 -u 0.2 -a 8K
+"
+
+echo
+printf '%-6s %9s %7s | %10s %12s | %10s %12s | %10s %9s | %10s %9s | %9s\n' \
+    image MB files "parse ms" "files/s" "FAT ms" "clusters/s" "copy ms" "MB/s" "write ms" "MB/s" "RSS KB"
+
+while read -r name options; do
+    [ -n "$name" ] || continue
+    image="$WORK/$name.img"
+    if ! $GEN $options -s "$SEED" "$image" 2> "$WORK/$name.gen"; then
+        cat "$WORK/$name.gen"
+        fail "$name: could not generate the image"
+        continue
+    fi
+
+    rm -rf "$WORK/$name"
+    if ! $BIN -H --stats -j "$THREADS" "$image" "$WORK/$name" > "$WORK/$name.txt" 2> "$WORK/$name.log"; then
+        fail "$name: notjustcats exited with an error, see $WORK/$name.log"
+        continue
+    fi
+    cmp -s "$WORK/$name.txt" "$image.expected" || fail "$name: listing differs from $image.expected"
+
+    # The --stats record is one flat JSON object, every value a number but the image path
+    grep '^{"image"' "$WORK/$name.log" | tail -n 1 | awk -v name="$name" -v image_bytes="$(wc -c < "$image")" '
+        function field(key,    at, rest) {
+            at = index($0, "\"" key "\":")
+            if (at == 0) return 0
+            rest = substr($0, at + length(key) + 3)
+            return rest + 0
+        }
+        {
+            files = field("files"); clusters = field("clusters"); mb = field("bytes_written") / 1048576
+            parse = field("boot_parse_ms") + field("directory_walk_ms"); chains = field("fat_decode_ms")
+            copy = field("data_copy_ms"); write = field("output_write_ms")
+            printf "%-6s %9.1f %7d | %10.3f %12.0f | %10.3f %12.0f | %10.3f %9.1f | %10.3f %9.1f | %9d\n",
+                name, image_bytes / 1048576, files,
+                parse, files / (parse > 0 ? parse / 1e3 : 1e-9),
+                chains, clusters / (chains > 0 ? chains / 1e3 : 1e-9),
+                copy, mb / (copy > 0 ? copy / 1e3 : 1e-9),
+                write, mb / (write > 0 ? write / 1e3 : 1e-9), field("peak_rss_kb")
+        }'
+done <<END
+$BENCHES
+END
+
+[ "$FAILED" -eq 0 ] || { echo "bench: FAILED"; exit 1; }
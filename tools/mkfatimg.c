@@ -0,0 +1,646 @@
+#define _GNU_SOURCE // pwrite, getopt
+#include <stdlib.h> // exit, strtod, strtoull, calloc, free
+#include <stdint.h> // uint8_t, uint16_t, uint32_t, uint64_t
+#include <stdio.h> // printf, fprintf, FILE, fopen
+#include <string.h> // memset, memcpy, strlen
+#include <fcntl.h> // open, O_RDWR, O_CREAT, O_TRUNC
+#include <unistd.h> // pread, pwrite, ftruncate, close, getopt
+
+#include "hash.h"
+
+#define SECTOR_BYTES 512
+#define ENTRY_BYTES 32
+#define FAT_COPIES 2
+#define FIRST_CLUSTER 2
+#define FAT12_MAX_CLUSTERS 4084
+#define FAT16_MAX_CLUSTERS 65524
+#define FILES_PER_DIRECTORY 16
+#define EXPECTED_SUFFIX ".expected"
+
+#define ATTR_DIRECTORY 0x10
+#define ATTR_ARCHIVE 0x20
+#define NAME_DELETED 0xE5
+
+/**
+ * @brief   Where everything goes on the volume being generated
+ */
+typedef struct Layout {
+    unsigned fat_bits;
+    uint64_t total_sectors;
+    unsigned sectors_per_cluster;
+    unsigned reserved_sectors;
+    unsigned root_entries;
+    uint64_t sectors_per_fat;
+    uint64_t n_Clusters;
+    uint64_t cluster_bytes;
+    uint64_t fat_offset;
+    uint64_t root_offset;
+    uint64_t data_offset;
+} Layout;
+
+/**
+ * @brief   A file or directory of the generated tree
+ */
+typedef struct Node {
+    char name[9];
+    char extension[4];
+    int directory;
+    int deleted;
+    int parent;
+    int depth;
+    uint32_t size;
+    uint32_t payload;       // which contents a file has, duplicates share one
+    uint32_t first_cluster;
+    uint32_t n_Children;
+    int first_child;
+    int last_child;
+    int next_sibling;
+    uint16_t date;
+    uint16_t time;
+} Node;
+
+/**
+ * @brief   What the command line asked for
+ */
+typedef struct Settings {
+    unsigned fat_bits;
+    uint64_t image_bytes;
+    unsigned sectors_per_cluster;
+    size_t n_Files;
+    int max_depth;
+    double fragmentation;
+    double deleted;
+    double duplicates;
+    uint64_t average_bytes;
+    uint64_t seed;
+    const char * template_path;
+} Settings;
+
+static uint64_t s_State;
+
+static uint64_t nextRandom(void)
+{
+    // xorshift64*
+    s_State ^= s_State >> 12;
+    s_State ^= s_State << 25;
+    s_State ^= s_State >> 27;
+    return s_State * 0x2545F4914F6CDD1DULL;
+}
+
+static double randomUnit(void)
+{
+    return (double)(nextRandom() >> 11) / (double)(1ULL << 53);
+}
+
+static uint64_t randomBelow(uint64_t a_Bound)
+{
+    return a_Bound == 0 ? 0 : nextRandom() % a_Bound;
+}
+
+static void fail(const char * a_Message)
+{
+    fprintf(stderr, "mkfatimg: %s\n", a_Message);
+    exit(EXIT_FAILURE);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage: mkfatimg [-t 12|16|32] [-z size] [-c sectors_per_cluster] [-n files] [-d depth]\n"
+        "                [-F fragmentation] [-x deleted] [-u duplicates] [-a average_size] [-s seed]\n"
+        "                [-b template.img] <output.img>\n"
+        "Writes <output.img> and <output.img>" EXPECTED_SUFFIX ", the listing notjustcats -H should print.\n"
+        "Ratios are between 0 and 1. Sizes take a K, M or G suffix.\n");
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t parseSize(const char * a_Text)
+{
+    char * end = NULL;
+    unsigned long long value = strtoull(a_Text, &end, 10);
+    if (end == a_Text) usage();
+    if (*end == 'K' || *end == 'k') value <<= 10;
+    else if (*end == 'M' || *end == 'm') value <<= 20;
+    else if (*end == 'G' || *end == 'g') value <<= 30;
+    return (uint64_t)value;
+}
+
+static double parseRatio(const char * a_Text)
+{
+    char * end = NULL;
+    double value = strtod(a_Text, &end);
+    if (end == a_Text || *end != '\0' || value < 0.0 || value > 1.0) usage();
+    return value;
+}
+
+static void putLittleEndian(uint8_t * a_pB_Data, uint64_t a_Value, int a_n_Bytes)
+{
+    for (int i = 0; i < a_n_Bytes; i++) a_pB_Data[i] = (uint8_t)(a_Value >> (8 * i));
+}
+
+static uint64_t getLittleEndian(const uint8_t * a_pB_Data, int a_n_Bytes)
+{
+    uint64_t value = 0;
+    for (int i = a_n_Bytes - 1; i >= 0; i--) value = (value << 8) | a_pB_Data[i];
+    return value;
+}
+
+static void writeAt(int a_Fd, const void * a_pData, size_t a_Length, uint64_t a_Offset)
+{
+    const uint8_t * data = (const uint8_t *)a_pData;
+    while (a_Length > 0)
+    {
+        ssize_t n = pwrite(a_Fd, data, a_Length, (off_t)a_Offset);
+        if (n <= 0) fail("cannot write the image");
+        data += n;
+        a_Length -= (size_t)n;
+        a_Offset += (uint64_t)n;
+    }
+}
+
+/**
+ * @brief   Works out the FAT size, and with it the data area, from the rest of the layout
+ */
+static void completeLayout(Layout * a_pLayout)
+{
+    uint64_t const root_sectors = ((uint64_t)a_pLayout->root_entries * ENTRY_BYTES + SECTOR_BYTES - 1) / SECTOR_BYTES;
+    if (a_pLayout->sectors_per_fat == 0)
+    {
+        uint64_t sectors_per_fat = 1;
+        for (;;)
+        {
+            uint64_t const data_sectors = a_pLayout->total_sectors - a_pLayout->reserved_sectors - FAT_COPIES * sectors_per_fat - root_sectors;
+            uint64_t const clusters = data_sectors / a_pLayout->sectors_per_cluster;
+            if (((clusters + FIRST_CLUSTER) * a_pLayout->fat_bits + 7) / 8 <= sectors_per_fat * SECTOR_BYTES) break;
+            sectors_per_fat++;
+        }
+        a_pLayout->sectors_per_fat = sectors_per_fat;
+    }
+
+    uint64_t const data_sector = a_pLayout->reserved_sectors + FAT_COPIES * a_pLayout->sectors_per_fat + root_sectors;
+    if (data_sector >= a_pLayout->total_sectors) fail("the image is too small for its metadata");
+    a_pLayout->n_Clusters = (a_pLayout->total_sectors - data_sector) / a_pLayout->sectors_per_cluster;
+    a_pLayout->cluster_bytes = (uint64_t)a_pLayout->sectors_per_cluster * SECTOR_BYTES;
+    a_pLayout->fat_offset = (uint64_t)a_pLayout->reserved_sectors * SECTOR_BYTES;
+    a_pLayout->root_offset = a_pLayout->fat_offset + FAT_COPIES * a_pLayout->sectors_per_fat * SECTOR_BYTES;
+    a_pLayout->data_offset = data_sector * SECTOR_BYTES;
+
+    // notjustcats, like every FAT driver, tells the FAT type from the cluster count alone
+    unsigned const bits = a_pLayout->n_Clusters <= FAT12_MAX_CLUSTERS ? 12 : (a_pLayout->n_Clusters <= FAT16_MAX_CLUSTERS ? 16 : 32);
+    if (bits != a_pLayout->fat_bits)
+    {
+        fprintf(stderr, "mkfatimg: %llu clusters make a FAT%u volume, not FAT%u; change -z or -c\n",
+            (unsigned long long)a_pLayout->n_Clusters, bits, a_pLayout->fat_bits);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief   Takes the layout from a template image's boot sector, such as blankfloppy.img
+ */
+static void layoutFromTemplate(Layout * a_pLayout, const uint8_t * a_pB_Boot)
+{
+    if (getLittleEndian(a_pB_Boot + 11, 2) != SECTOR_BYTES) fail("the template does not have 512-byte sectors");
+    a_pLayout->sectors_per_cluster = a_pB_Boot[13];
+    a_pLayout->reserved_sectors = (unsigned)getLittleEndian(a_pB_Boot + 14, 2);
+    a_pLayout->root_entries = (unsigned)getLittleEndian(a_pB_Boot + 17, 2);
+    a_pLayout->total_sectors = getLittleEndian(a_pB_Boot + 19, 2);
+    if (a_pLayout->total_sectors == 0) a_pLayout->total_sectors = getLittleEndian(a_pB_Boot + 32, 4);
+    a_pLayout->sectors_per_fat = getLittleEndian(a_pB_Boot + 22, 2);
+    if (a_pLayout->sectors_per_fat == 0) a_pLayout->sectors_per_fat = getLittleEndian(a_pB_Boot + 36, 4);
+    if (a_pLayout->sectors_per_cluster == 0 || a_pLayout->total_sectors == 0) fail("the template has no usable boot sector");
+}
+
+/**
+ * @brief   Fills the BIOS parameter block
+ */
+static void formatBootSector(uint8_t * a_pB_Boot, const Layout * a_pLayout, uint64_t a_VolumeId)
+{
+    int const fat32 = a_pLayout->fat_bits == 32;
+    int const floppy = a_pLayout->fat_bits == 12 && a_pLayout->total_sectors == 2880;
+
+    memcpy(a_pB_Boot, "\xEB\x3C\x90" "MKFATIMG", 11);
+    if (fat32) a_pB_Boot[1] = 0x58;
+    putLittleEndian(a_pB_Boot + 11, SECTOR_BYTES, 2);
+    a_pB_Boot[13] = (uint8_t)a_pLayout->sectors_per_cluster;
+    putLittleEndian(a_pB_Boot + 14, a_pLayout->reserved_sectors, 2);
+    a_pB_Boot[16] = FAT_COPIES;
+    putLittleEndian(a_pB_Boot + 17, a_pLayout->root_entries, 2);
+    putLittleEndian(a_pB_Boot + 19, a_pLayout->total_sectors < 65536 && !fat32 ? a_pLayout->total_sectors : 0, 2);
+    a_pB_Boot[21] = floppy ? 0xF0 : 0xF8;
+    putLittleEndian(a_pB_Boot + 22, fat32 ? 0 : a_pLayout->sectors_per_fat, 2);
+    putLittleEndian(a_pB_Boot + 24, floppy ? 18 : 63, 2);
+    putLittleEndian(a_pB_Boot + 26, floppy ? 2 : 255, 2);
+    putLittleEndian(a_pB_Boot + 32, a_pLayout->total_sectors < 65536 && !fat32 ? 0 : a_pLayout->total_sectors, 4);
+
+    uint8_t * extended = a_pB_Boot + 36;
+    if (fat32)
+    {
+        putLittleEndian(a_pB_Boot + 36, a_pLayout->sectors_per_fat, 4);
+        putLittleEndian(a_pB_Boot + 44, FIRST_CLUSTER, 4);
+        putLittleEndian(a_pB_Boot + 48, 1, 2);
+        putLittleEndian(a_pB_Boot + 50, 6, 2);
+        extended = a_pB_Boot + 64;
+    }
+    extended[0] = floppy ? 0x00 : 0x80;
+    extended[2] = 0x29;
+    putLittleEndian(extended + 3, a_VolumeId, 4);
+    memcpy(extended + 7, "NO NAME    ", 11);
+    memcpy(extended + 18, fat32 ? "FAT32   " : (a_pLayout->fat_bits == 16 ? "FAT16   " : "FAT12   "), 8);
+    a_pB_Boot[510] = 0x55;
+    a_pB_Boot[511] = 0xAA;
+}
+
+/**
+ * @brief   Packs the in-memory FAT into the on-disk format of the volume
+ */
+static uint8_t * encodeFat(const uint32_t * a_pFat, const Layout * a_pLayout)
+{
+    size_t const bytes = (size_t)(a_pLayout->sectors_per_fat * SECTOR_BYTES);
+    uint8_t * encoded = (uint8_t *)calloc(1, bytes);
+    if (encoded == NULL) fail("out of memory");
+
+    uint64_t const n_Entries = a_pLayout->n_Clusters + FIRST_CLUSTER;
+    for (uint64_t i = 0; i < n_Entries; i++)
+    {
+        uint32_t const value = a_pFat[i];
+        if (a_pLayout->fat_bits == 32) putLittleEndian(encoded + i * 4, value, 4);
+        else if (a_pLayout->fat_bits == 16) putLittleEndian(encoded + i * 2, value, 2);
+        else
+        {
+            size_t const at = (size_t)(i * 3 / 2);
+            if (i & 1)
+            {
+                encoded[at] = (uint8_t)((encoded[at] & 0x0F) | ((value & 0x0F) << 4));
+                encoded[at + 1] = (uint8_t)(value >> 4);
+            }
+            else
+            {
+                encoded[at] = (uint8_t)value;
+                encoded[at + 1] = (uint8_t)((encoded[at + 1] & 0xF0) | ((value >> 8) & 0x0F));
+            }
+        }
+    }
+    return encoded;
+}
+
+/**
+ * @brief   Hands out clusters front to back, skipping a few now and then to fragment a chain
+ * @details Nothing is ever handed out twice, so the clusters of deleted files stay free and
+ *          can be recovered in full.
+ */
+static uint32_t allocateChain(uint32_t * a_pFat, const Layout * a_pLayout, uint64_t * a_pCursor, uint64_t a_n_Clusters,
+    double a_Fragmentation, uint32_t a_EndOfChain, int a_Linked)
+{
+    if (a_n_Clusters == 0) return 0;
+
+    uint64_t const limit = a_pLayout->n_Clusters + FIRST_CLUSTER;
+    int const fragmented = randomUnit() < a_Fragmentation;
+    uint32_t first = 0;
+    uint32_t previous = 0;
+    for (uint64_t i = 0; i < a_n_Clusters; i++)
+    {
+        if (i > 0 && fragmented && randomUnit() < 0.5) *a_pCursor += 1 + randomBelow(3);
+        if (*a_pCursor >= limit) fail("the image is full; raise -z or lower -n or -a");
+
+        uint32_t const cluster = (uint32_t)(*a_pCursor)++;
+        if (first == 0) first = cluster;
+        if (a_Linked)
+        {
+            if (previous != 0) a_pFat[previous] = cluster;
+            a_pFat[cluster] = a_EndOfChain;
+        }
+        previous = cluster;
+    }
+    return first;
+}
+
+/**
+ * @brief   Fills a buffer with the next bytes of a payload
+ */
+static void payloadBytes(uint64_t * a_pState, uint8_t * a_pB_Buffer, size_t a_Length)
+{
+    for (size_t i = 0; i < a_Length; i += 8)
+    {
+        *a_pState += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = *a_pState;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        size_t const take = a_Length - i < 8 ? a_Length - i : 8;
+        memcpy(a_pB_Buffer + i, &z, take);
+    }
+}
+
+/**
+ * @brief   Writes a file's clusters and gives the SHA-256 of its contents
+ */
+static void writeFile(int a_Fd, const Layout * a_pLayout, const Node * a_pNode,
+    const uint32_t * a_pFat, uint64_t a_Seed, uint8_t * a_pB_Cluster, unsigned char a_Digest[SHA256_DIGEST_BYTES])
+{
+    Sha256 hash;
+    sha256Init(&hash);
+    uint64_t state = a_Seed ^ ((uint64_t)a_pNode->payload * 0xD1B54A32D192ED03ULL);
+
+    uint32_t cluster = a_pNode->first_cluster;
+    uint64_t remaining = a_pNode->size;
+    while (remaining > 0)
+    {
+        size_t const length = remaining < a_pLayout->cluster_bytes ? (size_t)remaining : (size_t)a_pLayout->cluster_bytes;
+        memset(a_pB_Cluster, 0, (size_t)a_pLayout->cluster_bytes);
+        payloadBytes(&state, a_pB_Cluster, length);
+        sha256Update(&hash, a_pB_Cluster, length);
+        writeAt(a_Fd, a_pB_Cluster, (size_t)a_pLayout->cluster_bytes, a_pLayout->data_offset + (cluster - FIRST_CLUSTER) * a_pLayout->cluster_bytes);
+
+        remaining -= length;
+        // A deleted file has no chain left, it was laid out contiguously
+        cluster = a_pNode->deleted ? cluster + 1 : a_pFat[cluster];
+    }
+    sha256Final(&hash, a_Digest);
+}
+
+/**
+ * @brief   Fills one 32-byte directory entry
+ */
+static void formatEntry(uint8_t * a_pB_Entry, const char * a_Name, const char * a_Extension, uint8_t a_Attributes,
+    uint32_t a_Cluster, uint32_t a_Size, uint16_t a_Date, uint16_t a_Time, int a_Deleted)
+{
+    memset(a_pB_Entry, ' ', 11);
+    memcpy(a_pB_Entry, a_Name, strlen(a_Name));
+    memcpy(a_pB_Entry + 8, a_Extension, strlen(a_Extension));
+    if (a_Deleted) a_pB_Entry[0] = NAME_DELETED;
+    a_pB_Entry[11] = a_Attributes;
+    putLittleEndian(a_pB_Entry + 14, a_Time, 2);
+    putLittleEndian(a_pB_Entry + 16, a_Date, 2);
+    putLittleEndian(a_pB_Entry + 18, a_Date, 2);
+    putLittleEndian(a_pB_Entry + 20, a_Cluster >> 16, 2);
+    putLittleEndian(a_pB_Entry + 22, a_Time, 2);
+    putLittleEndian(a_pB_Entry + 24, a_Date, 2);
+    putLittleEndian(a_pB_Entry + 26, a_Cluster & 0xFFFF, 2);
+    putLittleEndian(a_pB_Entry + 28, a_Size, 4);
+}
+
+/**
+ * @brief   Writes the path of a node the way the notjustcats listing shows it
+ */
+static size_t formatPath(const Node * a_pNodes, int a_Node, char * a_Buffer, size_t a_Capacity)
+{
+    if (a_Node == 0) return 0;
+    size_t length = formatPath(a_pNodes, a_pNodes[a_Node].parent, a_Buffer, a_Capacity);
+
+    const Node * node = &a_pNodes[a_Node];
+    int written = snprintf(a_Buffer + length, a_Capacity - length, "/%s%s%s", node->name,
+        node->extension[0] != '\0' ? "." : "", node->extension);
+    if (node->deleted) a_Buffer[length + 1] = '_';
+    return length + (size_t)written;
+}
+
+/**
+ * @brief   Prints the expected listing, files in the order notjustcats numbers them
+ */
+static void printExpected(FILE * a_File, const Node * a_pNodes, int a_Directory, const unsigned char * a_pDigests)
+{
+    for (int child = a_pNodes[a_Directory].first_child; child != -1; child = a_pNodes[child].next_sibling)
+    {
+        if (a_pNodes[child].directory)
+        {
+            printExpected(a_File, a_pNodes, child, a_pDigests);
+            continue;
+        }
+
+        char path[4096];
+        char digest[SHA256_HEX_BYTES];
+        path[0] = '\0';
+        formatPath(a_pNodes, child, path, sizeof(path));
+        formatDigest(a_pDigests + (size_t)a_pNodes[child].payload * SHA256_DIGEST_BYTES, digest);
+        fprintf(a_File, "FILE\t%s\t%s\t%u\t%s\n", a_pNodes[child].deleted ? "DELETED" : "NORMAL", path, a_pNodes[child].size, digest);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    Settings settings = { 12, 0, 0, 100, 2, 0.0, 0.0, 0.0, 16 * 1024, 1, NULL };
+    int option;
+    while ((option = getopt(argc, argv, "t:z:c:n:d:F:x:u:a:s:b:")) != -1)
+    {
+        if (option == 't') settings.fat_bits = (unsigned)atoi(optarg);
+        else if (option == 'z') settings.image_bytes = parseSize(optarg);
+        else if (option == 'c') settings.sectors_per_cluster = (unsigned)atoi(optarg);
+        else if (option == 'n') settings.n_Files = (size_t)strtoull(optarg, NULL, 10);
+        else if (option == 'd') settings.max_depth = atoi(optarg);
+        else if (option == 'F') settings.fragmentation = parseRatio(optarg);
+        else if (option == 'x') settings.deleted = parseRatio(optarg);
+        else if (option == 'u') settings.duplicates = parseRatio(optarg);
+        else if (option == 'a') settings.average_bytes = parseSize(optarg);
+        else if (option == 's') settings.seed = strtoull(optarg, NULL, 10);
+        else if (option == 'b') settings.template_path = optarg;
+        else usage();
+    }
+    if (argc - optind != 1) usage();
+    if (settings.fat_bits != 12 && settings.fat_bits != 16 && settings.fat_bits != 32) usage();
+    const char * output_path = argv[optind];
+    s_State = settings.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    // Defaults: a 1.44MB floppy, 64MB of 2KB clusters, 512MB of 4KB clusters
+    Layout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.fat_bits = settings.fat_bits;
+    uint8_t boot[SECTOR_BYTES];
+    memset(boot, 0, sizeof(boot));
+    if (settings.template_path != NULL)
+    {
+        int template_fd = open(settings.template_path, O_RDONLY);
+        if (template_fd < 0 || pread(template_fd, boot, sizeof(boot), 0) != (ssize_t)sizeof(boot)) fail("cannot read the template");
+        close(template_fd);
+        layoutFromTemplate(&layout, boot);
+    }
+    else
+    {
+        uint64_t const default_bytes = settings.fat_bits == 12 ? 1440 * 1024 : (settings.fat_bits == 16 ? 64ULL << 20 : 512ULL << 20);
+        unsigned const default_cluster = settings.fat_bits == 12 ? 1 : (settings.fat_bits == 16 ? 4 : 8);
+        layout.total_sectors = (settings.image_bytes != 0 ? settings.image_bytes : default_bytes) / SECTOR_BYTES;
+        layout.sectors_per_cluster = settings.sectors_per_cluster != 0 ? settings.sectors_per_cluster : default_cluster;
+        layout.reserved_sectors = settings.fat_bits == 32 ? 32 : 1;
+        layout.root_entries = settings.fat_bits == 32 ? 0 : (settings.fat_bits == 12 ? 224 : 512);
+    }
+    completeLayout(&layout);
+
+    // The tree: directories and files in the order their entries are written
+    size_t const n_Directories = settings.max_depth > 0 ? (settings.n_Files + FILES_PER_DIRECTORY - 1) / FILES_PER_DIRECTORY : 0;
+    size_t const n_Nodes = 1 + n_Directories + settings.n_Files;
+    Node * nodes = (Node *)calloc(n_Nodes, sizeof(Node));
+    int * directories = (int *)calloc(n_Directories + 1, sizeof(int));
+    if (nodes == NULL || directories == NULL) fail("out of memory");
+    nodes[0].directory = 1;
+    nodes[0].parent = -1;
+    nodes[0].first_child = nodes[0].last_child = nodes[0].next_sibling = -1;
+    size_t n_DirectoriesMade = 1;
+    directories[0] = 0;
+
+    uint32_t n_Payloads = 0;
+    size_t files_left = settings.n_Files;
+    size_t directories_left = n_Directories;
+    for (size_t i = 1; i < n_Nodes; i++)
+    {
+        Node * node = &nodes[i];
+        node->first_child = node->last_child = node->next_sibling = -1;
+        node->directory = randomBelow(files_left + directories_left) < directories_left;
+
+        // Half of the new directories go under the newest one, which is what makes the tree deep
+        int parent = -1;
+        for (int attempt = 0; attempt < 64 && parent == -1; attempt++)
+        {
+            int candidate = directories[randomBelow(n_DirectoriesMade)];
+            if (node->directory && attempt == 0 && randomUnit() < 0.5) candidate = directories[n_DirectoriesMade - 1];
+            if (node->directory && nodes[candidate].depth >= settings.max_depth) continue;
+            if (candidate == 0 && layout.root_entries != 0 && nodes[0].n_Children >= layout.root_entries) continue;
+            parent = candidate;
+        }
+        if (parent == -1) parent = directories[n_DirectoriesMade - 1];
+        if (parent == 0 && layout.root_entries != 0 && nodes[0].n_Children >= layout.root_entries) fail("the root directory is full; use -d 1 or more");
+
+        node->parent = parent;
+        node->depth = nodes[parent].depth + 1;
+        if (nodes[parent].last_child == -1) nodes[parent].first_child = (int)i;
+        else nodes[nodes[parent].last_child].next_sibling = (int)i;
+        nodes[parent].last_child = (int)i;
+        nodes[parent].n_Children++;
+
+        // Anywhere from 1980 to 2107, two-second resolution
+        unsigned const year = (unsigned)randomBelow(45), month = 1 + (unsigned)randomBelow(12), day = 1 + (unsigned)randomBelow(28);
+        node->date = (uint16_t)((year + 20) << 9 | month << 5 | day);
+        node->time = (uint16_t)(randomBelow(24) << 11 | randomBelow(60) << 5 | randomBelow(30));
+
+        if (node->directory)
+        {
+            snprintf(node->name, sizeof(node->name), "D%07u", (unsigned)(i % 10000000));
+            directories[n_DirectoriesMade++] = (int)i;
+            directories_left--;
+            continue;
+        }
+
+        static const char * const s_Extensions[] = { "BIN", "TXT", "DAT", "JPG", "" };
+        snprintf(node->name, sizeof(node->name), "F%07u", (unsigned)(i % 10000000));
+        snprintf(node->extension, sizeof(node->extension), "%s", s_Extensions[randomBelow(5)]);
+        node->deleted = randomUnit() < settings.deleted;
+        files_left--;
+
+        // A duplicate takes the contents of an earlier file, sizes vary around the average
+        size_t const earlier = (size_t)randomBelow(i - 1) + 1;
+        if (randomUnit() < settings.duplicates && !nodes[earlier].directory && nodes[earlier].size > 0)
+        {
+            node->size = nodes[earlier].size;
+            node->payload = nodes[earlier].payload;
+            continue;
+        }
+        node->size = (uint32_t)randomBelow(settings.average_bytes * 2 + 1);
+        node->payload = n_Payloads++;
+    }
+
+    // Clusters, in the order the entries were made
+    uint32_t const end_of_chain = settings.fat_bits == 32 ? 0x0FFFFFFF : (settings.fat_bits == 16 ? 0xFFFF : 0xFFF);
+    uint64_t const n_FatEntries = layout.n_Clusters + FIRST_CLUSTER;
+    uint32_t * fat = (uint32_t *)calloc((size_t)n_FatEntries, sizeof(uint32_t));
+    if (fat == NULL) fail("out of memory");
+    fat[0] = (settings.fat_bits == 32 ? 0x0FFFFF00 : (settings.fat_bits == 16 ? 0xFF00 : 0xF00)) | (layout.total_sectors == 2880 ? 0xF0 : 0xF8);
+    fat[1] = end_of_chain;
+
+    uint64_t cursor = FIRST_CLUSTER;
+    uint64_t const entries_per_cluster = layout.cluster_bytes / ENTRY_BYTES;
+    for (size_t i = 0; i < n_Nodes; i++)
+    {
+        Node * node = &nodes[i];
+        if (node->directory)
+        {
+            if (i == 0 && settings.fat_bits != 32) continue;
+            uint64_t const n_Entries = (uint64_t)node->n_Children + (i == 0 ? 1 : 3); // ".", ".." and the end
+            uint64_t const n_Clusters = (n_Entries + entries_per_cluster - 1) / entries_per_cluster;
+            node->first_cluster = allocateChain(fat, &layout, &cursor, n_Clusters, i == 0 ? 0.0 : settings.fragmentation, end_of_chain, 1);
+            continue;
+        }
+
+        // Recovery assumes a deleted file was contiguous, so deleted files are
+        uint64_t const n_Clusters = (node->size + layout.cluster_bytes - 1) / layout.cluster_bytes;
+        node->first_cluster = allocateChain(fat, &layout, &cursor, n_Clusters, node->deleted ? 0.0 : settings.fragmentation, end_of_chain, !node->deleted);
+    }
+
+    int fd = open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) fail("cannot create the image");
+    if (ftruncate(fd, (off_t)(layout.total_sectors * SECTOR_BYTES)) != 0) fail("cannot size the image");
+
+    if (settings.template_path == NULL) formatBootSector(boot, &layout, settings.seed);
+    writeAt(fd, boot, sizeof(boot), 0);
+
+    uint8_t * encoded = encodeFat(fat, &layout);
+    for (int copy = 0; copy < FAT_COPIES; copy++) writeAt(fd, encoded, (size_t)(layout.sectors_per_fat * SECTOR_BYTES), layout.fat_offset + copy * layout.sectors_per_fat * SECTOR_BYTES);
+    free(encoded);
+
+    // File contents, each payload hashed the first time it is written
+    uint8_t * cluster = (uint8_t *)malloc((size_t)layout.cluster_bytes);
+    unsigned char * digests = (unsigned char *)calloc((size_t)n_Payloads + 1, SHA256_DIGEST_BYTES);
+    if (cluster == NULL || digests == NULL) fail("out of memory");
+    for (size_t i = 1; i < n_Nodes; i++)
+    {
+        if (nodes[i].directory) continue;
+        writeFile(fd, &layout, &nodes[i], fat, settings.seed, cluster, digests + (size_t)nodes[i].payload * SHA256_DIGEST_BYTES);
+    }
+
+    // Directories, their chains read back out of the FAT
+    for (size_t i = 0; i < n_Nodes; i++)
+    {
+        Node const * node = &nodes[i];
+        if (!node->directory) continue;
+
+        uint64_t const n_Entries = (uint64_t)node->n_Children + 3;
+        uint8_t * entries = (uint8_t *)calloc((size_t)(n_Entries + entries_per_cluster), ENTRY_BYTES);
+        if (entries == NULL) fail("out of memory");
+
+        size_t n = 0;
+        if (i != 0)
+        {
+            uint32_t const parent_cluster = node->parent == 0 ? 0 : nodes[node->parent].first_cluster;
+            formatEntry(entries + ENTRY_BYTES * n++, ".", "", ATTR_DIRECTORY, node->first_cluster, 0, node->date, node->time, 0);
+            formatEntry(entries + ENTRY_BYTES * n++, "..", "", ATTR_DIRECTORY, parent_cluster, 0, node->date, node->time, 0);
+        }
+        for (int child = node->first_child; child != -1; child = nodes[child].next_sibling)
+        {
+            Node const * c = &nodes[child];
+            formatEntry(entries + ENTRY_BYTES * n++, c->name, c->extension, c->directory ? ATTR_DIRECTORY : ATTR_ARCHIVE,
+                c->first_cluster, c->directory ? 0 : c->size, c->date, c->time, c->deleted);
+        }
+
+        if (i == 0 && settings.fat_bits != 32)
+        {
+            writeAt(fd, entries, (size_t)layout.root_entries * ENTRY_BYTES < n * ENTRY_BYTES ? (size_t)layout.root_entries * ENTRY_BYTES : n * ENTRY_BYTES, layout.root_offset);
+        }
+        else
+        {
+            uint64_t written = 0;
+            for (uint32_t c = node->first_cluster; c >= FIRST_CLUSTER && c < n_FatEntries; c = fat[c])
+            {
+                writeAt(fd, entries + written, (size_t)layout.cluster_bytes, layout.data_offset + (c - FIRST_CLUSTER) * layout.cluster_bytes);
+                written += layout.cluster_bytes;
+            }
+        }
+        free(entries);
+    }
+    close(fd);
+
+    char expected_path[4096];
+    snprintf(expected_path, sizeof(expected_path), "%s%s", output_path, EXPECTED_SUFFIX);
+    FILE * expected = fopen(expected_path, "w");
+    if (expected == NULL) fail("cannot create the expected listing");
+    printExpected(expected, nodes, 0, digests);
+    fclose(expected);
+
+    fprintf(stderr, "FAT%u, %llu clusters of %llu bytes, %zu files in %zu directories, %u distinct contents\n",
+        layout.fat_bits, (unsigned long long)layout.n_Clusters, (unsigned long long)layout.cluster_bytes,
+        settings.n_Files, n_Directories, n_Payloads);
+
+    free(digests);
+    free(cluster);
+    free(fat);
+    free(directories);
+    free(nodes);
+    return EXIT_SUCCESS;
+}
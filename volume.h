@@ -0,0 +1,47 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t, int64_t
+
+#define VOLUME_NAME_MAX 13 // "NAME.EXT" and its terminator
+
+/**
+ * @brief   Random access to the files of a FAT12, FAT16 or FAT32 image, for use as a library
+ * @details Opening a volume reads the boot sector and decodes the FAT, nothing else. A
+ *          directory is parsed the first time a lookup or listing goes through it, and a
+ *          file's cluster chain is collected into extents the first time it is read, then
+ *          kept until the volume is closed. A file reads as far as its chain reaches, never past
+ *          its recorded size. Paths are the ones notjustcats lists, "/DIR/FILE.TXT", compared
+ *          without regard to case. Deleted entries show up with '_' as their first
+ *          character, a live entry wins over a deleted one of the same name. A damaged image
+ *          makes a call fail instead of ending the process. A volume and everything opened on
+ *          it are to be used by one thread at a time.
+ */
+typedef struct Volume Volume;
+typedef struct VolumeFile VolumeFile;
+typedef struct VolumeDirectory VolumeDirectory;
+
+typedef struct VolumeStat {
+    char name[VOLUME_NAME_MAX];
+    unsigned attributes;        // the FAT attribute byte
+    uint64_t size;              // as the directory entry records it, 0 for a directory
+    uint32_t first_cluster;
+    int64_t modified;           // seconds since the Unix epoch, the image's local time taken as UTC
+    int directory;
+    int deleted;
+} VolumeStat;
+
+Volume * openVolume(const char * a_Path);
+void closeVolume(Volume * a_pVolume);
+int volumeStat(Volume * a_pVolume, const char * a_Path, VolumeStat * a_pStat);
+
+VolumeDirectory * openVolumeDirectory(Volume * a_pVolume, const char * a_Path);
+int readVolumeDirectory(VolumeDirectory * a_pDirectory, VolumeStat * a_pStat);
+void closeVolumeDirectory(VolumeDirectory * a_pDirectory);
+
+VolumeFile * openVolumeFile(Volume * a_pVolume, const char * a_Path);
+int64_t readVolumeFile(VolumeFile * a_pFile, void * a_pBuffer, size_t a_Length, uint64_t a_Offset);
+void closeVolumeFile(VolumeFile * a_pFile);
+
+#endif // VOLUME_H